@@ -21,7 +21,6 @@ OUTSIDE_THRESH_WINNAME = 'Outside Line Thresholding'
 STOP_THRESH_WINNAME = 'Stop Line Thresholding'
 RED_LINE_CALIBRATION_WIN_TITLE = 'Stop Line Calibration'
 WIN_SIZE = 96
-MAX_MIN_DETECT_AREA = 96*96 # The minimum detect area for the line areas.
 
 
 def get_largest_contour(img: cv2.Mat):
@@ -91,6 +90,12 @@ class FrameHandler:
 
 
         if self.frame_to_thresh is None:
+            # Record the size that everything is calibrated at, so that the ESP-32 can rescale
+            # it to whatever size it captures at.
+            self.settings['native_frame_size'] = {
+                'height': frame.shape[0],
+                'width': frame.shape[1]
+            }
             self.setup_thresh_window(
                 OUTSIDE_THRESH_WINNAME,
                 frame.shape[0],
@@ -412,7 +417,7 @@ class FrameHandler:
             'Min Area for Detection',
             window_name,
             thresh_settings['min_detect_area'],
-            MAX_MIN_DETECT_AREA,
+            native_frame_height * native_frame_width,
             functools.partial(area_detection_callback, settings=thresh_settings)
         )
 
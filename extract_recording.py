@@ -0,0 +1,109 @@
+"""Extracts the frames from a recording made on the device by the frame recorder (see
+main/frame_recorder.h), for replaying and benchmarking the pipeline off-device.
+
+Get the recording off the device by reading the storage partition, e.g.
+    parttool.py read_partition --partition-name storage --output storage.bin
+    mkspiffs -u storage -b 4096 -p 256 storage.bin
+then run this on storage/recording.bin. Each frame is written to frames/NNNNNN.raw, exactly as
+captured, and described by a line of manifest.csv. Torn or corrupted records are skipped by
+searching for the next sync record."""
+
+import argparse
+import csv
+import os
+import struct
+
+
+RECORD_MAGIC = 0x524c
+RECORD_VERSION = 1
+RECORD_SYNC_MARKER = b'LDSYNC\r\n'
+
+RECORD_TYPE_SYNC = 0
+RECORD_TYPE_FRAME = 1
+
+# Mirror RecordHeader and FrameRecordInfo.
+HEADER = struct.Struct('<HBBI')
+FRAME_INFO = struct.Struct('<qIHHBBhf')
+
+# A whole sync record, as it appears in the log.
+SYNC_RECORD = HEADER.pack(RECORD_MAGIC, RECORD_TYPE_SYNC, RECORD_VERSION, len(RECORD_SYNC_MARKER)) + RECORD_SYNC_MARKER
+
+# The capture modes, by their CaptureMode value, and the bytes each pixel takes.
+CAPTURE_MODES = {0: ('rgb565', 2), 1: ('yuv422', 2), 2: ('grayscale', 1)}
+
+
+def read_records(data):
+    """Yields (type, payload) for every intact record in a log, skipping past broken ones."""
+    offset = 0
+    skipped = 0
+    while offset + HEADER.size <= len(data):
+        magic, record_type, version, length = HEADER.unpack_from(data, offset)
+        end = offset + HEADER.size + length
+        intact = (magic == RECORD_MAGIC and version == RECORD_VERSION and end <= len(data))
+        if intact and record_type == RECORD_TYPE_SYNC:
+            intact = data[offset + HEADER.size:end] == RECORD_SYNC_MARKER
+
+        if not intact:
+            # Lost our place; pick it up again at the next sync record.
+            resync = data.find(SYNC_RECORD, offset + 1)
+            if resync < 0:
+                skipped += len(data) - offset
+                break
+            skipped += resync - offset
+            offset = resync
+            continue
+
+        yield record_type, data[offset + HEADER.size:end]
+        offset = end
+
+    if skipped:
+        print(f'Skipped {skipped} corrupt bytes')
+
+
+def main():
+    """The main routine."""
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('recording', help='The recording file, e.g. recording.bin.')
+    parser.add_argument('--output-dir', default='recording', help='Where to write the frames and manifest.')
+    args = parser.parse_args()
+
+    with open(args.recording, 'rb') as f:
+        data = f.read()
+
+    frames_dir = os.path.join(args.output_dir, 'frames')
+    os.makedirs(frames_dir, exist_ok=True)
+
+    count = 0
+    with open(os.path.join(args.output_dir, 'manifest.csv'), 'w', newline='', encoding='ascii') as manifest_file:
+        manifest = csv.writer(manifest_file)
+        manifest.writerow([
+            'file', 'sequence', 'timestamp_us', 'width', 'height', 'format',
+            'outside_dist', 'outside_slope', 'stop_detected',
+        ])
+
+        for record_type, payload in read_records(data):
+            if record_type != RECORD_TYPE_FRAME or len(payload) < FRAME_INFO.size:
+                continue
+
+            (timestamp_us, sequence, width, height, capture_mode,
+                stop_detected, outside_dist, outside_slope) = FRAME_INFO.unpack_from(payload)
+            pixels = payload[FRAME_INFO.size:]
+            format_name, pixel_size = CAPTURE_MODES.get(capture_mode, (f'mode{capture_mode}', 0))
+            if pixel_size and len(pixels) != width * height * pixel_size:
+                print(f'Frame {sequence} is the wrong size; skipping it')
+                continue
+
+            name = f'{count:06d}.raw'
+            with open(os.path.join(frames_dir, name), 'wb') as f:
+                f.write(pixels)
+            manifest.writerow([
+                os.path.join('frames', name), sequence, timestamp_us, width, height, format_name,
+                outside_dist, f'{outside_slope:.4f}', stop_detected,
+            ])
+            count += 1
+
+    print(f'Extracted {count} frames to {args.output_dir}')
+
+
+if __name__ == '__main__':
+    main()
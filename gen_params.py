@@ -1,93 +1,882 @@
-"""Generates a header of thresholding values based upon those found in the debugger.
-This just prints the header to stdout, where it can be redirected to a file."""
+"""Generates the pipeline's constants and classification tables from the settings found in the
+debugger. Run by the build (see main/CMakeLists.txt), which writes params.h, class_table.cpp,
+perspective_table.cpp, distortion_table.cpp and profiles.cpp into the build directory. Without --output-dir, params.h is printed to
+stdout instead.
 
+Besides the outside and stop lines, the settings may list up to six "extra_classes" (a yellow
+center line, a finish marker...), each with a "name" and the same thresholds, cropping and
+minimum area as the lines. Each gets its own bit of the class table, so they add nothing to the
+per-pixel cost of classifying a frame.
+
+Each class's YUV thresholds, for frames captured in YUV, are converted from its HSV thresholds
+(see yuv_bounds) or given explicitly as "yuv_thresh"; likewise its luma thresholds, for grayscale
+frames (see luma_bounds), or "luma_thresh".
+
+The calibration profiles the ESP-32 can be switched between (see main/calibration_profiles.h)
+are generated into profiles.cpp, each with its own class table. The first, "indoor", is the
+settings as they are. The others are given by an optional "profiles" section, which maps
+"outdoor" and "dim" to changes to the settings' class keys (see PROFILE_KEYS): nested objects are
+merged into the settings, so a profile need only list the values it changes, and "extra_classes"
+is merged class by class. A profile which isn't listed is the same as the first.
+
+The distortion table undoes the lens's barrel distortion at single points. It is calibrated by an
+optional "distortion" section: either the coefficients of a radial model ("k1" and "k2", with
+radii in units of half the frame width, about "center" if given), or "lines": lists of points, as
+[x, y], each read off something straight in a captured frame, from which the coefficients are
+fitted. Without it, points are left as they are.
+
+The perspective table maps image points to the ground plane. It is calibrated by an optional
+"perspective" section in the settings: four points in the image ("image_points", in pixels of
+native_frame_size, as [x, y]) and where they lie on the ground ("ground_points_mm", as [x, y]: x
+to the right of the camera, y ahead of it). Laying a rectangle of tape on the floor in front of the
+car and reading its corners off a captured frame is enough. Without it, the table leaves points
+in pixels."""
+
+import argparse
+import functools
 import json
+import math
+import os
+import sys
+import zlib
+
+
+# Mirrors OpenCV's fixed-point 8-bit BGR->HSV conversion, so that thresholds converted from HSV
+# select exactly the colors which the HSV pipeline would have.
+HSV_SHIFT = 12
+SDIV_TABLE = [0] + [round((255 << HSV_SHIFT) / i) for i in range(1, 256)]
+HDIV_TABLE_180 = [0] + [round((180 << HSV_SHIFT) / (6 * i)) for i in range(1, 256)]
+
+
+def rgb565_colors():
+    """Yields every color the camera can produce in RGB565, as 8-bit (r, g, b), scaled the same
+    way as cv2.COLOR_BGR5652BGR."""
+    for pixel in range(1 << 16):
+        yield ((pixel >> 8) & 0xf8, (pixel >> 3) & 0xfc, (pixel << 3) & 0xf8)
+
+
+def rgb_to_hsv(r, g, b):
+    """Converts an 8-bit RGB color to OpenCV's 8-bit HSV (hue in [0, 180))."""
+    v = max(r, g, b)
+    diff = v - min(r, g, b)
+    s = (diff * SDIV_TABLE[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT
+
+    if v == r:
+        h = g - b
+    elif v == g:
+        h = b - r + 2 * diff
+    else:
+        h = r - g + 4 * diff
+    h = (h * HDIV_TABLE_180[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT
+    if h < 0:
+        h += 180
+
+    return (h, s, v)
+
+
+def rgb_to_yuv(r, g, b):
+    """Converts an 8-bit RGB color to the full-range BT.601 YUV produced by the OV2640."""
+    y = 0.299 * r + 0.587 * g + 0.114 * b
+    u = -0.169 * r - 0.331 * g + 0.5 * b + 128
+    v = 0.5 * r - 0.419 * g - 0.081 * b + 128
+
+    def clamp(x):
+        return min(255, max(0, round(x)))
+
+    return (clamp(y), clamp(u), clamp(v))
+
+
+def in_hsv_thresh(hsv, thresh):
+    """Checks if an HSV color is within a set of thresholds from the settings file."""
+    low = thresh['thresh_color_min']
+    high = thresh['thresh_color_max']
+    return (low['hue'] <= hsv[0] <= high['hue'] and
+            low['saturation'] <= hsv[1] <= high['saturation'] and
+            low['value'] <= hsv[2] <= high['value'])
+
+
+@functools.lru_cache(maxsize=None)
+def yuv_gamut():
+    """Gets the smallest YUV box which contains every RGB565 color, as (low, high)."""
+    low = [255, 255, 255]
+    high = [0, 0, 0]
+    for rgb in rgb565_colors():
+        yuv = rgb_to_yuv(*rgb)
+        for channel in range(3):
+            low[channel] = min(low[channel], yuv[channel])
+            high[channel] = max(high[channel], yuv[channel])
+    return (low, high)
+
+
+# The most of the YUV cube a set of YUV bounds may cover before the build fails. Bounds which
+# cover much more than this take in the floor as well as the line.
+MAX_YUV_BOX_FRACTION = 0.25
+
+
+def yuv_bounds(name, thresh):
+    """Gets the YUV thresholds for a set of thresholds from the settings file. If the settings
+    give YUV bounds explicitly ("yuv_thresh"), those are used. Otherwise they are converted from
+    the HSV bounds: the result is the smallest YUV box which contains every RGB565 color the HSV
+    bounds accept with a saturation of at most "yuv_max_saturation" (if given). A white line's HSV
+    bounds accept every bright color, however saturated, and the box around all of those covers
+    most of the cube; limiting the saturation keeps it to the near-white colors. Bounds at the
+    edge of what RGB565 can reach are widened to the edge of the 8-bit range, since the camera's
+    YUV isn't quantized to RGB565 first. Since the box is axis-aligned it may also accept some
+    colors the HSV bounds don't, so the build fails if it covers more than MAX_YUV_BOX_FRACTION of
+    the cube."""
+    if 'yuv_thresh' in thresh:
+        yuv = thresh['yuv_thresh']
+        low = (yuv['min']['y'], yuv['min']['u'], yuv['min']['v'])
+        high = (yuv['max']['y'], yuv['max']['u'], yuv['max']['v'])
+    else:
+        max_saturation = thresh.get('yuv_max_saturation', 255)
+        low = [255, 255, 255]
+        high = [0, 0, 0]
+        for rgb in rgb565_colors():
+            hsv = rgb_to_hsv(*rgb)
+            if not in_hsv_thresh(hsv, thresh) or hsv[1] > max_saturation:
+                continue
+            yuv = rgb_to_yuv(*rgb)
+            for channel in range(3):
+                low[channel] = min(low[channel], yuv[channel])
+                high[channel] = max(high[channel], yuv[channel])
+
+        # Nothing passes the HSV thresholds, so nothing should pass the YUV thresholds either.
+        if low[0] > high[0]:
+            return ((255, 255, 255), (0, 0, 0))
+
+        gamut_low, gamut_high = yuv_gamut()
+        for channel in range(3):
+            if low[channel] <= gamut_low[channel]:
+                low[channel] = 0
+            if high[channel] >= gamut_high[channel]:
+                high[channel] = 255
+        low = tuple(low)
+        high = tuple(high)
+
+    fraction = 1.0
+    for channel in range(3):
+        fraction *= max(0, high[channel] - low[channel] + 1) / 256
+    if fraction > MAX_YUV_BOX_FRACTION:
+        sys.exit(f'{name} YUV bounds {low}..{high} cover {fraction:.0%} of the YUV cube, so would take in '
+                 'the floor; give a "yuv_max_saturation" or explicit "yuv_thresh" in its settings')
+
+    return (low, high)
+
+
+def luma_bounds(thresh):
+    """Gets the luma thresholds, for grayscale frames, for a set of thresholds from the settings
+    file. If the settings give them explicitly ("luma_thresh", with "min" and "max"), those are
+    used. Otherwise they are the HSV value bounds, since the luma of a grey is its value. A class
+    whose HSV bounds accept no greys (a minimum saturation above zero) can't be told from the
+    floor by luma alone, so gets empty bounds and is never found in grayscale frames."""
+    if 'luma_thresh' in thresh:
+        luma = thresh['luma_thresh']
+        return (luma['min'], luma['max'])
+
+    if thresh['thresh_color_min']['saturation'] > 0:
+        return (255, 0)
+    return (thresh['thresh_color_min']['value'], thresh['thresh_color_max']['value'])
+
+
+# The class bits of the RGB565 class table. A pixel may be in several classes. Extra classes take
+# the bits above these, in order.
+OUTSIDE_CLASS_BIT = 0x01
+STOP_CLASS_BIT = 0x02
+
+# The most extra classes. Must match MAX_EXTRA_CLASSES in main/calibration.h.
+MAX_EXTRA_CLASSES = 6
+
+
+def extra_classes(settings, native_frame_size):
+    """Gets the extra classes from the settings, checked."""
+    classes = settings.get('extra_classes', [])
+    if len(classes) > MAX_EXTRA_CLASSES:
+        sys.exit(f'At most {MAX_EXTRA_CLASSES} extra classes fit in the class table ({len(classes)} given)')
+    for thresh in classes:
+        if not thresh.get('name', '').isidentifier():
+            sys.exit(f'Extra class name {thresh.get("name")!r} must be an identifier')
+        check_roi(f'Extra class {thresh["name"]}', thresh['cropping'], native_frame_size)
+    return classes
+
+
+def extra_class_bit(index):
+    """Gets the class table bit of an extra class."""
+    return STOP_CLASS_BIT << (index + 1)
+
+
+# The names of the calibration profiles, in slot order. Must match PROFILE_NAMES in
+# main/profile_format.h.
+PROFILE_NAMES = ('indoor', 'outdoor', 'dim')
+
+# The settings a profile may change. The rest (the frame size, perspective and distortion) are
+# properties of the camera rather than the lighting, and are shared by every profile.
+PROFILE_KEYS = ('outside_thresh', 'stop_thresh', 'outside_line_data', 'extra_classes')
+
+
+def merge_settings(name, base, changes):
+    """Merges a profile's changes into the settings: objects key by key, and lists (of extra
+    classes) item by item."""
+    if isinstance(base, dict) and isinstance(changes, dict):
+        merged = dict(base)
+        for key, value in changes.items():
+            merged[key] = merge_settings(name, base[key], value) if key in base else value
+        return merged
+    if isinstance(base, list) and isinstance(changes, list):
+        if len(base) != len(changes):
+            sys.exit(f'Profile {name} lists {len(changes)} extra classes, but the settings have {len(base)}')
+        return [merge_settings(name, item, change) for item, change in zip(base, changes)]
+    return changes
+
+
+def profile_settings(settings):
+    """Gets the settings of each calibration profile, in slot order."""
+    profiles = settings.get('profiles', {})
+    for name, changes in profiles.items():
+        if name not in PROFILE_NAMES[1:]:
+            sys.exit(f'Profile {name!r} must be one of {", ".join(PROFILE_NAMES[1:])}; '
+                     f'{PROFILE_NAMES[0]} is the settings themselves')
+        for key in changes:
+            if key not in PROFILE_KEYS:
+                sys.exit(f'Profile {name} may only change {", ".join(PROFILE_KEYS)}, not {key}')
+
+    result = [settings]
+    for name in PROFILE_NAMES[1:]:
+        merged = merge_settings(name, settings, profiles.get(name, {}))
+        names = [thresh.get('name') for thresh in merged.get('extra_classes', [])]
+        if names != [thresh.get('name') for thresh in settings.get('extra_classes', [])]:
+            sys.exit(f'Profile {name} may not rename extra classes')
+        result.append(merged)
+    return result
+
+
+def yuv_bounds_lines(prefix, thresh):
+    """Gets the lines declaring the YUV and luma thresholds for a set of thresholds from the
+    settings file."""
+    low, high = yuv_bounds(prefix.capitalize() + ' line', thresh)
+    lines = []
+    for channel, name in enumerate('yuv'):
+        lines.append(f'constexpr uint8_t {prefix}_yuv_min_{name} = {low[channel]};')
+    for channel, name in enumerate('yuv'):
+        lines.append(f'constexpr uint8_t {prefix}_yuv_max_{name} = {high[channel]};')
+    luma_low, luma_high = luma_bounds(thresh)
+    lines.append(f'constexpr uint8_t {prefix}_luma_min = {luma_low};')
+    lines.append(f'constexpr uint8_t {prefix}_luma_max = {luma_high};')
+    return lines
+
+
+def get_native_frame_size(settings):
+    """Gets the frame size the settings were calibrated at. Everything in them is in pixels of
+    this size; the ESP-32 rescales it to the size it captures at. Settings from before this was
+    recorded were all calibrated at 96x96."""
+    return settings.get('native_frame_size', {'width': 96, 'height': 96})
+
+
+def check_roi(name, cropping, native_frame_size):
+    """Checks that cropping leaves some of the frame to detect in, so that a bad calibration
+    fails the build rather than silently never detecting."""
+    width = native_frame_size['width'] - cropping['left'] - cropping['right']
+    height = native_frame_size['height'] - cropping['top'] - cropping['bottom']
+    if width <= 0 or height <= 0:
+        sys.exit(f'{name} cropping leaves no region of interest ({width}x{height})')
+
+
+def thresh_lines(prefix, thresh):
+    """Gets the lines declaring the HSV thresholds, cropping and minimum area for a set of
+    thresholds from the settings file."""
+    low = thresh['thresh_color_min']
+    high = thresh['thresh_color_max']
+    cropping = thresh['cropping']
+    return [
+        f'constexpr uint8_t {prefix}_thresh_min_hue = {low["hue"]};',
+        f'constexpr uint8_t {prefix}_thresh_min_sat = {low["saturation"]};',
+        f'constexpr uint8_t {prefix}_thresh_min_val = {low["value"]};',
+        '',
+        f'constexpr uint8_t {prefix}_thresh_max_hue = {high["hue"]};',
+        f'constexpr uint8_t {prefix}_thresh_max_sat = {high["saturation"]};',
+        f'constexpr uint8_t {prefix}_thresh_max_val = {high["value"]};',
+        '',
+        f'constexpr uint16_t {prefix}_cropping_top = {cropping["top"]};',
+        f'constexpr uint16_t {prefix}_cropping_bottom = {cropping["bottom"]};',
+        f'constexpr uint16_t {prefix}_cropping_left = {cropping["left"]};',
+        f'constexpr uint16_t {prefix}_cropping_right = {cropping["right"]};',
+        '',
+        f'constexpr uint32_t {prefix}_min_detect_area = {thresh["min_detect_area"]};',
+        '',
+    ] + yuv_bounds_lines(prefix, thresh)
+
+
+def class_table(settings):
+    """Builds the RGB565 class table: for every little-endian RGB565 pixel, the bits of the
+    classes whose HSV thresholds it falls within."""
+    classes = [(settings['outside_thresh'], OUTSIDE_CLASS_BIT), (settings['stop_thresh'], STOP_CLASS_BIT)]
+    classes += [(thresh, extra_class_bit(index)) for index, thresh in enumerate(settings.get('extra_classes', []))]
+    table = bytearray(1 << 16)
+    for pixel, rgb in enumerate(rgb565_colors()):
+        hsv = rgb_to_hsv(*rgb)
+        bits = 0
+        for thresh, bit in classes:
+            if in_hsv_thresh(hsv, thresh):
+                bits |= bit
+        table[pixel] = bits
+    return table
+
+
+# The number of intervals in the distortion table, which is indexed by squared radius. Must match
+# DISTORTION_TABLE_INTERVALS in main/distortion.h.
+DISTORTION_TABLE_INTERVALS = 64
+
+# How far, in pixels, points undistorted through the table may stray from the straight lines they
+# were distorted from before the build fails.
+DISTORTION_TOLERANCE = 0.1
+
+
+class LensModel:
+    """A radial distortion model: a point r from the center (in units of half the frame width)
+    is seen at r * (1 + k1 r^2 + k2 r^4)."""
+
+    def __init__(self, k1, k2, center, width):
+        self.k1 = k1
+        self.k2 = k2
+        self.center = center
+        self.unit = width / 2
+
+    def distort(self, x, y):
+        """Maps an undistorted point to where the lens puts it."""
+        dx = (x - self.center[0]) / self.unit
+        dy = (y - self.center[1]) / self.unit
+        r2 = dx * dx + dy * dy
+        scale = 1 + self.k1 * r2 + self.k2 * r2 * r2
+        return (self.center[0] + dx * scale * self.unit, self.center[1] + dy * scale * self.unit)
+
+    def undistort_scale(self, r_distorted):
+        """Finds how much a distorted radius (in pixels) must be scaled by to undistort it. Raises
+        ValueError if the model folds over before reaching it."""
+        if r_distorted == 0:
+            return 1.0
+        target = r_distorted / self.unit
+        r = target
+        for _ in range(50):
+            r2 = r * r
+            f = r * (1 + self.k1 * r2 + self.k2 * r2 * r2) - target
+            df = 1 + 3 * self.k1 * r2 + 5 * self.k2 * r2 * r2
+            if df <= 0:
+                raise ValueError('folds over')
+            r -= f / df
+        return r / target
+
+
+def line_residual(points):
+    """Gets the sum of squared distances of points from their best-fit straight line."""
+    n = len(points)
+    mx = sum(p[0] for p in points) / n
+    my = sum(p[1] for p in points) / n
+    sxx = sum((p[0] - mx) ** 2 for p in points)
+    syy = sum((p[1] - my) ** 2 for p in points)
+    sxy = sum((p[0] - mx) * (p[1] - my) for p in points)
+    # The smaller eigenvalue of the scatter matrix.
+    return (sxx + syy) / 2 - math.sqrt(((sxx - syy) / 2) ** 2 + sxy * sxy)
+
+
+def fit_lens(lines, center, width):
+    """Fits k1 and k2 so that points read off straight things come out straight, by a
+    Nelder-Mead search."""
+    def cost(k):
+        model = LensModel(k[0], k[1], center, width)
+        total = 0.0
+        for line in lines:
+            undistorted = []
+            for x, y in line:
+                try:
+                    scale = model.undistort_scale(math.hypot(x - center[0], y - center[1]))
+                except ValueError:
+                    return math.inf
+                undistorted.append((center[0] + (x - center[0]) * scale, center[1] + (y - center[1]) * scale))
+            total += line_residual(undistorted)
+        return total
+
+    simplex = [[0.0, 0.0], [0.05, 0.0], [0.0, 0.05]]
+    costs = [cost(k) for k in simplex]
+    for _ in range(300):
+        order = sorted(range(3), key=lambda i: costs[i])
+        simplex = [simplex[i] for i in order]
+        costs = [costs[i] for i in order]
+        centroid = [(simplex[0][i] + simplex[1][i]) / 2 for i in range(2)]
+        reflected = [2 * centroid[i] - simplex[2][i] for i in range(2)]
+        reflected_cost = cost(reflected)
+        if reflected_cost < costs[0]:
+            expanded = [3 * centroid[i] - 2 * simplex[2][i] for i in range(2)]
+            expanded_cost = cost(expanded)
+            simplex[2], costs[2] = (expanded, expanded_cost) if expanded_cost < reflected_cost else (reflected, reflected_cost)
+        elif reflected_cost < costs[1]:
+            simplex[2], costs[2] = reflected, reflected_cost
+        else:
+            contracted = [(centroid[i] + simplex[2][i]) / 2 for i in range(2)]
+            contracted_cost = cost(contracted)
+            if contracted_cost < costs[2]:
+                simplex[2], costs[2] = contracted, contracted_cost
+            else:
+                for j in (1, 2):
+                    simplex[j] = [(simplex[0][i] + simplex[j][i]) / 2 for i in range(2)]
+                    costs[j] = cost(simplex[j])
+    return simplex[costs.index(min(costs))]
+
+
+def lens_model(settings, native_frame_size):
+    """Gets the lens model from the settings, fitting it if need be, or None if there is none."""
+    if 'distortion' not in settings:
+        return None
+
+    width = native_frame_size['width']
+    height = native_frame_size['height']
+    distortion = settings['distortion']
+    center = distortion.get('center', [(width - 1) / 2, (height - 1) / 2])
+    if 'lines' in distortion:
+        if any(len(line) < 3 for line in distortion['lines']):
+            sys.exit('Each line for fitting the lens distortion needs at least three points')
+        k1, k2 = fit_lens(distortion['lines'], center, width)
+    else:
+        k1, k2 = distortion['k1'], distortion.get('k2', 0.0)
+    return LensModel(k1, k2, center, width)
+
+
+def distortion_table(model, native_frame_size):
+    """Builds the distortion table: the scale which undistorts a point, at even steps of squared
+    radius out to the furthest corner. Returns it and the step."""
+    width = native_frame_size['width']
+    height = native_frame_size['height']
+    if model is None:
+        return [1.0] * (DISTORTION_TABLE_INTERVALS + 1), 1.0
+
+    corners = [(0, 0), (width - 1, 0), (0, height - 1), (width - 1, height - 1)]
+    max_r2 = max((x - model.center[0]) ** 2 + (y - model.center[1]) ** 2 for x, y in corners)
+    step = max_r2 / DISTORTION_TABLE_INTERVALS
+    try:
+        table = [model.undistort_scale(math.sqrt(i * step)) for i in range(DISTORTION_TABLE_INTERVALS + 1)]
+    except ValueError:
+        sys.exit('Lens distortion model folds over within the frame; check k1 and k2')
+    return table, step
+
+
+def table_undistort(table, step, center, x, y):
+    """Undistorts a point through the table, exactly as main/distortion.h does."""
+    dx = x - center[0]
+    dy = y - center[1]
+    position = min((dx * dx + dy * dy) / step, DISTORTION_TABLE_INTERVALS)
+    index = min(int(position), DISTORTION_TABLE_INTERVALS - 1)
+    t = position - index
+    scale = table[index] + t * (table[index + 1] - table[index])
+    return (center[0] + dx * scale, center[1] + dy * scale)
+
+
+def check_distortion(model, table, step, native_frame_size):
+    """Checks the table against straight lines drawn across the frame and bent by the model:
+    undistorted through the table, every point must land back on its line."""
+    width = native_frame_size['width']
+    height = native_frame_size['height']
+    worst = 0.0
+    for angle in range(0, 180, 15):
+        direction = (math.cos(math.radians(angle)), math.sin(math.radians(angle)))
+        normal = (-direction[1], direction[0])
+        for offset in (-0.4, -0.2, 0.0, 0.2, 0.4):
+            origin = (model.center[0] + normal[0] * offset * width, model.center[1] + normal[1] * offset * height)
+            for i in range(-64, 65):
+                point = (origin[0] + direction[0] * i, origin[1] + direction[1] * i)
+                seen = model.distort(*point)
+                if not (0 <= seen[0] <= width - 1 and 0 <= seen[1] <= height - 1):
+                    continue
+                x, y = table_undistort(table, step, model.center, *seen)
+                worst = max(worst, abs((x - origin[0]) * normal[0] + (y - origin[1]) * normal[1]))
+    if worst > DISTORTION_TOLERANCE:
+        sys.exit(f'Distortion table bends straight lines by up to {worst:.2f} pixels')
+
+
+# How far the per-row perspective table may stray from the full homography, as a fraction of the
+# distance to the point, before the build fails. It only strays when the camera is rolled.
+PERSPECTIVE_TOLERANCE = 0.01
+
+
+def solve(matrix, vector):
+    """Solves a small dense linear system by Gaussian elimination with partial pivoting."""
+    n = len(vector)
+    rows = [list(matrix[i]) + [vector[i]] for i in range(n)]
+    for col in range(n):
+        pivot = max(range(col, n), key=lambda r: abs(rows[r][col]))
+        if abs(rows[pivot][col]) < 1e-12:
+            sys.exit('Perspective calibration points are degenerate (three in a line?)')
+        rows[col], rows[pivot] = rows[pivot], rows[col]
+        for r in range(col + 1, n):
+            factor = rows[r][col] / rows[col][col]
+            for c in range(col, n + 1):
+                rows[r][c] -= factor * rows[col][c]
+    result = [0.0] * n
+    for r in reversed(range(n)):
+        result[r] = (rows[r][n] - sum(rows[r][c] * result[c] for c in range(r + 1, n))) / rows[r][r]
+    return result
+
+
+def homography(image_points, ground_points):
+    """Finds the homography which takes four image points to four ground points, as a 3x3 list
+    of rows with the last element 1."""
+    matrix = []
+    vector = []
+    for (x, y), (gx, gy) in zip(image_points, ground_points):
+        matrix.append([x, y, 1, 0, 0, 0, -gx * x, -gx * y])
+        vector.append(gx)
+        matrix.append([0, 0, 0, x, y, 1, -gy * x, -gy * y])
+        vector.append(gy)
+    h = solve(matrix, vector) + [1.0]
+
+    # Scale it so that the points in front of the camera have a positive w, so that those behind
+    # the horizon can be told apart by their negative one.
+    x, y = image_points[0]
+    if h[6] * x + h[7] * y + h[8] < 0:
+        h = [-value for value in h]
+    return [h[0:3], h[3:6], h[6:9]]
+
+
+def to_ground(h, x, y):
+    """Maps an image point to the ground plane through a homography."""
+    w = h[2][0] * x + h[2][1] * y + h[2][2]
+    if w <= 0:
+        sys.exit(f'Image point ({x}, {y}) is at or above the horizon of the perspective calibration')
+    return ((h[0][0] * x + h[0][1] * y + h[0][2]) / w, (h[1][0] * x + h[1][1] * y + h[1][2]) / w)
+
+
+def perspective_rows(settings, native_frame_size, undistort):
+    """Builds the per-row perspective table: for each row of the calibrated frame, the ground x
+    as a linear function of the column (scale, offset), and the ground y. The frame is the
+    undistorted one; undistort maps the settings' image points into it. Returns the table, and
+    whether it is calibrated."""
+    width = native_frame_size['width']
+    height = native_frame_size['height']
+    if 'perspective' not in settings:
+        return [(1.0, 0.0, float(height - 1 - row)) for row in range(height)], False
+
+    perspective = settings['perspective']
+    if len(perspective['image_points']) != 4 or len(perspective['ground_points_mm']) != 4:
+        sys.exit('Perspective calibration needs exactly four image points and four ground points')
+    h = homography([undistort(*point) for point in perspective['image_points']], perspective['ground_points_mm'])
+
+    # Ground x is exactly linear along a row, and ground y constant, as long as the camera isn't
+    # rolled; the table is checked against the full homography in case it is. Rows cropped off by
+    # both lines are never detected in, and may be at or above the horizon, so they repeat the
+    # first row which is.
+    first_row = min(settings['outside_thresh']['cropping']['top'], settings['stop_thresh']['cropping']['top'])
+    rows = []
+    worst = 0.0
+    for row in range(first_row, height):
+        left = to_ground(h, 0, row)
+        right = to_ground(h, width - 1, row)
+        scale = (right[0] - left[0]) / (width - 1)
+        ground_y = to_ground(h, (width - 1) / 2, row)[1]
+        rows.append((scale, left[0], ground_y))
+        for col in range(width):
+            exact = to_ground(h, col, row)
+            error = math.hypot(scale * col + left[0] - exact[0], ground_y - exact[1])
+            worst = max(worst, error / max(1.0, math.hypot(*exact)))
+    rows = [rows[0]] * first_row + rows
+    if worst > PERSPECTIVE_TOLERANCE:
+        sys.exit(f'Perspective table is off by up to {worst:.1%}; is the camera rolled?')
+    return rows, True
+
+
+def params_header(settings, checksum, model, step):
+    """Gets the text of params.h."""
+    native_frame_size = get_native_frame_size(settings)
+    check_roi('Outside line', settings['outside_thresh']['cropping'], native_frame_size)
+    check_roi('Stop line', settings['stop_thresh']['cropping'], native_frame_size)
+
+    lines = [
+        '///////////////////////////////////////////////////////////////////////////////////////////////////',
+        '/// A generated file which contains constants determined in the Python debugging tool.',
+        '///',
+        '/// Author: Andrew Huffman',
+        '///////////////////////////////////////////////////////////////////////////////////////////////////',
+        '',
+        '#pragma once',
+        '',
+        '#include <stdint.h>',
+        '',
+        '// Identifies the settings (and class table) this build was generated from.',
+        f'constexpr uint32_t params_checksum = 0x{checksum:08x};',
+        '',
+        f'constexpr uint16_t calibration_width = {native_frame_size["width"]};',
+        f'constexpr uint16_t calibration_height = {native_frame_size["height"]};',
+        '',
+        '// Whether perspective_table.cpp maps points to the ground in millimetres, rather than',
+        '// leaving them in pixels.',
+        f'constexpr bool perspective_calibrated = {"true" if "perspective" in settings else "false"};',
+        '',
+        '// Whether distortion_table.cpp undoes the lens distortion, the center it is about, and the',
+        '// squared radius between its entries.',
+        f'constexpr bool lens_distortion_calibrated = {"false" if model is None else "true"};',
+        f'constexpr float distortion_center_col = {float_literal((native_frame_size["width"] - 1) / 2 if model is None else model.center[0])};',
+        f'constexpr float distortion_center_row = {float_literal((native_frame_size["height"] - 1) / 2 if model is None else model.center[1])};',
+        f'constexpr float distortion_r2_step = {float_literal(step)};',
+        '',
+        f'constexpr uint16_t expected_line_pos = {settings["outside_line_data"]["x"]};',
+        '',
+        f'constexpr uint16_t expected_red_y = {settings["stop_thresh"]["detect_loc"]["y"]};',
+        f'constexpr uint16_t expected_red_radius = {settings["stop_thresh"]["detect_loc"]["radius"]};',
+        '',
+        '// The bits of rgb565_class_table.',
+        f'constexpr uint8_t outside_class_bit = 0x{OUTSIDE_CLASS_BIT:02x};',
+        f'constexpr uint8_t stop_class_bit = 0x{STOP_CLASS_BIT:02x};',
+        '',
+    ]
+    lines += thresh_lines('outside', settings['outside_thresh'])
+    lines.append('')
+    lines += thresh_lines('stop', settings['stop_thresh'])
+    lines.append('')
+    lines += extra_class_lines(extra_classes(settings, native_frame_size))
+    return '\n'.join(lines)
+
+
+def extra_class_lines(classes):
+    """Gets the lines declaring the extra classes, as arrays indexed by class. With no extra
+    classes, the arrays hold one unused entry, since C++ has no empty arrays."""
+    entries = classes if classes else [None]
+
+    def array(declaration, values, inner=''):
+        return f'constexpr {declaration}[]{inner} = {{{", ".join(values)}}};'
+
+    def triple(values):
+        return '{' + ', '.join(str(value) for value in values) + '}'
+
+    def hsv(thresh, key):
+        color = thresh[key]
+        return (color['hue'], color['saturation'], color['value'])
+
+    unused = (0, 0, 0)
+    return [
+        '// The extra classes, beyond the outside and stop lines: their names, their bits of',
+        '// rgb565_class_table, then their thresholds, cropping (top, bottom, left, right) and minimum',
+        '// areas, as for the lines above.',
+        f'constexpr uint8_t extra_class_count = {len(classes)};',
+        array('const char* const extra_class_names', [f'"{thresh["name"]}"' if thresh else '""' for thresh in entries]),
+        array('uint8_t extra_class_bits', [f'0x{extra_class_bit(index):02x}' if thresh else '0' for index, thresh in enumerate(entries)]),
+        array('uint8_t extra_thresh_min', [triple(hsv(thresh, 'thresh_color_min') if thresh else unused) for thresh in entries], '[3]'),
+        array('uint8_t extra_thresh_max', [triple(hsv(thresh, 'thresh_color_max') if thresh else unused) for thresh in entries], '[3]'),
+        array('uint8_t extra_yuv_min', [triple(yuv_bounds(thresh['name'], thresh)[0] if thresh else unused) for thresh in entries], '[3]'),
+        array('uint8_t extra_yuv_max', [triple(yuv_bounds(thresh['name'], thresh)[1] if thresh else unused) for thresh in entries], '[3]'),
+        array('uint8_t extra_luma_min', [str(luma_bounds(thresh)[0]) if thresh else '0' for thresh in entries]),
+        array('uint8_t extra_luma_max', [str(luma_bounds(thresh)[1]) if thresh else '0' for thresh in entries]),
+        array('uint16_t extra_cropping', [triple((thresh['cropping'][side] for side in ('top', 'bottom', 'left', 'right')) if thresh else (0, 0, 0, 0)) for thresh in entries], '[4]'),
+        array('uint32_t extra_min_detect_area', [str(thresh['min_detect_area']) if thresh else '0' for thresh in entries]),
+        '',
+    ]
+
+
+def class_table_source(table):
+    """Gets the text of class_table.cpp."""
+    lines = [
+        '// A generated file; see gen_params.py.',
+        '',
+        '#include "class_table.h"',
+        '',
+        'namespace lane_detect',
+        '{',
+        '    const uint8_t rgb565_class_table[RGB565_CLASS_TABLE_SIZE] = {',
+    ]
+    for start in range(0, len(table), 32):
+        lines.append('        ' + ', '.join(str(bits) for bits in table[start:start + 32]) + ',')
+    lines += [
+        '    };',
+        '}',
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def line_calibration_literal(name, thresh, class_bit):
+    """Gets a LineCalibration (see main/calibration.h) for a set of thresholds from the settings
+    file, as an initializer."""
+    def triple(values):
+        return '{' + ', '.join(str(value) for value in values) + '}'
+
+    low = thresh['thresh_color_min']
+    high = thresh['thresh_color_max']
+    yuv_low, yuv_high = yuv_bounds(name, thresh)
+    luma_low, luma_high = luma_bounds(thresh)
+    cropping = thresh['cropping']
+    return ', '.join([
+        triple((low['hue'], low['saturation'], low['value'])),
+        triple((high['hue'], high['saturation'], high['value'])),
+        '{' + triple(yuv_low) + ', ' + triple(yuv_high) + '}',
+        str(luma_low),
+        str(luma_high),
+        ', '.join(str(cropping[side]) for side in ('top', 'bottom', 'left', 'right')),
+        str(thresh['min_detect_area']),
+        f'0x{class_bit:02x}',
+    ])
+
+
+def profiles_source(profiles, tables):
+    """Gets the text of profiles.cpp: each profile's calibration, in pixels of its native frame
+    size, and class table. The first profile's table is rgb565_class_table; any other which
+    classifies the same shares it."""
+    lines = [
+        '// A generated file; see gen_params.py.',
+        '',
+        '#include "generated_profiles.h"',
+        '',
+        'namespace lane_detect',
+        '{',
+    ]
+    table_names = []
+    for name, table in zip(PROFILE_NAMES, tables):
+        if table == tables[0]:
+            table_names.append('rgb565_class_table')
+            continue
+        table_names.append(f'{name}_class_table')
+        lines.append(f'    static const uint8_t {name}_class_table[RGB565_CLASS_TABLE_SIZE] = {{')
+        for start in range(0, len(table), 32):
+            lines.append('        ' + ', '.join(str(bits) for bits in table[start:start + 32]) + ',')
+        lines += ['    };', '']
+
+    lines.append('    const GeneratedProfile generated_profiles[PROFILE_COUNT] = {')
+    for name, profile, table_name in zip(PROFILE_NAMES, profiles, table_names):
+        classes = profile.get('extra_classes', [])
+        extras = [f'{{{line_calibration_literal(thresh["name"], thresh, extra_class_bit(index))}}}' for index, thresh in enumerate(classes)]
+        extras += ['{}'] * (MAX_EXTRA_CLASSES - len(classes))
+        stop = profile['stop_thresh']['detect_loc']
+        lines += [
+            f'        {{   // {name}',
+            '            {',
+            f'                {{{line_calibration_literal("Outside line", profile["outside_thresh"], OUTSIDE_CLASS_BIT)}}},',
+            f'                {{{line_calibration_literal("Stop line", profile["stop_thresh"], STOP_CLASS_BIT)}}},',
+            f'                {profile["outside_line_data"]["x"]}, {stop["y"]}, {stop["radius"]},',
+            f'                {{{", ".join(extras)}}},',
+            f'                {len(classes)},',
+            '            },',
+            f'            {table_name},',
+            '        },',
+        ]
+    lines += [
+        '    };',
+        '}',
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def float_literal(value):
+    """Formats a float as a C++ float literal."""
+    text = f'{value:.7g}'
+    if '.' not in text and 'e' not in text:
+        text += '.0'
+    return text + 'f'
+
+
+def perspective_table_source(rows):
+    """Gets the text of perspective_table.cpp."""
+    lines = [
+        '// A generated file; see gen_params.py.',
+        '',
+        '#include "perspective.h"',
+        '',
+        'namespace lane_detect',
+        '{',
+        '    const PerspectiveRow perspective_rows[calibration_height] = {',
+    ]
+    for scale, offset, ground_y in rows:
+        lines.append(f'        {{{float_literal(scale)}, {float_literal(offset)}, {float_literal(ground_y)}}},')
+    lines += [
+        '    };',
+        '}',
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def distortion_table_source(table):
+    """Gets the text of distortion_table.cpp."""
+    lines = [
+        '// A generated file; see gen_params.py.',
+        '',
+        '#include "distortion.h"',
+        '',
+        'namespace lane_detect',
+        '{',
+        '    const float undistort_scales[DISTORTION_TABLE_INTERVALS + 1] = {',
+    ]
+    for start in range(0, len(table), 8):
+        lines.append('        ' + ', '.join(float_literal(scale) for scale in table[start:start + 8]) + ',')
+    lines += [
+        '    };',
+        '}',
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def write_if_changed(path, text):
+    """Writes a file, unless it already holds the text, so that the build doesn't recompile
+    everything which includes it."""
+    if os.path.exists(path):
+        with open(path, 'r', encoding='ascii') as f:
+            if f.read() == text:
+                return
+    with open(path, 'w', encoding='ascii') as f:
+        f.write(text)
 
 
 def main():
     """The main routine."""
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--settings', default='debugger_settings.json', help='The debugger settings file.')
+    parser.add_argument('--output-dir', help='Where to write params.h and the tables.')
+    args = parser.parse_args()
+
     # Load settings.
-    with open('debugger_settings.json', 'r', encoding='ascii') as f:
+    with open(args.settings, 'r', encoding='ascii') as f:
         settings = json.load(f)
 
-    # Print the preamble.
-    print('///////////////////////////////////////////////////////////////////////////////////////////////////')
-    print('/// A generated file which contains constants determined in the Python debugging tool.')
-    print('///')
-    print('/// Author: Andrew Huffman')
-    print('///////////////////////////////////////////////////////////////////////////////////////////////////')
-    print()
-    print('#pragma once')
-    print()
-    print('#include <stdint.h>')
-    print()
-
-    # Print the calibrated line position.
-    print('constexpr uint8_t expected_line_pos = ' +
-          str(settings['outside_line_data']['x']) +
-          ';')
-    print()
-
-    # Print the stop-line position.
-    print(
-        'constexpr uint8_t expected_red_y = ' +
-        str(settings['stop_thresh']['detect_loc']['y']) +
-        ';'
-    )
-    print(
-        'constexpr uint8_t expected_red_radius = ' +
-        str(settings['stop_thresh']['detect_loc']['radius']) +
-        ';'
-    )
-    print()
-
-    # Print the min colors.
-    print(f'constexpr uint8_t outside_thresh_min_hue = {settings["outside_thresh"]["thresh_color_min"]["hue"]};')
-    print(f'constexpr uint8_t outside_thresh_min_sat = {settings["outside_thresh"]["thresh_color_min"]["saturation"]};')
-    print(f'constexpr uint8_t outside_thresh_min_val = {settings["outside_thresh"]["thresh_color_min"]["value"]};')
-    print()
-
-    # Print the max colors.
-    print(f'constexpr uint8_t outside_thresh_max_hue = {settings["outside_thresh"]["thresh_color_max"]["hue"]};')
-    print(f'constexpr uint8_t outside_thresh_max_sat = {settings["outside_thresh"]["thresh_color_max"]["saturation"]};')
-    print(f'constexpr uint8_t outside_thresh_max_val = {settings["outside_thresh"]["thresh_color_max"]["value"]};')
-    print()
-
-    # Print the cropping parameter.
-    outside_cropping = settings['outside_thresh']["cropping"]
-    print(f'constexpr uint8_t outside_cropping_top = {outside_cropping["top"]};')
-    print(f'constexpr uint8_t outside_cropping_bottom = {outside_cropping["bottom"]};')
-    print(f'constexpr uint8_t outside_cropping_left = {outside_cropping["left"]};')
-    print(f'constexpr uint8_t outside_cropping_right = {outside_cropping["right"]};')
-    print()
-
-    # Print the min detection area parameters.
-    print(f'constexpr uint16_t outside_min_detect_area = {settings["outside_thresh"]["min_detect_area"]};')
-    print()
-
-    # Print the min colors.
-    print(f'constexpr uint8_t stop_thresh_min_hue = {settings["stop_thresh"]["thresh_color_min"]["hue"]};')
-    print(f'constexpr uint8_t stop_thresh_min_sat = {settings["stop_thresh"]["thresh_color_min"]["saturation"]};')
-    print(f'constexpr uint8_t stop_thresh_min_val = {settings["stop_thresh"]["thresh_color_min"]["value"]};')
-    print()
-
-    # Print the max colors.
-    print(f'constexpr uint8_t stop_thresh_max_hue = {settings["stop_thresh"]["thresh_color_max"]["hue"]};')
-    print(f'constexpr uint8_t stop_thresh_max_sat = {settings["stop_thresh"]["thresh_color_max"]["saturation"]};')
-    print(f'constexpr uint8_t stop_thresh_max_val = {settings["stop_thresh"]["thresh_color_max"]["value"]};')
-    print()
-
-    # Print the cropping parameter.
-    stop_cropping = settings['stop_thresh']["cropping"]
-    print(f'constexpr uint8_t stop_cropping_top = {stop_cropping["top"]};')
-    print(f'constexpr uint8_t stop_cropping_bottom = {stop_cropping["bottom"]};')
-    print(f'constexpr uint8_t stop_cropping_left = {stop_cropping["left"]};')
-    print(f'constexpr uint8_t stop_cropping_right = {stop_cropping["right"]};')
-    print()
-
-    # Print the min detection area parameter.
-    print(f'constexpr uint16_t stop_min_detect_area = {settings["outside_thresh"]["min_detect_area"]};')
-    print()
+    # The checksum covers all the outputs; it is computed over the header without it.
+    native_frame_size = get_native_frame_size(settings)
+    extra_classes(settings, native_frame_size)
+    table = class_table(settings)
+
+    # Every profile is checked as the settings are. Most profiles only change a little, so most
+    # share the first's class table.
+    profiles = profile_settings(settings)
+    tables = [table]
+    for name, profile in zip(PROFILE_NAMES[1:], profiles[1:]):
+        check_roi(f'Profile {name} outside line', profile['outside_thresh']['cropping'], native_frame_size)
+        check_roi(f'Profile {name} stop line', profile['stop_thresh']['cropping'], native_frame_size)
+        extra_classes(profile, native_frame_size)
+        tables.append(table if profile == settings else class_table(profile))
+    profiles_text = profiles_source(profiles, tables)
+
+    # The perspective is calibrated in the undistorted frame.
+    model = lens_model(settings, native_frame_size)
+    scales, step = distortion_table(model, native_frame_size)
+    if model is not None:
+        check_distortion(model, scales, step, native_frame_size)
+        undistort = lambda x, y: table_undistort(scales, step, model.center, x, y)
+    else:
+        undistort = lambda x, y: (x, y)
+    distortion = distortion_table_source(scales)
+    perspective = perspective_table_source(perspective_rows(settings, native_frame_size, undistort)[0])
+
+    checksum = zlib.crc32(perspective.encode('ascii'), zlib.crc32(table))
+    checksum = zlib.crc32(distortion.encode('ascii'), checksum)
+    checksum = zlib.crc32(profiles_text.encode('ascii'), checksum)
+    checksum = zlib.crc32(params_header(settings, 0, model, step).encode('ascii'), checksum)
+    header = params_header(settings, checksum, model, step)
+
+    if args.output_dir is None:
+        print(header, end='')
+        return
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    write_if_changed(os.path.join(args.output_dir, 'params.h'), header)
+    write_if_changed(os.path.join(args.output_dir, 'class_table.cpp'), class_table_source(table))
+    write_if_changed(os.path.join(args.output_dir, 'perspective_table.cpp'), perspective)
+    write_if_changed(os.path.join(args.output_dir, 'distortion_table.cpp'), distortion)
+    write_if_changed(os.path.join(args.output_dir, 'profiles.cpp'), profiles_text)
+
 
 if __name__ == '__main__':
     main()
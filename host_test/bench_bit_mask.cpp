@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks bit-packed morphology against the same on a dense cv::Mat1b, and checks that the
+/// two agree pixel for pixel. Then, on a clean frame and a noisy one, reports what the opening the
+/// outside line gets does for the blob stage after it: the runs and blobs left, and how long
+/// encoding them and finding the blobs takes, with and without it.
+///
+/// The firmware's dense path was cv::morphologyEx, but the host has no OpenCV imgproc to call
+/// (only the headers and ESP-32 libraries are vendored). The dense side here is instead a
+/// straightforward separable erosion and dilation over cv::Mat1b, with cv::erode's default
+/// border (past the edges counts as set when eroding and clear when dilating). It stands in for
+/// the byte-a-pixel cost, not for OpenCV's vectorized speed.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test_support.h"
+
+#include "bit_mask.h"
+#include "rle_mask.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Erodes or dilates a dense mask along one axis, into another.
+    /// @param horizontal Whether the neighbours are left and right, rather than above and below.
+    void dense_pass(const cv::Mat1b& src, cv::Mat1b& dst, const bool horizontal, const bool erode)
+    {
+        const uint8_t border = erode ? 0xff : 0;
+        dst.create(src.rows, src.cols);
+        for (int row = 0; row < src.rows; row++)
+        {
+            const uint8_t* in = src.ptr<uint8_t>(row);
+            const uint8_t* above = (row > 0) ? src.ptr<uint8_t>(row - 1) : nullptr;
+            const uint8_t* below = (row + 1 < src.rows) ? src.ptr<uint8_t>(row + 1) : nullptr;
+            uint8_t* out = dst.ptr<uint8_t>(row);
+            for (int col = 0; col < src.cols; col++)
+            {
+                uint8_t first;
+                uint8_t second;
+                if (horizontal)
+                {
+                    first = (col > 0) ? in[col - 1] : border;
+                    second = (col + 1 < src.cols) ? in[col + 1] : border;
+                }
+                else
+                {
+                    first = above ? above[col] : border;
+                    second = below ? below[col] : border;
+                }
+                out[col] = erode ? (in[col] & first & second) : (in[col] | first | second);
+            }
+        }
+    }
+
+
+    /// @brief Applies a morphological operation to a dense mask of 0s and 0xffs, through a
+    /// scratch mask, as BitMask::apply does to a packed one.
+    void dense_apply(cv::Mat1b& mask, cv::Mat1b& scratch, const Morphology& morphology)
+    {
+        const auto pass = [&](const bool erode)
+        {
+            if (morphology.element != StructuringElement::Vertical)
+            {
+                dense_pass(mask, scratch, true, erode);
+                std::swap(mask, scratch);
+            }
+            if (morphology.element != StructuringElement::Horizontal)
+            {
+                dense_pass(mask, scratch, false, erode);
+                std::swap(mask, scratch);
+            }
+        };
+
+        if (MorphOp::Open == morphology.op)
+        {
+            pass(true);
+            pass(false);
+        }
+        else if (MorphOp::Close == morphology.op)
+        {
+            pass(false);
+            pass(true);
+        }
+    }
+
+
+    /// @brief A thresholded frame: a slanted line, with specks and gaps scattered over it at
+    /// about the given density.
+    cv::Mat1b noisy_mask(const int rows, const int cols, const int noise_per_mille)
+    {
+        cv::Mat1b mask(rows, cols);
+        uint32_t state = 0x12345678;
+        for (int row = 0; row < rows; row++)
+        {
+            const int middle = cols / 2 + (rows - row) * cols / (4 * rows);
+            for (int col = 0; col < cols; col++)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                const bool on_line = abs(col - middle) <= cols / 24;
+                const bool flipped = static_cast<int>(state % 1000) < noise_per_mille;
+                mask(row, col) = (on_line != flipped) ? 0xff : 0;
+            }
+        }
+        return mask;
+    }
+
+
+    /// @brief Copies a region of a mask into another, as the dense path must before working in
+    /// place. (The host shim has no cv::Mat::copyTo.)
+    void copy_region(const cv::Mat1b& src, const cv::Rect2i& roi, cv::Mat1b& dst)
+    {
+        dst.create(roi.height, roi.width);
+        for (int row = 0; row < roi.height; row++)
+        {
+            memcpy(dst.ptr<uint8_t>(row), src.ptr<uint8_t>(roi.y + row) + roi.x, roi.width);
+        }
+    }
+
+
+    /// @brief Counts the pixels of a region of a dense mask which disagree with a packed mask.
+    int count_mismatches(const cv::Mat1b& dense, const BitMask& bits)
+    {
+        int mismatches = 0;
+        for (int row = 0; row < dense.rows; row++)
+        {
+            const uint32_t* words = bits.row(row);
+            for (int col = 0; col < dense.cols; col++)
+            {
+                const bool set = (words[col >> 5] >> (col & 31)) & 1;
+                mismatches += (set != (0 != dense(row, col)));
+            }
+        }
+        return mismatches;
+    }
+
+
+    /// @brief Checks and times every operation and element at a frame size. The ROI is the whole
+    /// mask, offset by an odd column, so that words straddle the mask's bytes as they do after
+    /// cropping.
+    void check_and_time(const int rows, const int cols)
+    {
+        const cv::Mat1b frame = noisy_mask(rows, cols + 3, 30);
+        const cv::Rect2i roi(3, 0, cols, rows);
+
+        const MorphOp ops[] = {MorphOp::Open, MorphOp::Close};
+        const StructuringElement elements[] = {StructuringElement::Horizontal, StructuringElement::Vertical, StructuringElement::Square};
+        const char* const op_names[] = {"open", "close"};
+        const char* const element_names[] = {"3x1", "1x3", "3x3"};
+        for (int op = 0; op < 2; op++)
+        {
+            for (int element = 0; element < 3; element++)
+            {
+                const Morphology morphology = {ops[op], elements[element]};
+
+                cv::Mat1b dense;
+                cv::Mat1b scratch;
+                BitMask bits;
+                copy_region(frame, roi, dense);
+                dense_apply(dense, scratch, morphology);
+                bits.pack(frame, roi);
+                bits.apply(morphology);
+                CHECK(0 == count_mismatches(dense, bits));
+
+                const double dense_us = time_us([&]
+                {
+                    copy_region(frame, roi, dense);
+                    dense_apply(dense, scratch, morphology);
+                    keep(dense.data);
+                }, 50);
+                const double packed_us = time_us([&]
+                {
+                    bits.pack(frame, roi);
+                    bits.apply(morphology);
+                    keep(bits);
+                }, 50);
+                printf("%3dx%-3d %-5s %s: dense %8.2f us, packed %7.2f us (%.1fx)\n",
+                    cols, rows, op_names[op], element_names[element], dense_us, packed_us, dense_us / packed_us);
+            }
+        }
+    }
+
+
+    /// @brief Runs the blob stage on a frame straight from the threshold and after the outside
+    /// line's opening, and reports the runs, blobs and times of each. The line is always one blob
+    /// after the opening, and the noise left is fewer blobs than before.
+    /// @param noise_per_mille How many pixels in a thousand are flipped; 0 for a clean frame.
+    void check_and_time_blobs(const int rows, const int cols, const int noise_per_mille)
+    {
+        const cv::Mat1b frame = noisy_mask(rows, cols + 3, noise_per_mille);
+        const cv::Rect2i roi(3, 0, cols, rows);
+        const Morphology opening = {MorphOp::Open, StructuringElement::Horizontal};
+
+        RleMask raw;
+        RleMask cleaned;
+        BitMask bits;
+        raw.create(static_cast<uint16_t>(rows), static_cast<uint16_t>(cols + 3));
+        cleaned.create(static_cast<uint16_t>(rows), static_cast<uint16_t>(cols + 3));
+
+        const double raw_us = time_us([&]
+        {
+            raw.encode(frame, roi);
+            raw.find_blobs();
+            keep(raw);
+        }, 50);
+        const double raw_blobs_us = time_us([&] { raw.find_blobs(); keep(raw); }, 50);
+        const double cleaned_us = time_us([&]
+        {
+            bits.pack(frame, roi);
+            bits.apply(opening);
+            cleaned.encode(bits);
+            cleaned.find_blobs();
+            keep(cleaned);
+        }, 50);
+        const double cleaned_blobs_us = time_us([&] { cleaned.find_blobs(); keep(cleaned); }, 50);
+
+        if (0 == noise_per_mille)
+        {
+            CHECK(1 == raw.blob_count());
+            CHECK(1 == cleaned.blob_count());
+        }
+        else
+        {
+            CHECK(cleaned.blob_count() < raw.blob_count());
+        }
+        Blob line;
+        CHECK(cleaned.largest_blob(line) && line.bounds.height == rows);
+
+        printf("%3dx%-3d %-5s unopened: %5u runs, %4u blobs, find_blobs %6.2f us, encode + find_blobs %6.2f us\n",
+            cols, rows, noise_per_mille ? "noisy" : "clean", static_cast<unsigned>(raw.run_count()), raw.blob_count(), raw_blobs_us, raw_us);
+        printf("%3dx%-3d %-5s opened:   %5u runs, %4u blobs, find_blobs %6.2f us, pack + open + encode + find_blobs %6.2f us\n",
+            cols, rows, noise_per_mille ? "noisy" : "clean", static_cast<unsigned>(cleaned.run_count()), cleaned.blob_count(), cleaned_blobs_us, cleaned_us);
+    }
+}
+
+
+int main()
+{
+    check_and_time(96, 96);
+    check_and_time(120, 160);
+    check_and_time(240, 320);
+
+    for (const int noise_per_mille : {0, 80})
+    {
+        check_and_time_blobs(96, 96, noise_per_mille);
+        check_and_time_blobs(240, 320, noise_per_mille);
+    }
+    return finish();
+}
@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks taking each class's mask from the class map as the detectors do, split into planes
+/// once and each region extracted, against thresholding the map for each class and packing each
+/// region, for 1 to 8 classes at 96x96 and QVGA. Splitting costs the same however many classes
+/// there are, so the first should grow only by a cheap extract per class, and the second by a
+/// whole pass over the frame per class. Checks that the two give the same masks.
+///
+/// How the times compare depends on the machine and its load, so they are reported, not
+/// asserted.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "bit_mask.h"
+#include "class_planes.h"
+#include "class_table.h"
+#include "parallel_rows.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    void check_and_time(const uint16_t rows, const uint16_t cols)
+    {
+        TrackScene scene = {rows, cols};
+        scene.stop_height = 0.08f;
+        cv::Mat1b class_map;
+        parallel_lookup(render_rgb565(scene), rgb565_class_table, class_map);
+
+        // The detectors' crops leave out about the top third.
+        const cv::Rect2i roi(0, rows / 3, cols, rows - rows / 3);
+
+        ClassPlanes planes;
+        planes.create(rows, cols);
+        BitMask extracted[MAX_CLASSES];
+        BitMask packed[MAX_CLASSES];
+        cv::Mat1b mask;
+
+        printf("%ux%u:\n", cols, rows);
+        double first_us[2] = {};
+        double last_us[2] = {};
+        for (const uint8_t classes : {1, 2, 4, 8})
+        {
+            const double planes_us = time_us([&] {
+                planes.split(class_map, static_cast<uint16_t>(roi.y), rows);
+                for (uint8_t index = 0; index < classes; index++)
+                {
+                    extracted[index].extract(planes, index, roi);
+                }
+                keep(extracted[0].row(0));
+            }, 50);
+            const double threshold_us = time_us([&] {
+                for (uint8_t index = 0; index < classes; index++)
+                {
+                    parallel_test_bits(class_map, static_cast<uint8_t>(1 << index), mask);
+                    packed[index].pack(mask, roi);
+                }
+                keep(packed[0].row(0));
+            }, 50);
+
+            int mismatches = 0;
+            for (uint8_t index = 0; index < classes; index++)
+            {
+                for (uint16_t row = 0; row < roi.height; row++)
+                {
+                    mismatches += (memcmp(extracted[index].row(row), packed[index].row(row), packed[index].words_per_row() * sizeof(uint32_t)) != 0);
+                }
+            }
+            CHECK(0 == mismatches);
+
+            printf("  %u class(es): split + extract %6.1f us, threshold + pack %6.1f us\n", classes, planes_us, threshold_us);
+            if (1 == classes)
+            {
+                first_us[0] = planes_us;
+                first_us[1] = threshold_us;
+            }
+            last_us[0] = planes_us;
+            last_us[1] = threshold_us;
+        }
+
+        printf("  each class past the first: split + extract %5.2f us, threshold + pack %5.2f us\n",
+            (last_us[0] - first_us[0]) / 7, (last_us[1] - first_us[1]) / 7);
+    }
+}
+
+
+int main()
+{
+    check_and_time(96, 96);
+    check_and_time(240, 320);
+    return finish();
+}
@@ -0,0 +1,85 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks coarse-to-fine class lookup against looking up every pixel, at 96x96 up to VGA, and
+/// checks that the two give the same class map over the region wherever nothing is narrower than
+/// a cell. The saving should grow with the resolution, and coarse-to-fine should win at QVGA, the
+/// smallest size lane_detection.cpp turns it on at.
+///
+/// The speedup is only reported, as the host may be busy with other work.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "class_table.h"
+#include "coarse_lookup.h"
+#include "parallel_rows.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Checks and times one frame size and cell size.
+    /// @return How many times faster coarse-to-fine was than the full lookup.
+    double check_and_time(const uint16_t rows, const uint16_t cols, const uint8_t shift)
+    {
+        TrackScene scene = {rows, cols};
+        scene.stop_height = 0.08f;
+        const cv::Mat frame = render_rgb565(scene);
+
+        // The detectors' crops leave out about the top third.
+        const cv::Rect2i roi(0, rows / 3, cols, rows - rows / 3);
+        const cv::Mat frame_roi = frame(roi);
+
+        cv::Mat1b full;
+        cv::Mat1b coarse;
+        CoarseLookup coarse_lookup(shift);
+        coarse_lookup.create(rows, cols);
+
+        const double full_us = time_us([&] { parallel_lookup(frame_roi, rgb565_class_table, full); keep(full.data); }, 30);
+        const double coarse_us = time_us([&] { coarse_lookup.lookup(frame, rgb565_class_table, roi, coarse); keep(coarse.data); }, 30);
+
+        // The same classes within the region, and nothing outside it.
+        int mismatches = 0;
+        int classified = 0;
+        for (int row = 0; row < rows; row++)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                const uint8_t expected = roi.contains(cv::Point2i(col, row)) ? full(row - roi.y, col) : 0;
+                mismatches += (coarse(row, col) != expected);
+                classified += (expected != 0);
+            }
+        }
+        CHECK(0 == mismatches);
+        CHECK(classified > 0);
+
+        printf("%3ux%-3u shift %u: full %7.1f us, coarse-to-fine %7.1f us (%.2fx)\n",
+            cols, rows, shift, full_us, coarse_us, full_us / coarse_us);
+        return full_us / coarse_us;
+    }
+}
+
+
+int main()
+{
+    const uint16_t sizes[][2] = {{96, 96}, {120, 160}, {240, 320}, {480, 640}};
+    double qvga_speedup = 0.0;
+    for (const auto& size : sizes)
+    {
+        for (const uint8_t shift : {1, 2})
+        {
+            const double speedup = check_and_time(size[0], size[1], shift);
+            if (320 == size[1] && 2 == shift)
+            {
+                qvga_speedup = speedup;
+            }
+        }
+    }
+    printf("QVGA coarse-to-fine speedup %.2fx%s\n", qvga_speedup, (qvga_speedup > 1.0) ? "" : ", no faster than a full lookup");
+    return finish();
+}
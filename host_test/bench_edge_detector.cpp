@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks the edge detector against the thresholding path it can replace, per frame, in each
+/// capture format and at each frame size: both must find the outside line where it was drawn.
+/// The thresholding path is timed from the captured frame to runs, as the edge detector is: a
+/// class table lookup for RGB565 and grayscale, and a direct YUV threshold for YUV422.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "class_table.h"
+#include "edge_detector.h"
+#include "params.h"
+#include "parallel_rows.h"
+#include "rle_mask.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief The edge parameters lane_detection.cpp detects with, rescaled to a frame width as
+    /// it rescales them.
+    EdgeParams edge_params(const uint16_t cols)
+    {
+        return {24, static_cast<uint8_t>(2 * cols / 96), static_cast<uint8_t>(24 * cols / 96)};
+    }
+
+    constexpr kernels::YuvBounds outside_bounds = {
+        {outside_yuv_min_y, outside_yuv_min_u, outside_yuv_min_v},
+        {outside_yuv_max_y, outside_yuv_max_u, outside_yuv_max_v},
+    };
+
+
+    /// @brief Checks that the largest blob of some runs lies on the scene's line, from top to
+    /// bottom.
+    void check_found_line(const TrackScene& scene, RleMask& runs, const char* what)
+    {
+        Blob blob;
+        runs.find_blobs();
+        if (!CHECK(runs.largest_blob(blob)))
+        {
+            return;
+        }
+
+        const int middle_row = blob.bounds.y + blob.bounds.height / 2;
+        const float center_col = blob.bounds.x + 0.5f * (blob.bounds.width - 1);
+        if (!CHECK_NEAR(center_col, scene.line_col(middle_row), 1.0 + 0.01 * scene.cols)
+            || !CHECK(0 == blob.bounds.y && scene.rows == blob.bounds.y + blob.bounds.height))
+        {
+            fprintf(stderr, "    by %s at %ux%u\n", what, scene.cols, scene.rows);
+        }
+    }
+
+
+    /// @brief Checks and times both paths on one format at one frame size.
+    void check_and_time(const uint16_t rows, const uint16_t cols, const LumaSource source)
+    {
+        const TrackScene scene = {rows, cols};
+        const cv::Rect2i roi(0, 0, cols, rows);
+
+        cv::Mat frame;
+        const uint8_t* table = nullptr;
+        uint8_t luma_classes[256];
+        if (LumaSource::Rgb565 == source)
+        {
+            frame = render_rgb565(scene);
+            table = rgb565_class_table;
+        }
+        else if (LumaSource::Yuyv == source)
+        {
+            frame = render_yuyv(scene);
+        }
+        else
+        {
+            frame = render_gray(scene);
+            for (int luma = 0; luma < 256; luma++)
+            {
+                luma_classes[luma] = (luma >= outside_luma_min && luma <= outside_luma_max) ? outside_class_bit : 0;
+            }
+            table = luma_classes;
+        }
+
+        cv::Mat1b class_map;
+        cv::Mat1b mask;
+        RleMask threshold_runs;
+        threshold_runs.create(rows, cols);
+        const auto threshold = [&]
+        {
+            if (table != nullptr)
+            {
+                parallel_lookup(frame, table, class_map);
+                parallel_test_bits(class_map, outside_class_bit, mask);
+            }
+            else
+            {
+                parallel_in_range_yuyv(frame, outside_bounds, mask);
+            }
+            threshold_runs.encode(mask, roi);
+        };
+
+        EdgeDetector edges;
+        edges.create(rows, cols);
+        const EdgeParams params = edge_params(cols);
+        RleMask edge_runs;
+        edge_runs.create(rows, cols);
+        const auto detect_edges = [&]
+        {
+            edge_runs.clear();
+            edges.detect(frame, source, roi, params, edge_runs);
+        };
+
+        const double threshold_us = time_us(threshold, 30);
+        const double edges_us = time_us(detect_edges, 30);
+        check_found_line(scene, threshold_runs, "thresholding");
+        check_found_line(scene, edge_runs, "edges");
+
+        const char* const names[] = {"RGB565", "YUV422", "gray"};
+        printf("%3ux%-3u %-6s threshold %7.1f us, edges %7.1f us (%.2fx)\n",
+            cols, rows, names[static_cast<uint8_t>(source)], threshold_us, edges_us, threshold_us / edges_us);
+    }
+}
+
+
+int main()
+{
+    const uint16_t sizes[][2] = {{96, 96}, {120, 160}, {240, 320}};
+    for (const auto& size : sizes)
+    {
+        for (const LumaSource source : {LumaSource::Rgb565, LumaSource::Yuyv, LumaSource::Gray})
+        {
+            check_and_time(size[0], size[1], source);
+        }
+    }
+    return finish();
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks the fork-join: what a run costs over calling both jobs, with jobs too small to be
+/// worth it and with jobs the size of a detector. Also checks that both jobs run, and that an
+/// exception from either reaches the caller without leaving the worker stuck.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdexcept>
+#include <thread>
+
+#include "test_support.h"
+
+#include "fork_join.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Busy work which the compiler can't fold away.
+    /// @param steps How long to run, in steps of a few nanoseconds.
+    uint32_t work(const uint32_t steps)
+    {
+        uint32_t state = 0x2545f491;
+        for (uint32_t i = 0; i < steps; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+        }
+        return state;
+    }
+
+
+    /// @brief Both jobs run, every time.
+    void check_runs_both(ForkJoin& fork_join)
+    {
+        for (uint32_t steps = 0; steps < 1000; steps += 50)
+        {
+            uint32_t local = 0;
+            uint32_t remote = 0;
+            fork_join.run([&] { local = work(steps); }, [&] { remote = work(steps + 1); });
+            CHECK(work(steps) == local);
+            CHECK(work(steps + 1) == remote);
+        }
+    }
+
+
+    /// @brief A throw from either side is rethrown once both have finished, and the next run
+    /// still works.
+    void check_exceptions(ForkJoin& fork_join)
+    {
+        bool other_finished = false;
+        bool caught = false;
+        try
+        {
+            fork_join.run([] { throw std::runtime_error("local"); }, [&] { work(100000); other_finished = true; });
+        }
+        catch (const std::runtime_error&)
+        {
+            caught = true;
+        }
+        CHECK(caught && other_finished);
+
+        other_finished = false;
+        caught = false;
+        try
+        {
+            fork_join.run([&] { work(100000); other_finished = true; }, [] { throw std::runtime_error("remote"); });
+        }
+        catch (const std::runtime_error&)
+        {
+            caught = true;
+        }
+        CHECK(caught && other_finished);
+
+        bool ran = false;
+        fork_join.run([] {}, [&] { ran = true; });
+        CHECK(ran);
+    }
+
+
+    /// @brief Times both jobs called one after the other, and run through the fork-join. The
+    /// speedup is only reported: on a host with one core there is none to be had.
+    void benchmark(ForkJoin& fork_join)
+    {
+        printf("%u hardware threads\n", std::thread::hardware_concurrency());
+        const uint32_t sizes[] = {0, 1000, 100000, 1000000};
+        for (const uint32_t steps : sizes)
+        {
+            uint32_t local = 0;
+            uint32_t remote = 0;
+            const double serial_us = time_us([&]
+            {
+                local = work(steps);
+                remote = work(steps);
+                keep(local);
+                keep(remote);
+            }, 50);
+            const double forked_us = time_us([&]
+            {
+                fork_join.run([&] { local = work(steps); }, [&] { remote = work(steps); });
+                keep(local);
+                keep(remote);
+            }, 50);
+            printf("%7u steps a job: serial %9.2f us, forked %9.2f us (%.2fx)\n",
+                static_cast<unsigned>(steps), serial_us, forked_us, serial_us / forked_us);
+        }
+    }
+}
+
+
+int main()
+{
+    ForkJoin fork_join;
+    check_runs_both(fork_join);
+    check_exceptions(fork_join);
+    benchmark(fork_join);
+    return finish();
+}
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks the RANSAC line fitter at the pipeline's budget, and checks that it shrugs off the
+/// stray points which throw the slope through two extreme points, that the same points always
+/// give the same line, and that the deadline stops the fit however hopeless the points are.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include "test_support.h"
+
+#include "line_fit.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief The budget and seed lane_detection.cpp fits with.
+    constexpr LineFitBudget budget = OUTSIDE_LINE_FIT_BUDGET;
+    constexpr uint32_t seed = OUTSIDE_LINE_FIT_SEED;
+
+    /// @brief The line the points are taken from: a steep one, as the outside line usually is.
+    constexpr float true_slope = -4.0f;
+    constexpr float true_intercept = 60.0f;
+
+
+    /// @brief A small generator for the points, apart from the fitter's own.
+    struct Noise
+    {
+        uint32_t state = 0x9e3779b9;
+
+        /// @return A number from -1 to 1.
+        float next()
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return static_cast<float>(state % 2001) / 1000.0f - 1.0f;
+        }
+    };
+
+
+    /// @brief Gets the points along the line, one every other row, jittered by under a pixel,
+    /// and with every outlier_every-th point thrown 10 to 40 pixels off it, wrapping around a 96
+    /// pixel frame.
+    /// @param index The point's index.
+    /// @param col The point's column. Output param.
+    /// @param row The point's row. Output param.
+    void get_point(Noise& noise, const int index, const int outlier_every, float& col, float& row)
+    {
+        row = static_cast<float>(index * 2);
+        col = true_intercept + row / true_slope + 0.5f * noise.next();
+        if (outlier_every > 0 && 0 == index % outlier_every)
+        {
+            col = fmodf(col + 25.0f + 15.0f * noise.next(), 96.0f);
+        }
+    }
+
+
+    /// @brief Fills a fitter with as many points as it holds.
+    void add_points(LineFitter& fitter, const int outlier_every, const int count = budget.max_points)
+    {
+        Noise noise;
+        fitter.clear();
+        for (int index = 0; index < count; index++)
+        {
+            float col;
+            float row;
+            get_point(noise, index, outlier_every, col, row);
+            fitter.add_point(col, row);
+        }
+    }
+
+
+    /// @brief The slope through the points' first and last rows, as get_slope measures it from a
+    /// blob's extreme pixels.
+    float extreme_slope(const int outlier_every)
+    {
+        Noise noise;
+        float first_col;
+        float first_row;
+        float last_col = 0.0f;
+        float last_row = 0.0f;
+        get_point(noise, 0, outlier_every, first_col, first_row);
+        for (int index = 1; index < budget.max_points; index++)
+        {
+            get_point(noise, index, outlier_every, last_col, last_row);
+        }
+        return (last_row - first_row) / (last_col - first_col);
+    }
+
+
+    /// @brief With a sixth of the points stray, the fit stays on the line; the extreme points
+    /// don't.
+    void check_outliers()
+    {
+        LineFitter fitter(budget, seed);
+        add_points(fitter, 6);
+        LineFit fit;
+        CHECK(fitter.fit(fit));
+        CHECK_NEAR(1.0f / fit.slope, 1.0f / true_slope, 0.02f);
+        CHECK_NEAR(fit.intercept, true_intercept, 1.0f);
+        CHECK_NEAR(fit.inlier_ratio, 5.0f / 6, 0.05f);
+        CHECK(fabsf(1.0f / extreme_slope(6) - 1.0f / true_slope) > 0.05f);
+
+        printf("Slope with 1 in 6 points stray: fitted %.2f, extreme points %.2f, true %.2f\n",
+            fit.slope, extreme_slope(6), true_slope);
+    }
+
+
+    /// @brief Fitting the same points twice, with a fitter of the same seed or the same fitter
+    /// again, gives the same line.
+    void check_repeatable()
+    {
+        LineFitter first(budget, seed);
+        LineFitter second(budget, seed);
+        add_points(first, 4);
+        add_points(second, 4);
+
+        LineFit a;
+        LineFit b;
+        LineFit c;
+        CHECK(first.fit(a));
+        CHECK(second.fit(b));
+        CHECK(first.fit(c));
+        CHECK(a.slope == b.slope && a.intercept == b.intercept && a.inlier_ratio == b.inlier_ratio);
+        CHECK(a.slope == c.slope && a.intercept == c.intercept && a.inlier_ratio == c.inlier_ratio);
+    }
+
+
+    /// @brief The time per fit: clean points, which stop early; stray ones; and the worst case,
+    /// points with no line through them, which run every candidate. Then far more hopeless
+    /// points with the iterations uncapped, which only the deadline stops.
+    void benchmark()
+    {
+        LineFitter fitter(budget, seed);
+        LineFit fit;
+        const int outlier_everys[] = {0, 6, 2, 1};
+        const char* const names[] = {"clean", "1 in 6 stray", "1 in 2 stray", "all stray"};
+        for (int i = 0; i < 4; i++)
+        {
+            add_points(fitter, outlier_everys[i]);
+            const double us = time_us([&] { fitter.fit(fit); keep(fit); }, 200);
+            printf("%-13s %3u candidates, %7.2f us\n", names[i], fitter.iterations(), us);
+            CHECK(fitter.iterations() <= budget.max_iterations);
+        }
+
+        LineFitBudget uncapped = budget;
+        uncapped.max_points = 1000;
+        uncapped.max_iterations = UINT16_MAX;
+        uncapped.max_us = 200;
+        LineFitter deadline_fitter(uncapped, seed);
+        add_points(deadline_fitter, 1, uncapped.max_points);
+        const double us = time_us([&] { deadline_fitter.fit(fit); keep(fit); }, 20);
+        printf("%-13s %5u candidates, %7.2f us against a %u us deadline\n", "uncapped", deadline_fitter.iterations(), us,
+            static_cast<unsigned>(uncapped.max_us));
+        // Stopping short of the cap shows the deadline ended the fit. How far past it the fit ran
+        // is only reported, as the host may be busy with other work.
+        CHECK(deadline_fitter.iterations() < UINT16_MAX);
+    }
+}
+
+
+int main()
+{
+    check_outliers();
+    check_repeatable();
+    benchmark();
+    return finish();
+}
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks splitting a frame's rows between two cores, as parallel_for_rows does on the
+/// ESP-32: the range halved, one half on the calling thread and the other on a worker. Off-device
+/// parallel_for_rows goes through cv::parallel_for_, which the host shim runs serially, so the
+/// split is made here with a ForkJoin, around the same kernels, on the class lookup and the YUV
+/// threshold at 96x96 up to VGA. Checks that the split gives the same mask as parallel_for_rows.
+///
+/// The speedup is only reported: on a host with one core there is none to be had, and on the
+/// ESP-32 the workers' dispatch costs differ.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include <thread>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "class_table.h"
+#include "fork_join.h"
+#include "parallel_rows.h"
+#include "pixel_kernels.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Runs a body over rows on the calling thread, or split in half as the pool splits
+    /// them.
+    template <typename Body>
+    void split_rows(ForkJoin& fork_join, const int rows, const Body& body)
+    {
+        const int middle = rows >> 1;
+        fork_join.run([&] { body(cv::Range(0, middle)); }, [&] { body(cv::Range(middle, rows)); });
+    }
+
+
+    bool same_mask(const cv::Mat1b& a, const cv::Mat1b& b)
+    {
+        for (int row = 0; row < a.rows; row++)
+        {
+            if (memcmp(a.ptr<uint8_t>(row), b.ptr<uint8_t>(row), a.cols) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    /// @brief Checks and times one frame size.
+    void check_and_time(ForkJoin& fork_join, const uint16_t rows, const uint16_t cols)
+    {
+        TrackScene scene = {rows, cols};
+        scene.stop_height = 0.08f;
+        const cv::Mat rgb565 = render_rgb565(scene);
+        const cv::Mat yuyv = render_yuyv(scene);
+        const kernels::YuvBounds bounds = {{200, 118, 118}, {255, 138, 138}};
+
+        cv::Mat1b expected;
+        cv::Mat1b mask(rows, cols);
+        const auto lookup = [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; row++)
+            {
+                kernels::lookup_16(rgb565.ptr<uint16_t>(row), rgb565_class_table, mask.ptr<uint8_t>(row), cols);
+            }
+        };
+        const auto threshold = [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; row++)
+            {
+                kernels::threshold_yuyv(yuyv.ptr<uint8_t>(row), bounds, mask.ptr<uint8_t>(row), cols);
+            }
+        };
+
+        parallel_lookup(rgb565, rgb565_class_table, expected);
+        split_rows(fork_join, rows, lookup);
+        CHECK(same_mask(mask, expected));
+        const double lookup_serial_us = time_us([&] { lookup(cv::Range(0, rows)); keep(mask.data); }, 50);
+        const double lookup_split_us = time_us([&] { split_rows(fork_join, rows, lookup); keep(mask.data); }, 50);
+
+        parallel_in_range_yuyv(yuyv, bounds, expected);
+        split_rows(fork_join, rows, threshold);
+        CHECK(same_mask(mask, expected));
+        const double threshold_serial_us = time_us([&] { threshold(cv::Range(0, rows)); keep(mask.data); }, 50);
+        const double threshold_split_us = time_us([&] { split_rows(fork_join, rows, threshold); keep(mask.data); }, 50);
+
+        printf("%3ux%-3u lookup: one core %7.1f us, two %7.1f us (%.2fx); yuv threshold: one core %7.1f us, two %7.1f us (%.2fx)\n",
+            cols, rows, lookup_serial_us, lookup_split_us, lookup_serial_us / lookup_split_us,
+            threshold_serial_us, threshold_split_us, threshold_serial_us / threshold_split_us);
+    }
+}
+
+
+int main()
+{
+    printf("%u hardware threads\n", std::thread::hardware_concurrency());
+    ForkJoin fork_join;
+    const uint16_t sizes[][2] = {{96, 96}, {120, 160}, {240, 320}, {480, 640}};
+    for (const auto& size : sizes)
+    {
+        check_and_time(fork_join, size[0], size[1]);
+    }
+    return finish();
+}
@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Benchmarks the pixel kernels against their plain per-pixel versions in scalar_kernels.h, over
+/// a QVGA frame, and reports each one's throughput. The plain versions are compiled with the same
+/// flags, so any vectorizing the compiler manages on its own is counted for them too; the
+/// speedup is what writing against the universal intrinsics adds on top.
+///
+/// Only the results are checked. How much faster the kernels are depends on the machine and its
+/// load, so it is reported, not asserted.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "test_support.h"
+#include "test_frames.h"
+#include "scalar_kernels.h"
+
+#include "pixel_kernels.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    constexpr uint16_t rows = 240;
+    constexpr uint16_t cols = 320;
+    constexpr size_t pixels = static_cast<size_t>(rows) * cols;
+    constexpr int runs = 50;
+
+
+    /// @brief Times a kernel and its plain version over the frame, and reports them.
+    template <typename Kernel, typename Scalar>
+    void report(const char* name, const Kernel& kernel, const Scalar& plain)
+    {
+        const double kernel_us = time_us(kernel, runs);
+        const double plain_us = time_us(plain, runs);
+        printf("%-18s kernel %7.1f us (%6.1f Mpixel/s), scalar %7.1f us (%6.1f Mpixel/s), %.2fx\n",
+            name, kernel_us, pixels / kernel_us, plain_us, pixels / plain_us, plain_us / kernel_us);
+    }
+}
+
+
+int main()
+{
+    TrackScene scene = {rows, cols};
+    scene.stop_height = 0.08f;
+    const cv::Mat rgb565 = render_rgb565(scene);
+    const cv::Mat yuyv = render_yuyv(scene);
+    const cv::Mat gray = render_gray(scene);
+
+    std::vector<uint8_t> bgr(3 * pixels);
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const Rgb color = scene.color(static_cast<int>(i / cols), static_cast<int>(i % cols));
+        bgr[3 * i] = color.b;
+        bgr[3 * i + 1] = color.g;
+        bgr[3 * i + 2] = color.r;
+    }
+
+    std::vector<uint8_t> swapped(2 * pixels);
+    std::vector<uint8_t> swapped_plain(2 * pixels);
+    report("swap_bytes_16",
+        [&] { kernels::swap_bytes_16(rgb565.data, swapped.data(), pixels); keep(swapped[0]); },
+        [&] { scalar::swap_bytes_16(rgb565.data, swapped_plain.data(), pixels); keep(swapped_plain[0]); });
+    CHECK(swapped == swapped_plain);
+
+    const uint8_t low[3] = {200, 200, 200};
+    const uint8_t high[3] = {255, 255, 255};
+    std::vector<uint8_t> mask(pixels);
+    std::vector<uint8_t> mask_plain(pixels);
+    report("threshold_3ch",
+        [&] { kernels::threshold_3ch(bgr.data(), low, high, mask.data(), pixels); keep(mask[0]); },
+        [&] { scalar::threshold_3ch(bgr.data(), low, high, mask_plain.data(), pixels); keep(mask_plain[0]); });
+    CHECK(mask == mask_plain);
+
+    const kernels::YuvBounds bounds = {{200, 118, 118}, {255, 138, 138}};
+    report("threshold_yuyv",
+        [&] { kernels::threshold_yuyv(yuyv.data, bounds, mask.data(), pixels); keep(mask[0]); },
+        [&] { scalar::threshold_yuyv(yuyv.data, bounds, mask_plain.data(), pixels); keep(mask_plain[0]); });
+    CHECK(mask == mask_plain);
+
+    report("test_bits",
+        [&] { kernels::test_bits(gray.data, 0x80, mask.data(), pixels); keep(mask[0]); },
+        [&] { scalar::test_bits(gray.data, 0x80, mask_plain.data(), pixels); keep(mask_plain[0]); });
+    CHECK(mask == mask_plain);
+
+    // Column sums over the whole frame, one row at a time, as the histogram search does.
+    std::vector<uint16_t> sums(cols);
+    std::vector<uint16_t> sums_plain(cols);
+    report("accumulate_columns",
+        [&] {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (uint16_t row = 0; row < rows; row++)
+            {
+                kernels::accumulate_columns(mask.data() + row * cols, sums.data(), cols);
+            }
+            keep(sums[0]);
+        },
+        [&] {
+            std::fill(sums_plain.begin(), sums_plain.end(), 0);
+            for (uint16_t row = 0; row < rows; row++)
+            {
+                scalar::accumulate_columns(mask_plain.data() + row * cols, sums_plain.data(), cols);
+            }
+            keep(sums_plain[0]);
+        });
+    CHECK(sums == sums_plain);
+
+    std::vector<uint32_t> bits(pixels / 32);
+    std::vector<uint32_t> bits_plain(pixels / 32);
+    report("pack_mask",
+        [&] { kernels::pack_mask(mask.data(), bits.data(), pixels); keep(bits[0]); },
+        [&] { scalar::pack_mask(mask_plain.data(), bits_plain.data(), pixels); keep(bits_plain[0]); });
+    CHECK(bits == bits_plain);
+
+    return finish();
+}
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Runs the front of the pipeline (class lookup, thresholding, run-length encoding and blob
+/// finding, cropped by the calibration rescaled to the frame) on the same view of the track at
+/// 96x96, QQVGA and QVGA. Checks that each finds the outside line where it was drawn, that the
+/// types FrameGeometry picks hold every size, and times each stage, so that resolution can be
+/// traded against frame rate.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <limits>
+#include <type_traits>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "class_table.h"
+#include "frame_geometry.h"
+#include "params.h"
+#include "parallel_rows.h"
+#include "pixel_kernels.h"
+#include "rle_mask.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+// The smallest types which hold each size, and no smaller.
+static_assert(std::is_same_v<Square96::coord_t, uint8_t> && std::is_same_v<Square96::column_sum_t, uint16_t> && std::is_same_v<Square96::area_t, uint16_t>);
+static_assert(std::is_same_v<Qqvga::coord_t, uint8_t> && std::is_same_v<Qqvga::column_sum_t, uint16_t> && std::is_same_v<Qqvga::area_t, uint16_t>);
+static_assert(std::is_same_v<Qvga::coord_t, uint16_t> && std::is_same_v<Qvga::column_sum_t, uint16_t> && std::is_same_v<Qvga::area_t, uint32_t>);
+static_assert(std::is_same_v<FrameGeometry<320, 480>::column_sum_t, uint32_t>);
+
+// Calibrated positions land in the same place at every size.
+static_assert(Qvga::scale_col(expected_line_pos, calibration_width) == expected_line_pos * 320 / calibration_width);
+static_assert(Qvga::scale_area(calibration_width * calibration_height, calibration_width, calibration_height) == 320 * 240);
+
+namespace
+{
+    /// @brief Checks and times one frame size.
+    template <typename Geometry>
+    void check_and_time()
+    {
+        constexpr uint16_t rows = Geometry::height;
+        constexpr uint16_t cols = Geometry::width;
+        const TrackScene scene = {rows, cols};
+        const cv::Mat frame = render_rgb565(scene);
+
+        // The outside line's crop, as lane_detection.cpp rescales it.
+        const int top = Geometry::scale_row(outside_cropping_top, calibration_height);
+        const int bottom = Geometry::scale_row(outside_cropping_bottom, calibration_height);
+        const int left = Geometry::scale_col(outside_cropping_left, calibration_width);
+        const int right = Geometry::scale_col(outside_cropping_right, calibration_width);
+        const cv::Rect2i roi(left, top, cols - left - right, rows - top - bottom);
+
+        cv::Mat1b class_map;
+        cv::Mat1b mask;
+        RleMask runs;
+        runs.create(rows, cols);
+        Blob blob = {};
+
+        const auto lookup = [&] { parallel_lookup(frame, rgb565_class_table, class_map); };
+        const auto threshold = [&] { parallel_test_bits(class_map(roi), outside_class_bit, mask); };
+        const auto encode = [&]
+        {
+            runs.clear();
+            for (int row = 0; row < roi.height; row++)
+            {
+                runs.encode_row(static_cast<uint16_t>(roi.y + row), mask.ptr<uint8_t>(row) - roi.x, static_cast<uint16_t>(roi.x), static_cast<uint16_t>(roi.x + roi.width));
+            }
+        };
+        const auto blobs = [&] { runs.find_blobs(); runs.largest_blob(blob); };
+
+        const double lookup_us = time_us(lookup, 30);
+        const double threshold_us = time_us(threshold, 30);
+        const double encode_us = time_us(encode, 30);
+        const double blobs_us = time_us(blobs, 30);
+
+        // One blob, centered on the line as drawn, and as large as the line within the crop.
+        CHECK(1 == runs.blob_count());
+        const int middle_row = blob.bounds.y + blob.bounds.height / 2;
+        const float center_col = blob.bounds.x + 0.5f * (blob.bounds.width - 1);
+        CHECK_NEAR(center_col, scene.line_col(middle_row), 1.0 + 0.01 * cols);
+        CHECK(blob.bounds.y == top && blob.bounds.y + blob.bounds.height == rows - bottom);
+
+        uint32_t expected_area = 0;
+        for (int row = roi.y; row < roi.y + roi.height; row++)
+        {
+            for (int col = roi.x; col < roi.x + roi.width; col++)
+            {
+                expected_area += scene.on_line(row, col);
+            }
+        }
+        CHECK(blob.area == expected_area);
+        CHECK(blob.area <= std::numeric_limits<typename Geometry::area_t>::max());
+
+        // A column of a mask set throughout sums without overflowing the type chosen for it.
+        cv::Mat1b full_mask(rows, cols);
+        full_mask.setTo(0xff);
+        typename Geometry::column_sum_t sums[cols] = {};
+        for (int row = 0; row < rows; row++)
+        {
+            if constexpr (std::is_same_v<typename Geometry::column_sum_t, uint16_t>)
+            {
+                kernels::accumulate_columns(full_mask.ptr<uint8_t>(row), sums, cols);
+            }
+            else
+            {
+                for (int col = 0; col < cols; col++)
+                {
+                    sums[col] += full_mask(row, col);
+                }
+            }
+        }
+        CHECK(static_cast<uint32_t>(rows) * 0xff == sums[0] && sums[0] == sums[cols - 1]);
+
+        printf("%3ux%-3u lookup %7.1f us, threshold %6.1f us, encode %6.1f us, blobs %6.1f us: %7.1f us\n",
+            cols, rows, lookup_us, threshold_us, encode_us, blobs_us, lookup_us + threshold_us + encode_us + blobs_us);
+    }
+}
+
+
+int main()
+{
+    check_and_time<Square96>();
+    check_and_time<Qqvga>();
+    check_and_time<Qvga>();
+    return finish();
+}
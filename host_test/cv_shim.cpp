@@ -0,0 +1,245 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The few out-of-line parts of OpenCV's core which the pipeline uses, for the host tests. Only the
+/// headers and ESP-32 builds of OpenCV are vendored, so the host has nothing to link against; this
+/// covers 2-D cv::Mat (allocation, ROIs, setTo with a scalar) and runs parallel_for_ serially.
+/// Anything else fails loudly through cv::error.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc.hpp"
+#define EPS 192
+
+namespace cv
+{
+    namespace
+    {
+        /// @brief Gets at the value an _InputArray wraps, which OpenCV keeps protected.
+        struct InputArrayAccess : public _InputArray
+        {
+            static const void* object(const _InputArray& array)
+            {
+                return static_cast<const InputArrayAccess&>(array).obj;
+            }
+
+            static int flags_of(const _InputArray& array)
+            {
+                return static_cast<const InputArrayAccess&>(array).flags;
+            }
+
+            static Size size(const _InputArray& array)
+            {
+                return static_cast<const InputArrayAccess&>(array).sz;
+            }
+        };
+    }
+
+
+    void* fastMalloc(const size_t bytes)
+    {
+        return malloc(bytes ? bytes : 1);
+    }
+
+
+    void fastFree(void* data)
+    {
+        free(data);
+    }
+
+
+    void error(const int code, const String& err, const char* func, const char* file, const int line)
+    {
+        fprintf(stderr, "OpenCV error %d: %s (in %s, %s:%d)\n", code, err.c_str(), func, file, line);
+        abort();
+    }
+
+
+    UMatData::UMatData(const MatAllocator* allocator)
+    {
+        prevAllocator = currAllocator = allocator;
+        urefcount = refcount = mapcount = 0;
+        data = origdata = nullptr;
+        size = 0;
+        flags = static_cast<UMatData::MemoryFlag>(0);
+        handle = userdata = nullptr;
+        allocatorFlags_ = 0;
+        originalUMatData = nullptr;
+    }
+
+
+    UMatData::~UMatData()
+    {
+    }
+
+
+    void Mat::create(const int d, const int* sizes, int type)
+    {
+        CV_Assert(2 == d && sizes[0] >= 0 && sizes[1] >= 0);
+        type = CV_MAT_TYPE(type);
+        if (data && 2 == dims && sizes[0] == rows && sizes[1] == cols && this->type() == type)
+        {
+            return;
+        }
+
+        release();
+        flags = MAGIC_VAL | type;
+        dims = 2;
+        rows = sizes[0];
+        cols = sizes[1];
+        step.p[1] = CV_ELEM_SIZE(type);
+        step.p[0] = cols * step.p[1];
+
+        const size_t bytes = rows * step.p[0];
+        u = new UMatData(nullptr);
+        u->refcount = 1;
+        u->data = u->origdata = static_cast<uchar*>(fastMalloc(bytes));
+        u->size = bytes;
+        datastart = data = u->data;
+        dataend = datalimit = data + bytes;
+        updateContinuityFlag();
+    }
+
+
+    void Mat::deallocate()
+    {
+        if (u)
+        {
+            UMatData* const old = u;
+            u = nullptr;
+            fastFree(old->origdata);
+            delete old;
+        }
+    }
+
+
+    void Mat::copySize(const Mat&)
+    {
+        CV_Error(Error::StsNotImplemented, "Only 2-D matrices are part of the host shim");
+    }
+
+
+    void Mat::updateContinuityFlag()
+    {
+        if (rows <= 1 || step.p[0] == cols * elemSize())
+        {
+            flags |= CONTINUOUS_FLAG;
+        }
+        else
+        {
+            flags &= ~CONTINUOUS_FLAG;
+        }
+    }
+
+
+    Mat::Mat(const Mat& m, const Range& row_range, const Range& col_range):
+        flags(MAGIC_VAL), dims(0), rows(0), cols(0), data(0), datastart(0), dataend(0),
+        datalimit(0), allocator(0), u(0), size(&rows)
+    {
+        CV_Assert(2 == m.dims);
+        *this = m;
+        if (row_range != Range::all())
+        {
+            CV_Assert(0 <= row_range.start && row_range.start <= row_range.end && row_range.end <= m.rows);
+            rows = row_range.size();
+            data += step.p[0] * row_range.start;
+            flags |= SUBMATRIX_FLAG;
+        }
+        if (col_range != Range::all())
+        {
+            CV_Assert(0 <= col_range.start && col_range.start <= col_range.end && col_range.end <= m.cols);
+            cols = col_range.size();
+            data += col_range.start * elemSize();
+            flags |= SUBMATRIX_FLAG;
+        }
+        updateContinuityFlag();
+        if (rows <= 0 || cols <= 0)
+        {
+            release();
+            rows = cols = 0;
+        }
+    }
+
+
+    Mat::Mat(const Mat& m, const Rect& roi):
+        Mat(m, Range(roi.y, roi.y + roi.height), Range(roi.x, roi.x + roi.width))
+    {
+    }
+
+
+    Mat& Mat::setTo(InputArray value, InputArray mask)
+    {
+        CV_Assert(!InputArrayAccess::object(mask) && CV_8U == depth());
+        const int value_flags = InputArrayAccess::flags_of(value);
+        CV_Assert(_InputArray::MATX == (value_flags & _InputArray::KIND_MASK) && CV_64F == CV_MAT_DEPTH(value_flags));
+
+        // A plain number arrives as one double; a Scalar as four.
+        const double* const channels = static_cast<const double*>(InputArrayAccess::object(value));
+        const Size value_size = InputArrayAccess::size(value);
+        const int value_channels = value_size.width * value_size.height;
+
+        uchar pixel[CV_CN_MAX];
+        for (int channel = 0; channel < this->channels(); channel++)
+        {
+            pixel[channel] = saturate_cast<uchar>(channels[channel < value_channels ? channel : 0]);
+        }
+
+        for (int row = 0; row < rows; row++)
+        {
+            uchar* const dst = ptr(row);
+            for (int col = 0; col < cols; col++)
+            {
+                memcpy(dst + col * elemSize(), pixel, elemSize());
+            }
+        }
+        return *this;
+    }
+
+
+    Mat Mat::reshape(int, int, const int*) const
+    {
+        CV_Error(Error::StsNotImplemented, "Mat::reshape is not part of the host shim");
+    }
+
+
+    void Mat::convertTo(OutputArray, int, double, double) const
+    {
+        CV_Error(Error::StsNotImplemented, "Mat::convertTo is not part of the host shim");
+    }
+
+
+    InputOutputArray noArray()
+    {
+        static _InputOutputArray none;
+        return none;
+    }
+
+
+    ParallelLoopBody::~ParallelLoopBody()
+    {
+    }
+
+
+    void parallel_for_(const Range& range, const ParallelLoopBody& body, double)
+    {
+        body(range);
+    }
+
+
+    void cvtColor(InputArray, OutputArray, int, int)
+    {
+        CV_Error(Error::StsNotImplemented, "cv::cvtColor is not part of the host shim");
+    }
+
+
+    void inRange(InputArray, InputArray, InputArray, OutputArray)
+    {
+        CV_Error(Error::StsNotImplemented, "cv::inRange is not part of the host shim");
+    }
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Plain per-pixel versions of the pixel kernels, written from their documentation rather than
+/// from pixel_kernels.cpp, for the kernels to be checked and timed against.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pixel_kernels.h"
+
+namespace lane_detect::test::scalar
+{
+    inline void swap_bytes_16(const uint8_t* src, uint8_t* dst, const size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            const uint8_t first = src[2 * i];
+            dst[2 * i] = src[2 * i + 1];
+            dst[2 * i + 1] = first;
+        }
+    }
+
+
+    inline void threshold_3ch(const uint8_t* src, const uint8_t low[3], const uint8_t high[3], uint8_t* dst, const size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            bool in = true;
+            for (int channel = 0; channel < 3; channel++)
+            {
+                in = in && src[3 * i + channel] >= low[channel] && src[3 * i + channel] <= high[channel];
+            }
+            dst[i] = in ? 0xff : 0;
+        }
+    }
+
+
+    inline void threshold_yuyv(const uint8_t* src, const kernels::YuvBounds& bounds, uint8_t* dst, const size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            // Each pixel has its own Y, and the U and V of its pair. An unpaired last pixel has
+            // no V, so is never set.
+            const size_t pair = i & ~static_cast<size_t>(1);
+            if (pair + 1 >= pixels)
+            {
+                dst[i] = 0;
+                continue;
+            }
+            const uint8_t yuv[3] = {src[2 * i], src[2 * pair + 1], src[2 * pair + 3]};
+            bool in = true;
+            for (int channel = 0; channel < 3; channel++)
+            {
+                in = in && yuv[channel] >= bounds.low[channel] && yuv[channel] <= bounds.high[channel];
+            }
+            dst[i] = in ? 0xff : 0;
+        }
+    }
+
+
+    inline void test_bits(const uint8_t* src, const uint8_t bits, uint8_t* dst, const size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            dst[i] = (src[i] & bits) ? 0xff : 0;
+        }
+    }
+
+
+    inline void accumulate_columns(const uint8_t* mask, uint16_t* sums, const size_t cols)
+    {
+        for (size_t col = 0; col < cols; col++)
+        {
+            sums[col] += mask[col];
+        }
+    }
+
+
+    inline void pack_mask(const uint8_t* mask, uint32_t* bits, const size_t pixels)
+    {
+        for (size_t word = 0; word < (pixels + 31) / 32; word++)
+        {
+            bits[word] = 0;
+        }
+        for (size_t i = 0; i < pixels; i++)
+        {
+            bits[i / 32] |= static_cast<uint32_t>(mask[i] != 0) << (i % 32);
+        }
+    }
+}
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks that splitting a class map into planes and extracting a class's region gives the same
+/// bits as thresholding the map for that class and packing the region, as the detectors did
+/// before, for every class, on random class maps and regions. Frame widths which aren't a whole
+/// number of words, and regions which start partway through one, are included.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include <random>
+
+#include "test_support.h"
+
+#include "bit_mask.h"
+#include "class_planes.h"
+#include "parallel_rows.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    constexpr int trials = 100;
+
+    std::mt19937 rng(0x2545f491);
+
+
+    int uniform(const int low, const int high)
+    {
+        return std::uniform_int_distribution<int>(low, high)(rng);
+    }
+
+
+    /// @brief A random class map. Each class is set with its own probability, so that some
+    /// classes are sparse and others dense, and most pixels have several.
+    cv::Mat1b random_class_map(const uint16_t rows, const uint16_t cols)
+    {
+        int density[MAX_CLASSES];
+        for (int& percent : density)
+        {
+            percent = uniform(0, 100);
+        }
+
+        cv::Mat1b class_map(rows, cols);
+        for (int row = 0; row < rows; row++)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                uint8_t classes = 0;
+                for (uint8_t index = 0; index < MAX_CLASSES; index++)
+                {
+                    classes |= (uniform(0, 99) < density[index]) << index;
+                }
+                class_map(row, col) = classes;
+            }
+        }
+        return class_map;
+    }
+
+
+    /// @brief Whether two packed regions of the same size hold the same bits.
+    bool same_bits(const BitMask& a, const BitMask& b)
+    {
+        if (a.roi() != b.roi() || a.words_per_row() != b.words_per_row())
+        {
+            return false;
+        }
+        for (uint16_t row = 0; row < a.roi().height; row++)
+        {
+            if (memcmp(a.row(row), b.row(row), a.words_per_row() * sizeof(uint32_t)) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    /// @brief Every class's region, extracted from the planes, matches the class thresholded and
+    /// packed.
+    /// @param rows The frame's rows.
+    /// @param cols The frame's columns.
+    void check_extract(const uint16_t rows, const uint16_t cols)
+    {
+        ClassPlanes planes;
+        BitMask extracted;
+        BitMask packed;
+        cv::Mat1b mask;
+        int mismatches = 0;
+        int stray_bits = 0;
+        for (int trial = 0; trial < trials; trial++)
+        {
+            const cv::Mat1b class_map = random_class_map(rows, cols);
+            planes.split(class_map, 0, rows);
+
+            // Nothing past the frame's right edge.
+            const uint32_t last_word_mask = (0 == (cols & 31)) ? UINT32_MAX : ((1u << (cols & 31)) - 1);
+            for (uint8_t index = 0; index < MAX_CLASSES; index++)
+            {
+                for (uint16_t row = 0; row < rows; row++)
+                {
+                    stray_bits += (planes.row(index, row)[planes.words_per_row() - 1] & ~last_word_mask) != 0;
+                }
+            }
+
+            for (uint8_t index = 0; index < MAX_CLASSES; index++)
+            {
+                const int left = uniform(0, cols - 1);
+                const int top = uniform(0, rows - 1);
+                const cv::Rect2i roi(left, top, uniform(1, cols - left), uniform(1, rows - top));
+
+                extracted.extract(planes, index, roi);
+                parallel_test_bits(class_map, static_cast<uint8_t>(1 << index), mask);
+                packed.pack(mask, roi);
+                mismatches += !same_bits(extracted, packed);
+            }
+        }
+
+        printf("%ux%u: %d maps\n", cols, rows, trials);
+        CHECK(0 == mismatches);
+        CHECK(0 == stray_bits);
+    }
+
+
+    /// @brief Splitting some rows leaves the others as they were.
+    void check_partial_split()
+    {
+        constexpr uint16_t rows = 24;
+        constexpr uint16_t cols = 40;
+        ClassPlanes planes;
+        const cv::Mat1b first = random_class_map(rows, cols);
+        const cv::Mat1b second = random_class_map(rows, cols);
+        planes.split(first, 0, rows);
+        planes.split(second, 8, 16);
+
+        BitMask extracted;
+        BitMask packed;
+        cv::Mat1b mask;
+        int mismatches = 0;
+        for (uint8_t index = 0; index < MAX_CLASSES; index++)
+        {
+            for (uint16_t row = 0; row < rows; row++)
+            {
+                const cv::Mat1b& expected = (row >= 8 && row < 16) ? second : first;
+                const cv::Rect2i roi(0, row, cols, 1);
+                extracted.extract(planes, index, roi);
+                parallel_test_bits(expected, static_cast<uint8_t>(1 << index), mask);
+                packed.pack(mask, roi);
+                mismatches += !same_bits(extracted, packed);
+            }
+        }
+        CHECK(0 == mismatches);
+    }
+}
+
+
+int main()
+{
+    check_extract(96, 96);
+    check_extract(48, 70);
+    check_extract(30, 37);
+    check_extract(8, 160);
+    check_partial_split();
+    return finish();
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the generated distortion table against the lens model it was generated from: points
+/// are bent by the model, as the lens would see them, and undistort() must put them back where
+/// they were, at the calibrated frame size and at others.
+///
+/// Built against a table generated from settings/barrel_lens.json, whose coefficients arrive as
+/// LENS_K1 and LENS_K2.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+
+#include "distortion.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief How far, in pixels of the calibrated frame, a point may come back from where it
+    /// was. As gen_params.py's DISTORTION_TOLERANCE.
+    constexpr float tolerance = 0.1f;
+
+
+    /// @brief Bends a point as the lens does, in gen_params.py's model: r from the center, in
+    /// half frame widths, is seen at r * (1 + k1 r^2 + k2 r^4).
+    FramePoint distort(const FramePoint& point)
+    {
+        const float unit = 0.5f * calibration_width;
+        const float d_col = (point.col - distortion_center_col) / unit;
+        const float d_row = (point.row - distortion_center_row) / unit;
+        const float r2 = d_col * d_col + d_row * d_row;
+        const float scale = 1.0f + LENS_K1 * r2 + LENS_K2 * r2 * r2;
+        return {distortion_center_col + d_col * scale * unit, distortion_center_row + d_row * scale * unit};
+    }
+
+
+    /// @brief The center doesn't move, and a point off it moves outwards, since the lens is
+    /// barrel-shaped.
+    void check_known_points()
+    {
+        CHECK(lens_distortion_calibrated);
+
+        const FramePoint center = undistort(distortion_center_col, distortion_center_row, calibration_width, calibration_height);
+        CHECK_NEAR(center.col, distortion_center_col, 1e-4);
+        CHECK_NEAR(center.row, distortion_center_row, 1e-4);
+
+        const FramePoint corner = undistort(0.0f, 0.0f, calibration_width, calibration_height);
+        CHECK(corner.col < 0.0f && corner.row < 0.0f);
+    }
+
+
+    /// @brief Every point of a grid over the frame, at a frame size, which the lens keeps in the
+    /// frame, comes back to where it was.
+    /// @param scale The frame size, as a multiple of the calibrated one.
+    void check_round_trip(const int scale)
+    {
+        const uint16_t width = calibration_width * scale;
+        const uint16_t height = calibration_height * scale;
+
+        float worst = 0.0f;
+        int points = 0;
+        for (float row = -8.0f; row <= calibration_height + 8.0f; row += 0.75f)
+        {
+            for (float col = -8.0f; col <= calibration_width + 8.0f; col += 0.75f)
+            {
+                const FramePoint seen = distort({col, row});
+                if (seen.col < 0.0f || seen.col > calibration_width - 1 || seen.row < 0.0f || seen.row > calibration_height - 1)
+                {
+                    continue;
+                }
+
+                const FramePoint back = undistort(seen.col * scale, seen.row * scale, width, height);
+                worst = fmaxf(worst, hypotf(back.col / scale - col, back.row / scale - row));
+                points++;
+            }
+        }
+
+        printf("%ux%u: %d points, worst %.3f pixels\n", width, height, points, worst);
+        CHECK(points > 10000);
+        CHECK(worst <= tolerance);
+    }
+}
+
+
+int main()
+{
+    check_known_points();
+    check_round_trip(1);
+    check_round_trip(2);
+    return finish();
+}
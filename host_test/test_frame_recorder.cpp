@@ -0,0 +1,46 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks that the frame recorder stops, and closes its log, once the storage fills up, and that
+/// it can be started again afterwards. /dev/full stands in for a full flash partition.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+
+#include "frame_recorder.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Records to a full device: the first batch written fails, and the next frame offered
+    /// stops recording.
+    void check_stops_when_full()
+    {
+        FrameRecorder recorder("/dev/full", 8 * 1024, 2);
+        cv::Mat frame(48, 48, CV_8UC2);
+        frame.setTo(0);
+        FrameRecordInfo info = {};
+
+        CHECK(recorder.start());
+        for (int i = 0; i < 16 && recorder.recording(); i++)
+        {
+            recorder.record(frame, info);
+        }
+        CHECK(!recorder.recording());
+
+        // Started again, it records until the storage is found full again.
+        CHECK(recorder.start());
+        CHECK(recorder.recording());
+        recorder.stop();
+        CHECK(!recorder.recording());
+    }
+}
+
+
+int main()
+{
+    check_stops_when_full();
+    return finish();
+}
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Drives the frame scheduler with injected stage costs, and checks that it sheds as little work
+/// as will fit the budget, reacts to sudden jumps, and restores work once there is headroom.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+
+#include "frame_scheduler.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief What each stage costs, in microseconds, at each way it can be run.
+    struct StageCosts
+    {
+        uint32_t convert = 10000;
+        uint32_t outside_full = 20000;
+        uint32_t outside_shrunk = 12000;
+        uint32_t outside_scanline = 4000;
+        uint32_t stop = 16000;
+        uint32_t display = 10000;
+        uint32_t uart = 0;
+    };
+
+
+    /// @brief Runs one frame as the pipeline would: plans it, records what ran, and ends it.
+    /// @return The level the frame ran at.
+    QualityLevel run_frame(FrameScheduler& scheduler, const StageCosts& costs)
+    {
+        const FramePlan plan = scheduler.plan_frame();
+        scheduler.record_stage(Stage::Convert, costs.convert);
+        scheduler.record_stage(Stage::OutsideDetect,
+            plan.scanline_mode ? costs.outside_scanline : (plan.shrink_roi ? costs.outside_shrunk : costs.outside_full));
+        if (plan.run_stop_detection)
+        {
+            scheduler.record_stage(Stage::StopDetect, costs.stop);
+        }
+        if (plan.run_display)
+        {
+            scheduler.record_stage(Stage::Display, costs.display);
+        }
+        scheduler.record_stage(Stage::Uart, costs.uart);
+        scheduler.end_frame();
+        return plan.level;
+    }
+
+
+    /// @brief Runs frames, and gets the worst level any ran at.
+    QualityLevel run_frames(FrameScheduler& scheduler, const StageCosts& costs, const int frames)
+    {
+        QualityLevel worst = QualityLevel::Full;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            const QualityLevel level = run_frame(scheduler, costs);
+            worst = (level > worst) ? level : worst;
+        }
+        return worst;
+    }
+
+
+    /// @brief 56 ms at Full against a 50 ms budget, and 46 ms once the display is skipped: one
+    /// step is enough, and the scheduler must not go further while its smoothed cost catches up.
+    void check_one_step_is_enough()
+    {
+        FrameScheduler scheduler(50000);
+        const StageCosts costs;
+        const QualityLevel worst = run_frames(scheduler, costs, 500);
+        CHECK(QualityLevel::SkipDisplay == worst);
+        CHECK(QualityLevel::SkipDisplay == scheduler.level());
+        CHECK_NEAR(scheduler.frame_cost(), 46000, 100);
+    }
+
+
+    /// @brief Over budget at every level but the last: the scheduler must step all the way down.
+    void check_sheds_until_it_fits()
+    {
+        FrameScheduler scheduler(20000);
+        StageCosts costs;
+        costs.convert = 8000;
+        run_frames(scheduler, costs, 500);
+        CHECK(QualityLevel::Scanline == scheduler.level());
+    }
+
+
+    /// @brief A sudden jump past twice the budget is reacted to on the frame it happens, not
+    /// once the smoothed cost has caught up.
+    void check_reacts_to_jumps()
+    {
+        FrameScheduler scheduler(50000);
+        StageCosts costs;
+        costs.display = 0;
+        run_frames(scheduler, costs, 100);
+        CHECK(QualityLevel::Full == scheduler.level());
+
+        costs.convert = 80000;
+        run_frame(scheduler, costs);
+        CHECK(QualityLevel::Full != scheduler.level());
+    }
+
+
+    /// @brief Once the load drops, every level is restored, and without oscillating.
+    void check_restores()
+    {
+        FrameScheduler scheduler(50000);
+        StageCosts costs;
+        costs.display = 5000;
+        costs.convert = 40000;
+        run_frames(scheduler, costs, 200);
+        CHECK(scheduler.level() >= QualityLevel::DecimateStop);
+
+        costs.convert = 2000;
+        run_frames(scheduler, costs, 500);
+        CHECK(QualityLevel::Full == scheduler.level());
+
+        // Settled: stays at Full.
+        CHECK(QualityLevel::Full == run_frames(scheduler, costs, 500));
+    }
+}
+
+
+int main()
+{
+    check_one_step_is_enough();
+    check_sheds_until_it_fits();
+    check_reacts_to_jumps();
+    check_restores();
+    return finish();
+}
@@ -0,0 +1,174 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Synthetic frames for the host tests: a view of the track, drawn at any resolution in any of
+/// the formats the camera delivers.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+namespace lane_detect::test
+{
+    /// @brief An 8-bit RGB color.
+    struct Rgb
+    {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+
+    /// @brief The colors of the track: a grey floor, the white outside line and the red stop line,
+    /// within the shipped settings' thresholds.
+    constexpr Rgb floor_color = {100, 100, 98};
+    constexpr Rgb line_color = {244, 248, 240};
+    constexpr Rgb stop_color = {220, 120, 100};
+
+
+    /// @brief Converts a color to the full-range BT.601 YUV the camera delivers, as
+    /// gen_params.py's rgb_to_yuv does.
+    /// @param rgb The color.
+    /// @param yuv Y, U and V. Output param.
+    inline void rgb_to_yuv(const Rgb& rgb, uint8_t yuv[3])
+    {
+        const float y = 0.299f * rgb.r + 0.587f * rgb.g + 0.114f * rgb.b;
+        const float u = -0.169f * rgb.r - 0.331f * rgb.g + 0.5f * rgb.b + 128.0f;
+        const float v = 0.5f * rgb.r - 0.419f * rgb.g - 0.081f * rgb.b + 128.0f;
+        yuv[0] = cv::saturate_cast<uint8_t>(y);
+        yuv[1] = cv::saturate_cast<uint8_t>(u);
+        yuv[2] = cv::saturate_cast<uint8_t>(v);
+    }
+
+
+    /// @brief A view of the track: a floor with some texture, the outside line running up the
+    /// frame at a slant, and optionally a stop line across the frame. Positions are fractions of
+    /// the frame, so that the same scene can be drawn at any resolution.
+    struct TrackScene
+    {
+        uint16_t rows;
+        uint16_t cols;
+
+        /// @brief Where the middle of the outside line meets the bottom and top of the frame.
+        float line_bottom = 0.55f;
+        float line_top = 0.75f;
+
+        /// @brief The width of the outside line.
+        float line_width = 0.08f;
+
+        /// @brief The middle of the stop line, and its height; 0 for none.
+        float stop_middle = 0.85f;
+        float stop_height = 0.0f;
+
+        /// @brief How far the floor's channels stray from floor_color.
+        uint8_t floor_noise = 8;
+
+        /// @return The column of the middle of the outside line at a row, in pixels.
+        float line_col(const int row) const
+        {
+            const float y = (row + 0.5f) / rows;
+            return (line_bottom + (line_top - line_bottom) * (1.0f - y)) * cols - 0.5f;
+        }
+
+        /// @return Whether a pixel is on the outside line.
+        bool on_line(const int row, const int col) const
+        {
+            return fabsf(col - line_col(row)) <= 0.5f * line_width * cols;
+        }
+
+        /// @return Whether a pixel is on the stop line.
+        bool on_stop(const int row, const int col) const
+        {
+            return fabsf((row + 0.5f) / rows - stop_middle) <= 0.5f * stop_height;
+        }
+
+        /// @return The color of a pixel. The stop line is drawn over the outside line.
+        Rgb color(const int row, const int col) const
+        {
+            if (on_stop(row, col))
+            {
+                return stop_color;
+            }
+            if (on_line(row, col))
+            {
+                return line_color;
+            }
+
+            // A cheap hash of the position, so that the texture is the same from run to run.
+            uint32_t hash = (row * 73856093u) ^ (col * 19349663u);
+            hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+            const int offset = static_cast<int>((hash >> 8) % (2 * floor_noise + 1)) - floor_noise;
+            return {
+                cv::saturate_cast<uint8_t>(floor_color.r + offset),
+                cv::saturate_cast<uint8_t>(floor_color.g + offset),
+                cv::saturate_cast<uint8_t>(floor_color.b + offset),
+            };
+        }
+    };
+
+
+    /// @brief Draws a scene as little-endian RGB565 (CV_8UC2), as frames are once the camera's
+    /// bytes have been swapped.
+    inline cv::Mat render_rgb565(const TrackScene& scene)
+    {
+        cv::Mat frame(scene.rows, scene.cols, CV_8UC2);
+        for (int row = 0; row < scene.rows; row++)
+        {
+            uint16_t* const pixels = frame.ptr<uint16_t>(row);
+            for (int col = 0; col < scene.cols; col++)
+            {
+                const Rgb rgb = scene.color(row, col);
+                pixels[col] = static_cast<uint16_t>(((rgb.r >> 3) << 11) | ((rgb.g >> 2) << 5) | (rgb.b >> 3));
+            }
+        }
+        return frame;
+    }
+
+
+    /// @brief Draws a scene as YUV422 (CV_8UC2, packed Y0 U Y1 V), the chroma of each pair of
+    /// pixels averaged, as the camera does.
+    inline cv::Mat render_yuyv(const TrackScene& scene)
+    {
+        cv::Mat frame(scene.rows, scene.cols, CV_8UC2);
+        for (int row = 0; row < scene.rows; row++)
+        {
+            uint8_t* const bytes = frame.ptr<uint8_t>(row);
+            for (int col = 0; col + 1 < scene.cols; col += 2)
+            {
+                uint8_t left[3];
+                uint8_t right[3];
+                rgb_to_yuv(scene.color(row, col), left);
+                rgb_to_yuv(scene.color(row, col + 1), right);
+                bytes[2 * col] = left[0];
+                bytes[2 * col + 1] = static_cast<uint8_t>((left[1] + right[1] + 1) / 2);
+                bytes[2 * col + 2] = right[0];
+                bytes[2 * col + 3] = static_cast<uint8_t>((left[2] + right[2] + 1) / 2);
+            }
+        }
+        return frame;
+    }
+
+
+    /// @brief Draws a scene as 8-bit grayscale (CV_8UC1), the luma the camera delivers.
+    inline cv::Mat render_gray(const TrackScene& scene)
+    {
+        cv::Mat frame(scene.rows, scene.cols, CV_8UC1);
+        for (int row = 0; row < scene.rows; row++)
+        {
+            uint8_t* const pixels = frame.ptr<uint8_t>(row);
+            for (int col = 0; col < scene.cols; col++)
+            {
+                uint8_t yuv[3];
+                rgb_to_yuv(scene.color(row, col), yuv);
+                pixels[col] = yuv[0];
+            }
+        }
+        return frame;
+    }
+}
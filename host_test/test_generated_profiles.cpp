@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the calibration profiles gen_params.py generates from settings/profiles.json: that the
+/// first is the settings themselves, that the others carry only their own changes, and that each
+/// one's class table classifies for its own thresholds. Each profile's table is checked against
+/// the first's, whose thresholds the other tests check.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+
+#include "params.h"
+#include "generated_profiles.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief How one class's pixels in a profile's table compare to the first profile's.
+    struct ClassChange
+    {
+        /// @brief Pixels in the class in this profile but not the first.
+        uint32_t gained;
+
+        /// @brief Pixels in the class in the first profile but not this one.
+        uint32_t lost;
+    };
+
+
+    ClassChange compare_class(const uint8_t* table, const uint8_t class_bit)
+    {
+        ClassChange change = {0, 0};
+        for (size_t pixel = 0; pixel < RGB565_CLASS_TABLE_SIZE; pixel++)
+        {
+            const bool in_first = rgb565_class_table[pixel] & class_bit;
+            const bool in_this = table[pixel] & class_bit;
+            change.gained += (in_this && !in_first);
+            change.lost += (in_first && !in_this);
+        }
+        return change;
+    }
+
+
+    /// @brief The first profile is params.h, and uses the build's class table.
+    void check_first_is_settings()
+    {
+        const GeneratedProfile& indoor = generated_profiles[0];
+        CHECK(indoor.class_table == rgb565_class_table);
+        CHECK(outside_thresh_min_val == indoor.calibration.outside.hsv_low[2]);
+        CHECK(outside_luma_min == indoor.calibration.outside.luma_low);
+        CHECK(outside_cropping_top == indoor.calibration.outside.crop_top);
+        CHECK(outside_min_detect_area == indoor.calibration.outside.min_area);
+        CHECK(stop_yuv_max_v == indoor.calibration.stop.yuv.high[2]);
+        CHECK(expected_line_pos == indoor.calibration.line_pos);
+        CHECK(expected_red_y == indoor.calibration.stop_row);
+        CHECK(extra_class_count == indoor.calibration.extra_count);
+        CHECK(extra_class_bits[0] == indoor.calibration.extra[0].class_bit);
+    }
+
+
+    /// @brief The outdoor profile only raises the outside line's least value, and moves where
+    /// the line is expected, so its table takes fewer pixels as the outside line and no others
+    /// change.
+    void check_outdoor()
+    {
+        const GeneratedProfile& indoor = generated_profiles[0];
+        const GeneratedProfile& outdoor = generated_profiles[1];
+        CHECK(outdoor.class_table != rgb565_class_table);
+        CHECK(250 == outdoor.calibration.outside.hsv_low[2]);
+        CHECK(70 == outdoor.calibration.line_pos);
+        CHECK(indoor.calibration.stop_row == outdoor.calibration.stop_row);
+        CHECK(indoor.calibration.outside.crop_left == outdoor.calibration.outside.crop_left);
+
+        const ClassChange outside = compare_class(outdoor.class_table, outside_class_bit);
+        CHECK(0 == outside.gained && outside.lost > 0);
+        const ClassChange stop = compare_class(outdoor.class_table, stop_class_bit);
+        CHECK(0 == stop.gained && 0 == stop.lost);
+        const ClassChange extra = compare_class(outdoor.class_table, extra_class_bits[0]);
+        CHECK(0 == extra.gained && 0 == extra.lost);
+    }
+
+
+    /// @brief The dim profile lowers the least value of the outside line and of the extra class,
+    /// merged into the class by position, so both take more pixels.
+    void check_dim()
+    {
+        const GeneratedProfile& dim = generated_profiles[2];
+        CHECK(dim.class_table != rgb565_class_table);
+        CHECK(200 == dim.calibration.outside.hsv_low[2]);
+        CHECK(80 == dim.calibration.extra[0].hsv_low[2]);
+        CHECK(extra_thresh_min[0][0] == dim.calibration.extra[0].hsv_low[0]);
+        CHECK(1 == dim.calibration.extra_count);
+
+        const ClassChange outside = compare_class(dim.class_table, outside_class_bit);
+        CHECK(outside.gained > 0 && 0 == outside.lost);
+        const ClassChange extra = compare_class(dim.class_table, extra_class_bits[0]);
+        CHECK(extra.gained > 0 && 0 == extra.lost);
+        const ClassChange stop = compare_class(dim.class_table, stop_class_bit);
+        CHECK(0 == stop.gained && 0 == stop.lost);
+    }
+
+
+    /// @brief A generated profile, made into a stored one at QVGA as the firmware does at boot,
+    /// carries its detection region and luma table at that size.
+    void check_derived()
+    {
+        const Calibration calibration = rescale_calibration(generated_profiles[2].calibration, calibration_width, calibration_height, 320, 240);
+        const StoredProfile profile = make_profile(2, params_checksum, calibration, 320, 240, 2);
+        CHECK(2 == profile.derived.class_table);
+
+        // The extra class is cropped least, from the top; nothing is cropped from the sides.
+        const ProfileRegion& region = profile.derived.detection_region;
+        CHECK(0 == region.x && 100 == region.y);
+        CHECK(320 == region.width && 140 == region.height);
+
+        // Only the outside line has luma bounds; the others have color.
+        CHECK(outside_class_bit == profile.derived.luma_classes[200]);
+        CHECK(outside_class_bit == profile.derived.luma_classes[255]);
+        CHECK(0 == profile.derived.luma_classes[199]);
+    }
+}
+
+
+int main()
+{
+    check_first_is_settings();
+    check_outdoor();
+    check_dim();
+    check_derived();
+    return finish();
+}
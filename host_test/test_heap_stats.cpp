@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the heap meter: that a stage going over its allocation budget is caught, that the two
+/// stages which run at once are told apart, and that other threads' allocations are left out.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <thread>
+
+#include "test_support.h"
+
+#include "heap_stats.h"
+#include "fork_join.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Allocates and frees some blocks, in a way the compiler can't leave out.
+    void allocate(const int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int* volatile block = new int[4];
+            delete[] block;
+        }
+    }
+
+
+    /// @brief A stage over its budget fails the frame, and is counted; within it, doesn't.
+    void check_budget()
+    {
+        heap_stats::StageMeter meter;
+        meter.set_budget(Stage::Convert, 0);
+        meter.set_budget(Stage::OutsideDetect, 2);
+
+        meter.begin_frame();
+        meter.end_stage(Stage::Convert);
+        allocate(2);
+        meter.end_stage(Stage::OutsideDetect);
+        CHECK(meter.end_frame());
+        CHECK(2 == meter.last(Stage::OutsideDetect).allocs);
+        CHECK(2 == meter.last(Stage::OutsideDetect).frees);
+        CHECK(0 == meter.over_budget_frames());
+
+        meter.begin_frame();
+        allocate(1);
+        meter.end_stage(Stage::Convert);
+        meter.end_stage(Stage::OutsideDetect);
+        CHECK(!meter.end_frame());
+        CHECK(1 == meter.over_budget_frames());
+
+        meter.begin_frame();
+        meter.end_stage(Stage::Convert);
+        allocate(3);
+        meter.end_stage(Stage::OutsideDetect);
+        CHECK(!meter.end_frame());
+        CHECK(2 == meter.over_budget_frames());
+        CHECK(3 == meter.worst(Stage::OutsideDetect).allocs);
+    }
+
+
+    /// @brief Stages which run at once are told apart by the task they ran on.
+    void check_parallel_stages(ForkJoin& detectors)
+    {
+        heap_stats::StageMeter meter;
+        meter.begin_frame();
+        detectors.run([] { allocate(2); }, [] { allocate(5); });
+        meter.end_parallel_stages(Stage::OutsideDetect, Stage::StopDetect);
+        meter.end_frame();
+        CHECK(2 == meter.last(Stage::OutsideDetect).allocs);
+        CHECK(5 == meter.last(Stage::StopDetect).allocs);
+    }
+
+
+    /// @brief A thread which isn't counted (as the recorder's writer isn't) allocating in the
+    /// middle of a stage isn't charged to it.
+    void check_other_threads()
+    {
+        std::atomic<int> step = 0;
+        std::thread other([&]
+        {
+            while (step.load() != 1)
+            {
+                std::this_thread::yield();
+            }
+            allocate(10);
+            step.store(2);
+        });
+
+        heap_stats::StageMeter meter;
+        meter.set_budget(Stage::Convert, 1);
+        meter.begin_frame();
+        step.store(1);
+        allocate(1);
+        while (step.load() != 2)
+        {
+            std::this_thread::yield();
+        }
+        meter.end_stage(Stage::Convert);
+        CHECK(meter.end_frame());
+        CHECK(1 == meter.last(Stage::Convert).allocs);
+
+        other.join();
+    }
+}
+
+
+int main()
+{
+    ForkJoin detectors;
+    detectors.run(
+        [] { heap_stats::count_calling_task(0); },
+        [] { heap_stats::count_calling_task(1); });
+
+    check_budget();
+    check_parallel_stages(detectors);
+    check_other_threads();
+    return finish();
+}
@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Feeds the latency tracker frame timestamps, and checks that it numbers frames across drops
+/// counted in the configured frame period, including when every other frame is skipped, that its
+/// jitter is the distance from a whole number of periods, and that its histograms and percentiles
+/// are of the most recent frames.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+
+#include "latency_tracker.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief The sensor's frame period, in microseconds.
+    constexpr uint32_t period_us = 40000;
+
+
+    /// @brief Samples fill the window, then evict the oldest; buckets and percentiles follow.
+    void check_histogram()
+    {
+        RollingHistogram histogram(1000);
+        CHECK(0 == histogram.percentile(50));
+
+        for (uint32_t i = 0; i < 100; i++)
+        {
+            histogram.add(i * 100);
+        }
+        CHECK(100 == histogram.count());
+        CHECK(10 == histogram.bucket(0) && 10 == histogram.bucket(9) && 0 == histogram.bucket(10));
+        CHECK(5000 == histogram.percentile(50));
+        CHECK(9900 == histogram.percentile(100));
+
+        // Past the window, only the newest HISTOGRAM_WINDOW samples count, and anything past the
+        // last bucket lands in it.
+        for (uint32_t i = 0; i < HISTOGRAM_WINDOW; i++)
+        {
+            histogram.add(50000);
+        }
+        CHECK(HISTOGRAM_WINDOW == histogram.count());
+        CHECK(0 == histogram.bucket(0));
+        CHECK(HISTOGRAM_WINDOW == histogram.bucket(HISTOGRAM_BUCKETS - 1));
+        CHECK(50000 == histogram.percentile(0));
+    }
+
+
+    /// @brief Every frame processed: consecutive sequence numbers, nothing dropped, and the
+    /// latency is from capture to output.
+    void check_every_frame()
+    {
+        LatencyTracker tracker(period_us);
+        int64_t capture_us = 1000000;
+        for (uint32_t frame = 0; frame < 50; frame++, capture_us += period_us)
+        {
+            CHECK(frame == tracker.begin_frame(capture_us, capture_us + 2000));
+            tracker.mark_stage(Stage::Convert, capture_us + 5000);
+            tracker.end_frame(capture_us + 30000);
+        }
+
+        CHECK(0 == tracker.dropped());
+        CHECK(period_us == tracker.frame_period());
+        CHECK(period_us == tracker.processed_period());
+        CHECK(30000 == tracker.latency().percentile(50));
+        CHECK(0 == tracker.jitter().percentile(100));
+        CHECK(49 == tracker.last_frame().sequence);
+        CHECK(tracker.last_frame().stage_end_us[static_cast<uint8_t>(Stage::Convert)] - tracker.last_frame().capture_us == 5000);
+    }
+
+
+    /// @brief A pipeline which only keeps up with every other frame drops every other frame, and
+    /// keeps on counting them, since the period isn't learned from what it processes.
+    void check_every_other_frame()
+    {
+        LatencyTracker tracker(period_us);
+        int64_t capture_us = 0;
+        for (uint32_t frame = 0; frame < 100; frame++, capture_us += 2 * period_us)
+        {
+            CHECK(2 * frame == tracker.begin_frame(capture_us, capture_us));
+            tracker.end_frame(capture_us + 60000);
+        }
+
+        CHECK(99 == tracker.dropped());
+        CHECK(period_us == tracker.frame_period());
+        CHECK_NEAR(tracker.processed_period(), 2 * period_us, 1000);
+    }
+
+
+    /// @brief An interval a little off a whole number of periods is jitter, not a drop; a gap of
+    /// three periods, a little late, is two drops and the same jitter.
+    void check_jitter()
+    {
+        LatencyTracker tracker(period_us);
+        tracker.begin_frame(0, 0);
+        tracker.end_frame(1000);
+
+        CHECK(1 == tracker.begin_frame(period_us + 3000, period_us + 3000));
+        tracker.end_frame(period_us + 4000);
+        CHECK(0 == tracker.dropped());
+
+        CHECK(4 == tracker.begin_frame(4 * period_us + 6000, 4 * period_us + 6000));
+        tracker.end_frame(4 * period_us + 7000);
+        CHECK(2 == tracker.dropped());
+
+        CHECK(2 == tracker.jitter().count());
+        CHECK(3000 == tracker.jitter().percentile(0));
+        CHECK(3000 == tracker.jitter().percentile(100));
+    }
+}
+
+
+int main()
+{
+    check_histogram();
+    check_every_frame();
+    check_every_other_frame();
+    check_jitter();
+    return finish();
+}
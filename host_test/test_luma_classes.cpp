@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the luma thresholds generated from the shipped settings against grayscale frames: the
+/// outside line must be picked out of the floor, and the stop line, which luma can't tell from
+/// the floor, must not be found at all.
+///
+/// A frame extracted from a grayscale recording (see extract_recording.py) can be checked too:
+///   test_luma_classes <frame.raw> <width> <height>
+/// There is no telling where the line is in a recorded frame, so it is only checked that most of
+/// the frame isn't taken for line.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "params.h"
+#include "calibration.h"
+#include "parallel_rows.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief The most of a recorded frame which may be taken for the outside line.
+    constexpr float max_recorded_line_fraction = 0.25f;
+
+
+    /// @return The generated calibration, as far as classifying grayscale goes.
+    Calibration generated_calibration()
+    {
+        Calibration calibration = {};
+        calibration.outside.luma_low = outside_luma_min;
+        calibration.outside.luma_high = outside_luma_max;
+        calibration.outside.class_bit = outside_class_bit;
+        calibration.stop.luma_low = stop_luma_min;
+        calibration.stop.luma_high = stop_luma_max;
+        calibration.stop.class_bit = stop_class_bit;
+        return calibration;
+    }
+
+
+    /// @brief Classifies a grayscale frame as the pipeline does.
+    cv::Mat1b classify(const cv::Mat& gray)
+    {
+        uint8_t classes[256];
+        build_luma_classes(generated_calibration(), classes);
+        cv::Mat1b class_map;
+        parallel_lookup(gray, classes, class_map);
+        return class_map;
+    }
+
+
+    /// @brief Single luma values: the floor, the lines, and the floor at its brightest.
+    void check_levels()
+    {
+        uint8_t classes[256];
+        build_luma_classes(generated_calibration(), classes);
+
+        uint8_t yuv[3];
+        rgb_to_yuv(floor_color, yuv);
+        CHECK(0 == classes[yuv[0]]);
+        rgb_to_yuv({160, 160, 160}, yuv);
+        CHECK(0 == classes[yuv[0]]);
+        rgb_to_yuv(line_color, yuv);
+        CHECK(outside_class_bit == classes[yuv[0]]);
+        CHECK(outside_class_bit == classes[255]);
+        CHECK(0 == classes[0]);
+
+        for (int luma = 0; luma < 256; luma++)
+        {
+            CHECK(0 == (classes[luma] & stop_class_bit));
+        }
+    }
+
+
+    /// @brief Whole frames, at the resolutions the pipeline runs at.
+    void check_frames(const uint16_t rows, const uint16_t cols)
+    {
+        TrackScene scene = {rows, cols};
+        scene.stop_height = 0.06f;
+        const cv::Mat1b class_map = classify(render_gray(scene));
+
+        int mismatches = 0;
+        for (int row = 0; row < rows; row++)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                const bool line = scene.on_line(row, col) && !scene.on_stop(row, col);
+                if (class_map(row, col) != (line ? outside_class_bit : 0))
+                {
+                    mismatches++;
+                }
+            }
+        }
+        CHECK(0 == mismatches);
+    }
+
+
+    /// @brief A recorded frame.
+    void check_recorded(const char* path, const int cols, const int rows)
+    {
+        FILE* const file = fopen(path, "rb");
+        if (!CHECK(file != nullptr))
+        {
+            return;
+        }
+
+        cv::Mat gray(rows, cols, CV_8UC1);
+        const size_t read = fread(gray.data, 1, gray.total(), file);
+        fclose(file);
+        if (!CHECK(read == gray.total()))
+        {
+            return;
+        }
+
+        const cv::Mat1b class_map = classify(gray);
+        int line_pixels = 0;
+        for (int row = 0; row < rows; row++)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                line_pixels += (0 != (class_map(row, col) & outside_class_bit));
+            }
+        }
+        printf("%d of %d pixels taken for the outside line\n", line_pixels, rows * cols);
+        CHECK(line_pixels <= max_recorded_line_fraction * rows * cols);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    check_levels();
+    check_frames(96, 96);
+    check_frames(120, 160);
+    check_frames(240, 320);
+    if (4 == argc)
+    {
+        check_recorded(argv[1], atoi(argv[2]), atoi(argv[3]));
+    }
+    return finish();
+}
@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the generated perspective table against the pinhole camera it was calibrated from:
+/// points on the ground are seen through the camera, and to_ground() must put them back where
+/// they were, at the calibrated frame size and at others, and to_ground_line() must find the
+/// offset and heading of lines on the ground.
+///
+/// Built against a table generated from settings/perspective.json, whose image points are the
+/// corners of a ground rectangle seen through the camera in its pinhole_camera section; the
+/// camera arrives as CAMERA_HEIGHT_MM, CAMERA_PITCH_DEG, CAMERA_FOCAL_PX, CAMERA_CENTER_COL and
+/// CAMERA_CENTER_ROW.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "test_support.h"
+
+#include "perspective.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief How far a point may come back from where it was, as a fraction of its distance
+    /// from the camera. As gen_params.py's PERSPECTIVE_TOLERANCE.
+    constexpr float tolerance = 0.01f;
+
+    /// @brief The first row either line is detected in. Rows above repeat it in the table.
+    constexpr uint16_t first_row = std::min(outside_cropping_top, stop_cropping_top);
+
+    /// @brief The camera, from settings/perspective.json.
+    constexpr float camera_height = CAMERA_HEIGHT_MM;
+    constexpr float focal_length = CAMERA_FOCAL_PX;
+    constexpr float center_col = CAMERA_CENTER_COL;
+    constexpr float center_row = CAMERA_CENTER_ROW;
+    const float pitch = CAMERA_PITCH_DEG * static_cast<float>(M_PI) / 180.0f;
+
+
+    /// @brief A point in the calibrated frame.
+    struct ImagePoint
+    {
+        float col;
+        float row;
+    };
+
+
+    /// @brief Where the camera sees a point on the ground. The camera is above the origin,
+    /// looking straight ahead, pitched down and not rolled.
+    ImagePoint to_image(const GroundPoint& point)
+    {
+        const float depth = point.y * cosf(pitch) + camera_height * sinf(pitch);
+        const float down = camera_height * cosf(pitch) - point.y * sinf(pitch);
+        return {center_col + focal_length * point.x / depth, center_row + focal_length * down / depth};
+    }
+
+
+    /// @brief Where the ray through a point of the frame meets the ground.
+    GroundPoint from_image(const ImagePoint& point)
+    {
+        const float right = (point.col - center_col) / focal_length;
+        const float down = (point.row - center_row) / focal_length;
+        const float distance = camera_height / (sinf(pitch) + down * cosf(pitch));
+        return {distance * right, distance * (cosf(pitch) - down * sinf(pitch))};
+    }
+
+
+    /// @return How far a mapped point is from where it should be, as a fraction of its distance.
+    float relative_error(const GroundPoint& actual, const GroundPoint& expected)
+    {
+        return hypotf(actual.x - expected.x, actual.y - expected.y) / hypotf(expected.x, expected.y);
+    }
+
+
+    /// @brief The table is calibrated, and the middle column is straight ahead.
+    void check_known_points()
+    {
+        CHECK(perspective_calibrated);
+
+        for (uint16_t row = first_row; row < calibration_height; row += 8)
+        {
+            const GroundPoint ahead = to_ground(center_col, row, calibration_width, calibration_height);
+            CHECK_NEAR(ahead.x, 0.0f, 0.05f);
+            CHECK(relative_error(ahead, from_image({center_col, static_cast<float>(row)})) <= tolerance);
+        }
+
+        // Lower in the frame is nearer.
+        const GroundPoint far = to_ground(center_col, first_row, calibration_width, calibration_height);
+        const GroundPoint near = to_ground(center_col, calibration_height - 1, calibration_width, calibration_height);
+        CHECK(far.y > near.y && near.y > 0.0f);
+    }
+
+
+    /// @brief Every point of a grid over the rows detected in, at a frame size, maps to where
+    /// the camera's ray through it meets the ground. On a table row it is exact up to rounding;
+    /// between them, the rows are interpolated.
+    /// @param scale The frame size, as a multiple of the calibrated one.
+    void check_grid(const int scale)
+    {
+        const uint16_t width = calibration_width * scale;
+        const uint16_t height = calibration_height * scale;
+
+        float worst = 0.0f;
+        float worst_on_rows = 0.0f;
+        int points = 0;
+        for (float row = first_row; row <= calibration_height - 1; row += 0.25f)
+        {
+            for (float col = 0.0f; col <= calibration_width - 1; col += 0.5f)
+            {
+                const GroundPoint mapped = to_ground(col * scale, row * scale, width, height);
+                const float error = relative_error(mapped, from_image({col, row}));
+                worst = fmaxf(worst, error);
+                if (row == floorf(row))
+                {
+                    worst_on_rows = fmaxf(worst_on_rows, error);
+                }
+                points++;
+            }
+        }
+
+        printf("%ux%u: %d points, worst %.4f%% (%.4f%% on table rows)\n", width, height, points, 100 * worst, 100 * worst_on_rows);
+        CHECK(points > 10000);
+        CHECK(worst <= tolerance);
+        CHECK(worst_on_rows <= 1e-4f);
+    }
+
+
+    /// @brief Sees a straight line on the ground through the camera, and checks what
+    /// to_ground_line() makes of it, where it crosses y.
+    /// @param x The line's x at y.
+    /// @param y Where along the line it is seen.
+    /// @param heading The line's angle from straight ahead, positive to the right.
+    void check_line(const float x, const float y, const float heading)
+    {
+        const ImagePoint seen = to_image({x, y});
+        const ImagePoint further = to_image({x + 80.0f * sinf(heading), y + 80.0f * cosf(heading)});
+        const float slope = (further.row - seen.row) / (further.col - seen.col);
+
+        // The camera looks straight ahead, so x = 0 is the middle column on every row.
+        const GroundLine line = to_ground_line(seen.col, seen.row, slope, center_col, calibration_width, calibration_height);
+        printf("line at x %.0f, heading %.2f: offset %.2f, heading %.4f\n", x, heading, line.offset, line.heading);
+        CHECK_NEAR(line.offset, x, tolerance * hypotf(x, y));
+        CHECK_NEAR(line.heading, heading, 0.01);
+    }
+}
+
+
+int main()
+{
+    check_known_points();
+    check_grid(1);
+    check_grid(2);
+    check_line(60.0f, 150.0f, 0.0f);
+    check_line(-40.0f, 180.0f, 0.0f);
+    check_line(30.0f, 150.0f, 0.25f);
+    check_line(50.0f, 120.0f, -0.4f);
+    return finish();
+}
@@ -0,0 +1,282 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks each pixel kernel against its plain per-pixel version in scalar_kernels.h, on random
+/// pixels, at every length from empty to a few vectors and at a QVGA row, starting on and off
+/// alignment, so that the vector loops, the scalar tails and where they meet are all covered.
+/// Nothing past the end of an output may be written.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+#include "test_support.h"
+#include "scalar_kernels.h"
+
+#include "pixel_kernels.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief The longest run checked at every length; past several vectors of any width.
+    constexpr size_t max_short_pixels = 100;
+
+    /// @brief A QVGA row.
+    constexpr size_t long_pixels = 320;
+
+    /// @brief How far outputs are checked past their ends.
+    constexpr size_t guard_bytes = 64;
+
+    /// @brief Written to outputs beforehand, so that anything left or written past the end shows.
+    constexpr uint8_t poison = 0xa5;
+
+    std::mt19937 rng(0x2545f491);
+
+
+    std::vector<uint8_t> random_bytes(const size_t count)
+    {
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::vector<uint8_t> bytes(count);
+        for (uint8_t& value : bytes)
+        {
+            value = static_cast<uint8_t>(byte(rng));
+        }
+        return bytes;
+    }
+
+
+    /// @brief Calls a check at each length and alignment.
+    template <typename Check>
+    void for_each_run(const Check& check)
+    {
+        for (size_t offset = 0; offset < 4; offset++)
+        {
+            for (size_t pixels = 0; pixels <= max_short_pixels; pixels++)
+            {
+                check(offset, pixels);
+            }
+            check(offset, long_pixels);
+        }
+    }
+
+
+    /// @brief Whether two outputs match up to their ends, and nothing was written past them.
+    bool same_output(const uint8_t* actual, const uint8_t* expected, const size_t bytes)
+    {
+        if (memcmp(actual, expected, bytes) != 0)
+        {
+            return false;
+        }
+        for (size_t i = bytes; i < bytes + guard_bytes; i++)
+        {
+            if (actual[i] != poison)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+    void check_swap_bytes()
+    {
+        int mismatches = 0;
+        for_each_run([&](const size_t offset, const size_t pixels) {
+            const std::vector<uint8_t> src = random_bytes(2 * pixels + offset);
+            std::vector<uint8_t> actual(2 * pixels + offset + guard_bytes, poison);
+            std::vector<uint8_t> expected(2 * pixels, poison);
+            kernels::swap_bytes_16(src.data() + offset, actual.data() + offset, pixels);
+            scalar::swap_bytes_16(src.data() + offset, expected.data(), pixels);
+            mismatches += !same_output(actual.data() + offset, expected.data(), 2 * pixels);
+
+            // In place.
+            std::vector<uint8_t> in_place(src);
+            in_place.resize(in_place.size() + guard_bytes, poison);
+            kernels::swap_bytes_16(in_place.data() + offset, pixels);
+            mismatches += !same_output(in_place.data() + offset, expected.data(), 2 * pixels);
+        });
+        CHECK(0 == mismatches);
+    }
+
+
+    void check_threshold_3ch()
+    {
+        // Bounds which take in some of each channel's values, and an empty range, which must take
+        // in nothing.
+        const uint8_t lows[][3] = {{40, 90, 10}, {0, 0, 0}, {200, 0, 0}};
+        const uint8_t highs[][3] = {{220, 255, 180}, {255, 255, 255}, {100, 255, 255}};
+        int mismatches = 0;
+        int set = 0;
+        for (int bounds = 0; bounds < 3; bounds++)
+        {
+            for_each_run([&](const size_t offset, const size_t pixels) {
+                const std::vector<uint8_t> src = random_bytes(3 * pixels + offset);
+                std::vector<uint8_t> actual(pixels + offset + guard_bytes, poison);
+                std::vector<uint8_t> expected(pixels);
+                kernels::threshold_3ch(src.data() + offset, lows[bounds], highs[bounds], actual.data() + offset, pixels);
+                scalar::threshold_3ch(src.data() + offset, lows[bounds], highs[bounds], expected.data(), pixels);
+                mismatches += !same_output(actual.data() + offset, expected.data(), pixels);
+                for (const uint8_t value : expected)
+                {
+                    set += (value != 0);
+                }
+            });
+        }
+        CHECK(0 == mismatches);
+        CHECK(set > 0);
+    }
+
+
+    void check_threshold_yuyv()
+    {
+        // Narrow enough that the chroma bounds often fail on one of U and V but not the other.
+        const kernels::YuvBounds bounds = {{50, 60, 90}, {230, 200, 250}};
+        int mismatches = 0;
+        int set = 0;
+        for_each_run([&](const size_t offset, const size_t pixels) {
+            const std::vector<uint8_t> src = random_bytes(2 * pixels + offset);
+            std::vector<uint8_t> actual(pixels + offset + guard_bytes, poison);
+            std::vector<uint8_t> expected(pixels);
+            kernels::threshold_yuyv(src.data() + offset, bounds, actual.data() + offset, pixels);
+            scalar::threshold_yuyv(src.data() + offset, bounds, expected.data(), pixels);
+            mismatches += !same_output(actual.data() + offset, expected.data(), pixels);
+            for (const uint8_t value : expected)
+            {
+                set += (value != 0);
+            }
+        });
+        CHECK(0 == mismatches);
+        CHECK(set > 0);
+    }
+
+
+    void check_lookups()
+    {
+        std::vector<uint8_t> table_16(65536);
+        for (size_t i = 0; i < table_16.size(); i++)
+        {
+            table_16[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+        }
+        const std::vector<uint8_t> table_8 = random_bytes(256);
+
+        int mismatches = 0;
+        for_each_run([&](const size_t offset, const size_t pixels) {
+            // 16-bit pixels are always aligned to two bytes; the offset is in pixels.
+            const std::vector<uint8_t> bytes = random_bytes(2 * (pixels + offset));
+            std::vector<uint16_t> src(pixels + offset);
+            memcpy(src.data(), bytes.data(), bytes.size());
+
+            std::vector<uint8_t> actual(pixels + offset + guard_bytes, poison);
+            std::vector<uint8_t> expected(pixels);
+            kernels::lookup_16(src.data() + offset, table_16.data(), actual.data() + offset, pixels);
+            for (size_t i = 0; i < pixels; i++)
+            {
+                expected[i] = table_16[src[offset + i]];
+            }
+            mismatches += !same_output(actual.data() + offset, expected.data(), pixels);
+
+            std::fill(actual.begin(), actual.end(), poison);
+            kernels::lookup_8(bytes.data() + offset, table_8.data(), actual.data() + offset, pixels);
+            for (size_t i = 0; i < pixels; i++)
+            {
+                expected[i] = table_8[bytes[offset + i]];
+            }
+            mismatches += !same_output(actual.data() + offset, expected.data(), pixels);
+        });
+        CHECK(0 == mismatches);
+    }
+
+
+    void check_test_bits()
+    {
+        int mismatches = 0;
+        for (const uint8_t bits : {0x01, 0x06, 0x80, 0x00})
+        {
+            for_each_run([&](const size_t offset, const size_t pixels) {
+                const std::vector<uint8_t> src = random_bytes(pixels + offset);
+                std::vector<uint8_t> actual(pixels + offset + guard_bytes, poison);
+                std::vector<uint8_t> expected(pixels);
+                kernels::test_bits(src.data() + offset, bits, actual.data() + offset, pixels);
+                scalar::test_bits(src.data() + offset, bits, expected.data(), pixels);
+                mismatches += !same_output(actual.data() + offset, expected.data(), pixels);
+            });
+        }
+        CHECK(0 == mismatches);
+    }
+
+
+    void check_accumulate_columns()
+    {
+        int mismatches = 0;
+        for_each_run([&](const size_t offset, const size_t cols) {
+            // Sums start well above a byte, so that a carry into the high byte would show, but far
+            // enough below 65535 that they can't overflow.
+            std::vector<uint16_t> actual(cols + offset + guard_bytes, 0xa5a5);
+            std::vector<uint16_t> expected(cols, 0xa5a5);
+            for (size_t col = 0; col < cols; col++)
+            {
+                actual[offset + col] = expected[col] = static_cast<uint16_t>(150 * col);
+            }
+
+            // Several rows of a mask of 0s and 0xffs.
+            for (int row = 0; row < 3; row++)
+            {
+                std::vector<uint8_t> mask = random_bytes(cols + offset);
+                for (uint8_t& value : mask)
+                {
+                    value = (value & 1) ? 0xff : 0;
+                }
+                kernels::accumulate_columns(mask.data() + offset, actual.data() + offset, cols);
+                scalar::accumulate_columns(mask.data() + offset, expected.data(), cols);
+            }
+
+            mismatches += (memcmp(actual.data() + offset, expected.data(), cols * sizeof(uint16_t)) != 0);
+            for (size_t i = offset + cols; i < actual.size(); i++)
+            {
+                mismatches += (actual[i] != 0xa5a5);
+            }
+        });
+        CHECK(0 == mismatches);
+    }
+
+
+    void check_pack_mask()
+    {
+        int mismatches = 0;
+        for_each_run([&](const size_t offset, const size_t pixels) {
+            // Mostly 0s and 0xffs, as masks are, but any nonzero value counts as set.
+            std::vector<uint8_t> mask = random_bytes(pixels + offset);
+            for (uint8_t& value : mask)
+            {
+                value = (value < 96) ? 0 : (value < 224) ? 0xff : value;
+            }
+
+            const size_t words = (pixels + 31) / 32;
+            std::vector<uint32_t> actual(words + 2, 0xa5a5a5a5);
+            std::vector<uint32_t> expected(words);
+            kernels::pack_mask(mask.data() + offset, actual.data(), pixels);
+            scalar::pack_mask(mask.data() + offset, expected.data(), pixels);
+            mismatches += (memcmp(actual.data(), expected.data(), words * sizeof(uint32_t)) != 0);
+            mismatches += (actual[words] != 0xa5a5a5a5 || actual[words + 1] != 0xa5a5a5a5);
+        });
+        CHECK(0 == mismatches);
+    }
+}
+
+
+int main()
+{
+    check_swap_bytes();
+    check_threshold_3ch();
+    check_threshold_yuyv();
+    check_lookups();
+    check_test_bits();
+    check_accumulate_columns();
+    check_pack_mask();
+    return finish();
+}
@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the stored form of calibration profiles: that a profile survives being written out as
+/// bytes and read back, wherever in a buffer the bytes land, that blobs which aren't this slot's
+/// profile of this version and calibration are refused, and that a profile stored at another frame size is
+/// rescaled to the capture size.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "test_support.h"
+
+#include "profile_format.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief Stands in for the params_checksum of the build.
+    constexpr uint32_t CHECKSUM = 0x1234abcd;
+
+
+    /// @brief A calibration with every field set to something other than 0.
+    Calibration sample_calibration()
+    {
+        Calibration calibration;
+        memset(&calibration, 0, sizeof(calibration));
+
+        uint8_t class_bit = 1;
+        for (LineCalibration* line : {&calibration.outside, &calibration.stop, &calibration.extra[0]})
+        {
+            for (uint8_t channel = 0; channel < 3; channel++)
+            {
+                line->hsv_low[channel] = 10 + channel;
+                line->hsv_high[channel] = 200 + channel;
+                line->yuv.low[channel] = 20 + channel;
+                line->yuv.high[channel] = 220 + channel;
+            }
+            line->luma_low = 180;
+            line->luma_high = 250;
+            line->crop_top = 8;
+            line->crop_bottom = 16;
+            line->crop_left = 4;
+            line->crop_right = 12;
+            line->min_area = 40;
+            line->class_bit = class_bit;
+            class_bit <<= 1;
+        }
+        calibration.extra_count = 1;
+        calibration.line_pos = 60;
+        calibration.stop_row = 70;
+        calibration.stop_radius = 6;
+        return calibration;
+    }
+
+
+    /// @brief A profile written to bytes at any offset reads back the same.
+    void check_round_trip()
+    {
+        const Calibration calibration = sample_calibration();
+        const StoredProfile written = make_profile(1, CHECKSUM, calibration, 96, 96, 1);
+        CHECK(0 == strcmp(PROFILE_NAMES[1], written.name));
+
+        for (size_t offset = 0; offset < 4; offset++)
+        {
+            uint8_t bytes[sizeof(StoredProfile) + 4];
+            memcpy(bytes + offset, &written, sizeof(written));
+
+            StoredProfile read;
+            CHECK(ProfileStatus::Ok == read_profile(bytes + offset, sizeof(StoredProfile), 1, CHECKSUM, 96, 96, read));
+            CHECK(0 == memcmp(&written, &read, sizeof(read)));
+        }
+    }
+
+
+    /// @brief Blobs of the wrong size, magic, version, slot or calibration, or with contents no
+    /// profile could have, are refused, and leave the profile alone.
+    void check_refused()
+    {
+        const StoredProfile written = make_profile(0, CHECKSUM, sample_calibration(), 96, 96, 0);
+        StoredProfile read;
+        memset(&read, 0xa5, sizeof(read));
+        const StoredProfile untouched = read;
+
+        CHECK(ProfileStatus::WrongSize == read_profile(&written, sizeof(written) - 1, 0, CHECKSUM, 96, 96, read));
+        CHECK(ProfileStatus::WrongSlot == read_profile(&written, sizeof(written), 2, CHECKSUM, 96, 96, read));
+
+        StoredProfile stale = written;
+        stale.version = PROFILE_VERSION - 1;
+        CHECK(ProfileStatus::WrongVersion == read_profile(&stale, sizeof(stale), 0, CHECKSUM, 96, 96, read));
+
+        StoredProfile other = written;
+        other.magic = ~PROFILE_MAGIC;
+        CHECK(ProfileStatus::WrongMagic == read_profile(&other, sizeof(other), 0, CHECKSUM, 96, 96, read));
+
+        // A profile written before recalibrating and reflashing.
+        CHECK(ProfileStatus::WrongChecksum == read_profile(&written, sizeof(written), 0, CHECKSUM + 1, 96, 96, read));
+
+        // Profiles which would divide by zero or index past the extra classes when rescaled.
+        StoredProfile no_width = written;
+        no_width.frame_width = 0;
+        CHECK(ProfileStatus::Corrupt == read_profile(&no_width, sizeof(no_width), 0, CHECKSUM, 320, 240, read));
+
+        StoredProfile no_height = written;
+        no_height.frame_height = 0;
+        CHECK(ProfileStatus::Corrupt == read_profile(&no_height, sizeof(no_height), 0, CHECKSUM, 320, 240, read));
+
+        StoredProfile too_many = written;
+        too_many.calibration.extra_count = MAX_EXTRA_CLASSES + 1;
+        CHECK(ProfileStatus::Corrupt == read_profile(&too_many, sizeof(too_many), 0, CHECKSUM, 320, 240, read));
+
+        StoredProfile no_table = written;
+        no_table.derived.class_table = PROFILE_COUNT;
+        CHECK(ProfileStatus::Corrupt == read_profile(&no_table, sizeof(no_table), 0, CHECKSUM, 320, 240, read));
+
+        StoredProfile all_extra = written;
+        all_extra.calibration.extra_count = MAX_EXTRA_CLASSES;
+        StoredProfile accepted;
+        CHECK(ProfileStatus::Ok == read_profile(&all_extra, sizeof(all_extra), 0, CHECKSUM, 320, 240, accepted));
+
+        StoredProfile unclassified = written;
+        unclassified.derived.class_table = NO_CLASS_TABLE;
+        CHECK(ProfileStatus::Ok == read_profile(&unclassified, sizeof(unclassified), 0, CHECKSUM, 320, 240, accepted));
+
+        CHECK(0 == memcmp(&untouched, &read, sizeof(read)));
+    }
+
+
+    /// @brief A profile carries the union of its lines' regions, and the class bits of each luma.
+    void check_derived()
+    {
+        Calibration calibration = sample_calibration();
+        calibration.stop.crop_top = 2;
+        calibration.extra[0].crop_right = 0;
+
+        // A crop which leaves nothing adds nothing to the region.
+        calibration.extra[1] = calibration.extra[0];
+        calibration.extra[1].crop_left = 96;
+        calibration.extra_count = 2;
+
+        const StoredProfile profile = make_profile(0, CHECKSUM, calibration, 96, 96, NO_CLASS_TABLE);
+        const ProfileRegion& region = profile.derived.detection_region;
+        CHECK(4 == region.x && 2 == region.y);
+        CHECK(92 == region.width && 78 == region.height);
+        CHECK(NO_CLASS_TABLE == profile.derived.class_table);
+
+        // Every line takes luma 180 to 250.
+        CHECK(0x07 == profile.derived.luma_classes[180]);
+        CHECK(0x07 == profile.derived.luma_classes[250]);
+        CHECK(0 == profile.derived.luma_classes[179]);
+        CHECK(0 == profile.derived.luma_classes[251]);
+
+        // Nothing left to detect in.
+        Calibration empty = sample_calibration();
+        empty.outside.crop_top = 96;
+        empty.stop.crop_bottom = 96;
+        empty.extra[0].crop_left = 50;
+        empty.extra[0].crop_right = 50;
+        const StoredProfile nothing = make_profile(0, CHECKSUM, empty, 96, 96, NO_CLASS_TABLE);
+        CHECK(0 == nothing.derived.detection_region.width && 0 == nothing.derived.detection_region.height);
+    }
+
+
+    /// @brief A profile stored at 96x96 and read at QVGA has its pixel values rescaled, and its
+    /// colors left alone.
+    void check_rescaled()
+    {
+        const Calibration calibration = sample_calibration();
+        const StoredProfile written = make_profile(2, CHECKSUM, calibration, 96, 96, 2);
+
+        StoredProfile read;
+        CHECK(ProfileStatus::Ok == read_profile(&written, sizeof(written), 2, CHECKSUM, 320, 240, read));
+        CHECK(320 == read.frame_width && 240 == read.frame_height);
+        CHECK(200 == read.calibration.line_pos);
+        CHECK(175 == read.calibration.stop_row);
+        CHECK(15 == read.calibration.stop_radius);
+        CHECK(20 == read.calibration.outside.crop_top);
+        CHECK(40 == read.calibration.stop.crop_bottom);
+        CHECK(13 == read.calibration.extra[0].crop_left);
+        CHECK(333 == read.calibration.outside.min_area);
+        CHECK(0 == memcmp(&calibration.outside.yuv, &read.calibration.outside.yuv, sizeof(calibration.outside.yuv)));
+        CHECK(calibration.outside.luma_low == read.calibration.outside.luma_low);
+
+        // Derived again at the new size, from the rescaled crops.
+        const ProfileRegion& region = read.derived.detection_region;
+        CHECK(13 == region.x && 20 == region.y);
+        CHECK(267 == region.width && 180 == region.height);
+        CHECK(2 == read.derived.class_table);
+        CHECK(0 == memcmp(written.derived.luma_classes, read.derived.luma_classes, sizeof(read.derived.luma_classes)));
+    }
+}
+
+
+int main()
+{
+    check_round_trip();
+    check_refused();
+    check_derived();
+    check_rescaled();
+    return finish();
+}
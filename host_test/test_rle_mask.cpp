@@ -0,0 +1,396 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the run-length-encoded mask against a plain 8-connected flood fill over the same dense
+/// mask, on random masks: speckle, which tests every way pixels can touch diagonally, with lines
+/// and rectangles over it for larger blobs. Each blob found from the runs must be one the flood
+/// fill finds, in the same order, with the same bounds, area and extreme points, and the same
+/// answer to whether it intersects a rectangle. Encoding from a dense mask and from a packed one
+/// must give back the mask when rasterized, and ORing two masks must give their OR.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "test_support.h"
+
+#include "bit_mask.h"
+#include "rle_mask.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    constexpr uint16_t rows = 48;
+    constexpr uint16_t cols = 64;
+
+    /// @brief Enough runs per row that a row of the mask can never have more.
+    constexpr uint8_t runs_per_row = cols / 2;
+
+    constexpr int trials = 200;
+
+    std::mt19937 rng(0x2545f491);
+
+
+    int uniform(const int low, const int high)
+    {
+        return std::uniform_int_distribution<int>(low, high)(rng);
+    }
+
+
+    /// @brief Draws a random mask of 0s and 0xffs.
+    cv::Mat1b random_mask()
+    {
+        cv::Mat1b mask(rows, cols);
+        const int density = uniform(0, 60);
+        for (int row = 0; row < rows; row++)
+        {
+            for (int col = 0; col < cols; col++)
+            {
+                mask(row, col) = (uniform(0, 99) < density) ? 0xff : 0;
+            }
+        }
+
+        for (int shape = uniform(0, 4); shape > 0; shape--)
+        {
+            const int top = uniform(0, rows - 1);
+            const int left = uniform(0, cols - 1);
+            if (uniform(0, 1))
+            {
+                // A rectangle.
+                const int bottom = std::min<int>(rows, top + uniform(1, 12));
+                const int right = std::min<int>(cols, left + uniform(1, 20));
+                for (int row = top; row < bottom; row++)
+                {
+                    for (int col = left; col < right; col++)
+                    {
+                        mask(row, col) = 0xff;
+                    }
+                }
+            }
+            else
+            {
+                // A one-pixel line at a slant, which only holds together diagonally.
+                const int step = uniform(0, 1) ? 1 : -1;
+                for (int row = top, col = left; row < rows && col >= 0 && col < cols; row++, col += step)
+                {
+                    mask(row, col) = 0xff;
+                }
+            }
+        }
+        return mask;
+    }
+
+
+    /// @brief The blobs of a dense mask, by flood fill.
+    struct Components
+    {
+        /// @brief Each pixel's blob, row by row, numbered from 1 in the order their first pixels
+        /// are met in raster order; 0 where unset.
+        std::vector<int> labels;
+
+        /// @brief Each blob's statistics, in the same order.
+        std::vector<Blob> blobs;
+
+        int& label(const int row, const int col) { return labels[row * cols + col]; }
+        int label(const int row, const int col) const { return labels[row * cols + col]; }
+    };
+
+
+    Components flood_fill(const cv::Mat1b& mask)
+    {
+        Components result;
+        result.labels.assign(rows * cols, 0);
+        std::vector<cv::Point2i> stack;
+        for (int row = 0; row < mask.rows; row++)
+        {
+            for (int col = 0; col < mask.cols; col++)
+            {
+                if (0 == mask(row, col) || result.label(row, col) != 0)
+                {
+                    continue;
+                }
+
+                const int label = static_cast<int>(result.blobs.size()) + 1;
+                Blob blob;
+                blob.area = 0;
+                blob.leftmost = blob.rightmost = cv::Point2i(col, row);
+                int top = row;
+                int bottom = row;
+                result.label(row, col) = label;
+                stack.push_back({col, row});
+                while (!stack.empty())
+                {
+                    const cv::Point2i point = stack.back();
+                    stack.pop_back();
+                    blob.area++;
+                    top = std::min(top, point.y);
+                    bottom = std::max(bottom, point.y);
+
+                    // The extreme points are the topmost of any ties.
+                    if (point.x < blob.leftmost.x || (point.x == blob.leftmost.x && point.y < blob.leftmost.y))
+                    {
+                        blob.leftmost = point;
+                    }
+                    if (point.x > blob.rightmost.x || (point.x == blob.rightmost.x && point.y < blob.rightmost.y))
+                    {
+                        blob.rightmost = point;
+                    }
+
+                    for (int d_row = -1; d_row <= 1; d_row++)
+                    {
+                        for (int d_col = -1; d_col <= 1; d_col++)
+                        {
+                            const cv::Point2i next(point.x + d_col, point.y + d_row);
+                            if (next.x >= 0 && next.x < mask.cols && next.y >= 0 && next.y < mask.rows
+                                && mask(next.y, next.x) != 0 && 0 == result.label(next.y, next.x))
+                            {
+                                result.label(next.y, next.x) = label;
+                                stack.push_back(next);
+                            }
+                        }
+                    }
+                }
+
+                blob.bounds = cv::Rect2i(blob.leftmost.x, top, blob.rightmost.x + 1 - blob.leftmost.x, bottom + 1 - top);
+                blob.label = static_cast<uint16_t>(label);
+                result.blobs.push_back(blob);
+            }
+        }
+        return result;
+    }
+
+
+    /// @brief Whether any pixel of a flood-filled blob lies within a rectangle.
+    bool reference_intersects(const Components& components, const int label, const cv::Rect2i& rect)
+    {
+        const cv::Rect2i clipped = rect & cv::Rect2i(0, 0, cols, rows);
+        for (int row = clipped.y; row < clipped.y + clipped.height; row++)
+        {
+            for (int col = clipped.x; col < clipped.x + clipped.width; col++)
+            {
+                if (components.label(row, col) == label)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+    bool same_mask(const cv::Mat1b& a, const cv::Mat1b& b)
+    {
+        for (int row = 0; row < a.rows; row++)
+        {
+            for (int col = 0; col < a.cols; col++)
+            {
+                if ((a(row, col) != 0) != (b(row, col) != 0))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+
+    /// @brief The blobs found from the runs are the flood fill's, in the same order; the largest
+    /// has the largest bounding box; and each intersects the rectangles its pixels do.
+    void check_blobs()
+    {
+        int mismatches = 0;
+        int blobs = 0;
+        RleMask mask(runs_per_row);
+        mask.create(rows, cols);
+        for (int trial = 0; trial < trials; trial++)
+        {
+            const cv::Mat1b dense = random_mask();
+            const Components expected = flood_fill(dense);
+            mask.encode(dense, cv::Rect2i(0, 0, cols, rows));
+
+            if (mask.find_blobs() != expected.blobs.size())
+            {
+                mismatches++;
+                continue;
+            }
+            blobs += mask.blob_count();
+
+            int largest_area = 0;
+            for (uint16_t i = 0; i < mask.blob_count(); i++)
+            {
+                const Blob actual = mask.blob(i);
+                const Blob& reference = expected.blobs[i];
+                mismatches += (actual.bounds != reference.bounds || actual.area != reference.area
+                    || actual.leftmost != reference.leftmost || actual.rightmost != reference.rightmost);
+                largest_area = std::max(largest_area, reference.bounds.area());
+
+                // Every run is in its own blob, and no other.
+                for (uint16_t row = 0; row < rows; row++)
+                {
+                    for (uint8_t run = 0; run < mask.row_run_count(row); run++)
+                    {
+                        const bool in_reference = expected.label(row, mask.row_runs(row)[run].start) == reference.label;
+                        mismatches += (mask.in_blob(actual, row, run) != in_reference);
+                    }
+                }
+
+                for (int rect = 0; rect < 4; rect++)
+                {
+                    const cv::Rect2i probe(uniform(-4, cols - 1), uniform(-4, rows - 1), uniform(1, 12), uniform(1, 12));
+                    mismatches += (mask.intersects(actual, probe) != reference_intersects(expected, reference.label, probe));
+                }
+                mismatches += !mask.intersects(actual, reference.bounds);
+            }
+
+            Blob largest;
+            if (mask.largest_blob(largest) != !expected.blobs.empty()
+                || (!expected.blobs.empty() && largest.bounds.area() != largest_area))
+            {
+                mismatches++;
+            }
+        }
+
+        printf("%d masks, %d blobs\n", trials, blobs);
+        CHECK(0 == mismatches);
+        CHECK(blobs > trials);
+    }
+
+
+    /// @brief Encoding a region of a dense mask, or a packed one, and drawing it out again gives
+    /// back the region, with nothing outside it.
+    void check_encode_and_rasterize()
+    {
+        int mismatches = 0;
+        RleMask mask(runs_per_row);
+        BitMask bits;
+        cv::Mat1b drawn;
+        for (int trial = 0; trial < trials; trial++)
+        {
+            const cv::Mat1b dense = random_mask();
+            const int left = uniform(0, cols - 1);
+            const int top = uniform(0, rows - 1);
+            const cv::Rect2i roi(left, top, uniform(1, cols - left), uniform(1, rows - top));
+            cv::Mat1b expected(rows, cols);
+            for (int row = 0; row < rows; row++)
+            {
+                for (int col = 0; col < cols; col++)
+                {
+                    expected(row, col) = roi.contains(cv::Point2i(col, row)) ? dense(row, col) : 0;
+                }
+            }
+
+            mask.create(rows, cols);
+            mask.encode(dense, roi);
+            mask.rasterize(drawn);
+            mismatches += !same_mask(drawn, expected);
+
+            mask.create(rows, cols);
+            bits.pack(dense, roi);
+            mask.encode(bits);
+            mask.rasterize(drawn, 1);
+            mismatches += !same_mask(drawn, expected);
+
+            // The value set pixels are drawn with.
+            for (uint16_t row = 0; row < rows; row++)
+            {
+                for (uint16_t col = 0; col < cols; col++)
+                {
+                    mismatches += (drawn(row, col) != ((expected(row, col) != 0) ? 1 : 0));
+                }
+            }
+        }
+        CHECK(0 == mismatches);
+    }
+
+
+    /// @brief ORing two masks gives the OR of their dense masks, in runs which neither overlap
+    /// nor touch.
+    void check_composite_or()
+    {
+        int mismatches = 0;
+        RleMask a(runs_per_row);
+        RleMask b(runs_per_row);
+        RleMask both(runs_per_row);
+        a.create(rows, cols);
+        b.create(rows, cols);
+        cv::Mat1b drawn;
+        for (int trial = 0; trial < trials; trial++)
+        {
+            const cv::Mat1b dense_a = random_mask();
+            const cv::Mat1b dense_b = random_mask();
+            a.encode(dense_a, cv::Rect2i(0, 0, cols, rows));
+            b.encode(dense_b, cv::Rect2i(0, 0, cols, rows));
+            RleMask::composite_or(a, b, both);
+
+            cv::Mat1b expected(rows, cols);
+            for (int row = 0; row < rows; row++)
+            {
+                for (int col = 0; col < cols; col++)
+                {
+                    expected(row, col) = dense_a(row, col) | dense_b(row, col);
+                }
+            }
+            both.rasterize(drawn);
+            mismatches += !same_mask(drawn, expected);
+
+            for (uint16_t row = 0; row < rows; row++)
+            {
+                const Run* runs = both.row_runs(row);
+                for (uint8_t run = 1; run < both.row_run_count(row); run++)
+                {
+                    mismatches += (runs[run].start <= runs[run - 1].end);
+                }
+            }
+        }
+        CHECK(0 == mismatches);
+    }
+
+
+    /// @brief A row with more runs than fit keeps the first ones, and merges the rest into its
+    /// last, gaps and all, however it was encoded.
+    void check_full_rows()
+    {
+        cv::Mat1b dense(1, 32);
+        for (int col = 0; col < dense.cols; col++)
+        {
+            dense(0, col) = (col % 4 < 2) ? 0xff : 0;
+        }
+
+        RleMask mask(4);
+        mask.create(1, 32);
+        mask.encode(dense, cv::Rect2i(0, 0, 32, 1));
+        CHECK(4 == mask.row_run_count(0));
+        CHECK(8 == mask.row_runs(0)[2].start && 10 == mask.row_runs(0)[2].end);
+        CHECK(12 == mask.row_runs(0)[3].start && 30 == mask.row_runs(0)[3].end);
+
+        BitMask bits;
+        bits.pack(dense, cv::Rect2i(0, 0, 32, 1));
+        mask.create(1, 32);
+        mask.encode(bits);
+        CHECK(4 == mask.row_run_count(0));
+        CHECK(12 == mask.row_runs(0)[3].start && 30 == mask.row_runs(0)[3].end);
+
+        RleMask other(4);
+        RleMask both(4);
+        other.create(1, 32);
+        other.add_run(0, 2, 3);
+        RleMask::composite_or(mask, other, both);
+        CHECK(4 == both.row_run_count(0));
+        CHECK(0 == both.row_runs(0)[0].start && 3 == both.row_runs(0)[0].end);
+        CHECK(12 == both.row_runs(0)[3].start && 30 == both.row_runs(0)[3].end);
+    }
+}
+
+
+int main()
+{
+    check_blobs();
+    check_encode_and_rasterize();
+    check_composite_or();
+    check_full_rows();
+    return finish();
+}
@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Runs the detection stages on a view of the track under the heap meter, as the main loop does
+/// with a class table: the lookup and the split into class planes as the conversion; then each
+/// line's mask taken from its plane, cleaned, run-length encoded, drawn out and searched for
+/// blobs, with the outside line's fitted straight and curved. Once the first frame has sized
+/// everything, each stage must keep within its budget in STAGE_BUDGET_ALLOCS, frame after frame,
+/// whether the frame is clean or noisy.
+///
+/// The stages are put together here from the same parts as threshold_cropped() and the
+/// detectors in lane_detection.cpp, which only builds for the ESP-32.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "bit_mask.h"
+#include "class_planes.h"
+#include "class_table.h"
+#include "curve_fit.h"
+#include "frame_geometry.h"
+#include "heap_stats.h"
+#include "line_fit.h"
+#include "params.h"
+#include "parallel_rows.h"
+#include "rle_mask.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    using Geometry = Square96;
+
+    /// @brief One line's part of a detection stage, with everything it keeps across frames.
+    struct LineStage
+    {
+        LineStage(const uint8_t class_bit_, const Morphology& morphology_, const cv::Rect2i& roi_):
+            class_bit(class_bit_),
+            morphology(morphology_),
+            roi(roi_),
+            blob()
+        {
+        }
+
+        uint8_t class_bit;
+        Morphology morphology;
+        cv::Rect2i roi;
+        BitMask bits;
+        RleMask runs;
+        cv::Mat1b thresh;
+        Blob blob;
+
+        /// @brief Takes the line's mask from the planes, cleans it and finds its largest blob.
+        /// @return Whether there was a blob.
+        bool run(const ClassPlanes& planes)
+        {
+            thresh.create(Geometry::height, Geometry::width);
+            thresh.setTo(0);
+            runs.create(Geometry::height, Geometry::width);
+            bits.extract(planes, static_cast<uint8_t>(__builtin_ctz(class_bit)), roi);
+            bits.apply(morphology);
+            runs.encode(bits);
+            runs.rasterize(thresh);
+            runs.find_blobs();
+            return runs.largest_blob(blob);
+        }
+    };
+
+
+    /// @brief Gets a line's crop, from params.h, as lane_detection.cpp rescales it.
+    cv::Rect2i crop(const uint16_t top, const uint16_t bottom, const uint16_t left, const uint16_t right)
+    {
+        const int top_rows = Geometry::scale_row(top, calibration_height);
+        const int bottom_rows = Geometry::scale_row(bottom, calibration_height);
+        const int left_cols = Geometry::scale_col(left, calibration_width);
+        const int right_cols = Geometry::scale_col(right, calibration_width);
+        return cv::Rect2i(left_cols, top_rows, Geometry::width - left_cols - right_cols, Geometry::height - top_rows - bottom_rows);
+    }
+
+
+    /// @brief The whole pipeline's detection stages, with what they keep across frames.
+    struct Pipeline
+    {
+        cv::Mat1b class_map;
+        ClassPlanes planes;
+
+        // The outside line is opened with a 3x1 element, the stop line and extra classes with a
+        // 3x3, as in lane_detection.cpp.
+        LineStage outside{outside_class_bit, {MorphOp::Open, StructuringElement::Horizontal}, crop(outside_cropping_top, outside_cropping_bottom, outside_cropping_left, outside_cropping_right)};
+        LineStage stop{stop_class_bit, {MorphOp::Open, StructuringElement::Square}, crop(stop_cropping_top, stop_cropping_bottom, stop_cropping_left, stop_cropping_right)};
+        LineStage extra{0, {MorphOp::Open, StructuringElement::Square}, cv::Rect2i()};
+
+        LineFitter fitter{OUTSIDE_LINE_FIT_BUDGET, OUTSIDE_LINE_FIT_SEED};
+        CurveFitter curve{Geometry::height};
+
+        Pipeline()
+        {
+            planes.create(Geometry::height, Geometry::width);
+        }
+
+        void convert(const cv::Mat& frame)
+        {
+            parallel_lookup(frame, rgb565_class_table, class_map);
+            planes.split(class_map, 0, static_cast<uint16_t>(class_map.rows));
+        }
+
+        /// @return Whether the outside line was fitted.
+        bool detect_outside()
+        {
+            if (!outside.run(planes))
+            {
+                return false;
+            }
+
+            fitter.clear();
+            curve.clear();
+            for (int row = outside.blob.bounds.y; row < outside.blob.bounds.y + outside.blob.bounds.height; row++)
+            {
+                const Run* row_runs = outside.runs.row_runs(row);
+                for (uint8_t i = 0; i < outside.runs.row_run_count(row); i++)
+                {
+                    if (outside.runs.in_blob(outside.blob, row, i))
+                    {
+                        const float middle = 0.5f * (row_runs[i].start + row_runs[i].end - 1);
+                        fitter.add_point(middle, row);
+                        curve.add_point(middle, row, row_runs[i].end - row_runs[i].start);
+                    }
+                }
+            }
+
+            LineFit line_fit;
+            CurveFit curve_fit;
+            return fitter.fit(line_fit) && curve.fit(curve_fit);
+        }
+
+        /// @return Whether the stop line was found.
+        bool detect_stop()
+        {
+            const bool found = stop.run(planes);
+            for (uint8_t index = 0; index < extra_class_count; index++)
+            {
+                extra.class_bit = extra_class_bits[index];
+                extra.roi = crop(extra_cropping[index][0], extra_cropping[index][1], extra_cropping[index][2], extra_cropping[index][3]);
+                extra.run(planes);
+            }
+            return found;
+        }
+    };
+
+
+    /// @brief Runs frames through the pipeline under the meter, alternating between the scenes
+    /// so that each frame's runs and blobs differ from the last's, and checks every stage
+    /// against its budget.
+    void check_budgets(const cv::Mat& first, const cv::Mat& second)
+    {
+        Pipeline pipeline;
+        pipeline.convert(first);
+        pipeline.detect_outside();
+        pipeline.detect_stop();
+
+        heap_stats::StageMeter meter;
+        for (uint8_t stage = 0; stage < static_cast<uint8_t>(Stage::Count); stage++)
+        {
+            meter.set_budget(static_cast<Stage>(stage), heap_stats::STAGE_BUDGET_ALLOCS[stage]);
+        }
+
+        for (int frame = 0; frame < 8; frame++)
+        {
+            meter.begin_frame();
+            pipeline.convert((frame & 1) ? first : second);
+            meter.end_stage(Stage::Convert);
+            CHECK(pipeline.detect_outside());
+            meter.end_stage(Stage::OutsideDetect);
+            CHECK(pipeline.detect_stop());
+            meter.end_stage(Stage::StopDetect);
+            CHECK(meter.end_frame());
+        }
+
+        CHECK(0 == meter.over_budget_frames());
+        CHECK(0 == meter.worst(Stage::OutsideDetect).allocs);
+        CHECK(0 == meter.worst(Stage::StopDetect).allocs);
+        CHECK(meter.worst(Stage::Convert).allocs <= heap_stats::STAGE_BUDGET_ALLOCS[static_cast<uint8_t>(Stage::Convert)]);
+        printf("worst allocs/frame: convert %u, outside %u, stop %u\n",
+            static_cast<unsigned>(meter.worst(Stage::Convert).allocs),
+            static_cast<unsigned>(meter.worst(Stage::OutsideDetect).allocs),
+            static_cast<unsigned>(meter.worst(Stage::StopDetect).allocs));
+    }
+}
+
+
+int main()
+{
+    heap_stats::count_calling_task(0);
+
+    TrackScene clean = {Geometry::height, Geometry::width};
+    clean.stop_height = 0.08f;
+    clean.floor_noise = 0;
+    TrackScene noisy = clean;
+    noisy.floor_noise = 40;
+    noisy.line_bottom = 0.6f;
+
+    check_budgets(render_rgb565(clean), render_rgb565(noisy));
+    return finish();
+}
@@ -0,0 +1,178 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Feeds the line estimator detections, and checks that it follows a moving line, averages a
+/// near-vertical line's flipping slope to vertical, reports the line lost once it has been
+/// missed for too long, and predicts between frames and where to search for the line.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+
+#include "state_estimator.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    /// @brief The length of a control period, in ticks, and of a frame.
+    constexpr uint32_t period_ticks = 10;
+    constexpr uint32_t frame_ticks = 30;
+
+
+    /// @brief A line leaning 0.5 columns per row, drifting 1 pixel per frame: the offset, its rate
+    /// and the lean all settle on it.
+    void check_follows_line()
+    {
+        LineStateEstimator estimator(period_ticks);
+        uint32_t now = 0;
+        for (int frame = 0; frame < 200; frame++, now += frame_ticks)
+        {
+            estimator.advance_to(now, true);
+            estimator.update(frame, 2.0f);
+        }
+
+        const LaneEstimate estimate = estimator.estimate();
+        CHECK(estimate.valid);
+        CHECK_NEAR(static_cast<float>(estimate.offset) / FIXED_ONE, 199, 2);
+        CHECK_NEAR(static_cast<float>(estimate.offset_rate) / FIXED_ONE, 1.0f / 3, 0.05f);
+        CHECK_NEAR(static_cast<float>(estimate.lean) / FIXED_ONE, 0.5f, 0.02f);
+        CHECK_NEAR(lean_to_slope(estimate.lean), 2.0f, 0.1f);
+    }
+
+
+    /// @brief A vertical line measures a slope of either sign, or infinite: the lean stays
+    /// vertical, and so does the slope taken back from it.
+    void check_vertical_line()
+    {
+        const float slopes[] = {60.0f, -60.0f, INFINITY, -200.0f, 500.0f, -INFINITY};
+
+        LineStateEstimator estimator(period_ticks);
+        uint32_t now = 0;
+        for (int frame = 0; frame < 60; frame++, now += frame_ticks)
+        {
+            estimator.advance_to(now, true);
+            estimator.update(0, slopes[frame % 6]);
+        }
+
+        const LaneEstimate estimate = estimator.estimate();
+        CHECK_NEAR(static_cast<float>(estimate.lean) / FIXED_ONE, 0.0f, 0.02f);
+        CHECK(fabsf(lean_to_slope(estimate.lean)) > 50.0f);
+    }
+
+
+    /// @brief Through misses the estimate holds and is still valid; past max_predicted_periods it
+    /// isn't, and the next detection starts over rather than being averaged with the old line.
+    void check_lost()
+    {
+        LineStateEstimator estimator(period_ticks);
+        CHECK(!estimator.estimate().valid);
+
+        uint32_t now = 0;
+        for (int frame = 0; frame < 20; frame++, now += frame_ticks)
+        {
+            estimator.advance_to(now, true);
+            estimator.update(10, INFINITY);
+        }
+
+        estimator.advance_to(now, false);
+        CHECK(estimator.estimate().valid);
+        CHECK(3 == estimator.estimate().periods_since_measurement);
+
+        now += (max_predicted_periods + 1) * period_ticks;
+        estimator.advance_to(now, false);
+        CHECK(!estimator.estimate().valid);
+
+        now += frame_ticks;
+        estimator.advance_to(now, true);
+        estimator.update(-20, 1.0f);
+        const LaneEstimate estimate = estimator.estimate();
+        CHECK(estimate.valid);
+        CHECK(to_fixed(-20) == estimate.offset);
+        CHECK(to_fixed(1) == estimate.lean);
+    }
+
+
+    /// @brief Predicting between frames carries the offset on at its rate, and leaves the
+    /// estimator as it was.
+    void check_predict_to()
+    {
+        LineStateEstimator estimator(period_ticks);
+        uint32_t now = 0;
+        for (int frame = 0; frame < 200; frame++, now += frame_ticks)
+        {
+            estimator.advance_to(now, true);
+            estimator.update(frame, 2.0f);
+        }
+        now -= frame_ticks;
+
+        const LaneEstimate before = estimator.estimate();
+        const LaneEstimate predicted = estimator.predict_to(now + 2 * period_ticks);
+        CHECK(predicted.valid);
+        CHECK(before.offset + 2 * before.offset_rate == predicted.offset);
+        CHECK(predicted.offset_spread > before.offset_spread);
+        CHECK(2 == predicted.periods_since_measurement);
+
+        const LaneEstimate after = estimator.estimate();
+        CHECK(before.offset == after.offset && before.offset_spread == after.offset_spread);
+        CHECK(0 == after.periods_since_measurement);
+
+        // Less than a period ahead, nothing has moved yet.
+        CHECK(before.offset == estimator.predict_to(now + period_ticks - 1).offset);
+    }
+
+
+    /// @brief The search window covers the whole frame until there is a prediction, then follows
+    /// the leaning line across the band of rows, widening the longer the line goes unseen.
+    void check_predicted_window()
+    {
+        constexpr int16_t cols = 96;
+        constexpr int16_t expected_col = 40;
+        constexpr int16_t reference_row = 50;
+
+        LineStateEstimator estimator(period_ticks);
+        SearchWindow window = estimator.predicted_window(0, expected_col, reference_row, 30, 70, 3, cols);
+        CHECK(0 == window.first_col && cols - 1 == window.last_col);
+
+        // A steady line 4 pixels right of its column, leaning half a column per row.
+        uint32_t now = 0;
+        for (int frame = 0; frame < 100; frame++, now += frame_ticks)
+        {
+            estimator.advance_to(now, true);
+            estimator.update(4, 2.0f);
+        }
+
+        // At rows 30 and 70 the line is at columns 34 and 54; the window takes them in, and a
+        // spread or so more.
+        window = estimator.predicted_window(now, expected_col, reference_row, 30, 70, 1, cols);
+        CHECK(window.first_col <= 34 && window.last_col >= 54);
+        CHECK(window.first_col >= 16 && window.last_col <= 72);
+
+        // A narrower band needs fewer columns, and more spreads more.
+        const SearchWindow narrow = estimator.predicted_window(now, expected_col, reference_row, 48, 52, 1, cols);
+        CHECK(narrow.first_col <= 43 && narrow.last_col >= 45);
+        CHECK(narrow.last_col - narrow.first_col < window.last_col - window.first_col);
+        const SearchWindow wide = estimator.predicted_window(now, expected_col, reference_row, 30, 70, 2, cols);
+        CHECK(wide.first_col < window.first_col && wide.last_col > window.last_col);
+
+        // Unseen for longer, the window widens, and is clamped to the frame.
+        const SearchWindow later = estimator.predicted_window(now + 20 * period_ticks, expected_col, reference_row, 30, 70, 1, cols);
+        CHECK(later.first_col <= window.first_col && later.last_col >= window.last_col);
+        CHECK(later.first_col >= 0 && later.last_col <= cols - 1);
+
+        // Once lost, it is the whole frame again.
+        const SearchWindow lost = estimator.predicted_window(now + (max_predicted_periods + 1) * period_ticks, expected_col, reference_row, 30, 70, 1, cols);
+        CHECK(0 == lost.first_col && cols - 1 == lost.last_col);
+    }
+}
+
+
+int main()
+{
+    check_follows_line();
+    check_vertical_line();
+    check_lost();
+    check_predict_to();
+    check_predicted_window();
+    return finish();
+}
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// What the host tests and benchmarks share: checks which report and count failures rather than
+/// stopping at the first, and timing.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdio.h>
+#include <math.h>
+
+#include <chrono>
+
+namespace lane_detect::test
+{
+    /// @brief The number of checks which have failed so far.
+    inline int failures = 0;
+
+
+    /// @brief Reports a failed check.
+    /// @return False, so that a check can be used as a condition.
+    inline bool fail(const char* file, const int line, const char* expression)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        failures++;
+        return false;
+    }
+
+
+    /// @brief Reports how the checks went.
+    /// @return The exit code for main: nonzero if any check failed.
+    inline int finish()
+    {
+        if (failures)
+        {
+            fprintf(stderr, "%d check(s) failed\n", failures);
+            return 1;
+        }
+
+        printf("All checks passed\n");
+        return 0;
+    }
+
+
+    /// @brief Times a function: the fastest of several runs, which is the most repeatable figure
+    /// on a shared machine.
+    /// @param function The function.
+    /// @param runs The number of runs.
+    /// @return The time of the fastest run, in microseconds.
+    template <typename Function>
+    double time_us(const Function& function, const int runs)
+    {
+        double fastest = INFINITY;
+        for (int run = 0; run < runs; run++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            function();
+            const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            fastest = fmin(fastest, elapsed.count());
+        }
+        return fastest;
+    }
+
+
+    /// @brief Keeps the compiler from optimizing away a benchmark's result.
+    template <typename T>
+    void keep(const T& value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+}
+
+
+/// @brief Checks a condition, reporting it if false.
+#define CHECK(expression) ((expression) ? true : lane_detect::test::fail(__FILE__, __LINE__, #expression))
+
+/// @brief Checks that two numbers are within a tolerance of each other, reporting them if not.
+#define CHECK_NEAR(actual, expected, tolerance) \
+    ((fabs((double)(actual) - (double)(expected)) <= (tolerance)) ? true : \
+        (fprintf(stderr, "    %s = %g, expected %g +/- %g\n", #actual, (double)(actual), (double)(expected), (double)(tolerance)), \
+         lane_detect::test::fail(__FILE__, __LINE__, #actual " near " #expected)))
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Checks the YUV thresholds generated from the shipped settings against YUV frames: the outside
+/// line and the stop line must each be picked out of the floor, and nothing else.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "test_support.h"
+#include "test_frames.h"
+
+#include "params.h"
+#include "parallel_rows.h"
+
+using namespace lane_detect;
+using namespace lane_detect::test;
+
+namespace
+{
+    constexpr kernels::YuvBounds outside_bounds = {
+        {outside_yuv_min_y, outside_yuv_min_u, outside_yuv_min_v},
+        {outside_yuv_max_y, outside_yuv_max_u, outside_yuv_max_v},
+    };
+
+    constexpr kernels::YuvBounds stop_bounds = {
+        {stop_yuv_min_y, stop_yuv_min_u, stop_yuv_min_v},
+        {stop_yuv_max_y, stop_yuv_max_u, stop_yuv_max_v},
+    };
+
+
+    /// @brief Thresholds a pair of pixels of one color.
+    bool accepts(const kernels::YuvBounds& bounds, const Rgb& rgb)
+    {
+        uint8_t yuv[3];
+        rgb_to_yuv(rgb, yuv);
+        const uint8_t pair[4] = {yuv[0], yuv[1], yuv[0], yuv[2]};
+        uint8_t mask[2];
+        kernels::threshold_yuyv(pair, bounds, mask, 2);
+        return mask[0] && mask[1];
+    }
+
+
+    /// @brief Single colors: the floor at its darkest and brightest, the lines, a white line
+    /// blown out to full brightness, and bright saturated colors which share a white line's HSV
+    /// value but aren't white.
+    void check_colors()
+    {
+        CHECK(!accepts(outside_bounds, floor_color));
+        CHECK(!accepts(outside_bounds, {160, 150, 140}));
+        CHECK(!accepts(outside_bounds, {40, 40, 40}));
+        CHECK(accepts(outside_bounds, line_color));
+        CHECK(accepts(outside_bounds, {255, 255, 255}));
+        CHECK(accepts(outside_bounds, {232, 240, 248}));
+        CHECK(!accepts(outside_bounds, {40, 60, 250}));
+        CHECK(!accepts(outside_bounds, {250, 230, 40}));
+        CHECK(!accepts(outside_bounds, {60, 250, 250}));
+        CHECK(!accepts(outside_bounds, stop_color));
+
+        CHECK(accepts(stop_bounds, stop_color));
+        CHECK(!accepts(stop_bounds, floor_color));
+        CHECK(!accepts(stop_bounds, line_color));
+    }
+
+
+    /// @brief Counts the pixels of a frame's mask which disagree with the scene, leaving out the
+    /// pixels next to an edge, whose chroma the camera shares with the pixel across it.
+    template <typename OnClass>
+    int count_mismatches(const TrackScene& scene, const cv::Mat1b& mask, const OnClass& on_class)
+    {
+        int mismatches = 0;
+        for (int row = 0; row < scene.rows; row++)
+        {
+            for (int col = 1; col + 1 < scene.cols; col++)
+            {
+                const bool expected = on_class(row, col);
+                if (expected != on_class(row, col - 1) || expected != on_class(row, col + 1))
+                {
+                    continue;
+                }
+                if (expected != (0 != mask(row, col)))
+                {
+                    mismatches++;
+                }
+            }
+        }
+        return mismatches;
+    }
+
+
+    /// @brief Whole frames, at the resolutions the pipeline runs at.
+    void check_frames(const uint16_t rows, const uint16_t cols)
+    {
+        TrackScene scene = {rows, cols};
+        scene.stop_height = 0.06f;
+        const cv::Mat frame = render_yuyv(scene);
+
+        cv::Mat1b outside;
+        parallel_in_range_yuyv(frame, outside_bounds, outside);
+        CHECK(0 == count_mismatches(scene, outside, [&](const int row, const int col)
+        {
+            return scene.on_line(row, col) && !scene.on_stop(row, col);
+        }));
+
+        cv::Mat1b stop;
+        parallel_in_range_yuyv(frame, stop_bounds, stop);
+        CHECK(0 == count_mismatches(scene, stop, [&](const int row, const int col)
+        {
+            return scene.on_stop(row, col);
+        }));
+    }
+}
+
+
+int main()
+{
+    check_colors();
+    check_frames(96, 96);
+    check_frames(120, 160);
+    check_frames(240, 320);
+    return finish();
+}
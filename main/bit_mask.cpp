@@ -0,0 +1,182 @@
+#include "bit_mask.h"
+#include "class_planes.h"
+#include "pixel_kernels.h"
+
+
+namespace lane_detect
+{
+    BitMask::BitMask():
+        roi_(),
+        words_per_row_(0),
+        last_word_mask_(0),
+        current_(0)
+    {
+    }
+
+
+    void BitMask::reset(const cv::Rect2i& roi)
+    {
+        if (roi.size() != roi_.size())
+        {
+            words_per_row_ = static_cast<uint16_t>((roi.width + 31) >> 5);
+            last_word_mask_ = (0 == (roi.width & 31)) ? UINT32_MAX : ((1u << (roi.width & 31)) - 1);
+            const size_t words = static_cast<size_t>(words_per_row_) * roi.height;
+            planes_[0].resize(words);
+            planes_[1].resize(words);
+        }
+        roi_ = roi;
+        current_ = 0;
+    }
+
+
+    void BitMask::pack(const cv::Mat1b& mask, const cv::Rect2i& roi)
+    {
+        CV_Assert(roi.x >= 0 && roi.y >= 0 && roi.x + roi.width <= mask.cols && roi.y + roi.height <= mask.rows);
+        reset(roi);
+
+        for (int row = 0; row < roi.height; row++)
+        {
+            kernels::pack_mask(mask.ptr<uint8_t>(roi.y + row) + roi.x, &planes_[0][static_cast<uint32_t>(row) * words_per_row_], roi.width);
+        }
+    }
+
+
+    void BitMask::extract(const ClassPlanes& planes, const uint8_t index, const cv::Rect2i& roi)
+    {
+        CV_Assert(index < MAX_CLASSES && !roi.empty() && roi.x >= 0 && roi.y >= 0 && roi.x + roi.width <= planes.cols() && roi.y + roi.height <= planes.rows());
+        reset(roi);
+
+        // Each word of the region straddles two words of the plane, unless the region starts on
+        // a word.
+        const uint16_t first_word = static_cast<uint16_t>(roi.x >> 5);
+        const uint8_t shift = roi.x & 31;
+        const uint16_t plane_words = planes.words_per_row();
+        for (int row = 0; row < roi.height; row++)
+        {
+            const uint32_t* src = planes.row(index, static_cast<uint16_t>(roi.y + row));
+            uint32_t* dst = &planes_[0][static_cast<uint32_t>(row) * words_per_row_];
+            for (uint16_t word = 0; word < words_per_row_; word++)
+            {
+                const uint16_t low = first_word + word;
+                uint32_t bits = src[low] >> shift;
+                if (shift != 0 && low + 1 < plane_words)
+                {
+                    bits |= src[low + 1] << (32 - shift);
+                }
+                dst[word] = bits;
+            }
+            dst[words_per_row_ - 1] &= last_word_mask_;
+        }
+    }
+
+
+    void BitMask::horizontal(const bool erode)
+    {
+        const std::vector<uint32_t>& src = planes_[current_];
+        std::vector<uint32_t>& dst = planes_[current_ ^ 1];
+
+        // Past the edges is set for an erosion and clear for a dilation, so that the edges don't
+        // change anything. The unused bits of the last word are treated the same way, then cleared.
+        const uint32_t border = erode ? UINT32_MAX : 0;
+        const uint32_t last = words_per_row_ - 1;
+        for (int row = 0; row < roi_.height; row++)
+        {
+            const uint32_t* in = &src[static_cast<uint32_t>(row) * words_per_row_];
+            uint32_t* out = &dst[static_cast<uint32_t>(row) * words_per_row_];
+
+            uint32_t before = border;
+            uint32_t word = (0 == last) ? ((in[0] & last_word_mask_) | (border & ~last_word_mask_)) : in[0];
+            for (uint32_t i = 0; i <= last; i++)
+            {
+                uint32_t after = border;
+                if (i + 1 < last)
+                {
+                    after = in[i + 1];
+                }
+                else if (i + 1 == last)
+                {
+                    after = (in[last] & last_word_mask_) | (border & ~last_word_mask_);
+                }
+
+                // Each pixel's left neighbour is the bit below it, carried in from the previous
+                // word; its right neighbour is the bit above it, carried in from the next.
+                const uint32_t left = (word << 1) | (before >> 31);
+                const uint32_t right = (word >> 1) | (after << 31);
+                out[i] = erode ? (word & left & right) : (word | left | right);
+
+                before = word;
+                word = after;
+            }
+            out[last] &= last_word_mask_;
+        }
+
+        current_ ^= 1;
+    }
+
+
+    void BitMask::vertical(const bool erode)
+    {
+        const std::vector<uint32_t>& src = planes_[current_];
+        std::vector<uint32_t>& dst = planes_[current_ ^ 1];
+
+        const uint32_t border = erode ? UINT32_MAX : 0;
+        for (int row = 0; row < roi_.height; row++)
+        {
+            const uint32_t* above = (row > 0) ? &src[static_cast<uint32_t>(row - 1) * words_per_row_] : nullptr;
+            const uint32_t* in = &src[static_cast<uint32_t>(row) * words_per_row_];
+            const uint32_t* below = (row + 1 < roi_.height) ? &src[static_cast<uint32_t>(row + 1) * words_per_row_] : nullptr;
+            uint32_t* out = &dst[static_cast<uint32_t>(row) * words_per_row_];
+
+            for (uint16_t i = 0; i < words_per_row_; i++)
+            {
+                const uint32_t up = above ? above[i] : border;
+                const uint32_t down = below ? below[i] : border;
+                out[i] = erode ? (in[i] & up & down) : (in[i] | up | down);
+            }
+        }
+
+        current_ ^= 1;
+    }
+
+
+    void BitMask::erode(const StructuringElement element)
+    {
+        // A 3x3 square is a 3x1 row then a 1x3 column.
+        if (element != StructuringElement::Vertical)
+        {
+            horizontal(true);
+        }
+        if (element != StructuringElement::Horizontal)
+        {
+            vertical(true);
+        }
+    }
+
+
+    void BitMask::dilate(const StructuringElement element)
+    {
+        if (element != StructuringElement::Vertical)
+        {
+            horizontal(false);
+        }
+        if (element != StructuringElement::Horizontal)
+        {
+            vertical(false);
+        }
+    }
+
+
+    void BitMask::apply(const Morphology& morphology)
+    {
+        if (MorphOp::Open == morphology.op)
+        {
+            erode(morphology.element);
+            dilate(morphology.element);
+        }
+        else if (MorphOp::Close == morphology.op)
+        {
+            dilate(morphology.element);
+            erode(morphology.element);
+        }
+    }
+}
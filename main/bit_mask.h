@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// A binary mask packed 32 pixels to a word, for morphology between thresholding and blob
+/// analysis.
+///
+/// Opening a mask clears specks smaller than the structuring element, and closing fills gaps of
+/// that size, so that the blob stage isn't handed every speck of thresholding noise. Packed, a
+/// 3-wide erosion or dilation is two shifts and two ANDs (or ORs) for 32 pixels at once.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+namespace lane_detect
+{
+    class ClassPlanes;
+
+
+    /// @brief The shapes pixels are grown or shrunk by, as width x height.
+    enum class StructuringElement : uint8_t
+    {
+        /// @brief 3x1: a pixel and its left and right neighbours.
+        Horizontal = 0,
+
+        /// @brief 1x3: a pixel and its neighbours above and below.
+        Vertical = 1,
+
+        /// @brief 3x3: a pixel and all eight of its neighbours.
+        Square = 2,
+    };
+
+
+    /// @brief The morphological operations which can clean a mask.
+    enum class MorphOp : uint8_t
+    {
+        None = 0,
+
+        /// @brief An erosion then a dilation: clears specks.
+        Open = 1,
+
+        /// @brief A dilation then an erosion: fills gaps.
+        Close = 2,
+    };
+
+
+    /// @brief How a mask is cleaned.
+    struct Morphology
+    {
+        MorphOp op;
+        StructuringElement element;
+    };
+
+
+    /// @brief A region of a binary mask, packed a bit a pixel. Bit i of a row's word w is column
+    /// 32w + i of the region. Bits past the region's right edge are always clear.
+    class BitMask
+    {
+        public:
+        BitMask();
+
+        /// @brief Packs a region of a dense mask. Only allocates if the region's size has changed.
+        /// @param mask The dense mask. Any non-zero byte is set.
+        /// @param roi The region to pack. Must lie within the mask.
+        void pack(const cv::Mat1b& mask, const cv::Rect2i& roi);
+
+        /// @brief Takes a region of one class's plane, already packed. Only allocates if the
+        /// region's size has changed.
+        /// @param planes The split class map.
+        /// @param index The class's index: the index of its bit in the class map.
+        /// @param roi The region to take. Must lie within the planes.
+        void extract(const ClassPlanes& planes, uint8_t index, const cv::Rect2i& roi);
+
+        /// @brief Shrinks the set pixels: a pixel stays set only if the whole element around it
+        /// is set. Pixels past the edges count as set, as in cv::erode.
+        /// @param element The structuring element.
+        void erode(StructuringElement element);
+
+        /// @brief Grows the set pixels: a pixel is set if any of the element around it is set.
+        /// @param element The structuring element.
+        void dilate(StructuringElement element);
+
+        /// @brief Applies a morphological operation.
+        /// @param morphology The operation and its structuring element.
+        void apply(const Morphology& morphology);
+
+        /// @return The packed words of a row of the region.
+        const uint32_t* row(uint16_t row) const { return &planes_[current_][static_cast<uint32_t>(row) * words_per_row_]; }
+
+        /// @return The number of words in each row.
+        uint16_t words_per_row() const { return words_per_row_; }
+
+        /// @return The region this was packed from, in the dense mask.
+        const cv::Rect2i& roi() const { return roi_; }
+
+        private:
+        /// @brief Sizes the planes for a region, and makes it the current one.
+        void reset(const cv::Rect2i& roi);
+
+        /// @brief Erodes or dilates each row with its left and right neighbours, into the other
+        /// plane.
+        void horizontal(bool erode);
+
+        /// @brief Erodes or dilates each row with the rows above and below, into the other plane.
+        void vertical(bool erode);
+
+        cv::Rect2i roi_;
+        uint16_t words_per_row_;
+
+        /// @brief The bits in use in the last word of each row.
+        uint32_t last_word_mask_;
+
+        /// @brief Each operation reads one plane and writes the other.
+        std::vector<uint32_t> planes_[2];
+        uint8_t current_;
+    };
+}
@@ -0,0 +1,276 @@
+#include "black_box.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#endif
+
+#include "camera_task.h"
+#include "debugging.h"
+
+
+namespace lane_detect
+{
+    #ifdef ESP_PLATFORM
+    static const char TAG[] = "black_box";
+
+    // The dump only runs when nothing else wants the core; it can take tens of minutes at the
+    // serial port's rate.
+    constexpr UBaseType_t dumper_priority = tskIDLE_PRIORITY + 1;
+    constexpr uint32_t dumper_stack_size = 4096;
+    #endif
+
+
+    BlackBox::BlackBox(const size_t memory_budget, const uint16_t post_trigger_frames, const bool dump_on_trigger):
+        memory_budget_(memory_budget),
+        post_trigger_frames_(post_trigger_frames),
+        dump_on_trigger_(dump_on_trigger),
+        width_(0),
+        height_(0),
+        frame_size_(0),
+        slot_size_(0),
+        slot_count_(0),
+        memory_(nullptr),
+        entries_(nullptr),
+        head_(0),
+        filled_(0),
+        trigger_(BlackBoxTrigger::None),
+        frames_to_freeze_(0),
+        dump_requested_(false),
+        state_(State::Recording)
+        #ifdef ESP_PLATFORM
+        ,
+        dumper_(nullptr)
+        #endif
+    {
+    }
+
+
+    BlackBox::~BlackBox()
+    {
+        #ifdef ESP_PLATFORM
+        if (dumper_ != nullptr)
+        {
+            vTaskDelete(dumper_);
+        }
+        #endif
+        free(memory_);
+        delete[] entries_;
+    }
+
+
+    bool BlackBox::allocate(const uint16_t width, const uint16_t height)
+    {
+        width_ = width;
+        height_ = height;
+
+        // Room for a 16-bit frame and two masks, kept 16-byte aligned for the SIMD kernels.
+        const size_t pixels = static_cast<size_t>(width) * height;
+        frame_size_ = 2 * pixels;
+        slot_size_ = (frame_size_ + 2 * pixels + 15) & ~static_cast<size_t>(15);
+        const size_t slots = memory_budget_ / slot_size_;
+        if (slots < 2)
+        {
+            return false;
+        }
+        slot_count_ = (slots > UINT16_MAX) ? UINT16_MAX : static_cast<uint16_t>(slots);
+
+        #ifdef ESP_PLATFORM
+        memory_ = static_cast<uint8_t*>(heap_caps_aligned_alloc(16, memory_used(), MALLOC_CAP_SPIRAM));
+        #else
+        memory_ = static_cast<uint8_t*>(aligned_alloc(16, memory_used()));
+        #endif
+        if (nullptr == memory_)
+        {
+            #ifdef ESP_PLATFORM
+            ESP_LOGE(TAG, "No memory for %u slots", static_cast<unsigned>(slot_count_));
+            #endif
+            slot_count_ = 0;
+            return false;
+        }
+        entries_ = new BlackBoxEntry[slot_count_];
+
+        #ifdef ESP_PLATFORM
+        // The rest of the pipeline is mostly on PRO_CPU. Without the dumper nothing recorded could
+        // ever be read back, so the black box is disabled rather than left to fill.
+        const BaseType_t created = xTaskCreatePinnedToCore(dump_task, "black_box", dumper_stack_size, this, dumper_priority, &dumper_, APP_CPU_NUM);
+        if (created != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create the dumper; black box disabled");
+            dumper_ = nullptr;
+            free(memory_);
+            memory_ = nullptr;
+            delete[] entries_;
+            entries_ = nullptr;
+            slot_count_ = 0;
+            return false;
+        }
+        ESP_LOGI(TAG, "%u slots, %u bytes", static_cast<unsigned>(slot_count_), static_cast<unsigned>(memory_used()));
+        #endif
+        return true;
+    }
+
+
+    uint8_t* BlackBox::frame_buffer(size_t& size)
+    {
+        if (0 == slot_count_ || State::Recording != state_.load(std::memory_order_acquire))
+        {
+            size = 0;
+            return nullptr;
+        }
+
+        size = frame_size_;
+        return slot_data(head_);
+    }
+
+
+    cv::Mat1b BlackBox::mask(const bool stop)
+    {
+        if (0 == slot_count_ || State::Recording != state_.load(std::memory_order_acquire))
+        {
+            return cv::Mat1b();
+        }
+
+        uint8_t* data = slot_data(head_) + frame_size_ + (stop ? static_cast<size_t>(width_) * height_ : 0);
+        return cv::Mat1b(height_, width_, data);
+    }
+
+
+    void BlackBox::commit(const BlackBoxEntry& entry)
+    {
+        if (0 == slot_count_ || State::Recording != state_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        entries_[head_] = entry;
+        head_ = (head_ + 1 == slot_count_) ? 0 : head_ + 1;
+        if (filled_ < slot_count_)
+        {
+            filled_++;
+        }
+
+        if (trigger_ != BlackBoxTrigger::None)
+        {
+            if (frames_to_freeze_ > 0)
+            {
+                frames_to_freeze_--;
+                return;
+            }
+
+            state_.store(State::Frozen, std::memory_order_release);
+            if (dump_on_trigger_ || dump_requested_)
+            {
+                start_dump();
+            }
+        }
+    }
+
+
+    void BlackBox::trigger(const BlackBoxTrigger reason)
+    {
+        if (0 == slot_count_ || State::Recording != state_.load(std::memory_order_acquire) || trigger_ != BlackBoxTrigger::None)
+        {
+            return;
+        }
+
+        trigger_ = reason;
+        frames_to_freeze_ = (post_trigger_frames_ < slot_count_) ? post_trigger_frames_ : slot_count_ - 1;
+    }
+
+
+    void BlackBox::request_dump()
+    {
+        const State state = state_.load(std::memory_order_acquire);
+        if (0 == slot_count_ || State::Dumping == state)
+        {
+            return;
+        }
+
+        if (State::Frozen == state)
+        {
+            start_dump();
+            return;
+        }
+
+        dump_requested_ = true;
+        trigger(BlackBoxTrigger::Command);
+    }
+
+
+    void BlackBox::start_dump()
+    {
+        state_.store(State::Dumping, std::memory_order_release);
+        #ifdef ESP_PLATFORM
+        xTaskNotifyGive(dumper_);
+        #else
+        dump();
+        #endif
+    }
+
+
+    void BlackBox::dump()
+    {
+        printf("BBOXSTART %u %u\n", static_cast<unsigned>(trigger_), static_cast<unsigned>(filled_));
+
+        const uint16_t first = (filled_ < slot_count_) ? 0 : head_;
+        for (uint16_t i = 0; i < filled_; i++)
+        {
+            const uint16_t slot = (first + i) % slot_count_;
+            const BlackBoxEntry& entry = entries_[slot];
+            const FrameRecordInfo& info = entry.info;
+
+            printf("BBOX seq=%lu t=%lld mode=%u dist=%d slope=%.3f stop=%u level=%u frame=%lu",
+                static_cast<unsigned long>(info.sequence),
+                static_cast<long long>(info.timestamp_us),
+                static_cast<unsigned>(info.capture_mode),
+                static_cast<int>(info.outside_dist),
+                static_cast<double>(info.outside_slope),
+                static_cast<unsigned>(info.stop_detected),
+                static_cast<unsigned>(entry.level),
+                static_cast<unsigned long>(entry.frame_us));
+            for (uint8_t stage = 0; stage < static_cast<uint8_t>(Stage::Count); stage++)
+            {
+                printf(" %lu", static_cast<unsigned long>(entry.stage_us[stage]));
+            }
+            printf("\n");
+
+            // Grayscale frames are a byte a pixel; everything else two.
+            uint8_t* data = slot_data(slot);
+            const int frame_type = (static_cast<uint8_t>(CaptureMode::Grayscale) == info.capture_mode) ? CV_8UC1 : CV_8UC2;
+            debug::send_matrix(cv::Mat(info.height, info.width, frame_type, data));
+            debug::send_matrix(cv::Mat1b(info.height, info.width, data + frame_size_));
+            if (entry.stop_mask_valid)
+            {
+                debug::send_matrix(cv::Mat1b(info.height, info.width, data + frame_size_ + static_cast<size_t>(width_) * height_));
+            }
+        }
+
+        printf("BBOXEND\n");
+        fflush(stdout);
+
+        // Re-arm.
+        head_ = 0;
+        filled_ = 0;
+        trigger_ = BlackBoxTrigger::None;
+        dump_requested_ = false;
+        state_.store(State::Recording, std::memory_order_release);
+    }
+
+
+    #ifdef ESP_PLATFORM
+    void BlackBox::dump_task(void* self_p)
+    {
+        auto self = static_cast<BlackBox*>(self_p);
+        while (true)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            ESP_LOGI(TAG, "Dumping %u frames", static_cast<unsigned>(self->filled_));
+            self->dump();
+        }
+    }
+    #endif
+}
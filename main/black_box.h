@@ -0,0 +1,184 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// An always-on "black box" of the last few seconds of frames, masks, stage timings and outputs,
+/// held in a ring in PSRAM, for working out after the fact why the car missed a stop line or
+/// left the lane.
+///
+/// Frames aren't copied a second time for the box. get_frame() has to byte-swap (or, for YUV and
+/// grayscale, copy) each frame out of the camera's buffer anyway, and it does so straight into the
+/// next slot; the detectors write their masks into the slot's own, and committing a frame is then
+/// just filling in its entry.
+///
+/// When triggered, the box records a few more frames and then freezes. Its contents are dumped
+/// over the serial port in the background, in the same format as debug::send_matrix(), and it is
+/// re-armed once the dump finishes. The serial port is also the controller's, and a dump takes
+/// tens of minutes at its rate, so unless the box is told to dump on every trigger (e.g. in
+/// calibration mode, where the controller isn't listening), a frozen box holds its frames until
+/// a dump is asked for.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#include "frame_recorder.h"
+#include "frame_scheduler.h"
+
+namespace lane_detect
+{
+    /// @brief Why the black box was triggered.
+    enum class BlackBoxTrigger : uint8_t
+    {
+        None,
+        Command,        ///< The controller asked.
+        StopDetected,   ///< The stop line was just detected.
+        Overrun,        ///< A frame ran over its latency budget.
+    };
+
+
+    /// @brief What is recorded about each frame, besides its pixels and masks.
+    struct BlackBoxEntry
+    {
+        /// @brief The frame's time, size, capture mode and outputs.
+        FrameRecordInfo info;
+
+        /// @brief How long each stage took on this frame, in microseconds. 0 if it didn't run.
+        uint32_t stage_us[static_cast<uint8_t>(Stage::Count)];
+
+        /// @brief How long the whole frame took, in microseconds.
+        uint32_t frame_us;
+
+        /// @brief The scheduler's QualityLevel.
+        uint8_t level;
+
+        /// @brief Whether stop detection ran this frame, so that the stop mask is this frame's.
+        bool stop_mask_valid;
+    };
+
+
+    /// @brief A ring of the most recent frames.
+    class BlackBox
+    {
+        public:
+        /// @param memory_budget The most PSRAM to use, in bytes. The number of slots follows from
+        /// this and the frame size.
+        /// @param post_trigger_frames How many frames to keep recording after a trigger, so that
+        /// the dump shows what followed as well as what led up to it.
+        /// @param dump_on_trigger Whether to dump as soon as the box freezes, whatever triggered
+        /// it, rather than holding the frames until request_dump().
+        BlackBox(size_t memory_budget, uint16_t post_trigger_frames, bool dump_on_trigger);
+        ~BlackBox();
+
+        BlackBox(const BlackBox&) = delete;
+        BlackBox& operator=(const BlackBox&) = delete;
+
+        /// @brief Allocates the ring. Call once, before use.
+        /// @param width The frame width.
+        /// @param height The frame height.
+        /// @return False if there was no memory for at least two slots, or the dumper couldn't
+        /// be started; the black box then records nothing.
+        bool allocate(uint16_t width, uint16_t height);
+
+        /// @brief Gets the buffer the next frame should be moved into.
+        /// @param size The size of the buffer, in bytes. Output param.
+        /// @return The buffer, or nullptr while frozen or dumping (or unallocated), in which case the frame
+        /// should be left where it is.
+        uint8_t* frame_buffer(size_t& size);
+
+        /// @brief Gets the next slot's mask for a detector to write into.
+        /// @param stop Whether the stop mask, rather than the outside-line mask.
+        /// @return The mask, or an empty matrix while frozen or dumping.
+        cv::Mat1b mask(bool stop);
+
+        /// @brief Fills in the next slot's entry and moves on. Does nothing while frozen or dumping.
+        /// @param entry The entry.
+        void commit(const BlackBoxEntry& entry);
+
+        /// @brief Triggers the box. Ignored if it is already triggered.
+        /// @param reason Why.
+        void trigger(BlackBoxTrigger reason);
+
+        /// @brief Dumps the box: at once if it is frozen, else once it freezes, triggering it if
+        /// it hasn't been. Ignored while dumping.
+        void request_dump();
+
+        /// @brief Whether a dump is going out over the serial port, which nothing else should
+        /// write to meanwhile.
+        bool dumping() const { return State::Dumping == state_.load(std::memory_order_acquire); }
+
+        /// @brief Whether a dump is going out, or has been asked for and will go out once the box
+        /// freezes.
+        bool dump_pending() const { return dumping() || dump_requested_; }
+
+        /// @brief The number of slots.
+        uint16_t slot_count() const { return slot_count_; }
+
+        /// @brief The PSRAM used, in bytes.
+        size_t memory_used() const { return slot_count_ * slot_size_; }
+
+        private:
+        /// @brief Where the box is between triggers.
+        enum class State : uint8_t
+        {
+            Recording,  ///< Taking frames; triggered or not.
+            Frozen,     ///< Holding its frames for a dump.
+            Dumping,    ///< Being dumped, by the dumper task.
+        };
+
+        /// @brief Starts the dump of a frozen box.
+        void start_dump();
+
+        /// @brief The pixels of one slot; the frame, then the two masks.
+        uint8_t* slot_data(uint16_t slot) const { return memory_ + static_cast<size_t>(slot) * slot_size_; }
+
+        /// @brief Sends every slot, oldest first, then re-arms.
+        void dump();
+
+        size_t memory_budget_;
+        uint16_t post_trigger_frames_;
+        bool dump_on_trigger_;
+        uint16_t width_;
+        uint16_t height_;
+        size_t frame_size_;
+        size_t slot_size_;
+        uint16_t slot_count_;
+        uint8_t* memory_;
+        BlackBoxEntry* entries_;
+
+        /// @brief The slot the next frame goes in.
+        uint16_t head_;
+
+        /// @brief The number of slots which hold a frame.
+        uint16_t filled_;
+
+        BlackBoxTrigger trigger_;
+        uint16_t frames_to_freeze_;
+
+        /// @brief Whether a dump was asked for before the box froze.
+        bool dump_requested_;
+
+        /// @brief Only the main task moves the box out of Recording and Frozen, and only the
+        /// dumper out of Dumping, so this is the only state shared with the dumper; the rest is
+        /// handed back and forth with it.
+        std::atomic<State> state_;
+
+        #ifdef ESP_PLATFORM
+        /// @brief Waits for the box to freeze, and dumps it.
+        static void dump_task(void* self_p);
+
+        TaskHandle_t dumper_;
+        #endif
+    };
+}
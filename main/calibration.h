@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The calibration which the detectors run against: colors, cropping and area limits, as set in
+/// the Python debugging tool.
+///
+/// The detectors are templates over where the calibration comes from. FixedCalibration bakes it
+/// in at compile time, so the compiler may fold the values it can see where the detectors are
+/// inlined; the thresholding and cropping take a line's calibration by reference, so little is
+/// folded in practice. RuntimeCalibration holds it in memory, so that it can be tuned live.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#include "pixel_kernels.h"
+
+namespace lane_detect
+{
+    /// @brief The most extra classes, beyond the outside and stop lines. The class map has room
+    /// for eight classes; must match MAX_EXTRA_CLASSES in gen_params.py.
+    constexpr uint8_t MAX_EXTRA_CLASSES = 6;
+
+
+    /// @brief The calibration of one line detector.
+    struct LineCalibration
+    {
+        /// @brief The lower bound of the line's color, in OpenCV's 8-bit HSV.
+        uint8_t hsv_low[3];
+
+        /// @brief The upper bound of the line's color, in OpenCV's 8-bit HSV.
+        uint8_t hsv_high[3];
+
+        /// @brief The bounds of the line's color, in YUV.
+        kernels::YuvBounds yuv;
+
+        /// @brief The bounds of the line's luma, for grayscale frames. Empty (low above high) if
+        /// the line can't be told from the floor by luma.
+        uint8_t luma_low;
+        uint8_t luma_high;
+
+        /// @brief The number of pixels cropped off each side of the frame before detecting.
+        uint16_t crop_top;
+        uint16_t crop_bottom;
+        uint16_t crop_left;
+        uint16_t crop_right;
+
+        /// @brief The least area (in pixels) which counts as a detection.
+        uint32_t min_area;
+
+        /// @brief The line's bit in a class map (see class_table.h).
+        uint8_t class_bit;
+    };
+
+
+    /// @brief The calibration of the whole pipeline, in pixels of the capture resolution.
+    struct Calibration
+    {
+        /// @brief The outside (solid white) line.
+        LineCalibration outside;
+
+        /// @brief The stop (red) line.
+        LineCalibration stop;
+
+        /// @brief The column the outside line should be at.
+        uint16_t line_pos;
+
+        /// @brief The row the stop line is detected at, and how far from it counts.
+        uint16_t stop_row;
+        uint16_t stop_radius;
+
+        /// @brief Any other classes, each detected as a blob (e.g. a yellow center line). Only
+        /// the first extra_count are in use.
+        LineCalibration extra[MAX_EXTRA_CLASSES];
+        uint8_t extra_count;
+    };
+
+
+    /// @brief Builds the class map table for grayscale frames, from the lines' luma bounds.
+    /// @param calibration The calibration.
+    /// @param classes The class bits of each luma value. Output param.
+    inline void build_luma_classes(const Calibration& calibration, uint8_t classes[256])
+    {
+        for (int luma = 0; luma < 256; luma++)
+        {
+            const auto bit = [luma](const LineCalibration& line)
+            {
+                return (luma >= line.luma_low && luma <= line.luma_high) ? line.class_bit : 0;
+            };
+
+            uint8_t bits = bit(calibration.outside) | bit(calibration.stop);
+            for (uint8_t index = 0; index < calibration.extra_count; index++)
+            {
+                bits |= bit(calibration.extra[index]);
+            }
+            classes[luma] = bits;
+        }
+    }
+
+
+    /// @brief A calibration known at compile time.
+    /// @tparam Values The calibration. Must be a constexpr object with static storage.
+    template <const Calibration& Values>
+    struct FixedCalibration
+    {
+        /// @brief The calibration.
+        static constexpr const Calibration& values = Values;
+    };
+
+
+    /// @brief A calibration which may change while running.
+    struct RuntimeCalibration
+    {
+        /// @brief The calibration.
+        Calibration values;
+    };
+}
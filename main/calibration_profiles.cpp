@@ -0,0 +1,159 @@
+#include "calibration_profiles.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#ifdef ESP_PLATFORM
+#include "nvs.h"
+#include "nvs_flash.h"
+#endif
+
+
+namespace lane_detect
+{
+    static const char TAG[] = "calibration_profiles";
+
+    // The NVS namespace the profiles are stored under.
+    static const char NVS_NAMESPACE[] = "calibration";
+
+
+    CalibrationProfiles::CalibrationProfiles(const uint16_t frame_width, const uint16_t frame_height, const uint32_t params_checksum):
+        frame_width_(frame_width),
+        frame_height_(frame_height),
+        params_checksum_(params_checksum)
+    {
+        memset(profiles_, 0, sizeof(profiles_));
+    }
+
+
+    #ifdef ESP_PLATFORM
+    void CalibrationProfiles::load(const GeneratedProfile (&generated)[PROFILE_COUNT], const uint16_t generated_width, const uint16_t generated_height)
+    {
+        // The partition may be blank, or left over from an older IDF.
+        esp_err_t err = nvs_flash_init();
+        if (ESP_ERR_NVS_NO_FREE_PAGES == err || ESP_ERR_NVS_NEW_VERSION_FOUND == err)
+        {
+            nvs_flash_erase();
+            err = nvs_flash_init();
+        }
+
+        nvs_handle_t handle = 0;
+        if (ESP_OK == err)
+        {
+            err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+        }
+
+        // A bit per slot which must be seeded. ESP_ERR_NVS_NOT_FOUND is a namespace which has
+        // never been written, and leaves every one of them set.
+        uint8_t stale = (1 << PROFILE_COUNT) - 1;
+        if (ESP_OK == err)
+        {
+            for (uint8_t slot = 0; slot < PROFILE_COUNT; slot++)
+            {
+                StoredProfile stored;
+                size_t size = sizeof(stored);
+
+                // ESP_ERR_NVS_INVALID_LENGTH (a blob of another size) is caught by the size check.
+                const ProfileStatus status = (ESP_OK == nvs_get_blob(handle, PROFILE_NAMES[slot], &stored, &size))
+                    ? read_profile(&stored, size, slot, params_checksum_, frame_width_, frame_height_, profiles_[slot])
+                    : ProfileStatus::WrongSize;
+                if (ProfileStatus::Ok == status)
+                {
+                    stale &= ~(1 << slot);
+                }
+                else
+                {
+                    ESP_LOGW(TAG, "Profile '%s' is missing, stale or from another calibration (%d); seeding it", PROFILE_NAMES[slot], static_cast<int>(status));
+                }
+            }
+            nvs_close(handle);
+        }
+        else if (err != ESP_ERR_NVS_NOT_FOUND)
+        {
+            ESP_LOGE(TAG, "Can't open NVS (%s); using the generated profiles", esp_err_to_name(err));
+        }
+
+        for (uint8_t slot = 0; slot < PROFILE_COUNT; slot++)
+        {
+            if (0 == (stale & (1 << slot)))
+            {
+                continue;
+            }
+
+            const Calibration calibration = rescale_calibration(generated[slot].calibration, generated_width, generated_height, frame_width_, frame_height_);
+            err = save(slot, calibration, slot);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Can't save profile '%s' (%s); it is only in RAM", PROFILE_NAMES[slot], esp_err_to_name(err));
+            }
+        }
+    }
+
+
+    esp_err_t CalibrationProfiles::save(const uint8_t slot, const Calibration& calibration, const uint8_t class_table)
+    {
+        if (slot >= PROFILE_COUNT)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        profiles_[slot] = make_profile(slot, params_checksum_, calibration, frame_width_, frame_height_, class_table);
+
+        nvs_handle_t handle = 0;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        err = nvs_set_blob(handle, PROFILE_NAMES[slot], &profiles_[slot], sizeof(StoredProfile));
+        if (ESP_OK == err)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+        return err;
+    }
+    #else
+    void CalibrationProfiles::load(const GeneratedProfile (&generated)[PROFILE_COUNT], const uint16_t generated_width, const uint16_t generated_height)
+    {
+        // Off-device there is no NVS; every profile starts as generated.
+        for (uint8_t slot = 0; slot < PROFILE_COUNT; slot++)
+        {
+            save(slot, rescale_calibration(generated[slot].calibration, generated_width, generated_height, frame_width_, frame_height_), slot);
+        }
+    }
+
+
+    esp_err_t CalibrationProfiles::save(const uint8_t slot, const Calibration& calibration, const uint8_t class_table)
+    {
+        if (slot >= PROFILE_COUNT)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        profiles_[slot] = make_profile(slot, params_checksum_, calibration, frame_width_, frame_height_, class_table);
+        return ESP_OK;
+    }
+    #endif
+
+
+    bool CalibrationProfiles::select(const uint8_t slot, RuntimeCalibration& calibration, ProfileDerived& derived) const
+    {
+        if (slot >= PROFILE_COUNT)
+        {
+            return false;
+        }
+
+        calibration.values = profiles_[slot].calibration;
+        derived = profiles_[slot].derived;
+        return true;
+    }
+
+
+    const StoredProfile& CalibrationProfiles::profile(const uint8_t slot) const
+    {
+        return profiles_[slot];
+    }
+}
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Named calibration profiles (e.g. indoor, outdoor, dim), persisted in the NVS partition.
+///
+/// Each profile is stored as one NVS blob in the layout of profile_format.h. The profiles are
+/// seeded from the ones gen_params.py generates (see generated_profiles.h), and reseeded whenever
+/// the build's calibration changes. All profiles are read into RAM at boot; switching between them
+/// is then a copy, cheap enough to do between two frames.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "calibration.h"
+#include "generated_profiles.h"
+#include "profile_format.h"
+
+namespace lane_detect
+{
+    /// @brief The calibration profiles, held in RAM.
+    class CalibrationProfiles
+    {
+        public:
+        /// @param frame_width The frame width the pipeline captures at.
+        /// @param frame_height The frame height the pipeline captures at.
+        /// @param params_checksum The params_checksum of this build.
+        CalibrationProfiles(uint16_t frame_width, uint16_t frame_height, uint32_t params_checksum);
+
+        /// @brief Reads every profile from NVS. Slots which are empty, or hold a profile of
+        /// another version or calibration, are saved from the generated profiles. Call once at
+        /// boot.
+        /// @param generated The generated profiles, by slot.
+        /// @param generated_width The frame width the generated profiles are in pixels of.
+        /// @param generated_height The frame height the generated profiles are in pixels of.
+        void load(const GeneratedProfile (&generated)[PROFILE_COUNT], uint16_t generated_width, uint16_t generated_height);
+
+        /// @brief Writes a calibration into a slot, in RAM and in NVS, with what is derived from
+        /// it. Slow (it writes flash); not for use between frames.
+        /// @param slot The slot.
+        /// @param calibration The calibration, in pixels of the capture frame size.
+        /// @param class_table The slot of the generated profile whose class table classifies for
+        /// the calibration's colors, or NO_CLASS_TABLE.
+        /// @return The NVS error, if any.
+        esp_err_t save(uint8_t slot, const Calibration& calibration, uint8_t class_table);
+
+        /// @brief Switches a runtime calibration to a profile.
+        /// @param slot The profile's slot.
+        /// @param calibration The calibration to overwrite.
+        /// @param derived What is derived from the calibration. Overwritten.
+        /// @return False if there is no such slot.
+        bool select(uint8_t slot, RuntimeCalibration& calibration, ProfileDerived& derived) const;
+
+        /// @brief Gets a profile.
+        /// @param slot The slot. Must be less than PROFILE_COUNT.
+        /// @return The profile.
+        const StoredProfile& profile(uint8_t slot) const;
+
+        private:
+        uint16_t frame_width_;
+        uint16_t frame_height_;
+        uint32_t params_checksum_;
+        StoredProfile profiles_[PROFILE_COUNT];
+    };
+}
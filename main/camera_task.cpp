@@ -1,6 +1,7 @@
 #include "camera_task.h"
 
 #include <stdint.h>
+#include <string.h>
 
 
 #include "freertos/FreeRTOS.h"
@@ -17,6 +18,8 @@
 
 #include "thread_safe_queue.h"
 #include "common.h"
+#include "parallel_rows.h"
+#include "pixel_kernels.h"
 
 
 const char TAG[] = "camera_task";
@@ -47,9 +50,15 @@ const char TAG[] = "camera_task";
 
 namespace lane_detect
 {
+    // The frame size the camera was last configured with, so that it can be restarted at it.
+    static framesize_t configured_frame_size = FRAMESIZE_96X96;
+
+
     /// @brief Configures the ESP-32-CAM.
-    void config_cam()
+    void config_cam(const CaptureMode mode, const framesize_t frame_size)
     {
+        configured_frame_size = frame_size;
+
         camera_config_t config;
         config.ledc_channel = LEDC_CHANNEL_0;
         config.ledc_timer = LEDC_TIMER_0;
@@ -70,8 +79,19 @@ namespace lane_detect
         config.pin_pwdn = PWDN_GPIO_NUM;
         config.pin_reset = RESET_GPIO_NUM;
         config.xclk_freq_hz = 20000000;
-        config.pixel_format = PIXFORMAT_RGB565; 
-        config.frame_size = FRAMESIZE_96X96;
+        switch (mode)
+        {
+            case CaptureMode::Yuv422:
+                config.pixel_format = PIXFORMAT_YUV422;
+                break;
+            case CaptureMode::Grayscale:
+                config.pixel_format = PIXFORMAT_GRAYSCALE;
+                break;
+            default:
+                config.pixel_format = PIXFORMAT_RGB565;
+                break;
+        }
+        config.frame_size = frame_size;
         config.jpeg_quality = 12;
         config.fb_count = 1;
 
@@ -84,12 +104,34 @@ namespace lane_detect
     }
 
 
+    void set_capture_mode(const CaptureMode mode, camera_fb_t** fb_p)
+    {
+        // The driver won't deinit while a frame buffer is still checked out.
+        if (*fb_p != nullptr)
+        {
+            esp_camera_fb_return(*fb_p);
+            *fb_p = nullptr;
+        }
+
+        esp_camera_deinit();
+        config_cam(mode, configured_frame_size);
+    }
+
+
     cv::Mat get_frame(camera_fb_t** fb_p)
+    {
+        int64_t capture_us = 0;
+        return get_frame(fb_p, nullptr, 0, capture_us);
+    }
+
+
+    cv::Mat get_frame(camera_fb_t** fb_p, uint8_t* dst, const size_t dst_size, int64_t& capture_us)
     {
         // If a previous picture has been taken, give the frame-buffer back.
         if (*fb_p != nullptr)
         {
             esp_camera_fb_return(*fb_p);
+            *fb_p = nullptr;
         }
 
         // Take the picture.
@@ -100,20 +142,34 @@ namespace lane_detect
             return cv::Mat();
         }
 
+        capture_us = static_cast<int64_t>(fb->timestamp.tv_sec) * 1000000 + fb->timestamp.tv_usec;
+
         // Build the OpenCV matrix.
-        // CV_8UC2 is two-channel color, with 8-bit channels.
-        auto result = cv::Mat(fb->height, fb->width, CV_8UC2, fb->buf);
+        // CV_8UC2 is two-channel color, with 8-bit channels. Grayscale is a single channel.
+        const int type = (PIXFORMAT_GRAYSCALE == fb->format) ? CV_8UC1 : CV_8UC2;
+        const bool move = (dst != nullptr && fb->len <= dst_size);
+        auto result = cv::Mat(fb->height, fb->width, type, move ? dst : fb->buf);
 
-        // Flip the bytes of the matrix so that it can be processed using OpenCV functions.
-        for (auto row = 0; row < result.rows; row++)
+        if (PIXFORMAT_RGB565 == fb->format)
         {
-            for (auto col = 0; col < result.cols; col++)
+            // Flip the bytes of the matrix so that it can be processed using OpenCV functions.
+            const uint8_t* src = fb->buf;
+            parallel_for_rows(cv::Range(0, result.rows), [&](const cv::Range& rows)
             {
-                auto& pixel = result.at<cv::Vec2b>(row, col);
-                const auto temp = pixel[0];
-                pixel[0] = pixel[1];
-                pixel[1] = temp;
-            }
+                const size_t offset = static_cast<size_t>(rows.start) * result.step;
+                kernels::swap_bytes_16(src + offset, result.data + offset, rows.size() * result.cols);
+            });
+        }
+        else if (move)
+        {
+            // YUV and grayscale are thresholded as the camera delivers them.
+            memcpy(dst, fb->buf, fb->len);
+        }
+
+        if (move)
+        {
+            esp_camera_fb_return(fb);
+            *fb_p = nullptr;
         }
 
         return result;
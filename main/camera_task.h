@@ -14,15 +14,74 @@
 
 namespace lane_detect
 {
+    /// @brief The pixel formats the pipeline can capture in.
+    enum class CaptureMode : uint8_t
+    {
+        Rgb565,     ///< Byte-swapped for OpenCV, then converted to HSV for thresholding.
+        Yuv422,     ///< Thresholded directly on luma and chroma, with no conversion.
+        Grayscale,  ///< Luma only, at one byte per pixel. Only the outside line can be detected.
+    };
+
+
+    /// @brief Gets the camera frame size for a frame geometry.
+    /// @param width The width of the frame, in pixels.
+    /// @param height The height of the frame, in pixels.
+    /// @return The frame size, or FRAMESIZE_INVALID if the camera has no such size.
+    constexpr framesize_t frame_size_for(const uint16_t width, const uint16_t height)
+    {
+        return (96 == width && 96 == height) ? FRAMESIZE_96X96
+            : (160 == width && 120 == height) ? FRAMESIZE_QQVGA
+            : (320 == width && 240 == height) ? FRAMESIZE_QVGA
+            : FRAMESIZE_INVALID;
+    }
+
+
+    /// @brief Gets the time between frames from the sensor at a frame size, as config_cam() sets
+    /// it up. The OV2640 runs every size up to CIF in its CIF mode, which at the 20 MHz XCLK
+    /// gives 25 frames a second.
+    /// @param frame_size The frame size.
+    /// @return The frame period, in microseconds, or 0 for a size the pipeline doesn't capture at.
+    constexpr uint32_t frame_period_for(const framesize_t frame_size)
+    {
+        return (FRAMESIZE_96X96 == frame_size || FRAMESIZE_QQVGA == frame_size || FRAMESIZE_QVGA == frame_size) ? 40000 : 0;
+    }
+
+
     /// @brief Configures the ESP-32-CAM.
-    void config_cam();
+    /// @param mode The pixel format to capture in.
+    /// @param frame_size The frame size to capture at.
+    void config_cam(CaptureMode mode = CaptureMode::Rgb565, framesize_t frame_size = FRAMESIZE_96X96);
+
+
+    /// @brief Switches the camera to a different capture mode, without rebooting. The camera is
+    /// restarted at the frame size it was last configured with, so this takes a few frames' worth
+    /// of time.
+    /// @param mode The pixel format to capture in.
+    /// @param fb The frame buffer currently held, if any. It is returned to the camera first, and
+    /// set to nullptr.
+    void set_capture_mode(CaptureMode mode, camera_fb_t** fb);
 
 
     /// @brief Gets a frame from the ESP-32 camera and interprets it as an OpenCV matrix.
     /// @param fb The frame buffer. If this is not nullptr, this will be freed back to the ESP-32
     /// cam prior to overwriting. Note that this pointer ought to be freed before it ever
     /// goes out of scope.
-    /// @param mat The matrix into which the frame is read. Note that the data from `fb` was not
-    /// copied; just the reference. So if fb is freed this Mat is invalidated.
+    /// @return The frame, depending on the capture mode: a CV_8UC2 matrix of RGB565 (byte-swapped
+    /// for OpenCV) or packed YUV422, or a CV_8UC1 matrix of luma. Note that the data from `fb` was not copied; just the
+    /// reference. So if fb is freed this Mat is invalidated.
     cv::Mat get_frame(camera_fb_t** fb);
+
+
+    /// @brief Gets a frame from the ESP-32 camera, moving it into a buffer of the caller's. The
+    /// move is folded into the byte swap RGB565 needs anyway, and the camera gets its buffer back
+    /// straight away.
+    /// @param fb The frame buffer. As with get_frame(), any held buffer is returned first. Left
+    /// as nullptr.
+    /// @param dst The buffer to move the frame into.
+    /// @param dst_size The size of dst, in bytes. If the frame doesn't fit, it is left in the
+    /// camera's buffer, as with get_frame().
+    /// @param capture_us When the driver stamped the frame, at its VSYNC, per esp_timer. Output
+    /// param.
+    /// @return The frame, as with get_frame(), but over dst when it fit.
+    cv::Mat get_frame(camera_fb_t** fb, uint8_t* dst, size_t dst_size, int64_t& capture_us);
 }
\ No newline at end of file
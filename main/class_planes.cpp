@@ -0,0 +1,104 @@
+#include "class_planes.h"
+
+#include <string.h>
+
+#include "parallel_rows.h"
+
+
+namespace lane_detect
+{
+    /// @brief Transposes an 8x8 bit matrix held a row per byte: afterwards bit j of byte i is
+    /// what bit i of byte j was. Three rounds of swapping blocks across the diagonal.
+    static inline uint64_t transpose_8x8(uint64_t x)
+    {
+        uint64_t t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull;
+        x ^= t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull;
+        x ^= t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull;
+        x ^= t ^ (t << 28);
+        return x;
+    }
+
+
+    ClassPlanes::ClassPlanes():
+        rows_(0),
+        cols_(0),
+        words_per_row_(0)
+    {
+    }
+
+
+    void ClassPlanes::create(const uint16_t rows, const uint16_t cols)
+    {
+        if (rows != rows_ || cols != cols_)
+        {
+            rows_ = rows;
+            cols_ = cols;
+            words_per_row_ = static_cast<uint16_t>((cols + 31) >> 5);
+            for (std::vector<uint32_t>& plane : planes_)
+            {
+                plane.assign(static_cast<size_t>(words_per_row_) * rows, 0);
+            }
+        }
+    }
+
+
+    void ClassPlanes::split_row(const uint8_t* src, const uint16_t row)
+    {
+        const uint32_t first = static_cast<uint32_t>(row) * words_per_row_;
+        for (uint16_t word = 0; word < words_per_row_; word++)
+        {
+            // Each group of eight pixels is loaded little-endian, so that pixel i is byte i;
+            // transposed, byte c is then class c's bits for the eight pixels, pixel i at bit i.
+            // Pixels past the frame's edge load as no class.
+            uint32_t packed[MAX_CLASSES] = {};
+            for (uint8_t group = 0; group < 4; group++)
+            {
+                const int col = (word << 5) + (group << 3);
+                uint64_t bytes = 0;
+                if (col + 8 <= cols_)
+                {
+                    memcpy(&bytes, src + col, sizeof(bytes));
+                }
+                else if (col < cols_)
+                {
+                    memcpy(&bytes, src + col, cols_ - col);
+                }
+
+                // Most of a frame is no class at all.
+                if (0 == bytes)
+                {
+                    continue;
+                }
+
+                const uint64_t classes = transpose_8x8(bytes);
+                for (uint8_t index = 0; index < MAX_CLASSES; index++)
+                {
+                    packed[index] |= static_cast<uint32_t>((classes >> (index << 3)) & 0xff) << (group << 3);
+                }
+            }
+
+            for (uint8_t index = 0; index < MAX_CLASSES; index++)
+            {
+                planes_[index][first + word] = packed[index];
+            }
+        }
+    }
+
+
+    void ClassPlanes::split(const cv::Mat1b& class_map, const uint16_t first_row, const uint16_t end_row)
+    {
+        create(static_cast<uint16_t>(class_map.rows), static_cast<uint16_t>(class_map.cols));
+        CV_Assert(first_row <= end_row && end_row <= rows_);
+
+        // Each row has its own words in every plane, so the halves never touch.
+        parallel_for_rows(cv::Range(first_row, end_row), [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; row++)
+            {
+                split_row(class_map.ptr<uint8_t>(row), static_cast<uint16_t>(row));
+            }
+        });
+    }
+}
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Splits a class map into one packed bit plane per class, in a single pass.
+///
+/// A class map holds up to eight classes a pixel, one per bit, each looked up once per pixel (see
+/// class_table.h). Rather than thresholding the map once per class, every class is split out at
+/// once: eight pixels' class bytes are loaded as one 64-bit word, and transposing it as an 8x8 bit
+/// matrix gives a byte of eight pixel bits for each class. The cost is the same however many
+/// classes are in use; each class's detector then takes its region from its plane (see
+/// BitMask::extract).
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+namespace lane_detect
+{
+    /// @brief The most classes a class map can hold.
+    constexpr uint8_t MAX_CLASSES = 8;
+
+
+    /// @brief A class map, split into a bit plane per class. Bit i of a row's word w is column
+    /// 32w + i. Bits past the right edge of the frame are always clear.
+    class ClassPlanes
+    {
+        public:
+        ClassPlanes();
+
+        /// @brief Sizes the planes. Only allocates if the size has changed, so calling this at
+        /// start-up keeps split() from allocating.
+        /// @param rows The number of rows in the class maps to come.
+        /// @param cols The number of columns.
+        void create(uint16_t rows, uint16_t cols);
+
+        /// @brief Splits some rows of a class map into the planes, a row at a time across both
+        /// cores. Rows outside the range are left as they were.
+        /// @param class_map The class map. Any rows other than those split may be stale.
+        /// @param first_row The first row to split.
+        /// @param end_row One past the last row to split.
+        void split(const cv::Mat1b& class_map, uint16_t first_row, uint16_t end_row);
+
+        /// @param index The class's index: the index of its bit in the class map.
+        /// @param row The row.
+        /// @return The packed words of a row of a class's plane.
+        const uint32_t* row(uint8_t index, uint16_t row) const { return &planes_[index][static_cast<uint32_t>(row) * words_per_row_]; }
+
+        /// @return The number of words in each row.
+        uint16_t words_per_row() const { return words_per_row_; }
+
+        /// @return The number of rows.
+        uint16_t rows() const { return rows_; }
+
+        /// @return The number of columns.
+        uint16_t cols() const { return cols_; }
+
+        private:
+        /// @brief Splits one row.
+        void split_row(const uint8_t* src, uint16_t row);
+
+        uint16_t rows_;
+        uint16_t cols_;
+        uint16_t words_per_row_;
+
+        /// @brief One plane per class.
+        std::vector<uint32_t> planes_[MAX_CLASSES];
+    };
+}
@@ -0,0 +1,23 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The RGB565 class table, generated at build time by gen_params.py from the debugger settings.
+/// It lives in flash, so nothing is built at boot.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lane_detect
+{
+    /// @brief The number of entries in the class table: one per RGB565 pixel.
+    constexpr size_t RGB565_CLASS_TABLE_SIZE = 1 << 16;
+
+    /// @brief For every little-endian RGB565 pixel, the class bits (see outside_class_bit,
+    /// stop_class_bit and extra_class_bits in params.h) of the classes whose HSV thresholds it
+    /// falls within. Looking a pixel up here gives the same answer as converting it to HSV and
+    /// thresholding.
+    extern const uint8_t rgb565_class_table[RGB565_CLASS_TABLE_SIZE];
+}
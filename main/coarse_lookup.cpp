@@ -0,0 +1,205 @@
+#include "coarse_lookup.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "parallel_rows.h"
+
+
+namespace lane_detect
+{
+    CoarseLookup::CoarseLookup(const uint8_t shift):
+        shift_(shift),
+        rows_(0),
+        cols_(0)
+    {
+    }
+
+
+    void CoarseLookup::create(const uint16_t rows, const uint16_t cols)
+    {
+        if (rows != rows_ || cols != cols_)
+        {
+            rows_ = rows;
+            cols_ = cols;
+            const int step = 1 << shift_;
+            cells_.create((rows + step - 1) >> shift_, (cols + step - 1) >> shift_);
+        }
+        cell_runs_.create(static_cast<uint16_t>(cells_.rows), static_cast<uint16_t>(cells_.cols));
+    }
+
+
+    /// @brief Samples the middle of each cell along a row: the first and last are taken at the
+    /// nearest pixel within the region, and the rest a cell apart.
+    template <typename Pixel>
+    static inline void sample_cells(const Pixel* pixels, const uint8_t* table, const int shift, const int first_col, const int end_col, const int first_cell_col, const int end_cell_col, uint8_t* cells)
+    {
+        const int half = (1 << shift) >> 1;
+        const auto clamped = [&](const int cell_col)
+        {
+            return table[pixels[std::min(std::max((cell_col << shift) + half, first_col), end_col - 1)]];
+        };
+
+        cells[first_cell_col] = clamped(first_cell_col);
+        const Pixel* pixel = pixels + ((first_cell_col + 1) << shift) + half;
+        for (int cell_col = first_cell_col + 1; cell_col < end_cell_col - 1; cell_col++, pixel += 1 << shift)
+        {
+            cells[cell_col] = table[*pixel];
+        }
+        cells[end_cell_col - 1] = clamped(end_cell_col - 1);
+    }
+
+
+    int CoarseLookup::sample_row_of(const int cell_row, const cv::Rect2i& roi, const int first_cell_row, const int end_cell_row) const
+    {
+        // The first and last are at the region's edges, so that every row lies between two.
+        if (cell_row == first_cell_row)
+        {
+            return roi.y;
+        }
+        if (cell_row == end_cell_row - 1)
+        {
+            return roi.y + roi.height - 1;
+        }
+        return (cell_row << shift_) + ((1 << shift_) >> 1);
+    }
+
+
+    void CoarseLookup::sample_row(const cv::Mat& src, const uint8_t* table, const cv::Rect2i& roi, const int cell_row, const int first_cell_row, const int end_cell_row, const int first_cell_col, const int end_cell_col)
+    {
+        const int row = sample_row_of(cell_row, roi, first_cell_row, end_cell_row);
+        uint8_t* cells = cells_.ptr<uint8_t>(cell_row);
+        if (CV_8UC2 == src.type())
+        {
+            sample_cells(src.ptr<uint16_t>(row), table, shift_, roi.x, roi.x + roi.width, first_cell_col, end_cell_col, cells);
+        }
+        else
+        {
+            sample_cells(src.ptr<uint8_t>(row), table, shift_, roi.x, roi.x + roi.width, first_cell_col, end_cell_col, cells);
+        }
+        cell_runs_.encode_row(static_cast<uint16_t>(cell_row), cells, static_cast<uint16_t>(first_cell_col), static_cast<uint16_t>(end_cell_col));
+    }
+
+
+    void CoarseLookup::refine_row(const cv::Mat& src, const uint8_t* table, const cv::Rect2i& roi, const int row, const int first_cell_row, const int end_cell_row, cv::Mat1b& dst) const
+    {
+        uint8_t* out = dst.ptr<uint8_t>(row);
+        const bool wide = (CV_8UC2 == src.type());
+        const int half = (1 << shift_) >> 1;
+        const int end_col = roi.x + roi.width;
+
+        // Looks up a span, clearing the gap since the last one.
+        int cleared_to = 0;
+        const auto look_up = [&](const int start, const int end)
+        {
+            memset(out + cleared_to, 0, start - cleared_to);
+            if (wide)
+            {
+                kernels::lookup_16(src.ptr<uint16_t>(row) + start, table, out + start, end - start);
+            }
+            else
+            {
+                kernels::lookup_8(src.ptr<uint8_t>(row) + start, table, out + start, end - start);
+            }
+            cleared_to = end;
+        };
+
+        // Anything on this row which was sampled at all was sampled on one of the two sampled
+        // rows either side of it, and reaches at most up to the next sample along. So the runs
+        // of those two rows' cells, widened to the samples either side of them, cover it. They
+        // are merged in order of their starts, so that overlapping spans are looked up once.
+        const int above = std::max(std::min((row - half) >> shift_, end_cell_row - 2), first_cell_row);
+        const Run* lists[2];
+        uint8_t counts[2];
+        uint8_t next[2] = {};
+        uint8_t list_count = 0;
+        for (int neighbour = above; neighbour <= std::min(above + 1, end_cell_row - 1); neighbour++)
+        {
+            lists[list_count] = cell_runs_.row_runs(static_cast<uint16_t>(neighbour));
+            counts[list_count] = cell_runs_.row_run_count(static_cast<uint16_t>(neighbour));
+            list_count++;
+        }
+
+        int span_start = -1;
+        int span_end = -1;
+        while (true)
+        {
+            int best = -1;
+            for (uint8_t list = 0; list < list_count; list++)
+            {
+                if (next[list] < counts[list] && (best < 0 || lists[list][next[list]].start < lists[best][next[best]].start))
+                {
+                    best = list;
+                }
+            }
+            if (best < 0)
+            {
+                break;
+            }
+
+            const Run& run = lists[best][next[best]++];
+            const int start = std::max((run.start << shift_) - half + 1, roi.x);
+            const int end = std::min((run.end << shift_) + half, end_col);
+            if (start <= span_end)
+            {
+                span_end = std::max(span_end, end);
+                continue;
+            }
+            if (span_start >= 0)
+            {
+                look_up(span_start, span_end);
+            }
+            span_start = start;
+            span_end = end;
+        }
+        if (span_start >= 0)
+        {
+            look_up(span_start, span_end);
+        }
+        memset(out + cleared_to, 0, cols_ - cleared_to);
+    }
+
+
+    void CoarseLookup::lookup(const cv::Mat& src, const uint8_t* table, const cv::Rect2i& roi, cv::Mat1b& dst)
+    {
+        CV_Assert(CV_8UC2 == src.type() || CV_8UC1 == src.type());
+        create(static_cast<uint16_t>(src.rows), static_cast<uint16_t>(src.cols));
+        dst.create(src.rows, src.cols);
+
+        const cv::Rect2i clipped = roi & cv::Rect2i(0, 0, cols_, rows_);
+        if (clipped.empty())
+        {
+            dst.setTo(0);
+            return;
+        }
+
+        // Each row has its own cells and run slots, so the halves never touch.
+        const int step = 1 << shift_;
+        const int first_cell_row = clipped.y >> shift_;
+        const int end_cell_row = (clipped.y + clipped.height + step - 1) >> shift_;
+        const int first_cell_col = clipped.x >> shift_;
+        const int end_cell_col = (clipped.x + clipped.width + step - 1) >> shift_;
+        parallel_for_rows(cv::Range(first_cell_row, end_cell_row), [&](const cv::Range& range)
+        {
+            for (int cell_row = range.start; cell_row < range.end; cell_row++)
+            {
+                sample_row(src, table, clipped, cell_row, first_cell_row, end_cell_row, first_cell_col, end_cell_col);
+            }
+        });
+
+        parallel_for_rows(cv::Range(0, rows_), [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; row++)
+            {
+                if (row < clipped.y || row >= clipped.y + clipped.height)
+                {
+                    memset(dst.ptr<uint8_t>(row), 0, cols_);
+                }
+                else
+                {
+                    refine_row(src, table, clipped, row, first_cell_row, end_cell_row, dst);
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Classifies a frame through a lookup table coarse-to-fine, so that only the parts of the frame
+/// near something of interest are classified in full.
+///
+/// Most of a frame is floor. A first pass looks up one pixel in each 2^shift x 2^shift cell and
+/// encodes the cells which hit any class as runs (see RleMask). The second pass then looks up, on
+/// each row, only the columns under the runs of the sampled rows either side of it, widened to the
+/// samples either side, so that the whole of anything that was hit is covered; the rest of the
+/// class map is cleared. The first pass costs 4^-shift of a full lookup, and the second only
+/// scales with how much of the frame is of interest, so the saving grows with the resolution.
+/// Anything which falls between the samples, i.e. narrower than the cell, may be missed
+/// altogether.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+#include "rle_mask.h"
+
+namespace lane_detect
+{
+    /// @brief Classifies frames coarse-to-fine through a lookup table.
+    class CoarseLookup
+    {
+        public:
+        /// @param shift The size of a cell, as a power of two: 1 samples every second pixel of
+        /// every second row, 2 every fourth.
+        explicit CoarseLookup(uint8_t shift);
+
+        /// @brief Sizes the coarse pass's buffers. Only allocates if the size has changed, so
+        /// calling this at start-up keeps lookup() from allocating.
+        /// @param rows The number of rows in the frames to come.
+        /// @param cols The number of columns.
+        void create(uint16_t rows, uint16_t cols);
+
+        /// @brief Looks a region of a frame up in a table, as parallel_lookup does, but only near
+        /// where the coarse pass found a nonzero entry. Both passes run across both cores.
+        /// @param src The frame: CV_8UC2 (looked up as native-endian 16-bit pixels, in a
+        /// 65536-entry table) or CV_8UC1 (in a 256-entry table).
+        /// @param table The table. A looked-up value of 0 is taken as nothing of interest.
+        /// @param roi The region to look up. Everything outside it is cleared.
+        /// @param dst The looked-up values. Output param.
+        void lookup(const cv::Mat& src, const uint8_t* table, const cv::Rect2i& roi, cv::Mat1b& dst);
+
+        /// @return The cells the last lookup's coarse pass hit, as runs of cells.
+        const RleMask& cells() const { return cell_runs_; }
+
+        private:
+        /// @brief Gets the row a row of cells is sampled on.
+        int sample_row_of(int cell_row, const cv::Rect2i& roi, int first_cell_row, int end_cell_row) const;
+
+        /// @brief Looks up one sampled pixel per cell on a row of cells, and encodes the hits.
+        void sample_row(const cv::Mat& src, const uint8_t* table, const cv::Rect2i& roi, int cell_row, int first_cell_row, int end_cell_row, int first_cell_col, int end_cell_col);
+
+        /// @brief Looks up one row of the frame in full, under the runs of the cells around it.
+        void refine_row(const cv::Mat& src, const uint8_t* table, const cv::Rect2i& roi, int row, int first_cell_row, int end_cell_row, cv::Mat1b& dst) const;
+
+        uint8_t shift_;
+        uint16_t rows_;
+        uint16_t cols_;
+
+        /// @brief The sampled entries, a byte per cell.
+        cv::Mat1b cells_;
+
+        /// @brief The cells which hit.
+        RleMask cell_runs_;
+    };
+}
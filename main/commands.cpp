@@ -0,0 +1,82 @@
+#include "commands.h"
+
+#include "driver/uart.h"
+
+
+namespace lane_detect
+{
+    // The byte which ends a command.
+    constexpr char COMMAND_END = 'E';
+
+
+    CommandReader::CommandReader(const int uart_num):
+        uart_num_(uart_num),
+        code_(0),
+        arg_(0),
+        negative_(false)
+    {
+    }
+
+
+    bool CommandReader::poll(Command& command)
+    {
+        char byte;
+        while (uart_read_bytes(uart_num_, &byte, 1, 0) == 1)
+        {
+            if (feed(byte, command))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    bool CommandReader::feed(const char byte, Command& command)
+    {
+        // Waiting for a command letter. Anything else (line endings, noise) is skipped.
+        if (0 == code_)
+        {
+            if (byte >= 'A' && byte <= 'Z' && byte != COMMAND_END)
+            {
+                code_ = byte;
+                arg_ = 0;
+                negative_ = false;
+            }
+            return false;
+        }
+
+        // An argument too large for an int32_t is malformed; the command is dropped, and the rest
+        // of its digits skipped, rather than wrapping around to some other argument.
+        if (byte >= '0' && byte <= '9')
+        {
+            const int32_t digit = byte - '0';
+            if (arg_ > (INT32_MAX - digit) / 10)
+            {
+                code_ = 0;
+                return false;
+            }
+            arg_ = arg_ * 10 + digit;
+            return false;
+        }
+
+        if ('-' == byte && 0 == arg_)
+        {
+            negative_ = true;
+            return false;
+        }
+
+        if (COMMAND_END == byte)
+        {
+            command.code = code_;
+            command.arg = negative_ ? -arg_ : arg_;
+            code_ = 0;
+            return true;
+        }
+
+        // A malformed command; drop it. If this byte is itself a letter, start over with it.
+        code_ = 0;
+        return feed(byte, command);
+    }
+}
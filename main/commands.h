@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Reads commands sent to the ESP-32 over the control UART. Commands are framed the same way as
+/// the control output: a single letter, an optional decimal argument, and an 'E'. For example,
+/// "M2E" is command 'M' with argument 2.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+namespace lane_detect
+{
+    /// @brief The command letters which are understood.
+    namespace command_code
+    {
+        /// @brief Switches the capture mode. The argument is a CaptureMode.
+        constexpr char CAPTURE_MODE = 'M';
+
+        /// @brief Switches the calibration profile. The argument is the profile's slot, below
+        /// PROFILE_COUNT; others are ignored.
+        constexpr char PROFILE = 'P';
+
+        /// @brief Starts or stops the frame recorder. The argument is how many frames to record
+        /// one of, or 0 to stop.
+        constexpr char RECORD = 'R';
+
+        /// @brief Dumps the black box over the serial port: what it froze on its last trigger, or
+        /// else the last few seconds. Line messages stop until the dump is done, which takes tens
+        /// of minutes, so stop the car first. The argument is ignored.
+        constexpr char BLACK_BOX = 'B';
+
+        /// @brief Prints the latency histograms and dropped-frame count over the serial port. Line
+        /// messages stop until it is sent. The argument is ignored.
+        constexpr char LATENCY = 'L';
+
+        /// @brief Prints each stage's heap allocations and the high-water marks over the serial
+        /// port. Line messages stop until it is sent. The argument is ignored.
+        constexpr char HEAP = 'H';
+
+        /// @brief Switches how the outside line is found. The argument is an OutsideDetector.
+        constexpr char OUTSIDE_DETECTOR = 'O';
+    }
+
+
+    /// @brief A command received over the UART.
+    struct Command
+    {
+        /// @brief The command letter.
+        char code;
+
+        /// @brief The command's argument. 0 if none was given.
+        int32_t arg;
+    };
+
+
+    /// @brief Accumulates bytes from the UART into commands, without ever blocking.
+    class CommandReader
+    {
+        public:
+        /// @param uart_num The UART to read from. Its driver must already be installed.
+        explicit CommandReader(int uart_num);
+
+        /// @brief Reads whatever bytes are waiting, and returns the first complete command.
+        /// Call once per frame; any further commands are returned on later calls.
+        /// @param command The command. Output param.
+        /// @return Whether a command was read.
+        bool poll(Command& command);
+
+        /// @brief Feeds one byte to the parser. Exposed so that the parser can be driven without
+        /// a UART.
+        /// @param byte The byte.
+        /// @param command The command, if this byte completed one. Output param.
+        /// @return Whether a command was completed.
+        bool feed(char byte, Command& command);
+
+        private:
+        int uart_num_;
+        char code_;
+        int32_t arg_;
+        bool negative_;
+    };
+}
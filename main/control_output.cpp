@@ -0,0 +1,155 @@
+#include "control_output.h"
+
+#include <algorithm>
+
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+
+namespace lane_detect
+{
+    static const char TAG[] = "control_output";
+
+    // The sender preempts the pipeline, and its row workers, so that messages go out on time; it
+    // only ever runs for the length of one prediction and one write.
+    constexpr UBaseType_t sender_priority = 6;
+    constexpr uint32_t sender_stack_size = 3072;
+
+
+    ControlOutput::ControlOutput(const int uart_num, const uint32_t baud, const TickType_t period_ticks, const Formatter formatter):
+        uart_num_(uart_num),
+        baud_(baud),
+        period_ticks_(period_ticks),
+        formatter_(formatter),
+        lock_(xSemaphoreCreateMutex()),
+        estimator_(),
+        frame_(),
+        published_(false),
+        held_(false),
+        next_send_us_(0),
+        wire_us_(MAX_CONTROL_MESSAGE_LENGTH * 10 * 1000000 / baud),
+        sender_(nullptr)
+    {
+        if (nullptr == lock_)
+        {
+            ESP_LOGE(TAG, "Failed to create the control output lock");
+        }
+    }
+
+
+    ControlOutput::~ControlOutput()
+    {
+        if (sender_ != nullptr)
+        {
+            vTaskDelete(sender_);
+        }
+        if (lock_ != nullptr)
+        {
+            vSemaphoreDelete(lock_);
+        }
+    }
+
+
+    bool ControlOutput::start()
+    {
+        if (sender_ != nullptr)
+        {
+            return true;
+        }
+        if (nullptr == lock_)
+        {
+            return false;
+        }
+
+        const BaseType_t created = xTaskCreatePinnedToCore(sender_task, "control_output", sender_stack_size, this, sender_priority, &sender_, PRO_CPU_NUM);
+        if (created != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create the control sender; sending once per frame");
+            sender_ = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+
+    int64_t ControlOutput::publish(const LineStateEstimator& estimator, const ControlFrame& frame)
+    {
+        if (nullptr == lock_)
+        {
+            return esp_timer_get_time();
+        }
+
+        xSemaphoreTake(lock_, portMAX_DELAY);
+        estimator_ = estimator;
+        frame_ = frame;
+        published_ = true;
+        xSemaphoreGive(lock_);
+
+        // Without a sender, each frame sends its own message, straight away.
+        if (nullptr == sender_)
+        {
+            send();
+            return esp_timer_get_time() + wire_us_;
+        }
+
+        xSemaphoreTake(lock_, portMAX_DELAY);
+        const int64_t reaches_us = std::max(next_send_us_, esp_timer_get_time()) + wire_us_;
+        xSemaphoreGive(lock_);
+        return reaches_us;
+    }
+
+
+    void ControlOutput::hold(const bool held)
+    {
+        if (nullptr == lock_)
+        {
+            return;
+        }
+
+        // Taking the lock waits out a message being written.
+        xSemaphoreTake(lock_, portMAX_DELAY);
+        held_ = held;
+        xSemaphoreGive(lock_);
+    }
+
+
+    bool ControlOutput::held() const
+    {
+        return held_;
+    }
+
+
+    void ControlOutput::sender_task(void* self_p)
+    {
+        ControlOutput* const self = static_cast<ControlOutput*>(self_p);
+        TickType_t wake_ticks = xTaskGetTickCount();
+        while (true)
+        {
+            vTaskDelayUntil(&wake_ticks, self->period_ticks_);
+            self->send();
+        }
+    }
+
+
+    void ControlOutput::send()
+    {
+        char message[MAX_CONTROL_MESSAGE_LENGTH];
+
+        // The time is taken under the lock, so it is never before the published estimator's.
+        xSemaphoreTake(lock_, portMAX_DELAY);
+        const TickType_t now_ticks = xTaskGetTickCount();
+        next_send_us_ = esp_timer_get_time() + period_ticks_ * portTICK_PERIOD_MS * 1000;
+        if (published_ && !held_)
+        {
+            const int length = formatter_(estimator_.predict_to(now_ticks), frame_, message, sizeof(message));
+            const size_t written = static_cast<size_t>(std::clamp<int>(length, 0, sizeof(message) - 1));
+
+            // With no TX buffer, the write returns once the bytes are in the FIFO; they reach the
+            // controller one frame time (ten bits each) later.
+            uart_write_bytes(uart_num_, message, written);
+            wire_us_ = written * 10 * 1000000 / baud_;
+        }
+        xSemaphoreGive(lock_);
+    }
+}
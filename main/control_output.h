@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Sends the control messages to the controller at a fixed rate, rather than once per frame.
+///
+/// After each frame the main loop publishes the line estimator and what else the frame found; a
+/// task of its own then sends, once every period, the estimator's prediction for that moment. So
+/// the controller hears from the car at a steady rate however long frames take, and its messages
+/// keep moving between frames rather than holding the last frame's offset until the next.
+///
+/// What goes in a message (the ground mapping, the extra classes) belongs to the pipeline, so
+/// messages are written by a formatter it supplies.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "state_estimator.h"
+
+namespace lane_detect
+{
+    /// @brief The longest control message, in bytes.
+    constexpr size_t MAX_CONTROL_MESSAGE_LENGTH = 48;
+
+
+    /// @brief What a frame found, besides the line estimate, for the control messages. Held until
+    /// the next frame.
+    struct ControlFrame
+    {
+        /// @brief The calibrated column of the outside line, which the estimate's offset is from.
+        int16_t line_pos;
+
+        /// @brief The row the outside line was last seen at.
+        float line_row;
+
+        /// @brief The outside line's curvature where it was last seen.
+        float curvature;
+
+        /// @brief How far the frame's detection can be trusted, from 0 to 100.
+        uint8_t confidence;
+
+        /// @brief The number of extra classes calibrated.
+        uint8_t extra_count;
+
+        /// @brief Bit i is set while extra class i is detected.
+        uint8_t extra_detected;
+    };
+
+
+    /// @brief Sends the control messages.
+    class ControlOutput
+    {
+        public:
+        /// @brief Writes a control message.
+        /// @param estimate The line estimate, predicted to when the message is sent.
+        /// @param frame What the latest frame found.
+        /// @param message Where to write the message.
+        /// @param size The space at message; at least MAX_CONTROL_MESSAGE_LENGTH.
+        /// @return The length of the message.
+        using Formatter = int (*)(const LaneEstimate& estimate, const ControlFrame& frame, char* message, size_t size);
+
+        /// @param uart_num The UART to send on. Its driver must be installed.
+        /// @param baud The UART's baud rate, for how long a message takes on the wire.
+        /// @param period_ticks How often to send, in RTOS ticks. Must leave room on the wire for
+        /// the longest message.
+        /// @param formatter Writes the messages.
+        ControlOutput(int uart_num, uint32_t baud, TickType_t period_ticks, Formatter formatter);
+        ~ControlOutput();
+
+        ControlOutput(const ControlOutput&) = delete;
+        ControlOutput& operator=(const ControlOutput&) = delete;
+
+        /// @brief Starts the sender. Nothing is sent until the first publish().
+        /// @return False if the sender couldn't be started; each publish() then sends one message
+        /// itself, as frames used to.
+        bool start();
+
+        /// @brief Hands over the state after a frame. The sender predicts from it until the next.
+        /// @param estimator The line estimator, updated with the frame.
+        /// @param frame What else the frame found.
+        /// @return When the first message from this state will have reached the controller, in
+        /// esp_timer microseconds.
+        int64_t publish(const LineStateEstimator& estimator, const ControlFrame& frame);
+
+        /// @brief Stops or resumes sending. Once this returns holding, no message is being
+        /// written, so something else may have the UART.
+        void hold(bool held);
+
+        /// @brief Whether sending is held.
+        bool held() const;
+
+        private:
+        /// @brief Sends once every period.
+        static void sender_task(void* self_p);
+
+        /// @brief Sends the message for now, unless held or nothing is published yet.
+        void send();
+
+        int uart_num_;
+        uint32_t baud_;
+        TickType_t period_ticks_;
+        Formatter formatter_;
+
+        /// @brief Guards everything below.
+        SemaphoreHandle_t lock_;
+        LineStateEstimator estimator_;
+        ControlFrame frame_;
+        bool published_;
+        bool held_;
+
+        /// @brief When the sender will next wake, in esp_timer microseconds; 0 before it first has.
+        int64_t next_send_us_;
+
+        /// @brief How long the last message took on the wire.
+        uint32_t wire_us_;
+
+        TaskHandle_t sender_;
+    };
+}
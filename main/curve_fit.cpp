@@ -0,0 +1,72 @@
+#include "curve_fit.h"
+
+#include <string.h>
+
+
+namespace lane_detect
+{
+    // The determinant of the normal equations, over the total weight cubed, below which the
+    // points are taken to span too few rows. Points spread evenly over a span of s (in scaled
+    // rows, the whole frame being 2) give s^6 / 2160, so this asks for about a fifth of the frame.
+    constexpr float MIN_SPREAD = 1e-6f;
+
+
+    CurveFitter::CurveFitter(const uint16_t rows):
+        origin_row_(0.5f * (rows - 1)),
+        row_scale_(2.0f / rows)
+    {
+        clear();
+    }
+
+
+    void CurveFitter::clear()
+    {
+        memset(row_sums_, 0, sizeof(row_sums_));
+        memset(col_sums_, 0, sizeof(col_sums_));
+    }
+
+
+    void CurveFitter::add_point(const float col, const float row, const float weight)
+    {
+        const float t = (row - origin_row_) * row_scale_;
+        const float t2 = t * t;
+        row_sums_[0] += weight;
+        row_sums_[1] += weight * t;
+        row_sums_[2] += weight * t2;
+        row_sums_[3] += weight * t2 * t;
+        row_sums_[4] += weight * t2 * t2;
+        col_sums_[0] += weight * col;
+        col_sums_[1] += weight * col * t;
+        col_sums_[2] += weight * col * t2;
+    }
+
+
+    bool CurveFitter::fit(CurveFit& fit) const
+    {
+        // The normal equations' matrix is symmetric, with s[i + j] at (i, j). It is inverted by
+        // its cofactors, of which only six are distinct.
+        const float* s = row_sums_;
+        const float* r = col_sums_;
+        const float c00 = s[2] * s[4] - s[3] * s[3];
+        const float c01 = s[2] * s[3] - s[1] * s[4];
+        const float c02 = s[1] * s[3] - s[2] * s[2];
+        const float c11 = s[0] * s[4] - s[2] * s[2];
+        const float c12 = s[1] * s[2] - s[0] * s[3];
+        const float c22 = s[0] * s[2] - s[1] * s[1];
+        const float det = s[0] * c00 + s[1] * c01 + s[2] * c02;
+        if (s[0] <= 0.0f || det <= MIN_SPREAD * s[0] * s[0] * s[0])
+        {
+            return false;
+        }
+
+        // Back from scaled rows to pixels.
+        const float a = (c00 * r[0] + c01 * r[1] + c02 * r[2]) / det;
+        const float b = (c01 * r[0] + c11 * r[1] + c12 * r[2]) / det;
+        const float c = (c02 * r[0] + c12 * r[1] + c22 * r[2]) / det;
+        fit.origin_row = origin_row_;
+        fit.col = a;
+        fit.gradient = b * row_scale_;
+        fit.bend = c * row_scale_ * row_scale_;
+        return true;
+    }
+}
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Fits a quadratic curve to the outside line, giving its curvature as well as its slope.
+///
+/// The line's column is fitted as a function of its row, col = a + b*row + c*row^2, by weighted
+/// least squares. Only the sums the normal equations need are kept (sum w*row^k for k up to 4,
+/// and sum w*col*row^k for k up to 2), so points are folded in as they're found and each frame's
+/// fit is a fixed 3x3 solve, however many points there were. Rows are taken about the middle of
+/// the frame and scaled to [-1, 1], so that row^4 doesn't swamp the other sums in a float.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+namespace lane_detect
+{
+    /// @brief A curve fitted by a CurveFitter. The column at a row d rows below origin_row is
+    /// col + gradient * d + bend * d^2.
+    struct CurveFit
+    {
+        /// @brief The row the curve is taken about.
+        float origin_row;
+
+        /// @brief The column at origin_row.
+        float col;
+
+        /// @brief The change in column per row, at origin_row.
+        float gradient;
+
+        /// @brief Half the second derivative of the column by the row; the same all along.
+        float bend;
+
+        /// @param row The row.
+        /// @return The signed curvature at the row, in radians per pixel along the curve:
+        /// positive if, going up the frame, the curve bends towards higher columns.
+        float curvature(const float row) const
+        {
+            const float slope = gradient + 2.0f * bend * (row - origin_row);
+            const float stretch = 1.0f + slope * slope;
+            return 2.0f * bend / (stretch * sqrtf(stretch));
+        }
+    };
+
+
+    /// @brief Fits a quadratic curve to weighted points, from running sums.
+    class CurveFitter
+    {
+        public:
+        /// @param rows The number of rows in the frame the points come from.
+        explicit CurveFitter(uint16_t rows);
+
+        /// @brief Drops the points, for the next fit.
+        void clear();
+
+        /// @brief Adds a point.
+        /// @param col The point's column. May be fractional.
+        /// @param row The point's row.
+        /// @param weight How much the point counts, e.g. the length of the run it is the middle
+        /// of. Must be positive.
+        void add_point(float col, float row, float weight = 1.0f);
+
+        /// @brief Fits a curve to the points.
+        /// @param fit The curve. Output param. Only written on success.
+        /// @return False if the points span too few rows to tell a curve from a line.
+        bool fit(CurveFit& fit) const;
+
+        private:
+        float origin_row_;
+        float row_scale_;
+
+        /// @brief Sums of weight * t^k, and of weight * col * t^k, where t is the scaled row.
+        float row_sums_[5];
+        float col_sums_[3];
+    };
+}
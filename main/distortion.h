@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Undoes the lens's barrel distortion at single points, through a table generated at build time
+/// by gen_params.py from the debugger settings.
+///
+/// The wide lens bows straight lane lines, which skews the slopes measured from their ends and
+/// the ground points mapped from them. Rather than remapping whole frames, only the few points
+/// the detectors report are corrected: the table holds, at even steps of squared distance from
+/// the lens's center, how far a point must be scaled away from the center, so a point costs one
+/// interpolated lookup and no square root.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#include "params.h"
+
+namespace lane_detect
+{
+    /// @brief The number of intervals in the distortion table. Must match gen_params.py.
+    constexpr uint16_t DISTORTION_TABLE_INTERVALS = 64;
+
+    /// @brief The scale which undoes the distortion at each step of distortion_r2_step squared
+    /// pixels (of the calibrated frame) from the center, out to the furthest corner. All 1 if
+    /// !lens_distortion_calibrated.
+    extern const float undistort_scales[DISTORTION_TABLE_INTERVALS + 1];
+
+
+    /// @brief A point in the frame. May be fractional.
+    struct FramePoint
+    {
+        float col;
+        float row;
+    };
+
+
+    /// @brief Finds where a point would be without the lens's distortion.
+    /// @param col The column.
+    /// @param row The row.
+    /// @param width The width of the frame the point is in.
+    /// @param height The height of the frame the point is in.
+    /// @return The point, in the same frame. Undistorted points near the corners may lie outside
+    /// it.
+    inline FramePoint undistort(const float col, const float row, const uint16_t width, const uint16_t height)
+    {
+        if (!lens_distortion_calibrated)
+        {
+            return {col, row};
+        }
+
+        const float col_scale = static_cast<float>(calibration_width) / width;
+        const float row_scale = static_cast<float>(calibration_height) / height;
+        const float d_col = col * col_scale - distortion_center_col;
+        const float d_row = row * row_scale - distortion_center_row;
+
+        float position = (d_col * d_col + d_row * d_row) / distortion_r2_step;
+        if (position > DISTORTION_TABLE_INTERVALS)
+        {
+            position = DISTORTION_TABLE_INTERVALS;
+        }
+        uint16_t index = static_cast<uint16_t>(position);
+        if (index >= DISTORTION_TABLE_INTERVALS)
+        {
+            index = DISTORTION_TABLE_INTERVALS - 1;
+        }
+        const float t = position - index;
+        const float scale = undistort_scales[index] + t * (undistort_scales[index + 1] - undistort_scales[index]);
+
+        return {(distortion_center_col + d_col * scale) / col_scale, (distortion_center_row + d_row * scale) / row_scale};
+    }
+}
@@ -0,0 +1,169 @@
+#include "edge_detector.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "parallel_rows.h"
+
+
+namespace lane_detect
+{
+    /// @brief Gets the luma of a little-endian RGB565 pixel, with BT.601 weights in 8-bit fixed
+    /// point.
+    static inline uint8_t rgb565_luma(const uint16_t pixel)
+    {
+        const uint32_t r5 = pixel >> 11;
+        const uint32_t g6 = (pixel >> 5) & 0x3f;
+        const uint32_t b5 = pixel & 0x1f;
+        const uint32_t r = (r5 << 3) | (r5 >> 2);
+        const uint32_t g = (g6 << 2) | (g6 >> 4);
+        const uint32_t b = (b5 << 3) | (b5 >> 2);
+        return static_cast<uint8_t>((77 * r + 150 * g + 29 * b) >> 8);
+    }
+
+
+    EdgeDetector::EdgeDetector():
+        rows_(0),
+        cols_(0)
+    {
+    }
+
+
+    void EdgeDetector::create(const uint16_t rows, const uint16_t cols)
+    {
+        if (rows != rows_ || cols != cols_)
+        {
+            rows_ = rows;
+            cols_ = cols;
+            luma_.resize(static_cast<size_t>(rows) * cols);
+        }
+    }
+
+
+    void EdgeDetector::read_luma(const cv::Mat& frame, const LumaSource source, const int first_row, const int end_row, const int first_col, const int end_col)
+    {
+        for (int row = first_row; row < end_row; row++)
+        {
+            uint8_t* dst = &luma_[static_cast<size_t>(row) * cols_];
+            if (LumaSource::Rgb565 == source)
+            {
+                const uint16_t* src = frame.ptr<uint16_t>(row);
+                for (int col = first_col; col < end_col; col++)
+                {
+                    dst[col] = rgb565_luma(src[col]);
+                }
+            }
+            else if (LumaSource::Yuyv == source)
+            {
+                const uint8_t* src = frame.ptr<uint8_t>(row);
+                for (int col = first_col; col < end_col; col++)
+                {
+                    dst[col] = src[2 * col];
+                }
+            }
+            else
+            {
+                const uint8_t* src = frame.ptr<uint8_t>(row);
+                std::copy(src + first_col, src + end_col, dst + first_col);
+            }
+        }
+    }
+
+
+    void EdgeDetector::find_segments(const int row, const cv::Rect2i& roi, const EdgeParams& params, RleMask& runs) const
+    {
+        const uint8_t* above = &luma_[static_cast<size_t>(std::max(row - 1, 0)) * cols_];
+        const uint8_t* middle = &luma_[static_cast<size_t>(row) * cols_];
+        const uint8_t* below = &luma_[static_cast<size_t>(std::min(row + 1, rows_ - 1)) * cols_];
+
+        // The Sobel kernel smooths down the columns 1-2-1, then differences across them, so a
+        // step of one level is a response of 4. Past the frame's edges the edge pixels repeat.
+        const int first_col = std::max(roi.x - 1, 0);
+        const int last_col = std::min(roi.x + roi.width, cols_ - 1);
+        const auto column = [&](const int col)
+        {
+            const int clamped = std::min(std::max(col, first_col), last_col);
+            return above[clamped] + 2 * middle[clamped] + below[clamped];
+        };
+
+        // An edge is where the gradient peaks along the row. A neighbour of the other sign is a
+        // different edge, so it doesn't suppress this one. Of two equal neighbours the left one
+        // is kept: the last dark pixel of a rising edge, and the last bright one of a falling
+        // edge.
+        const int16_t min_response = static_cast<int16_t>(params.min_contrast) * 4;
+        const auto peaks = [](const int16_t g, const int16_t left, const int16_t right)
+        {
+            const bool rising = g > 0;
+            const int16_t left_mag = ((left > 0) == rising) ? abs(left) : 0;
+            const int16_t right_mag = ((right > 0) == rising) ? abs(right) : 0;
+            return abs(g) > left_mag && abs(g) >= right_mag;
+        };
+
+        // The column sums slide along the row, so each is taken once.
+        int here = column(roi.x);
+        int after = column(roi.x + 1);
+        int16_t previous = static_cast<int16_t>(here - column(roi.x - 2));
+        int16_t current = static_cast<int16_t>(after - column(roi.x - 1));
+
+        int rise = -1;
+        for (int col = roi.x; col < roi.x + roi.width; col++)
+        {
+            const int ahead = column(col + 2);
+            const int16_t next = static_cast<int16_t>(ahead - here);
+            if (abs(current) >= min_response && peaks(current, previous, next))
+            {
+                if (current > 0)
+                {
+                    // The nearest rising edge is the one a falling edge pairs with.
+                    rise = col;
+                }
+                else if (rise >= 0)
+                {
+                    const int width = col - rise;
+                    if (width >= params.min_width && width <= params.max_width)
+                    {
+                        runs.add_run(static_cast<uint16_t>(row), static_cast<uint16_t>(rise + 1), static_cast<uint16_t>(col + 1));
+                    }
+                    rise = -1;
+                }
+            }
+            previous = current;
+            current = next;
+            here = after;
+            after = ahead;
+        }
+    }
+
+
+    void EdgeDetector::detect(const cv::Mat& frame, const LumaSource source, const cv::Rect2i& roi, const EdgeParams& params, RleMask& runs)
+    {
+        CV_Assert((LumaSource::Gray == source) ? (CV_8UC1 == frame.type()) : (CV_8UC2 == frame.type()));
+        CV_Assert(runs.rows() == frame.rows && runs.cols() == frame.cols);
+        create(static_cast<uint16_t>(frame.rows), static_cast<uint16_t>(frame.cols));
+
+        const cv::Rect2i clipped = roi & cv::Rect2i(0, 0, cols_, rows_);
+        if (clipped.empty())
+        {
+            return;
+        }
+
+        // The kernel reaches one pixel past the region on every side.
+        const int first_row = std::max(clipped.y - 1, 0);
+        const int end_row = std::min(clipped.y + clipped.height + 1, static_cast<int>(rows_));
+        const int first_col = std::max(clipped.x - 1, 0);
+        const int end_col = std::min(clipped.x + clipped.width + 1, static_cast<int>(cols_));
+        parallel_for_rows(cv::Range(first_row, end_row), [&](const cv::Range& range)
+        {
+            read_luma(frame, source, range.start, range.end, first_col, end_col);
+        });
+
+        // Each row has its own run slots, so the halves never touch.
+        parallel_for_rows(cv::Range(clipped.y, clipped.y + clipped.height), [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; row++)
+            {
+                find_segments(row, clipped, params, runs);
+            }
+        });
+    }
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Finds bright lines on a darker floor from luma gradients, instead of color thresholds.
+///
+/// Thresholds on hue and saturation drift with the lighting, and getting to HSV costs a
+/// conversion. A lane line is brighter than the floor either side of it, whatever the lighting,
+/// so each row is searched for a rising edge followed closely by a falling one. Everything is
+/// integer: luma is taken straight from the captured pixels, the gradient is a horizontal Sobel,
+/// and edges are thinned by non-maximum suppression along the row. The segments between paired
+/// edges are written as runs, so the blob analysis downstream is the same as for thresholding.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+#include "rle_mask.h"
+
+namespace lane_detect
+{
+    /// @brief How the luma of a captured frame is read.
+    enum class LumaSource : uint8_t
+    {
+        Rgb565 = 0,     ///< Little-endian RGB565, CV_8UC2; luma is weighted from the channels.
+        Yuyv = 1,       ///< Packed YUV422, CV_8UC2; luma is every other byte.
+        Gray = 2,       ///< CV_8UC1; the pixels are luma.
+    };
+
+
+    /// @brief The ways the outside line can be found.
+    enum class OutsideDetector : uint8_t
+    {
+        Threshold = 0,  ///< Thresholded on color (or luma, in grayscale) against the calibration.
+        Edges = 1,      ///< Found between paired luma edges by an EdgeDetector.
+    };
+
+
+    /// @brief Which edges make a line.
+    struct EdgeParams
+    {
+        /// @brief The least luma step across an edge, in levels.
+        uint8_t min_contrast;
+
+        /// @brief The narrowest line, in pixels between its rising and falling edges.
+        uint8_t min_width;
+
+        /// @brief The widest line.
+        uint8_t max_width;
+    };
+
+
+    /// @brief Finds line segments between paired luma edges.
+    class EdgeDetector
+    {
+        public:
+        EdgeDetector();
+
+        /// @brief Sizes the luma plane. Only allocates if the size has changed, so calling this at
+        /// start-up keeps detect() from allocating.
+        /// @param rows The number of rows in the frames to come.
+        /// @param cols The number of columns.
+        void create(uint16_t rows, uint16_t cols);
+
+        /// @brief Finds the segments between a rising edge and the falling edge after it, in each
+        /// row of a region, a row at a time across both cores. Each segment becomes a run, from
+        /// the rising edge up to the falling one.
+        /// @param frame The captured frame.
+        /// @param source How to read the frame's luma.
+        /// @param roi The region to search. Rows outside it are left alone.
+        /// @param params Which edges make a line.
+        /// @param runs The segments, already created at the frame's size. Output param.
+        void detect(const cv::Mat& frame, LumaSource source, const cv::Rect2i& roi, const EdgeParams& params, RleMask& runs);
+
+        private:
+        /// @brief Reads the luma of some rows of the frame into the plane.
+        void read_luma(const cv::Mat& frame, LumaSource source, int first_row, int end_row, int first_col, int end_col);
+
+        /// @brief Finds the segments in one row of the region.
+        void find_segments(int row, const cv::Rect2i& roi, const EdgeParams& params, RleMask& runs) const;
+
+        uint16_t rows_;
+        uint16_t cols_;
+
+        /// @brief The luma of each pixel, a row of cols_ per row of the frame.
+        std::vector<uint8_t> luma_;
+    };
+}
@@ -0,0 +1,164 @@
+#include "fork_join.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#endif
+
+
+namespace lane_detect
+{
+    void ForkJoin::run_remote()
+    {
+        remote_error_ = nullptr;
+        try
+        {
+            remote_job_(remote_context_);
+        }
+        catch (...)
+        {
+            remote_error_ = std::current_exception();
+        }
+    }
+
+
+    #ifdef ESP_PLATFORM
+
+    static const char TAG[] = "fork_join";
+
+
+    ForkJoin::ForkJoin(const uint32_t stack_size, const uint8_t priority):
+        remote_job_(nullptr),
+        remote_context_(nullptr),
+        worker_(nullptr),
+        done_(xSemaphoreCreateBinary())
+    {
+        if (nullptr == done_)
+        {
+            ESP_LOGE(TAG, "Failed to create the fork-join semaphore");
+            return;
+        }
+
+        // The caller is assumed to be on PRO_CPU (where app_main runs), so the worker goes on the other core.
+        const BaseType_t created = xTaskCreatePinnedToCore(worker_task, "fork_join", stack_size, this, priority, &worker_, APP_CPU_NUM);
+        if (created != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create the fork-join worker");
+            worker_ = nullptr;
+        }
+    }
+
+
+    ForkJoin::~ForkJoin()
+    {
+        if (worker_ != nullptr)
+        {
+            vTaskDelete(worker_);
+        }
+        if (done_ != nullptr)
+        {
+            vSemaphoreDelete(done_);
+        }
+    }
+
+
+    void ForkJoin::worker_task(void* self_p)
+    {
+        auto self = static_cast<ForkJoin*>(self_p);
+        while (true)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            self->run_remote();
+            xSemaphoreGive(self->done_);
+        }
+    }
+
+
+    void ForkJoin::fork()
+    {
+        // Without a worker, fall back to running the job inline.
+        if (worker_ == nullptr)
+        {
+            run_remote();
+            return;
+        }
+
+        xTaskNotifyGive(worker_);
+    }
+
+
+    void ForkJoin::join()
+    {
+        if (worker_ != nullptr)
+        {
+            xSemaphoreTake(done_, portMAX_DELAY);
+        }
+    }
+
+    #else
+
+    ForkJoin::ForkJoin(const uint32_t, const uint8_t):
+        remote_job_(nullptr),
+        remote_context_(nullptr),
+        job_pending_(false),
+        job_done_(false),
+        stopping_(false)
+    {
+        worker_ = std::thread(&ForkJoin::worker_loop, this);
+    }
+
+
+    ForkJoin::~ForkJoin()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        worker_.join();
+    }
+
+
+    void ForkJoin::worker_loop()
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this]() { return job_pending_ || stopping_; });
+                if (stopping_)
+                {
+                    return;
+                }
+                job_pending_ = false;
+            }
+
+            run_remote();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                job_done_ = true;
+            }
+            cond_.notify_all();
+        }
+    }
+
+
+    void ForkJoin::fork()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_pending_ = true;
+            job_done_ = false;
+        }
+        cond_.notify_all();
+    }
+
+
+    void ForkJoin::join()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return job_done_; });
+    }
+
+    #endif
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// A fork-join facility which runs two independent jobs at once: one on the calling core, and
+/// one on a worker pinned to the other core. On the ESP-32 the worker is a FreeRTOS task on
+/// APP_CPU, woken by a task notification; it signals that the job is done through a semaphore of
+/// its own rather than by notifying the caller, so that nothing else which notifies the calling
+/// task can end a join early. Elsewhere it is a std::thread.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <exception>
+#include <type_traits>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#else
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace lane_detect
+{
+    class ForkJoin
+    {
+        public:
+        /// @brief Starts the worker.
+        /// @param stack_size The worker's stack size, in bytes. Ignored off-device.
+        /// @param priority The worker's priority. Ignored off-device.
+        explicit ForkJoin(uint32_t stack_size = 9216, uint8_t priority = 5);
+
+        ~ForkJoin();
+
+        ForkJoin(const ForkJoin&) = delete;
+        ForkJoin& operator=(const ForkJoin&) = delete;
+
+        /// @brief Runs `remote` on the worker and `local` on the calling thread, and returns once
+        /// both have finished. If either throws, the exception is rethrown here after the join.
+        /// Neither job is copied, and nothing is allocated.
+        /// @param local The job to run on the calling thread.
+        /// @param remote The job to run on the worker.
+        template <typename Local, typename Remote>
+        void run(Local&& local, Remote&& remote)
+        {
+            using RemoteJob = std::remove_reference_t<Remote>;
+            remote_job_ = [](void* context)
+            {
+                (*static_cast<RemoteJob*>(context))();
+            };
+            remote_context_ = const_cast<void*>(static_cast<const void*>(&remote));
+
+            fork();
+
+            std::exception_ptr local_error;
+            try
+            {
+                local();
+            }
+            catch (...)
+            {
+                local_error = std::current_exception();
+            }
+
+            join();
+
+            if (local_error)
+            {
+                std::rethrow_exception(local_error);
+            }
+            if (remote_error_)
+            {
+                std::rethrow_exception(remote_error_);
+            }
+        }
+
+        private:
+        /// @brief Hands the current job to the worker.
+        void fork();
+
+        /// @brief Waits for the worker to finish the current job.
+        void join();
+
+        /// @brief Runs the current job on the worker, catching anything it throws.
+        void run_remote();
+
+        void (*remote_job_)(void*);
+        void* remote_context_;
+        std::exception_ptr remote_error_;
+
+        #ifdef ESP_PLATFORM
+        static void worker_task(void* self);
+
+        TaskHandle_t worker_;
+
+        /// @brief Given by the worker when it finishes a job.
+        SemaphoreHandle_t done_;
+        #else
+        void worker_loop();
+
+        std::thread worker_;
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        bool job_pending_;
+        bool job_done_;
+        bool stopping_;
+        #endif
+    };
+}
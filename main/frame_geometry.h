@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Compile-time description of the frame size the pipeline runs at. The types used for pixel
+/// coordinates, column sums and areas are chosen from the frame size, so that small frames keep
+/// small types and large frames don't silently overflow them.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <type_traits>
+
+namespace lane_detect
+{
+    /// @brief The geometry of a frame of a given size.
+    /// @tparam Width The width of the frame, in pixels.
+    /// @tparam Height The height of the frame, in pixels.
+    template <uint16_t Width, uint16_t Height>
+    struct FrameGeometry
+    {
+        static_assert(Width > 0 && Height > 0, "A frame must have pixels");
+
+        /// @brief The width of the frame, in pixels.
+        static constexpr uint16_t width = Width;
+
+        /// @brief The height of the frame, in pixels.
+        static constexpr uint16_t height = Height;
+
+        /// @brief Holds any row or column in the frame.
+        using coord_t = std::conditional_t<(Width <= UINT8_MAX && Height <= UINT8_MAX), uint8_t, uint16_t>;
+
+        /// @brief Holds the sum of a whole column of a 0/255 mask.
+        using column_sum_t = std::conditional_t<(static_cast<uint32_t>(Height) * UINT8_MAX <= UINT16_MAX), uint16_t, uint32_t>;
+
+        /// @brief Holds any area (in pixels) within the frame.
+        using area_t = std::conditional_t<(static_cast<uint32_t>(Width) * Height <= UINT16_MAX), uint16_t, uint32_t>;
+
+        /// @brief Rescales a column from a frame of another width to this one.
+        /// @param col The column.
+        /// @param from_width The width of the frame the column was measured in.
+        /// @return The column in this frame.
+        static constexpr coord_t scale_col(const uint32_t col, const uint32_t from_width)
+        {
+            return static_cast<coord_t>(col * Width / from_width);
+        }
+
+        /// @brief Rescales a row from a frame of another height to this one.
+        /// @param row The row.
+        /// @param from_height The height of the frame the row was measured in.
+        /// @return The row in this frame.
+        static constexpr coord_t scale_row(const uint32_t row, const uint32_t from_height)
+        {
+            return static_cast<coord_t>(row * Height / from_height);
+        }
+
+        /// @brief Rescales an area from a frame of another size to this one.
+        /// @param area The area, in pixels.
+        /// @param from_width The width of the frame the area was measured in.
+        /// @param from_height The height of the frame the area was measured in.
+        /// @return The area in this frame.
+        static constexpr area_t scale_area(const uint32_t area, const uint32_t from_width, const uint32_t from_height)
+        {
+            return static_cast<area_t>(static_cast<uint64_t>(area) * Width * Height / (static_cast<uint64_t>(from_width) * from_height));
+        }
+    };
+
+
+    /// @brief The frame sizes the camera is run at.
+    using Square96 = FrameGeometry<96, 96>;
+    using Qqvga = FrameGeometry<160, 120>;
+    using Qvga = FrameGeometry<320, 240>;
+}
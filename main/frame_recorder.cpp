@@ -0,0 +1,359 @@
+#include "frame_recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#endif
+
+
+namespace lane_detect
+{
+    #ifdef ESP_PLATFORM
+    static const char TAG[] = "frame_recorder";
+
+    // The writer yields to everything in the pipeline; it only has to keep up on average.
+    constexpr UBaseType_t writer_priority = 1;
+    constexpr uint32_t writer_stack_size = 3072;
+
+
+    /// @brief Mounts the "storage" partition at /storage, formatting it if it has never been.
+    /// @return Whether it is mounted.
+    static bool mount_storage()
+    {
+        static bool mounted = false;
+        if (mounted)
+        {
+            return true;
+        }
+
+        esp_vfs_spiffs_conf_t conf = {};
+        conf.base_path = "/storage";
+        conf.partition_label = "storage";
+        conf.max_files = 2;
+        conf.format_if_mount_failed = true;
+
+        const esp_err_t err = esp_vfs_spiffs_register(&conf);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to mount storage (%s)", esp_err_to_name(err));
+            return false;
+        }
+
+        size_t total = 0;
+        size_t used = 0;
+        esp_spiffs_info(conf.partition_label, &total, &used);
+        ESP_LOGI(TAG, "Storage mounted: %u of %u bytes used", static_cast<unsigned>(used), static_cast<unsigned>(total));
+        mounted = true;
+        return true;
+    }
+    #endif
+
+
+    FrameRecorder::FrameRecorder(const char* path, const size_t batch_size, const uint8_t batch_count):
+        path_(path),
+        batch_size_(batch_size),
+        batch_count_(batch_count),
+        batches_(nullptr),
+        current_(nullptr),
+        file_(nullptr),
+        recording_(false),
+        storage_full_(false),
+        every_n_(1),
+        sequence_(0),
+        dropped_(0),
+        records_since_sync_(0)
+        #ifdef ESP_PLATFORM
+        ,
+        free_batches_(nullptr),
+        full_batches_(nullptr),
+        writer_(nullptr)
+        #endif
+    {
+    }
+
+
+    FrameRecorder::~FrameRecorder()
+    {
+        #ifdef ESP_PLATFORM
+        if (writer_ != nullptr)
+        {
+            vTaskDelete(writer_);
+        }
+        #endif
+        close_file();
+
+        if (batches_ != nullptr)
+        {
+            for (uint8_t i = 0; i < batch_count_; i++)
+            {
+                free(batches_[i].data);
+            }
+            delete[] batches_;
+        }
+    }
+
+
+    bool FrameRecorder::start(const uint8_t every_n)
+    {
+        every_n_ = (every_n > 0) ? every_n : 1;
+        if (recording_)
+        {
+            return true;
+        }
+
+        // The buffers and writer are set up on first use, so that a recorder which is never
+        // started costs nothing.
+        if (nullptr == batches_)
+        {
+            #ifdef ESP_PLATFORM
+            if (!mount_storage())
+            {
+                return false;
+            }
+            #endif
+
+            batches_ = new Batch[batch_count_];
+            for (uint8_t i = 0; i < batch_count_; i++)
+            {
+                #ifdef ESP_PLATFORM
+                batches_[i].data = static_cast<uint8_t*>(heap_caps_malloc(batch_size_, MALLOC_CAP_SPIRAM));
+                #else
+                batches_[i].data = static_cast<uint8_t*>(malloc(batch_size_));
+                #endif
+                batches_[i].used = 0;
+                if (nullptr == batches_[i].data)
+                {
+                    #ifdef ESP_PLATFORM
+                    ESP_LOGE(TAG, "No memory for the batch buffers");
+                    #endif
+                    for (uint8_t j = 0; j <= i; j++)
+                    {
+                        free(batches_[j].data);
+                    }
+                    delete[] batches_;
+                    batches_ = nullptr;
+                    return false;
+                }
+            }
+
+            #ifdef ESP_PLATFORM
+            free_batches_ = xQueueCreate(batch_count_, sizeof(Batch*));
+            full_batches_ = xQueueCreate(batch_count_ + 1, sizeof(Batch*));
+            for (uint8_t i = 0; i < batch_count_; i++)
+            {
+                Batch* batch = &batches_[i];
+                xQueueSend(free_batches_, &batch, 0);
+            }
+
+            // The pipeline's own work is mostly on PRO_CPU, so the writer goes on the other core.
+            xTaskCreatePinnedToCore(writer_task, "frame_recorder", writer_stack_size, this, writer_priority, &writer_, APP_CPU_NUM);
+            #endif
+        }
+
+        recording_ = true;
+        storage_full_.store(false, std::memory_order_relaxed);
+        records_since_sync_ = 0;
+        append_record(RecordType::Sync, RECORD_SYNC_MARKER, sizeof(RECORD_SYNC_MARKER));
+        return true;
+    }
+
+
+    void FrameRecorder::stop()
+    {
+        if (!recording_)
+        {
+            return;
+        }
+        recording_ = false;
+
+        submit_current();
+
+        #ifdef ESP_PLATFORM
+        Batch* close = nullptr;
+        xQueueSend(full_batches_, &close, portMAX_DELAY);
+        #else
+        close_file();
+        #endif
+    }
+
+
+    bool FrameRecorder::recording() const
+    {
+        return recording_;
+    }
+
+
+    void FrameRecorder::record(const cv::Mat& frame, FrameRecordInfo info)
+    {
+        if (recording_ && storage_full_.load(std::memory_order_relaxed))
+        {
+            stop();
+        }
+        if (!recording_)
+        {
+            return;
+        }
+
+        info.sequence = sequence_++;
+        if (info.sequence % every_n_ != 0)
+        {
+            return;
+        }
+
+        CV_Assert(frame.isContinuous());
+        info.width = frame.cols;
+        info.height = frame.rows;
+
+        if (records_since_sync_ >= SYNC_INTERVAL)
+        {
+            records_since_sync_ = 0;
+            append_record(RecordType::Sync, RECORD_SYNC_MARKER, sizeof(RECORD_SYNC_MARKER));
+        }
+
+        const size_t pixel_bytes = frame.total() * frame.elemSize();
+        if (!append_record(RecordType::Frame, &info, sizeof(info), frame.data, pixel_bytes))
+        {
+            dropped_++;
+            return;
+        }
+        records_since_sync_++;
+    }
+
+
+    uint32_t FrameRecorder::dropped() const
+    {
+        return dropped_;
+    }
+
+
+    bool FrameRecorder::append_record(
+        const RecordType type,
+        const void* first,
+        const size_t first_size,
+        const void* second,
+        const size_t second_size
+    )
+    {
+        const size_t size = sizeof(RecordHeader) + first_size + second_size;
+        if (size > batch_size_)
+        {
+            return false;
+        }
+
+        if (current_ != nullptr && current_->used + size > batch_size_)
+        {
+            submit_current();
+        }
+
+        if (nullptr == current_)
+        {
+            #ifdef ESP_PLATFORM
+            if (xQueueReceive(free_batches_, &current_, 0) != pdTRUE)
+            {
+                current_ = nullptr;
+                return false;
+            }
+            #else
+            current_ = &batches_[0];
+            #endif
+            current_->used = 0;
+        }
+
+        RecordHeader header;
+        header.magic = RECORD_MAGIC;
+        header.type = static_cast<uint8_t>(type);
+        header.version = RECORD_VERSION;
+        header.length = first_size + second_size;
+
+        uint8_t* out = current_->data + current_->used;
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + sizeof(header), first, first_size);
+        if (second_size > 0)
+        {
+            memcpy(out + sizeof(header) + first_size, second, second_size);
+        }
+        current_->used += size;
+        return true;
+    }
+
+
+    void FrameRecorder::submit_current()
+    {
+        if (nullptr == current_)
+        {
+            return;
+        }
+
+        Batch* batch = current_;
+        current_ = nullptr;
+
+        #ifdef ESP_PLATFORM
+        // There is always room: the queue holds every batch, plus the close message.
+        xQueueSend(full_batches_, &batch, 0);
+        #else
+        write_batch(batch);
+        #endif
+    }
+
+
+    void FrameRecorder::write_batch(Batch* batch)
+    {
+        if (nullptr == file_)
+        {
+            file_ = fopen(path_, "ab");
+        }
+
+        if (file_ != nullptr && batch->used > 0)
+        {
+            const size_t written = fwrite(batch->data, 1, batch->used, file_);
+            fflush(file_);
+            if (written != batch->used)
+            {
+                #ifdef ESP_PLATFORM
+                ESP_LOGW(TAG, "Storage is full; stopping recording");
+                #endif
+                storage_full_.store(true, std::memory_order_relaxed);
+            }
+        }
+        batch->used = 0;
+
+        #ifdef ESP_PLATFORM
+        xQueueSend(free_batches_, &batch, 0);
+        #endif
+    }
+
+
+    void FrameRecorder::close_file()
+    {
+        if (file_ != nullptr)
+        {
+            fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+
+    #ifdef ESP_PLATFORM
+    void FrameRecorder::writer_task(void* self_p)
+    {
+        auto self = static_cast<FrameRecorder*>(self_p);
+        while (true)
+        {
+            Batch* batch = nullptr;
+            xQueueReceive(self->full_batches_, &batch, portMAX_DELAY);
+            if (nullptr == batch)
+            {
+                self->close_file();
+            }
+            else
+            {
+                self->write_batch(batch);
+            }
+        }
+    }
+    #endif
+}
@@ -0,0 +1,180 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Records raw camera frames, with what was detected in them, to a log on the flash "storage"
+/// partition (SPIFFS), for replaying and benchmarking off-device. See extract_recording.py.
+///
+/// The log is a sequence of records, each a RecordHeader and a payload. Every SYNC_INTERVAL
+/// records (and at the start of each session) a sync record is written, so that a reader can
+/// find its place again after a torn or corrupted record.
+///
+/// Recording copies the frame into a batch buffer in PSRAM and returns; a background task writes
+/// whole batches to flash. If flash falls behind, frames are dropped rather than stalling the
+/// pipeline.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#endif
+
+namespace lane_detect
+{
+    /// @brief Starts every record.
+    constexpr uint16_t RECORD_MAGIC = 0x524c;
+
+    /// @brief The version of the log format.
+    constexpr uint8_t RECORD_VERSION = 1;
+
+    /// @brief The payload of a sync record.
+    constexpr uint8_t RECORD_SYNC_MARKER[8] = {'L', 'D', 'S', 'Y', 'N', 'C', '\r', '\n'};
+
+    /// @brief How many records are written between sync records.
+    constexpr uint8_t SYNC_INTERVAL = 16;
+
+
+    /// @brief The kinds of record.
+    enum class RecordType : uint8_t
+    {
+        Sync,   ///< Payload is RECORD_SYNC_MARKER.
+        Frame,  ///< Payload is a FrameRecordInfo, then the frame's pixels, row by row.
+    };
+
+
+    /// @brief Precedes every record. All fields are little-endian.
+    struct RecordHeader
+    {
+        uint16_t magic;
+        uint8_t type;
+        uint8_t version;
+
+        /// @brief The length of the payload which follows, in bytes.
+        uint32_t length;
+    };
+    static_assert(8 == sizeof(RecordHeader), "The log format depends on this layout");
+
+
+    /// @brief Describes a recorded frame, and what was detected in it.
+    struct FrameRecordInfo
+    {
+        /// @brief When the frame was captured, per esp_timer.
+        int64_t timestamp_us;
+
+        /// @brief Counts every frame offered to the recorder, so dropped frames show as gaps.
+        uint32_t sequence;
+
+        uint16_t width;
+        uint16_t height;
+
+        /// @brief The CaptureMode, which says how to interpret the pixels.
+        uint8_t capture_mode;
+
+        uint8_t stop_detected;
+
+        /// @brief What was sent to the controller.
+        int16_t outside_dist;
+
+        float outside_slope;
+    };
+    static_assert(24 == sizeof(FrameRecordInfo), "The log format depends on this layout");
+
+
+    /// @brief Records frames to a log file.
+    class FrameRecorder
+    {
+        public:
+        /// @param path The file to append to, e.g. "/storage/recording.bin".
+        /// @param batch_size The size of each batch buffer. Frames larger than this (with their
+        /// header) can't be recorded.
+        /// @param batch_count The number of batch buffers.
+        explicit FrameRecorder(const char* path, size_t batch_size = 160 * 1024, uint8_t batch_count = 2);
+        ~FrameRecorder();
+
+        FrameRecorder(const FrameRecorder&) = delete;
+        FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+        /// @brief Starts recording. Mounts the storage partition and starts the writer, the
+        /// first time.
+        /// @param every_n Records one frame in this many.
+        /// @return False if storage or the buffers aren't available.
+        bool start(uint8_t every_n = 1);
+
+        /// @brief Stops recording. Whatever is batched is written out, in the background.
+        void stop();
+
+        /// @brief Whether recording.
+        bool recording() const;
+
+        /// @brief Offers a frame to the recorder. Never waits on flash. If the writer has found
+        /// the storage full, recording is stopped here instead.
+        /// @param frame The frame, as captured (after any byte swapping). Must be continuous.
+        /// @param info What was detected. The sequence number is filled in here.
+        void record(const cv::Mat& frame, FrameRecordInfo info);
+
+        /// @brief The number of frames which were to be recorded, but had no room.
+        uint32_t dropped() const;
+
+        private:
+        /// @brief A buffer of records, waiting to be written or being filled.
+        struct Batch
+        {
+            uint8_t* data;
+            size_t used;
+        };
+
+        /// @brief Appends a record to the current batch, handing it off and taking a fresh one
+        /// if it doesn't fit.
+        /// @return False if there was no room.
+        bool append_record(RecordType type, const void* first, size_t first_size, const void* second = nullptr, size_t second_size = 0);
+
+        /// @brief Hands the current batch to the writer, if it has anything in it.
+        void submit_current();
+
+        /// @brief Writes a batch to the file, opening it if needed. Returns the batch to the
+        /// free list.
+        void write_batch(Batch* batch);
+
+        /// @brief Flushes and closes the file.
+        void close_file();
+
+        const char* path_;
+        size_t batch_size_;
+        uint8_t batch_count_;
+        Batch* batches_;
+        Batch* current_;
+        FILE* file_;
+
+        /// @brief Only touched by the task which records.
+        bool recording_;
+
+        /// @brief Set by the writer when storage fills up; the recording task stops when it
+        /// sees it, so that the file is closed the usual way.
+        std::atomic<bool> storage_full_;
+        uint8_t every_n_;
+        uint32_t sequence_;
+        uint32_t dropped_;
+        uint8_t records_since_sync_;
+
+        #ifdef ESP_PLATFORM
+        /// @brief Writes batches as they are handed off. A null batch means "close the file".
+        static void writer_task(void* self_p);
+
+        QueueHandle_t free_batches_;
+        QueueHandle_t full_batches_;
+        TaskHandle_t writer_;
+        #endif
+    };
+}
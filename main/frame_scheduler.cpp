@@ -0,0 +1,195 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+
+
+namespace lane_detect
+{
+    // Costs are smoothed as ema += (sample - ema) / 2^EMA_SHIFT.
+    constexpr uint8_t EMA_SHIFT = 3;
+
+    // How many frames after a downgrade the smoothed frame cost is left to settle before it can
+    // cause another. Only a jump past twice the budget downgrades again meanwhile.
+    constexpr uint8_t SETTLE_FRAMES = 4;
+
+
+    const char* stage_name(const Stage stage)
+    {
+        static const char* const names[static_cast<uint8_t>(Stage::Count)] = {
+            "convert", "outside", "stop", "display", "uart"
+        };
+        return (stage < Stage::Count) ? names[static_cast<uint8_t>(stage)] : "?";
+    }
+
+
+    /// @brief Folds a sample into an exponential moving average. An average of 0 is taken to
+    /// mean "no samples yet," and is replaced outright.
+    static uint32_t ema_update(const uint32_t ema, const uint32_t sample)
+    {
+        if (0 == ema)
+        {
+            return sample;
+        }
+
+        const int32_t delta = static_cast<int32_t>(sample) - static_cast<int32_t>(ema);
+        return static_cast<uint32_t>(static_cast<int32_t>(ema) + (delta >> EMA_SHIFT));
+    }
+
+
+    FrameScheduler::FrameScheduler(const uint32_t budget_us, const uint8_t stop_every_n, const uint8_t restore_after):
+        budget_us_(budget_us),
+        stop_every_n_(std::max<uint8_t>(1, stop_every_n)),
+        restore_after_(restore_after),
+        level_(QualityLevel::Full),
+        plan_(),
+        frame_index_(0),
+        frame_cost_us_(0),
+        stage_ema_us_(),
+        outside_full_ema_us_(0),
+        outside_shrunk_ema_us_(0),
+        outside_scanline_ema_us_(0),
+        frame_ema_us_(0),
+        settle_frames_(0),
+        headroom_frames_(0),
+        level_frames_()
+    {
+    }
+
+
+    FramePlan FrameScheduler::plan_frame()
+    {
+        plan_.level = level_;
+        plan_.run_display = level_ < QualityLevel::SkipDisplay;
+        plan_.run_stop_detection = level_ < QualityLevel::DecimateStop || 0 == (frame_index_ % stop_every_n_);
+        plan_.shrink_roi = level_ >= QualityLevel::ShrinkRoi;
+        plan_.scanline_mode = level_ >= QualityLevel::Scanline;
+
+        frame_cost_us_ = 0;
+        level_frames_[static_cast<uint8_t>(level_)]++;
+        frame_index_++;
+
+        return plan_;
+    }
+
+
+    void FrameScheduler::record_stage(const Stage stage, const uint32_t cost_us, const bool on_critical_path)
+    {
+        auto& ema = stage_ema_us_[static_cast<uint8_t>(stage)];
+        ema = ema_update(ema, cost_us);
+        if (on_critical_path)
+        {
+            frame_cost_us_ += cost_us;
+        }
+
+        if (Stage::OutsideDetect == stage)
+        {
+            if (plan_.scanline_mode)
+            {
+                outside_scanline_ema_us_ = ema_update(outside_scanline_ema_us_, cost_us);
+            }
+            else if (plan_.shrink_roi)
+            {
+                outside_shrunk_ema_us_ = ema_update(outside_shrunk_ema_us_, cost_us);
+            }
+            else
+            {
+                outside_full_ema_us_ = ema_update(outside_full_ema_us_, cost_us);
+            }
+        }
+    }
+
+
+    void FrameScheduler::end_frame()
+    {
+        frame_ema_us_ = ema_update(frame_ema_us_, frame_cost_us_);
+        if (settle_frames_ > 0)
+        {
+            settle_frames_--;
+        }
+
+        // Over budget: shed the next piece of work straight away. The smoothed cost is used so
+        // that a single slow frame doesn't cause a downgrade, but the raw cost is also checked so
+        // that a sudden large jump is reacted to within a frame or two.
+        const bool over_budget = (0 == settle_frames_ && frame_ema_us_ > budget_us_) || frame_cost_us_ > 2 * budget_us_;
+        if (over_budget && level_ < QualityLevel::Scanline)
+        {
+            level_ = static_cast<QualityLevel>(static_cast<uint8_t>(level_) + 1);
+            headroom_frames_ = 0;
+
+            // The smoothed cost is still mostly the old level's; left as it is, it would stay over
+            // budget for several frames and shed more work than needed. Start it again from the
+            // new level's frames.
+            frame_ema_us_ = 0;
+            settle_frames_ = SETTLE_FRAMES;
+            return;
+        }
+
+        if (QualityLevel::Full == level_)
+        {
+            return;
+        }
+
+        // Only restore once the better level is predicted to fit, with some margin, for several
+        // frames in a row. Otherwise the levels would oscillate.
+        const uint32_t restore_threshold = budget_us_ - (budget_us_ >> 3);
+        if (predicted_cost_of_better_level() <= restore_threshold)
+        {
+            headroom_frames_++;
+        }
+        else
+        {
+            headroom_frames_ = 0;
+        }
+
+        if (headroom_frames_ >= restore_after_)
+        {
+            level_ = static_cast<QualityLevel>(static_cast<uint8_t>(level_) - 1);
+            headroom_frames_ = 0;
+            frame_ema_us_ = predicted_cost_of_better_level();
+        }
+    }
+
+
+    uint32_t FrameScheduler::predicted_cost_of_better_level() const
+    {
+        const uint32_t current = frame_ema_us_;
+        uint32_t added = 0;
+
+        switch (level_)
+        {
+            case QualityLevel::SkipDisplay:
+                added = stage_cost(Stage::Display);
+                break;
+
+            case QualityLevel::DecimateStop:
+                // Currently the stop detection's cost is spread over N frames.
+                added = stage_cost(Stage::StopDetect) - stage_cost(Stage::StopDetect) / stop_every_n_;
+                break;
+
+            case QualityLevel::ShrinkRoi:
+                added = outside_full_ema_us_ > outside_shrunk_ema_us_ ? outside_full_ema_us_ - outside_shrunk_ema_us_ : 0;
+                break;
+
+            case QualityLevel::Scanline:
+                added = outside_shrunk_ema_us_ > outside_scanline_ema_us_ ? outside_shrunk_ema_us_ - outside_scanline_ema_us_ : 0;
+                break;
+
+            default:
+                break;
+        }
+
+        return current + added;
+    }
+
+
+    uint32_t FrameScheduler::stage_cost(const Stage stage) const
+    {
+        return stage_ema_us_[static_cast<uint8_t>(stage)];
+    }
+
+
+    uint32_t FrameScheduler::frames_at_level(const QualityLevel level) const
+    {
+        return level_frames_[static_cast<uint8_t>(level)];
+    }
+}
@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// A scheduler which holds each frame to a latency budget, shedding work in a fixed order when
+/// the measured stage costs exceed it and restoring that work once there is headroom.
+///
+/// The scheduler never reads a clock itself; stage costs are handed to it, so it can be driven
+/// with injected costs off-device.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+namespace lane_detect
+{
+    /// @brief The stages of the per-frame pipeline whose cost is tracked.
+    enum class Stage : uint8_t
+    {
+        Convert,
+        OutsideDetect,
+        StopDetect,
+        Display,
+        Uart,
+        Count
+    };
+
+
+    /// @brief Gets a stage's name, for reports.
+    /// @param stage The stage.
+    /// @return The name.
+    const char* stage_name(Stage stage);
+
+
+    /// @brief The degradation levels, in the order they are applied. Each level also includes all
+    /// the degradations of the levels before it.
+    enum class QualityLevel : uint8_t
+    {
+        Full,           ///< Everything runs every frame.
+        SkipDisplay,    ///< The LCD is not drawn.
+        DecimateStop,   ///< Stop-line detection runs only every Nth frame.
+        ShrinkRoi,      ///< The outside line is searched for in a smaller region.
+        Scanline,       ///< The outside line is found from a handful of sampled rows.
+        Count
+    };
+
+
+    /// @brief What the pipeline should run for a frame.
+    struct FramePlan
+    {
+        QualityLevel level;
+        bool run_display;
+        bool run_stop_detection;
+        bool shrink_roi;
+        bool scanline_mode;
+    };
+
+
+    class FrameScheduler
+    {
+        public:
+        /// @brief Constructs the scheduler.
+        /// @param budget_us The latency budget of one frame, in microseconds.
+        /// @param stop_every_n When decimating, stop-line detection runs once per this many frames.
+        /// @param restore_after The number of consecutive frames with headroom before a level is restored.
+        explicit FrameScheduler(uint32_t budget_us, uint8_t stop_every_n = 3, uint8_t restore_after = 15);
+
+        /// @brief Decides what to run for the next frame. Call once at the start of every frame.
+        FramePlan plan_frame();
+
+        /// @brief Records the cost of a stage which ran during the current frame.
+        /// @param stage The stage.
+        /// @param cost_us How long it took, in microseconds.
+        /// @param on_critical_path Whether the cost adds to the frame's time. Stages which ran in
+        /// parallel should pass false, and their wall time given to record_frame_time.
+        void record_stage(Stage stage, uint32_t cost_us, bool on_critical_path = true);
+
+        /// @brief Adds time to the current frame without attributing it to any one stage.
+        /// @param cost_us The time, in microseconds.
+        void record_frame_time(uint32_t cost_us) { frame_cost_us_ += cost_us; }
+
+        /// @brief Closes out the current frame, and moves between levels if needed.
+        void end_frame();
+
+        /// @return The current degradation level.
+        QualityLevel level() const { return level_; }
+
+        /// @return The smoothed cost of a stage, in microseconds, the last times it ran.
+        uint32_t stage_cost(Stage stage) const;
+
+        /// @return The smoothed cost of a whole frame, in microseconds.
+        uint32_t frame_cost() const { return frame_ema_us_; }
+
+        /// @return The number of frames which have been run at the given level.
+        uint32_t frames_at_level(QualityLevel level) const;
+
+        /// @return The latency budget of one frame, in microseconds.
+        uint32_t budget() const { return budget_us_; }
+
+        private:
+        /// @brief Predicts how much a frame would cost at the level one better than the current.
+        uint32_t predicted_cost_of_better_level() const;
+
+        uint32_t budget_us_;
+        uint8_t stop_every_n_;
+        uint8_t restore_after_;
+
+        QualityLevel level_;
+        FramePlan plan_;
+        uint32_t frame_index_;
+
+        /// @brief Costs of the stages recorded so far in the current frame.
+        uint32_t frame_cost_us_;
+
+        uint32_t stage_ema_us_[static_cast<uint8_t>(Stage::Count)];
+
+        /// @brief The outside detection's cost is tracked separately for each way it can be run,
+        /// since the ROI and scanline levels change it.
+        uint32_t outside_full_ema_us_;
+        uint32_t outside_shrunk_ema_us_;
+        uint32_t outside_scanline_ema_us_;
+
+        uint32_t frame_ema_us_;
+
+        /// @brief Frames left before the smoothed frame cost can cause another downgrade.
+        uint8_t settle_frames_;
+
+        uint8_t headroom_frames_;
+        uint32_t level_frames_[static_cast<uint8_t>(QualityLevel::Count)];
+    };
+}
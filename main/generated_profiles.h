@@ -0,0 +1,34 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The calibration profiles, generated at build time by gen_params.py from the debugger settings:
+/// the settings themselves, and the lighting variants they list. They live in flash, and seed the
+/// profiles kept in NVS (see calibration_profiles.h).
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#include "calibration.h"
+#include "class_table.h"
+#include "profile_format.h"
+
+namespace lane_detect
+{
+    /// @brief A calibration profile as generated.
+    struct GeneratedProfile
+    {
+        /// @brief The calibration, in pixels of the frame size the settings were calibrated at
+        /// (calibration_width x calibration_height in params.h).
+        Calibration calibration;
+
+        /// @brief The RGB565 class table for the calibration's colors. Profiles which classify
+        /// alike share one.
+        const uint8_t* class_table;
+    };
+
+    /// @brief The generated profiles, by slot. The first is the settings as they are, so its class
+    /// table is rgb565_class_table.
+    extern const GeneratedProfile generated_profiles[PROFILE_COUNT];
+}
@@ -0,0 +1,382 @@
+#include "heap_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <new>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if HEAP_STATS_CALL_SITES
+#include "esp_debug_helpers.h"
+#endif
+#else
+#define IRAM_ATTR
+#endif
+
+
+namespace lane_detect::heap_stats
+{
+    /// @brief The counts of one counted task. Only the task writes them, but they are read from
+    /// another, so they are atomic.
+    struct TaskCounters
+    {
+        std::atomic<uint32_t> allocs;
+        std::atomic<uint32_t> bytes;
+        std::atomic<uint32_t> frees;
+    };
+
+    static TaskCounters counters[TASK_SLOTS];
+
+    #ifdef ESP_PLATFORM
+    /// @brief The counted tasks, by slot.
+    static std::atomic<TaskHandle_t> counted_tasks[TASK_SLOTS];
+    #else
+    /// @brief The calling thread's slot, or -1 if it isn't counted.
+    static thread_local int8_t calling_slot_index = -1;
+    #endif
+
+    #if HEAP_STATS_CALL_SITES && defined(ESP_PLATFORM)
+    static CallSite call_sites[CALL_SITE_COUNT];
+    static portMUX_TYPE call_sites_lock = portMUX_INITIALIZER_UNLOCKED;
+
+    // The frames between an allocation's call site and the hook: the hook, the heap, and malloc
+    // (or new).
+    constexpr uint8_t SKIPPED_FRAMES = 3;
+    #endif
+
+
+    /// @brief Gets the calling task's slot.
+    /// @return The slot, or -1 if the task isn't counted.
+    static inline IRAM_ATTR int8_t calling_slot()
+    {
+        #ifdef ESP_PLATFORM
+        const TaskHandle_t task = xTaskGetCurrentTaskHandle();
+        if (task != nullptr)
+        {
+            for (uint8_t slot = 0; slot < TASK_SLOTS; slot++)
+            {
+                if (counted_tasks[slot].load(std::memory_order_relaxed) == task)
+                {
+                    return static_cast<int8_t>(slot);
+                }
+            }
+        }
+        return -1;
+        #else
+        return calling_slot_index;
+        #endif
+    }
+
+
+    static inline IRAM_ATTR void count_alloc(const size_t size)
+    {
+        const int8_t slot = calling_slot();
+        if (slot < 0)
+        {
+            return;
+        }
+
+        TaskCounters& task = counters[slot];
+        task.allocs.fetch_add(1, std::memory_order_relaxed);
+        task.bytes.fetch_add(static_cast<uint32_t>(size), std::memory_order_relaxed);
+    }
+
+
+    static inline IRAM_ATTR void count_free()
+    {
+        const int8_t slot = calling_slot();
+        if (slot >= 0)
+        {
+            counters[slot].frees.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+
+    #if HEAP_STATS_CALL_SITES && defined(ESP_PLATFORM)
+    /// @brief Adds an allocation to the table of call sites. Once the table is full, allocations
+    /// from new call sites are not recorded.
+    static void record_call_site(const size_t size)
+    {
+        uintptr_t pcs[CALL_SITE_DEPTH] = {};
+        esp_backtrace_frame_t frame = {};
+        esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+        for (uint8_t depth = 0; depth < SKIPPED_FRAMES + CALL_SITE_DEPTH; depth++)
+        {
+            if (!esp_backtrace_get_next_frame(&frame))
+            {
+                break;
+            }
+            if (depth >= SKIPPED_FRAMES)
+            {
+                pcs[depth - SKIPPED_FRAMES] = esp_cpu_process_stack_pc(frame.pc);
+            }
+        }
+
+        portENTER_CRITICAL_SAFE(&call_sites_lock);
+        for (uint8_t i = 0; i < CALL_SITE_COUNT; i++)
+        {
+            CallSite& site = call_sites[i];
+            if (0 == site.allocs)
+            {
+                memcpy(site.pcs, pcs, sizeof(pcs));
+            }
+            else if (memcmp(site.pcs, pcs, sizeof(pcs)) != 0)
+            {
+                continue;
+            }
+
+            site.allocs++;
+            site.bytes += size;
+            break;
+        }
+        portEXIT_CRITICAL_SAFE(&call_sites_lock);
+    }
+    #endif
+
+
+    void count_calling_task(const uint8_t slot)
+    {
+        #ifdef ESP_PLATFORM
+        counted_tasks[slot].store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+        #else
+        calling_slot_index = static_cast<int8_t>(slot);
+        #endif
+    }
+
+
+    Counters task_counters(const uint8_t slot)
+    {
+        Counters result;
+        result.allocs = counters[slot].allocs.load(std::memory_order_relaxed);
+        result.bytes = counters[slot].bytes.load(std::memory_order_relaxed);
+        result.frees = counters[slot].frees.load(std::memory_order_relaxed);
+        return result;
+    }
+
+
+    HighWater high_water()
+    {
+        HighWater result = {};
+        #ifdef ESP_PLATFORM
+        result.internal = heap_caps_get_total_size(MALLOC_CAP_INTERNAL) - heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+        result.psram = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) - heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+        #endif
+        return result;
+    }
+
+
+    void report_call_sites()
+    {
+        #if HEAP_STATS_CALL_SITES && defined(ESP_PLATFORM)
+        // Copy the table out, so as not to print inside the critical section.
+        CallSite sites[CALL_SITE_COUNT];
+        portENTER_CRITICAL(&call_sites_lock);
+        memcpy(sites, call_sites, sizeof(sites));
+        portEXIT_CRITICAL(&call_sites_lock);
+
+        std::sort(sites, sites + CALL_SITE_COUNT, [](const CallSite& a, const CallSite& b)
+        {
+            return a.allocs > b.allocs;
+        });
+        for (const CallSite& site : sites)
+        {
+            if (0 == site.allocs)
+            {
+                break;
+            }
+            printf("HEAPSITE %lu allocs, %lu bytes; Backtrace:",
+                static_cast<unsigned long>(site.allocs),
+                static_cast<unsigned long>(site.bytes));
+            for (const uintptr_t pc : site.pcs)
+            {
+                printf(" 0x%08x:0x00000000", static_cast<unsigned>(pc));
+            }
+            printf("\n");
+        }
+        fflush(stdout);
+        #endif
+    }
+
+
+    StageMeter::StageMeter():
+        mark_(),
+        last_(),
+        worst_(),
+        budget_(),
+        over_budget_frames_(0)
+    {
+        std::fill(std::begin(budget_), std::end(budget_), UINT32_MAX);
+    }
+
+
+    void StageMeter::set_budget(const Stage stage, const uint32_t allocs)
+    {
+        budget_[static_cast<uint8_t>(stage)] = allocs;
+    }
+
+
+    Counters StageMeter::take(const uint8_t slot)
+    {
+        const Counters now = task_counters(slot);
+        Counters delta;
+        delta.allocs = now.allocs - mark_[slot].allocs;
+        delta.bytes = now.bytes - mark_[slot].bytes;
+        delta.frees = now.frees - mark_[slot].frees;
+        mark_[slot] = now;
+        return delta;
+    }
+
+
+    void StageMeter::begin_frame()
+    {
+        for (uint8_t slot = 0; slot < TASK_SLOTS; slot++)
+        {
+            mark_[slot] = task_counters(slot);
+        }
+        memset(last_, 0, sizeof(last_));
+    }
+
+
+    void StageMeter::end_stage(const Stage stage)
+    {
+        Counters& counts = last_[static_cast<uint8_t>(stage)];
+        for (uint8_t slot = 0; slot < TASK_SLOTS; slot++)
+        {
+            const Counters delta = take(slot);
+            counts.allocs += delta.allocs;
+            counts.bytes += delta.bytes;
+            counts.frees += delta.frees;
+        }
+    }
+
+
+    void StageMeter::end_parallel_stages(const Stage local, const Stage remote)
+    {
+        const int8_t local_slot = calling_slot();
+        for (uint8_t slot = 0; slot < TASK_SLOTS; slot++)
+        {
+            Counters& counts = last_[static_cast<uint8_t>((slot == local_slot) ? local : remote)];
+            const Counters delta = take(slot);
+            counts.allocs += delta.allocs;
+            counts.bytes += delta.bytes;
+            counts.frees += delta.frees;
+        }
+    }
+
+
+    bool StageMeter::end_frame()
+    {
+        bool within_budget = true;
+        for (uint8_t stage = 0; stage < static_cast<uint8_t>(Stage::Count); stage++)
+        {
+            worst_[stage].allocs = std::max(worst_[stage].allocs, last_[stage].allocs);
+            worst_[stage].bytes = std::max(worst_[stage].bytes, last_[stage].bytes);
+            worst_[stage].frees = std::max(worst_[stage].frees, last_[stage].frees);
+            within_budget = within_budget && last_[stage].allocs <= budget_[stage];
+        }
+
+        if (!within_budget)
+        {
+            over_budget_frames_++;
+        }
+        return within_budget;
+    }
+
+
+    void StageMeter::report()
+    {
+        const HighWater marks = high_water();
+        printf("HEAP high water: internal %u, psram %u; %lu frames over budget\n",
+            static_cast<unsigned>(marks.internal),
+            static_cast<unsigned>(marks.psram),
+            static_cast<unsigned long>(over_budget_frames_));
+        for (uint8_t stage = 0; stage < static_cast<uint8_t>(Stage::Count); stage++)
+        {
+            printf("HEAP %s: last %lu allocs/%lu bytes/%lu frees, worst %lu allocs/%lu bytes\n",
+                stage_name(static_cast<Stage>(stage)),
+                static_cast<unsigned long>(last_[stage].allocs),
+                static_cast<unsigned long>(last_[stage].bytes),
+                static_cast<unsigned long>(last_[stage].frees),
+                static_cast<unsigned long>(worst_[stage].allocs),
+                static_cast<unsigned long>(worst_[stage].bytes));
+        }
+        fflush(stdout);
+        report_call_sites();
+
+        memset(worst_, 0, sizeof(worst_));
+    }
+}
+
+
+#ifdef ESP_PLATFORM
+#ifdef CONFIG_HEAP_USE_HOOKS
+// Called by the heap on every successful allocation and free.
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    lane_detect::heap_stats::count_alloc(size);
+    #if HEAP_STATS_CALL_SITES
+    lane_detect::heap_stats::record_call_site(size);
+    #endif
+}
+
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void* ptr)
+{
+    lane_detect::heap_stats::count_free();
+}
+#endif
+#else
+// Off-device there are no heap hooks, so new and delete are replaced instead.
+void* operator new(const size_t size)
+{
+    void* ptr = malloc(size ? size : 1);
+    if (nullptr == ptr)
+    {
+        throw std::bad_alloc();
+    }
+    lane_detect::heap_stats::count_alloc(size);
+    return ptr;
+}
+
+
+void* operator new[](const size_t size)
+{
+    return operator new(size);
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr != nullptr)
+    {
+        lane_detect::heap_stats::count_free();
+        free(ptr);
+    }
+}
+
+
+void operator delete[](void* ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+#endif
@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Counts heap allocations, so that the pipeline's per-frame allocations can be seen, and held
+/// to a budget per stage.
+///
+/// On the ESP-32, every allocation and free is counted through the heap's hooks (which need
+/// CONFIG_HEAP_USE_HOOKS), so malloc() from OpenCV and the C library is seen as well as new.
+/// Elsewhere, only new and delete are counted.
+///
+/// Only the tasks which ask to be counted (see count_calling_task()) are, each on its own, so
+/// that the two stages which run at once, one on each core, can be told apart. Allocations by any
+/// other task (the recorder's writer, the black box's dumper, the row workers) are left out
+/// rather than charged to whichever stage happened to be running.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "frame_scheduler.h"
+
+// Set this to "1" to also record where allocations are made from. Costs a backtrace per
+// allocation; for debugging only.
+#define HEAP_STATS_CALL_SITES 0
+
+namespace lane_detect::heap_stats
+{
+    /// @brief The number of tasks counts are kept for.
+    constexpr uint8_t TASK_SLOTS = 2;
+
+    /// @brief The number of distinct call sites which are recorded.
+    constexpr uint8_t CALL_SITE_COUNT = 24;
+
+    /// @brief The number of return addresses which identify a call site.
+    constexpr uint8_t CALL_SITE_DEPTH = 3;
+
+
+    /// @brief The most heap allocations each stage may make in a frame, by Stage; frames over are
+    /// counted and reported. Conversion allocates the two HSV intermediates when the class table
+    /// can't be used, and nothing otherwise. The detectors work in masks and runs sized once at
+    /// start-up.
+    constexpr uint32_t STAGE_BUDGET_ALLOCS[static_cast<uint8_t>(Stage::Count)] = {
+        2,              // Convert
+        0,              // OutsideDetect
+        0,              // StopDetect
+        UINT32_MAX,     // Display
+        0,              // Uart
+    };
+
+
+    /// @brief Counts of heap activity.
+    struct Counters
+    {
+        uint32_t allocs;
+        uint32_t bytes;
+        uint32_t frees;
+    };
+
+
+    /// @brief How much of each kind of memory has been in use at once, at most.
+    struct HighWater
+    {
+        /// @brief Internal DRAM, in bytes.
+        size_t internal;
+
+        /// @brief PSRAM, in bytes.
+        size_t psram;
+    };
+
+
+    /// @brief Where a number of allocations were made from.
+    struct CallSite
+    {
+        /// @brief The return addresses, innermost first.
+        uintptr_t pcs[CALL_SITE_DEPTH];
+
+        uint32_t allocs;
+        uint32_t bytes;
+    };
+
+
+    /// @brief Counts the calling task's heap activity from now on, in a slot of its own. A slot
+    /// should only be taken once.
+    /// @param slot The slot, below TASK_SLOTS.
+    void count_calling_task(uint8_t slot);
+
+
+    /// @brief Gets one counted task's counts so far.
+    /// @param slot The task's slot.
+    /// @return The counts.
+    Counters task_counters(uint8_t slot);
+
+
+    /// @brief Gets the high-water marks since boot.
+    HighWater high_water();
+
+
+    /// @brief Prints the most common call sites, if HEAP_STATS_CALL_SITES is on, to the serial
+    /// port. The addresses are decoded by `idf.py monitor`.
+    void report_call_sites();
+
+
+    /// @brief Breaks the counts down by pipeline stage, frame by frame.
+    class StageMeter
+    {
+        public:
+        StageMeter();
+
+        /// @brief Sets the most allocations a stage may make in a frame. Unset stages have no
+        /// limit.
+        /// @param stage The stage.
+        /// @param allocs The most allocations.
+        void set_budget(Stage stage, uint32_t allocs);
+
+        /// @brief Starts a frame. Anything counted since the last frame ended is left out.
+        void begin_frame();
+
+        /// @brief Attributes everything counted since the last mark to a stage.
+        /// @param stage The stage.
+        void end_stage(Stage stage);
+
+        /// @brief Attributes everything counted since the last mark to two stages which ran at
+        /// once, by the task it was counted on.
+        /// @param local The stage which ran on the calling task.
+        /// @param remote The stage which ran on the other counted task.
+        void end_parallel_stages(Stage local, Stage remote);
+
+        /// @brief Finishes a frame, folding it into the worst case.
+        /// @return False if a stage went over its budget this frame.
+        bool end_frame();
+
+        /// @return A stage's counts in the last frame.
+        const Counters& last(Stage stage) const { return last_[static_cast<uint8_t>(stage)]; }
+
+        /// @return A stage's counts in its worst frame since the last report.
+        const Counters& worst(Stage stage) const { return worst_[static_cast<uint8_t>(stage)]; }
+
+        /// @return The number of frames in which a stage went over its budget.
+        uint32_t over_budget_frames() const { return over_budget_frames_; }
+
+        /// @brief Prints every stage's last and worst counts, and the high-water marks, to the
+        /// serial port, then starts a new worst case.
+        void report();
+
+        private:
+        /// @brief Takes the counts since the last mark, of one counted task.
+        Counters take(uint8_t slot);
+
+        /// @brief The counts as of the last mark, per counted task.
+        Counters mark_[TASK_SLOTS];
+
+        Counters last_[static_cast<uint8_t>(Stage::Count)];
+        Counters worst_[static_cast<uint8_t>(Stage::Count)];
+        uint32_t budget_[static_cast<uint8_t>(Stage::Count)];
+        uint32_t over_budget_frames_;
+    };
+}
@@ -11,6 +11,7 @@
 
 // Stdlib imports imports
 #include <stdio.h>
+#include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 #include <iostream>
@@ -24,6 +25,7 @@
 #include "sdkconfig.h"
 #include "esp_camera.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "driver/uart.h"
 
@@ -41,6 +43,30 @@
 #include "debugging.h"
 #include "params.h"
 #include "lcd.h"
+#include "state_estimator.h"
+#include "control_output.h"
+#include "frame_scheduler.h"
+#include "fork_join.h"
+#include "parallel_rows.h"
+#include "pixel_kernels.h"
+#include "commands.h"
+#include "frame_geometry.h"
+#include "calibration.h"
+#include "calibration_profiles.h"
+#include "generated_profiles.h"
+#include "frame_recorder.h"
+#include "black_box.h"
+#include "latency_tracker.h"
+#include "heap_stats.h"
+#include "bit_mask.h"
+#include "class_planes.h"
+#include "coarse_lookup.h"
+#include "rle_mask.h"
+#include "perspective.h"
+#include "distortion.h"
+#include "edge_detector.h"
+#include "line_fit.h"
+#include "curve_fit.h"
 
 
 static char TAG[]="lane_detection";
@@ -48,6 +74,10 @@ static char TAG[]="lane_detection";
 // If this is a "1," then send the raw image from the ESP-32 over the serial port. If 0, don't.
 #define CALIBRATION_MODE 0
 
+// If this is a "1," the calibration is held in memory, loaded from the profiles in NVS, and can
+// be switched while running. If 0, it is compiled into the detectors.
+#define LIVE_TUNING 1
+
 // The pin to write to.
 #define TX_GPIO GPIO_NUM_1
 
@@ -57,6 +87,110 @@ static char TAG[]="lane_detection";
 // The baudrate of the TX communication.
 constexpr uint16_t tx_baud = 19200;
 
+// The controller is sent "D<offset>E": the outside line's offset from its calibrated column, in pixels.
+// When the perspective is calibrated (see gen_params.py), it is followed by "G<offset>E", the
+// same offset on the ground in millimetres, and "A<heading>E", the line's angle from straight
+// ahead in milliradians, positive to the right. Then "R<curvature>E" gives how sharply the line
+// curves, in ten-thousandths of a radian per pixel, positive if it bends right further ahead, and
+// "C<confidence>E" how far this frame's detection can be trusted, from 0 (missed) to 100. When
+// there are extra classes, "K<classes>E" comes last: bit i is set while extra class i is detected.
+// Once the line has been missed for too long to predict, "LE" (lost) is sent in place of the D,
+// G, A and R fields, rather than holding their last values. The message is sent every
+// control_output_ms milliseconds, from the line estimator's prediction for that moment (see
+// control_output.h), so it keeps coming at the same rate however long frames take; the other
+// fields are the latest frame's.
+constexpr uint32_t control_output_ms = 40;
+static_assert(lane_detect::MAX_CONTROL_MESSAGE_LENGTH * 10 * 1000 / tx_baud < control_output_ms, "The longest control message doesn't fit in a control output period");
+
+// The pixel format to capture in at boot. In YUV422 the frame is thresholded directly, skipping
+// both color conversions. In grayscale only the outside line is detected. The mode can be
+// changed at runtime with the 'M' command.
+constexpr lane_detect::CaptureMode initial_capture_mode = lane_detect::CaptureMode::Rgb565;
+
+// The frame size to capture at. Everything calibrated is rescaled to it, so this can be traded
+// against frame rate without recalibrating.
+using frame_geometry = lane_detect::Square96;
+constexpr framesize_t frame_size = lane_detect::frame_size_for(frame_geometry::width, frame_geometry::height);
+static_assert(FRAMESIZE_INVALID != frame_size, "The camera has no frame size matching frame_geometry");
+static_assert(0 != lane_detect::frame_period_for(frame_size), "The sensor's frame period at frame_size is unknown");
+
+// The latency budget of one frame, in microseconds. The frame scheduler sheds work to stay within it.
+constexpr uint32_t frame_budget_us = 50000;
+
+// Class maps are looked up coarse-to-fine: one pixel in every 2^coarse_shift x 2^coarse_shift
+// cell first, then in full only around what that hits (see coarse_lookup.h). Anything narrower
+// than a cell may be missed, and at low resolutions the first pass costs more than it saves, so it
+// is only used from 320 columns up; 0 looks every pixel up.
+constexpr uint8_t coarse_shift = (frame_geometry::width >= 320) ? 2 : 0;
+
+// When the scheduler shrinks the ROI, this fraction (as a shift) of the remaining rows is cropped off the top.
+constexpr uint8_t roi_shrink_shift = 1;
+
+// When the scheduler shrinks the ROI or samples scanlines, the outside line is only searched for
+// in the columns the estimator predicts it in, this many spreads either side.
+constexpr uint8_t search_window_spreads = 2;
+
+// When decimated, stop-line detection runs once per this many frames.
+constexpr uint8_t stop_every_n_frames = 3;
+
+// How often, in frames, the scheduler statistics are logged. Only in calibration mode; otherwise
+// the log would go out on the controller's UART.
+constexpr uint32_t scheduler_report_frames = 256;
+
+// The distance between sampled rows in scanline mode.
+constexpr uint8_t scanline_spacing = 4;
+
+// How each line's mask is cleaned between thresholding and blob analysis; MorphOp::None skips it.
+// Opening the outside line's mask with a 3x1 element clears specks narrower than the line without
+// thinning it vertically; the stop line is thick enough to be opened with a 3x3, as are the
+// extra classes' blobs.
+constexpr lane_detect::Morphology outside_morphology = {lane_detect::MorphOp::Open, lane_detect::StructuringElement::Horizontal};
+constexpr lane_detect::Morphology stop_morphology = {lane_detect::MorphOp::Open, lane_detect::StructuringElement::Square};
+constexpr lane_detect::Morphology extra_morphology = {lane_detect::MorphOp::Open, lane_detect::StructuringElement::Square};
+
+// How the outside line is found at boot; it can be changed at runtime with the 'O' command. Edges
+// are found on luma, so they don't drift with the lighting as color thresholds do, and in
+// grayscale they need no conversion at all. The scheduler's scanline mode still thresholds.
+constexpr lane_detect::OutsideDetector initial_outside_detector = lane_detect::OutsideDetector::Threshold;
+
+// Which luma edges make the outside line when it is found by edges: at least this much brighter
+// than the floor either side, and between these widths, given in pixels of a 96 column frame and
+// rescaled to frame_geometry like the calibration.
+constexpr lane_detect::EdgeParams outside_edge_params = {
+    24,
+    static_cast<uint8_t>(frame_geometry::scale_col(2, 96)),
+    static_cast<uint8_t>(frame_geometry::scale_col(24, 96)),
+};
+static_assert(24 * frame_geometry::width / 96 <= UINT8_MAX, "The widest edge-detected line doesn't fit EdgeParams");
+
+// How far each detection of the outside line is trusted, from 0 to 100, is the geometric mean of
+// four scores: its area against full_area times the least area which counts; the fraction of its
+// rows that are a single run; the fraction of its points on the fitted line; and how near it is
+// to the estimator's prediction, falling to nothing at agreement_spreads spreads away, or
+// unpredicted_agreement when there was no prediction.
+constexpr float confidence_full_area = 2.0f;
+constexpr float confidence_agreement_spreads = 3.0f;
+constexpr float confidence_unpredicted_agreement = 0.5f;
+
+// The length of one control period, over which the line estimator predicts.
+constexpr TickType_t control_period_ticks = pdMS_TO_TICKS(10);
+
+// Where recorded frames are appended, on the storage partition. Started with the 'R' command;
+// see extract_recording.py.
+constexpr const char* recording_path = "/storage/recording.bin";
+
+// The PSRAM given to the black box, which keeps the last few seconds of frames (about 40 at 96x96)
+// for dumping when something goes wrong. Triggered by the 'B' command, a stop line, or a frame
+// over budget.
+constexpr size_t black_box_bytes = 1536 * 1024;
+
+// How many frames the black box keeps after it is triggered.
+constexpr uint16_t black_box_post_trigger_frames = 10;
+
+// Whether the black box dumps itself whenever it is triggered. The dump goes over the
+// controller's UART and takes tens of minutes, so outside calibration mode a triggered box only
+// holds its frames until the 'B' command asks for them.
+constexpr bool black_box_dump_on_trigger = (CALIBRATION_MODE == 1);
 
 // This is necessary because it allows ESP-IDF to find the main function,
 // even though C++ mangles the function name.
@@ -64,42 +198,53 @@ extern "C" {
 void app_main(void);
 }
 
-using contour_t = std::vector<cv::Point2i>;
-
-
 /// @brief Finds the center of the lane in the image.
+/// @tparam Geometry The geometry of the mask, which picks the coordinate and sum types.
 /// @param mask The binary image.
 /// @param start_row Based upon our cropping, we know that allot of the image won't
 /// contain any data. Pass this in, so that we don't waste time considering that
 /// sector of the image.
 /// @return The project center column.
-inline uint8_t get_lane_center(const cv::Mat1b& mask, const uint8_t start_row = 0)
+template <typename Geometry = frame_geometry>
+inline typename Geometry::coord_t get_lane_center(const cv::Mat1b& mask, const typename Geometry::coord_t start_row = 0)
 {
+    using coord_t = typename Geometry::coord_t;
+    using column_sum_t = typename Geometry::column_sum_t;
+
     //const auto start_tick = xTaskGetTickCount();
 
-    uint16_t result = 0; // The center column.
-    uint16_t sums[mask.cols] = {0};
+    CV_Assert(mask.cols <= Geometry::width && mask.rows <= Geometry::height);
+    coord_t result = 0; // The center column.
+    column_sum_t sums[Geometry::width] = {0};
 
     // Sum up the columns into the "sums" array,
-    for (uint16_t row = start_row; row < mask.rows; row++)
+    for (int row = start_row; row < mask.rows; row++)
     {
-        for (uint16_t col = 0; col < mask.cols; col++)
+        if constexpr (std::is_same_v<column_sum_t, uint16_t>)
+        {
+            lane_detect::kernels::accumulate_columns(mask.ptr<uint8_t>(row), sums, mask.cols);
+        }
+        else
         {
-            sums[col] += mask.at<uint8_t>(row, col);
+            const uint8_t* mask_row = mask.ptr<uint8_t>(row);
+            for (int col = 0; col < mask.cols; col++)
+            {
+                sums[col] += mask_row[col];
+            }
         }
     }
 
     // Split the image into two halves -- the left half should contain the left dotted line,
     // the right half should contain the right solid line.
-    const uint8_t half = (mask.cols >> 1);
+    const coord_t half = (mask.cols >> 1);
 
     // Find the max of that which is on the left side of the image. Call that the dotted line.
-    uint16_t dotted_col = 0;
-    uint16_t max = 0;
+    coord_t dotted_col = 0;
+    column_sum_t max = 0;
 
-    for (uint16_t col = 0; col < half; col++)
+    for (coord_t col = 0; col < half; col++)
     {
-        const uint16_t val = sums[col];
+        const column_sum_t val = sums[col];
         if (val > max)
         {
             max = val;
@@ -108,12 +253,12 @@ inline uint8_t get_lane_center(const cv::Mat1b& mask, const uint8_t start_row =
     }
 
     // Find the max of that which is on the right side of the image. Call that the solid line.
-    uint16_t solid_col = 0;
+    coord_t solid_col = 0;
     max = 0;
 
-    for (uint16_t col = half; col < mask.cols; col++)
+    for (int col = half; col < mask.cols; col++)
     {
-        const uint16_t val = sums[col];
+        const column_sum_t val = sums[col];
         if (val > max)
         {
             max = val;
@@ -132,211 +277,569 @@ inline uint8_t get_lane_center(const cv::Mat1b& mask, const uint8_t start_row =
 }
 
 
-/// @brief Finds the contour of the solid line, assumed to be the largest contour in the given mask.
-/// @param mask The binary image.
-/// @return The contour of the solid line.
-inline contour_t get_solid_line(const cv::Mat1b& mask)
+/// @brief Gets the slope between two points of a line, as it would be without the lens's
+/// distortion.
+/// @param a A point on the line, in the full frame.
+/// @param b Another point on the line.
+/// @return The slope, rows per column. Infinite if the line is vertical.
+inline float get_undistorted_slope(const cv::Point2i& a, const cv::Point2i& b)
 {
-    // Get the contours.
-    std::vector<contour_t> contours;
-    cv::findContours(mask, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    const lane_detect::FramePoint first = lane_detect::undistort(a.x, a.y, frame_geometry::width, frame_geometry::height);
+    const lane_detect::FramePoint second = lane_detect::undistort(b.x, b.y, frame_geometry::width, frame_geometry::height);
+    const float rise = first.row - second.row;
+    const float run = first.col - second.col;
 
-    if (0 == contours.size())
+    float slope;
+    if (run != 0)
     {
-        return contour_t();
+        slope = rise/run;
     }
-
-    // Find the largest contour, assume that's the solid line.
-    std::sort(contours.begin(), contours.end(), [](const contour_t& a, const contour_t& b)
+    else
     {
-        const cv::Rect2i a_rect = cv::boundingRect(a);
-        const cv::Rect2i b_rect = cv::boundingRect(b);
+        slope = INFINITY;
+    }
+
+    return slope;
+}
+
 
-        return a_rect.area() > b_rect.area();
-    });
-    const auto& solid_line = contours[0];
-    return solid_line;
+/// @brief Gets the slope through the solid line.
+/// @param blob The blob of the solid line.
+/// @return The slope.
+inline float get_slope(const lane_detect::Blob& blob)
+{
+    // Since we know that the solid line is approximately "line-shaped," an approximation
+    // of the slope should be just rise over run between its furthest left and furthest right
+    // points.
+    return get_undistorted_slope(blob.leftmost, blob.rightmost);
 }
 
 
-inline contour_t get_stop_line(const cv::Mat1b& mask)
+/// @brief What a detection of the outside line rests on, for judging how far to trust it.
+struct LineEvidence
 {
-    // Get the contours.
-    std::vector<contour_t> contours;
-    cv::findContours(mask, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    /// @brief The line's area over the least area which counts as a detection.
+    float area_ratio;
 
-    if (0 == contours.size())
+    /// @brief The fraction of the line's rows which hold exactly one of its runs; a clean line
+    /// has no gaps and doesn't split.
+    float row_consistency;
+};
+
+
+/// @brief Scores how far a detection of the outside line can be trusted.
+/// @param evidence What the detection rests on.
+/// @param fit The line fitted to it.
+/// @param predicted The estimate just before the detection was folded in.
+/// @param offset The detected offset from the calibrated column, in pixels.
+/// @return The confidence, from 0 to 100.
+inline int detection_confidence(const LineEvidence& evidence, const lane_detect::LineFit& fit, const lane_detect::LaneEstimate& predicted, const int offset)
+{
+    float agreement = confidence_unpredicted_agreement;
+    if (predicted.valid)
     {
-        return contour_t();
+        const float residual = fabsf(static_cast<float>(lane_detect::to_fixed(offset) - predicted.offset));
+        const float spread = static_cast<float>(std::max(predicted.offset_spread, lane_detect::FIXED_ONE));
+        agreement = std::max(0.0f, 1.0f - residual / (confidence_agreement_spreads * spread));
     }
 
-    // Find the largest contour, assume that's the solid line.
-    std::sort(contours.begin(), contours.end(), [](const contour_t& a, const contour_t& b)
+    const float area = std::min(1.0f, evidence.area_ratio / confidence_full_area);
+    const float product = area * evidence.row_consistency * fit.inlier_ratio * agreement;
+    return static_cast<int>(lroundf(100.0f * sqrtf(sqrtf(product))));
+}
+
+
+/// @brief Fits a line to the points a fitter has been given, falling back on a slope through a
+/// known point when too few of them agree.
+/// @param fitter The fitter, with the points added, undistorted.
+/// @param point A point on the line, for the fallback.
+/// @param slope The slope for the fallback.
+/// @return The line, in the undistorted frame. The fallback has an inlier ratio of 0.
+inline lane_detect::LineFit fit_line(lane_detect::LineFitter& fitter, const cv::Point2i& point, const float slope)
+{
+    lane_detect::LineFit fit;
+    if (fitter.fit(fit))
     {
-        const cv::Rect2i a_rect = cv::boundingRect(a);
-        const cv::Rect2i b_rect = cv::boundingRect(b);
+        return fit;
+    }
 
-        return a_rect.area() > b_rect.area();
-    });
-    const auto& solid_line = contours[0];
-    return solid_line;
+    const lane_detect::FramePoint undistorted = lane_detect::undistort(point.x, point.y, frame_geometry::width, frame_geometry::height);
+    fit.slope = slope;
+    fit.intercept = (0.0f != slope) ? undistorted.col - undistorted.row / slope : INFINITY;
+    fit.inlier_ratio = 0.0f;
+    return fit;
 }
 
 
-/// @brief Gets the slope through the solid line.
-/// @param contour The contour of the solid line.
-/// @return The slope.
-inline float get_slope(const contour_t& contour)
+/// @brief Fits a line through the solid line, from the middles of its runs, and gathers the
+/// runs for fitting a curve.
+/// @param runs The mask the blob was found in.
+/// @param blob The blob of the solid line.
+/// @param fitter The fitter. Its points are replaced.
+/// @param curve The curve fitter. Its points are replaced by every run of the blob, each weighted
+/// by its length, which sums the same as adding each of its pixels.
+/// @param row_consistency The fraction of the blob's rows which hold exactly one of its runs.
+/// Output param.
+/// @return The line, in the undistorted frame.
+inline lane_detect::LineFit fit_blob(const lane_detect::RleMask& runs, const lane_detect::Blob& blob, lane_detect::LineFitter& fitter, lane_detect::CurveFitter& curve, float& row_consistency)
 {
-    // Find the furthest left and furthest right point.
-    cv::Point2i leftmost(INT_MAX, 0);
-    cv::Point2i rightmost(INT_MIN, 0);
-
-    for (const auto& point : contour)
+    // Rows are skipped evenly for the line so that its points span the whole blob, and each
+    // sampled row gets an equal share of the points, so that rows of several runs near the top
+    // can't use them all up before the bottom is reached.
+    fitter.clear();
+    curve.clear();
+    const int step = std::max(1, (blob.bounds.height + lane_detect::OUTSIDE_LINE_FIT_BUDGET.max_points - 1) / lane_detect::OUTSIDE_LINE_FIT_BUDGET.max_points);
+    const int sampled_rows = (blob.bounds.height + step - 1) / step;
+    const int points_per_row = std::max(1, lane_detect::OUTSIDE_LINE_FIT_BUDGET.max_points / sampled_rows);
+    int single_rows = 0;
+    for (int row = blob.bounds.y; row < blob.bounds.y + blob.bounds.height; row++)
     {
-        // Check for leftmost
-        if (point.x < leftmost.x)
+        const bool sampled = 0 == (row - blob.bounds.y) % step;
+        const lane_detect::Run* row_runs = runs.row_runs(row);
+        int blob_runs = 0;
+        for (uint8_t i = 0; i < runs.row_run_count(row); i++)
         {
-            leftmost = point;
+            if (runs.in_blob(blob, row, i))
+            {
+                blob_runs++;
+                const float middle = 0.5f * (row_runs[i].start + row_runs[i].end - 1);
+                const lane_detect::FramePoint point = lane_detect::undistort(middle, row, frame_geometry::width, frame_geometry::height);
+                curve.add_point(point.col, point.row, row_runs[i].end - row_runs[i].start);
+                if (sampled && blob_runs <= points_per_row)
+                {
+                    fitter.add_point(point.col, point.row);
+                }
+            }
         }
-
-        // Check for rightmost
-        if (point.x > rightmost.x)
+        if (1 == blob_runs)
         {
-            rightmost = point;
+            single_rows++;
         }
     }
+    row_consistency = static_cast<float>(single_rows) / blob.bounds.height;
 
+    const cv::Point2i center(blob.bounds.x + (blob.bounds.width >> 1), blob.bounds.y + (blob.bounds.height >> 1));
+    return fit_line(fitter, center, get_slope(blob));
+}
 
-    // Since we know that the solid line is approximately "line-shaped," an approximation
-    // of the slope should be just rise over run with these.
-    const float rise = leftmost.y - rightmost.y;
-    const float run = leftmost.x - rightmost.x;
 
-    float slope;
-    if (run != 0)
+static_assert(extra_class_count <= lane_detect::MAX_EXTRA_CLASSES, "params.h has more extra classes than a Calibration holds");
+
+/// @brief Gets an extra class's calibration from params.h, rescaled like the lines'.
+/// @param index The class's index.
+/// @return The calibration, or an empty one past the last class.
+constexpr lane_detect::LineCalibration extra_calibration(const uint8_t index)
+{
+    if (index >= extra_class_count)
     {
-        slope = rise/run;
+        return {};
     }
-    else
+
+    return {
+        {extra_thresh_min[index][0], extra_thresh_min[index][1], extra_thresh_min[index][2]},
+        {extra_thresh_max[index][0], extra_thresh_max[index][1], extra_thresh_max[index][2]},
+        {{extra_yuv_min[index][0], extra_yuv_min[index][1], extra_yuv_min[index][2]}, {extra_yuv_max[index][0], extra_yuv_max[index][1], extra_yuv_max[index][2]}},
+        extra_luma_min[index],
+        extra_luma_max[index],
+        frame_geometry::scale_row(extra_cropping[index][0], calibration_height),
+        frame_geometry::scale_row(extra_cropping[index][1], calibration_height),
+        frame_geometry::scale_col(extra_cropping[index][2], calibration_width),
+        frame_geometry::scale_col(extra_cropping[index][3], calibration_width),
+        frame_geometry::scale_area(extra_min_detect_area[index], calibration_width, calibration_height),
+        extra_class_bits[index],
+    };
+}
+
+
+/// @brief The calibration from params.h, rescaled from the resolution it was calibrated at to
+/// frame_geometry.
+constexpr lane_detect::Calibration params_calibration = {
     {
-        slope = INFINITY;
+        {outside_thresh_min_hue, outside_thresh_min_sat, outside_thresh_min_val},
+        {outside_thresh_max_hue, outside_thresh_max_sat, outside_thresh_max_val},
+        {{outside_yuv_min_y, outside_yuv_min_u, outside_yuv_min_v}, {outside_yuv_max_y, outside_yuv_max_u, outside_yuv_max_v}},
+        outside_luma_min,
+        outside_luma_max,
+        frame_geometry::scale_row(outside_cropping_top, calibration_height),
+        frame_geometry::scale_row(outside_cropping_bottom, calibration_height),
+        frame_geometry::scale_col(outside_cropping_left, calibration_width),
+        frame_geometry::scale_col(outside_cropping_right, calibration_width),
+        frame_geometry::scale_area(outside_min_detect_area, calibration_width, calibration_height),
+        outside_class_bit,
+    },
+    {
+        {stop_thresh_min_hue, stop_thresh_min_sat, stop_thresh_min_val},
+        {stop_thresh_max_hue, stop_thresh_max_sat, stop_thresh_max_val},
+        {{stop_yuv_min_y, stop_yuv_min_u, stop_yuv_min_v}, {stop_yuv_max_y, stop_yuv_max_u, stop_yuv_max_v}},
+        stop_luma_min,
+        stop_luma_max,
+        frame_geometry::scale_row(stop_cropping_top, calibration_height),
+        frame_geometry::scale_row(stop_cropping_bottom, calibration_height),
+        frame_geometry::scale_col(stop_cropping_left, calibration_width),
+        frame_geometry::scale_col(stop_cropping_right, calibration_width),
+        frame_geometry::scale_area(stop_min_detect_area, calibration_width, calibration_height),
+        stop_class_bit,
+    },
+    frame_geometry::scale_col(expected_line_pos, calibration_width),
+    frame_geometry::scale_row(expected_red_y, calibration_height),
+    frame_geometry::scale_row(expected_red_radius, calibration_height),
+    {extra_calibration(0), extra_calibration(1), extra_calibration(2), extra_calibration(3), extra_calibration(4), extra_calibration(5)},
+    extra_class_count,
+};
+
+/// @brief The calibration, baked in at compile time.
+using StaticCalibration = lane_detect::FixedCalibration<params_calibration>;
+
+
+/// @brief Thresholds a region of a frame into the same region of a mask. The rest of the mask
+/// is left alone.
+/// @param frame The frame: three-channel HSV, two-channel packed YUV422, or a single-channel class
+/// map. (RGB565 and grayscale frames are always converted to one of these before reaching here.)
+/// @param line The calibration of the line to threshold for.
+/// @param roi The region to threshold.
+/// @param thresh The mask, already allocated to the frame's size. Output param.
+inline void threshold_region(const cv::Mat& frame, const lane_detect::LineCalibration& line, const cv::Rect2i& roi, cv::Mat1b& thresh)
+{
+    if (CV_8UC3 == frame.type())
+    {
+        cv::Mat1b thresh_roi = thresh(roi);
+        lane_detect::parallel_in_range(frame(roi), line.hsv_low, line.hsv_high, thresh_roi);
+        return;
     }
 
-    return slope;
+    // A class map already says which lines each pixel belongs to.
+    if (CV_8UC1 == frame.type())
+    {
+        cv::Mat1b thresh_roi = thresh(roi);
+        lane_detect::parallel_test_bits(frame(roi), line.class_bit, thresh_roi);
+        return;
+    }
+
+    // In YUV422, each pair of pixels shares its chroma, so the region is widened to whole pairs
+    // and the extra columns are cleared afterwards.
+    const int first_col = roi.x & ~1;
+    const int end_col = std::min(frame.cols, (roi.x + roi.width + 1) & ~1);
+    const cv::Rect2i pairs(first_col, roi.y, end_col - first_col, roi.height);
+    cv::Mat1b thresh_pairs = thresh(pairs);
+    lane_detect::parallel_in_range_yuyv(frame(pairs), line.yuv, thresh_pairs);
+
+    if (first_col < roi.x)
+    {
+        thresh(cv::Rect2i(first_col, roi.y, 1, roi.height)).setTo(0);
+    }
+    if (end_col > roi.x + roi.width)
+    {
+        thresh(cv::Rect2i(end_col - 1, roi.y, 1, roi.height)).setTo(0);
+    }
 }
 
 
-/// @brief Crops a captured frame based upon cropping parameters.
-/// @param frame The frame to crop. Modified.
-/// @param top The number of pixels on the top to crop off.
-/// @param bottom The number of pixels on the bottom to crop off.
-/// @param left The number of pixels on the left to crop off.
-/// @param right The number of pixels on the right to crop off.
-inline void apply_cropping(
-    cv::Mat& frame,
-    const uint16_t top,
-    const uint16_t bottom,
-    const uint16_t left,
-    const uint16_t right
-)
+/// @brief A search window which leaves every column to the calibrated cropping.
+constexpr lane_detect::SearchWindow whole_row = {0, INT16_MAX};
+
+
+/// @brief Narrows a line's calibrated columns to a search window.
+/// @param line The calibration of the line, including its cropping.
+/// @param window The columns to search.
+/// @param cols The width of the frame.
+/// @return The columns left to search. Empty if none are.
+inline cv::Range search_columns(const lane_detect::LineCalibration& line, const lane_detect::SearchWindow& window, const int cols)
+{
+    const int start = std::max<int>(line.crop_left, window.first_col);
+    const int end = std::min<int>(cols - line.crop_right, window.last_col + 1);
+    return cv::Range(start, std::max(start, end));
+}
+
+
+/// @brief Thresholds the part of a frame left after cropping. Everything outside of the crop is
+/// zero in the output. The input is only read, so several detectors may share it.
+/// @param frame The frame to threshold, in HSV, YUV422 or as a class map.
+/// @param planes The frame split by class, if it is a class map; otherwise nullptr.
+/// @param line The calibration of the line to threshold for, including its cropping.
+/// @param thresh The thresholded frame. Output param.
+/// @param runs The thresholded frame's runs, after morphology. Output param.
+/// @param bits Space for the morphology, kept across frames.
+/// @param morphology The morphology to clean the runs with. The thresholded frame is left as is,
+/// unless it was taken from the planes, in which case it is drawn from the cleaned runs.
+/// @param extra_top Rows to crop off the top in addition to the calibrated cropping.
+/// @param window The columns to search, within the calibrated cropping.
+inline void threshold_cropped(const cv::Mat& frame, const lane_detect::ClassPlanes* planes, const lane_detect::LineCalibration& line, cv::Mat1b& thresh, lane_detect::RleMask& runs, lane_detect::BitMask& bits, const lane_detect::Morphology& morphology, const uint16_t extra_top = 0, const lane_detect::SearchWindow& window = whole_row)
 {
-    // Do the top cropping.
-    if (top > 0)
+    thresh.create(frame.rows, frame.cols);
+    thresh.setTo(0);
+    runs.create(frame.rows, frame.cols);
+
+    const int top = line.crop_top + extra_top;
+    const int rows = frame.rows - top - line.crop_bottom;
+    const cv::Range columns = search_columns(line, window, frame.cols);
+    const int cols = columns.size();
+    if (rows <= 0 || cols <= 0)
     {
-        cv::rectangle(frame, cv::Rect2i(cv::Point2i(0, 0), cv::Point2i(frame.cols, top)), cv::Scalar(0, 0, 0), -1);
+        return;
     }
 
-    // Do the bottom cropping.
-    if (bottom > 0)
+    // The planes already hold the line's mask, packed, so nothing need be thresholded.
+    const cv::Rect2i roi(columns.start, top, cols, rows);
+    if (planes != nullptr)
     {
-        cv::rectangle(frame, cv::Rect2i(cv::Point2i(0, frame.rows), cv::Point2i(frame.cols, frame.rows - bottom)), cv::Scalar(0, 0, 0), -1);
+        bits.extract(*planes, static_cast<uint8_t>(__builtin_ctz(line.class_bit)), roi);
+        bits.apply(morphology);
+        runs.encode(bits);
+        runs.rasterize(thresh);
+        return;
     }
 
-    // Do the left cropping.
-    if (left > 0)
+    // Each row is encoded straight after thresholding, while it's still in the cache.
+    threshold_region(frame, line, roi, thresh);
+    if (lane_detect::MorphOp::None == morphology.op)
     {
-        cv::rectangle(frame, cv::Rect2i(cv::Point2i(0, 0), cv::Point2i(left, frame.rows)), cv::Scalar(0, 0, 0), -1);
+        runs.encode(thresh, roi);
+        return;
     }
 
-    // Do the right cropping.
-    if (right > 0)
+    bits.pack(thresh, roi);
+    bits.apply(morphology);
+    runs.encode(bits);
+}
+
+
+/// @brief Takes the largest blob of a mask as the outside line, and extracts its parameters.
+/// @param line The calibration of the outside line.
+/// @param runs The mask's runs.
+/// @param fitter Fits the line's slope.
+/// @param curve Gathers the line's points, for fitting its curvature. Output param.
+/// @param center_point The centerpoint of the detected line. Output param.
+/// @param fit The line through the detected line. Output param.
+/// @param evidence What the detection rests on. Output param.
+inline void locate_outside_line(const lane_detect::LineCalibration& line, lane_detect::RleMask& runs, lane_detect::LineFitter& fitter, lane_detect::CurveFitter& curve, cv::Point2i& center_point, lane_detect::LineFit& fit, LineEvidence& evidence)
+{
+    // The largest blob is assumed to be the solid line.
+    runs.find_blobs();
+    lane_detect::Blob solid_line;
+
+    // If there is less area than the min. expected, don't record as a detection
+    if (!runs.largest_blob(solid_line) || static_cast<uint32_t>(solid_line.bounds.area()) < line.min_area)
     {
-        cv::rectangle(frame, cv::Rect2i(cv::Point2i(frame.cols, 0), cv::Point2i(frame.cols - right, frame.rows)), cv::Scalar(0, 0, 0), -1);
+        curve.clear();
+        center_point.x = -1;
+        center_point.y = -1;
+        fit = {NAN, NAN, 0.0f};
+        evidence = {0.0f, 0.0f};
+        return;
     }
+
+    const cv::Rect2i& solid_line_rect = solid_line.bounds;
+    center_point.x = solid_line_rect.x + (solid_line_rect.width >> 1);
+    center_point.y = solid_line_rect.y + (solid_line_rect.height >> 1);
+
+    fit = fit_blob(runs, solid_line, fitter, curve, evidence.row_consistency);
+    evidence.area_ratio = static_cast<float>(solid_line_rect.area()) / std::max<uint32_t>(line.min_area, 1);
 }
 
 
 /// @brief Finds the outside line and extracts parameters.
-/// @param hsv The frame, in HSV, to extract data from.
+/// @param calibration The calibration to detect with. A FixedCalibration or RuntimeCalibration.
+/// @param frame The frame, in HSV, YUV422 or as a class map, to extract data from.
+/// @param planes The frame split by class, if it is a class map; otherwise nullptr.
 /// @param thresh The thresholded frame. Output param.
+/// @param runs The thresholded frame's runs, cleaned by outside_morphology. Output param.
+/// @param bits Space for the morphology, kept across frames.
+/// @param fitter Fits the line's slope.
+/// @param curve Gathers the line's points, for fitting its curvature. Output param.
 /// @param center_point The centerpoint of the detected line. Output param.
-/// @param slope The slope of the detected line. Output param.
-void outside_line_detection(cv::Mat& hsv, cv::Mat1b& thresh, cv::Point2i& center_point, float& slope)
+/// @param fit The line through the detected line. Output param.
+/// @param evidence What the detection rests on. Output param.
+/// @param extra_top Rows to crop off the top in addition to the calibrated cropping.
+/// @param window The columns to search, within the calibrated cropping.
+template <typename CalibrationSource>
+void outside_line_detection(const CalibrationSource& calibration, const cv::Mat& frame, const lane_detect::ClassPlanes* planes, cv::Mat1b& thresh, lane_detect::RleMask& runs, lane_detect::BitMask& bits, lane_detect::LineFitter& fitter, lane_detect::CurveFitter& curve, cv::Point2i& center_point, lane_detect::LineFit& fit, LineEvidence& evidence, const uint16_t extra_top = 0, const lane_detect::SearchWindow& window = whole_row)
 {
-    apply_cropping(hsv, outside_cropping_top, outside_cropping_bottom, outside_cropping_left, outside_cropping_right);
+    const lane_detect::LineCalibration& line = calibration.values.outside;
+    threshold_cropped(frame, planes, line, thresh, runs, bits, outside_morphology, extra_top, window);
+    locate_outside_line(line, runs, fitter, curve, center_point, fit, evidence);
+}
 
-    const auto low = cv::Scalar(outside_thresh_min_hue, outside_thresh_min_sat, outside_thresh_min_val);
-    const auto high = cv::Scalar(outside_thresh_max_hue, outside_thresh_max_sat, outside_thresh_max_val);
-    cv::inRange(hsv, low, high, thresh);
 
-    const auto solid_line = get_solid_line(thresh);
-    if (0 == solid_line.size())
+/// @brief Finds the outside line between paired luma edges, rather than by thresholding.
+/// @param calibration The calibration to detect with. A FixedCalibration or RuntimeCalibration.
+/// Only its cropping and minimum area are used.
+/// @param captured The frame as captured, in RGB565, YUV422 or grayscale.
+/// @param source How to read the captured frame's luma.
+/// @param thresh The segments between edges, as a mask. Output param.
+/// @param runs The segments between edges. Output param.
+/// @param edges The edge detector, kept across frames.
+/// @param fitter Fits the line's slope.
+/// @param curve Gathers the line's points, for fitting its curvature. Output param.
+/// @param center_point The centerpoint of the detected line. Output param.
+/// @param fit The line through the detected line. Output param.
+/// @param evidence What the detection rests on. Output param.
+/// @param extra_top Rows to crop off the top in addition to the calibrated cropping.
+/// @param window The columns to search, within the calibrated cropping.
+template <typename CalibrationSource>
+void outside_line_edges(const CalibrationSource& calibration, const cv::Mat& captured, const lane_detect::LumaSource source, cv::Mat1b& thresh, lane_detect::RleMask& runs, lane_detect::EdgeDetector& edges, lane_detect::LineFitter& fitter, lane_detect::CurveFitter& curve, cv::Point2i& center_point, lane_detect::LineFit& fit, LineEvidence& evidence, const uint16_t extra_top = 0, const lane_detect::SearchWindow& window = whole_row)
+{
+    const lane_detect::LineCalibration& line = calibration.values.outside;
+    runs.create(captured.rows, captured.cols);
+
+    const int top = line.crop_top + extra_top;
+    const int rows = captured.rows - top - line.crop_bottom;
+    const cv::Range columns = search_columns(line, window, captured.cols);
+    const int cols = columns.size();
+    if (rows > 0 && cols > 0)
     {
-        center_point.x = -1;
-        center_point.y = -1;
-        slope = NAN;
+        edges.detect(captured, source, cv::Rect2i(columns.start, top, cols, rows), outside_edge_params, runs);
     }
-    else
-    {
-        const auto solid_line_rect = cv::boundingRect(solid_line);
+    runs.rasterize(thresh);
+    locate_outside_line(line, runs, fitter, curve, center_point, fit, evidence);
+}
+
 
-        // If there is less area than the min. expected, don't record as a detection
-        if (solid_line_rect.area() < outside_min_detect_area)
+/// @brief Finds the outside line from a handful of sampled rows, rather than the whole frame.
+/// Much cheaper than outside_line_detection, at the cost of robustness; used when the frame
+/// scheduler is out of budget.
+/// @param calibration The calibration to detect with. A FixedCalibration or RuntimeCalibration.
+/// @param frame The frame, in HSV or YUV422, to extract data from.
+/// @param thresh The thresholded frame, with only the sampled rows filled in. Output param.
+/// @param runs The thresholded frame's runs, likewise. Output param.
+/// @param fitter Fits the line's slope, to the sampled rows' hits.
+/// @param curve Gathers the sampled rows' hits, for fitting the line's curvature. Output param.
+/// @param center_point The centerpoint of the detected line. Output param.
+/// @param fit The line through the detected line. Output param.
+/// @param evidence What the detection rests on. Output param.
+/// @param extra_top Rows to crop off the top in addition to the calibrated cropping.
+/// @param window The columns to sample, within the calibrated cropping.
+template <typename CalibrationSource>
+void outside_line_scanline(const CalibrationSource& calibration, const cv::Mat& frame, cv::Mat1b& thresh, lane_detect::RleMask& runs, lane_detect::LineFitter& fitter, lane_detect::CurveFitter& curve, cv::Point2i& center_point, lane_detect::LineFit& fit, LineEvidence& evidence, const uint16_t extra_top = 0, const lane_detect::SearchWindow& window = whole_row)
+{
+    const lane_detect::LineCalibration& line = calibration.values.outside;
+    thresh.create(frame.rows, frame.cols);
+    thresh.setTo(0);
+    runs.create(frame.rows, frame.cols);
+
+    // If the window lies wholly in the cropping, there is nothing to sample.
+    const cv::Range columns = search_columns(line, window, frame.cols);
+    const int first_col = columns.start;
+    const int last_col = columns.end;
+    const int first_row = line.crop_top + extra_top;
+    const int last_row = columns.empty() ? first_row : frame.rows - line.crop_bottom;
+
+    // The midpoint of the widest run on each sampled row is taken as a point on the line.
+    cv::Point2i first_hit(-1, -1);
+    cv::Point2i last_hit(-1, -1);
+    int sum_x = 0;
+    int sum_y = 0;
+    int hits = 0;
+    int sampled_rows = 0;
+    int area = 0;
+    fitter.clear();
+    curve.clear();
+
+    for (int row = first_row; row < last_row; row += scanline_spacing)
+    {
+        sampled_rows++;
+        const cv::Rect2i row_rect(first_col, row, last_col - first_col, 1);
+        threshold_region(frame, line, row_rect, thresh);
+        runs.encode_row(row, thresh.ptr<uint8_t>(row), first_col, last_col);
+
+        int best_start = -1;
+        int best_len = 0;
+        const lane_detect::Run* row_runs = runs.row_runs(row);
+        for (uint8_t i = 0; i < runs.row_run_count(row); i++)
         {
-            center_point.x = -1;
-            center_point.y = -1;
-            slope = NAN;
+            if (row_runs[i].end - row_runs[i].start > best_len)
+            {
+                best_len = row_runs[i].end - row_runs[i].start;
+                best_start = row_runs[i].start;
+            }
         }
 
+        if (best_start < 0)
+        {
+            continue;
+        }
 
-        center_point.x = solid_line_rect.x + (solid_line_rect.width >> 1);
-        center_point.y = solid_line_rect.y + (solid_line_rect.height >> 1);
-
-        cv::line(thresh, cv::Point2i(center_point.x, 0), cv::Point2i(center_point.x, thresh.rows), 0xff);
-
-        slope = get_slope(solid_line);
+        const cv::Point2i hit(best_start + (best_len >> 1), row);
+        if (hits == 0)
+        {
+            first_hit = hit;
+        }
+        last_hit = hit;
+        const lane_detect::FramePoint point = lane_detect::undistort(hit.x, hit.y, frame_geometry::width, frame_geometry::height);
+        fitter.add_point(point.col, point.row);
+        curve.add_point(point.col, point.row, best_len);
+        sum_x += hit.x;
+        sum_y += hit.y;
+        area += best_len * scanline_spacing;
+        hits++;
     }
 
+    if (hits < 2 || static_cast<uint32_t>(area) < line.min_area)
+    {
+        center_point.x = -1;
+        center_point.y = -1;
+        fit = {NAN, NAN, 0.0f};
+        evidence = {0.0f, 0.0f};
+        return;
+    }
 
-}
+    center_point.x = sum_x / hits;
+    center_point.y = sum_y / hits;
 
+    // Each sampled row has at most one hit, so a row without one is the only inconsistency.
+    evidence.area_ratio = static_cast<float>(area) / std::max<uint32_t>(line.min_area, 1);
+    evidence.row_consistency = static_cast<float>(hits) / sampled_rows;
 
-bool rectangles_overlap(cv::Rect2i rect1, cv::Rect2i rect2)
-{
-    // Check if there is no overlap between the two rectangles
-    return !(rect1.x > rect2.x + rect2.width || rect2.x > rect1.x + rect1.width ||
-        rect1.y > rect2.y + rect2.height || rect2.y > rect1.y + rect1.height);
+    fit = fit_line(fitter, center_point, get_undistorted_slope(first_hit, last_hit));
 }
 
 
 /// @brief Finds the red line and extracts parameters.
-/// @param hsv The frame, in HSV, to extract data from.
+/// @param calibration The calibration to detect with. A FixedCalibration or RuntimeCalibration.
+/// @param frame The frame, in HSV, YUV422 or as a class map, to extract data from.
+/// @param planes The frame split by class, if it is a class map; otherwise nullptr.
 /// @param thresh The threshold frame, Output param.
+/// @param runs The threshold frame's runs, cleaned by stop_morphology. Output param.
+/// @param bits Space for the morphology, kept across frames.
 /// @param detected Whether or not the red line is "detected." Output param.
-void stop_line_detection(cv::Mat& hsv, cv::Mat1b& thresh, bool& detected)
+template <typename CalibrationSource>
+void stop_line_detection(const CalibrationSource& calibration, const cv::Mat& frame, const lane_detect::ClassPlanes* planes, cv::Mat1b& thresh, lane_detect::RleMask& runs, lane_detect::BitMask& bits, bool& detected)
 {
-    apply_cropping(hsv, stop_cropping_top, stop_cropping_bottom, stop_cropping_left, stop_cropping_right);
-
-    const auto low = cv::Scalar(stop_thresh_min_hue, stop_thresh_min_sat, stop_thresh_min_val);
-    const auto high = cv::Scalar(stop_thresh_max_hue, stop_thresh_max_sat, stop_thresh_max_val);
-    cv::inRange(hsv, low, high, thresh);
+    const lane_detect::Calibration& values = calibration.values;
+    threshold_cropped(frame, planes, values.stop, thresh, runs, bits, stop_morphology);
+
+    // The largest blob is the stop line, if it's big enough and has some part of it in the band
+    // the stop line is expected in.
+    runs.find_blobs();
+    lane_detect::Blob stop_line;
+    const cv::Rect2i detection_rect(cv::Point2i(0, values.stop_row - values.stop_radius), cv::Point2i(thresh.cols, values.stop_row + values.stop_radius));
+    detected = runs.largest_blob(stop_line) && static_cast<uint32_t>(stop_line.bounds.area()) >= values.stop.min_area && runs.intersects(stop_line, detection_rect);
+}
 
-    const auto stop_line = get_stop_line(thresh);
 
-    const auto stop_line_rect = cv::boundingRect(stop_line);
-    const cv::Rect2i detection_rect(cv::Point2i(0, expected_red_y - expected_red_radius), cv::Point2i(thresh.cols, expected_red_y + expected_red_radius));
-    detected = stop_line_rect.area() >= stop_min_detect_area && rectangles_overlap(stop_line_rect, detection_rect);
+/// @brief Finds the extra classes. Each is detected if its largest blob is big enough.
+/// @param calibration The calibration to detect with. A FixedCalibration or RuntimeCalibration.
+/// @param frame The frame, in HSV, YUV422 or as a class map, to extract data from.
+/// @param planes The frame split by class, if it is a class map; otherwise nullptr.
+/// @param thresh Space for each class's thresholded frame, kept across frames.
+/// @param runs Space for each class's runs, kept across frames.
+/// @param bits Space for the morphology, kept across frames.
+/// @return The detected classes: bit i for extra class i.
+template <typename CalibrationSource>
+uint8_t extra_class_detection(const CalibrationSource& calibration, const cv::Mat& frame, const lane_detect::ClassPlanes* planes, cv::Mat1b& thresh, lane_detect::RleMask& runs, lane_detect::BitMask& bits)
+{
+    const lane_detect::Calibration& values = calibration.values;
+    uint8_t detected = 0;
+    for (uint8_t index = 0; index < values.extra_count; index++)
+    {
+        threshold_cropped(frame, planes, values.extra[index], thresh, runs, bits, extra_morphology);
+        runs.find_blobs();
+        lane_detect::Blob blob;
+        if (runs.largest_blob(blob) && static_cast<uint32_t>(blob.bounds.area()) >= values.extra[index].min_area)
+        {
+            detected |= 1 << index;
+        }
+    }
+    return detected;
 }
 
 
@@ -344,7 +847,7 @@ void stop_line_detection(cv::Mat& hsv, cv::Mat1b& thresh, bool& detected)
 class PrintParams
 {
     public:
-    PrintParams(): frame(cv::Mat1b()), outside_line_slope(0), start_tick(0), outside_dist_from_ideal(0), stop_detected(false) {}
+    PrintParams(): frame(cv::Mat1b()), outside_line_slope(0), frame_period_us(0), outside_dist_from_ideal(0), stop_detected(false) {}
 
     /// @brief The image to print to the screen.
     cv::Mat1b frame;
@@ -352,8 +855,8 @@ class PrintParams
     /// @brief The slope of the detected outside line.
     float outside_line_slope;
 
-    /// @brief The number of ticks which have thus far passed.
-    TickType_t start_tick;
+    /// @brief The time between processed frames, in microseconds. 0 if not yet known.
+    uint32_t frame_period_us;
 
     /// @brief The number of pixels the line on the screen is from its ideal, calibrated position.
     int outside_dist_from_ideal;
@@ -371,16 +874,178 @@ void output_to_screen(SSD1306_t& screen, PrintParams& params)
     lane_detect::lcd_draw_matrix(screen, params.frame);
 
     // Calculate the FPS.
-    const auto delta_ticks = xTaskGetTickCount() - params.start_tick;
-    const auto framerate = static_cast<double>(configTICK_RATE_HZ) / delta_ticks; // How many seconds it took to process a frame.
+    const int framerate = (params.frame_period_us > 0) ? static_cast<int>(1000000 / params.frame_period_us) : 0;
 
     lane_detect::lcd_draw_data(screen, "Stop Detected:", params.stop_detected);
     lane_detect::lcd_draw_data(screen, "Dist:", params.outside_dist_from_ideal);
+    lane_detect::lcd_draw_data(screen, "FPS:", framerate);
+}
+
+
+/// @brief Gets how the luma of frames captured in a mode is read.
+/// @param mode The capture mode.
+/// @return The luma source.
+inline lane_detect::LumaSource luma_source(const lane_detect::CaptureMode mode)
+{
+    switch (mode)
+    {
+        case lane_detect::CaptureMode::Yuv422:
+            return lane_detect::LumaSource::Yuyv;
+        case lane_detect::CaptureMode::Grayscale:
+            return lane_detect::LumaSource::Gray;
+        default:
+            return lane_detect::LumaSource::Rgb565;
+    }
+}
+
+
+/// @brief Writes a control message (see control_output_ms), from the line estimate at the time it
+/// is sent and the latest frame's findings.
+/// @param estimate The line estimate, predicted to when the message is sent.
+/// @param frame What the latest frame found.
+/// @param message Where to write the message.
+/// @param size The space at message.
+/// @return The length of the message.
+int format_control_message(const lane_detect::LaneEstimate& estimate, const lane_detect::ControlFrame& frame, char* message, const size_t size)
+{
+    int length = 0;
+    if (estimate.valid)
+    {
+        length += snprintf(message, size, "D%dE", lane_detect::from_fixed(estimate.offset));
+
+        // Only the estimated line is mapped to the ground, not the frame. The slope was measured
+        // without the lens's distortion, so the points it passes through are undistorted too.
+        if (perspective_calibrated)
+        {
+            const float line_col = frame.line_pos + static_cast<float>(estimate.offset) / lane_detect::FIXED_ONE;
+            const float line_slope = lane_detect::lean_to_slope(estimate.lean);
+            const lane_detect::FramePoint line_point = lane_detect::undistort(line_col, frame.line_row, frame_geometry::width, frame_geometry::height);
+            const lane_detect::FramePoint expected_point = lane_detect::undistort(frame.line_pos, frame.line_row, frame_geometry::width, frame_geometry::height);
+            const lane_detect::GroundLine ground_line = lane_detect::to_ground_line(line_point.col, line_point.row, line_slope, expected_point.col, frame_geometry::width, frame_geometry::height);
+            length += snprintf(message + length, size - length, "G%ldEA%ldE",
+                lroundf(ground_line.offset),
+                lroundf(ground_line.heading * 1000.0f));
+        }
+        length += snprintf(message + length, size - length, "R%ldE", lroundf(frame.curvature * 10000.0f));
+    }
+    else
+    {
+        length += snprintf(message, size, "LE");
+    }
+    length += snprintf(message + length, size - length, "C%uE", static_cast<unsigned>(frame.confidence));
+    if (frame.extra_count > 0)
+    {
+        length += snprintf(message + length, size - length, "K%uE", static_cast<unsigned>(frame.extra_detected));
+    }
+    return length;
+}
+
+
+/// @brief Sends a report the controller asked for, over its UART. The line messages are held
+/// until the last byte is out, so that none is cut into the report.
+/// @param control The control output.
+/// @param report Prints the report.
+template <typename Report>
+void send_report(lane_detect::ControlOutput& control, const Report& report)
+{
+    const bool was_held = control.held();
+    control.hold(true);
+    report();
+    uart_wait_tx_done(UART_NUM, portMAX_DELAY);
+    control.hold(was_held);
+}
+
+
+/// @brief Carries out a command from the controller. Nothing is logged, since the log would go
+/// out on the controller's UART.
+/// @param command The command.
+/// @param capture_mode The current capture mode. Updated.
+/// @param outside_detector How the outside line is found. Updated.
+/// @param fb The frame buffer currently held, if any.
+/// @param calibration The calibration being detected with. Updated.
+/// @param derived What is derived from the calibration. Updated with it.
+/// @param profiles The calibration profiles. Only used with a RuntimeCalibration.
+/// @param recorder The frame recorder.
+/// @param black_box The black box.
+/// @param control The control output, held while the black box is dumped or a report is sent.
+/// @param latency The latency tracker.
+/// @param heap_meter The per-stage heap counts.
+template <typename CalibrationSource>
+void handle_command(
+    const lane_detect::Command& command,
+    lane_detect::CaptureMode& capture_mode,
+    lane_detect::OutsideDetector& outside_detector,
+    camera_fb_t** fb,
+    CalibrationSource& calibration,
+    lane_detect::ProfileDerived& derived,
+    const lane_detect::CalibrationProfiles* profiles,
+    lane_detect::FrameRecorder& recorder,
+    lane_detect::BlackBox& black_box,
+    lane_detect::ControlOutput& control,
+    const lane_detect::LatencyTracker& latency,
+    lane_detect::heap_stats::StageMeter& heap_meter
+)
+{
+    if (lane_detect::command_code::CAPTURE_MODE == command.code)
+    {
+        if (command.arg >= 0 && command.arg <= static_cast<int32_t>(lane_detect::CaptureMode::Grayscale))
+        {
+            capture_mode = static_cast<lane_detect::CaptureMode>(command.arg);
+            lane_detect::set_capture_mode(capture_mode, fb);
+        }
+    }
+    else if (lane_detect::command_code::OUTSIDE_DETECTOR == command.code)
+    {
+        if (command.arg >= 0 && command.arg <= static_cast<int32_t>(lane_detect::OutsideDetector::Edges))
+        {
+            outside_detector = static_cast<lane_detect::OutsideDetector>(command.arg);
+        }
+    }
+    else if (lane_detect::command_code::PROFILE == command.code)
+    {
+        // A compiled-in calibration can't be switched.
+        if constexpr (std::is_same_v<CalibrationSource, lane_detect::RuntimeCalibration>)
+        {
+            if (profiles != nullptr && command.arg >= 0 && command.arg < lane_detect::PROFILE_COUNT)
+            {
+                profiles->select(command.arg, calibration, derived);
+            }
+        }
+    }
+    else if (lane_detect::command_code::RECORD == command.code)
+    {
+        if (command.arg <= 0)
+        {
+            recorder.stop();
+        }
+        else
+        {
+            recorder.start(static_cast<uint8_t>(std::min<int32_t>(command.arg, UINT8_MAX)));
+        }
+    }
+    else if (lane_detect::command_code::BLACK_BOX == command.code)
+    {
+        // The dump may start at once, so the messages stop first.
+        control.hold(true);
+        black_box.request_dump();
+    }
+    else if (lane_detect::command_code::LATENCY == command.code)
+    {
+        send_report(control, [&] { latency.report(); });
+    }
+    else if (lane_detect::command_code::HEAP == command.code)
+    {
+        send_report(control, [&] { heap_meter.report(); });
+    }
 }
 
 
 /// @brief The main driver loop.
-inline void main_loop()
+/// @param calibration The calibration to detect with. A FixedCalibration or RuntimeCalibration.
+/// @param derived What is derived from the calibration.
+/// @param profiles The calibration profiles to switch between, if the calibration can be switched.
+template <typename CalibrationSource>
+inline void main_loop(CalibrationSource& calibration, lane_detect::ProfileDerived derived, const lane_detect::CalibrationProfiles* profiles = nullptr)
 {
     camera_fb_t* fb = nullptr;
 
@@ -402,56 +1067,456 @@ inline void main_loop()
     uart_driver_install(0, 1024 * 2, 0, 0, NULL, 0);
     #endif
 
+    // Commands from the controller, and the state they change.
+    #if(CALIBRATION_MODE == 0)
+    lane_detect::CommandReader commands(UART_NUM);
+
+    // Sends the controller its messages at a steady rate, from what each frame publishes.
+    lane_detect::ControlOutput control(UART_NUM, tx_baud, pdMS_TO_TICKS(control_output_ms), format_control_message);
+    control.start();
+
+    // From here on the UART is the controller's, which would take a log line for a garbled
+    // message, so nothing is logged.
+    esp_log_level_set("*", ESP_LOG_NONE);
+    #endif
+    lane_detect::CaptureMode capture_mode = initial_capture_mode;
+    lane_detect::OutsideDetector outside_detector = initial_outside_detector;
+
+    // Records frames to flash when the controller asks, for replaying off-device.
+    lane_detect::FrameRecorder recorder(recording_path);
+
+    // Keeps the last few seconds, for dumping when something goes wrong.
+    lane_detect::BlackBox black_box(black_box_bytes, black_box_post_trigger_frames, black_box_dump_on_trigger);
+    black_box.allocate(frame_geometry::width, frame_geometry::height);
+    #if(CALIBRATION_MODE == 1)
+    uint32_t black_box_us = 0;
+    #endif
+
+    // Smooths the outside line across frames, and predicts through frames where it is missed.
+    lane_detect::LineStateEstimator line_estimator(control_period_ticks);
+
+    // The row the outside line was last seen at, where the estimate is mapped to the ground and
+    // its search window is centered.
+    float line_row = frame_geometry::height >> 1;
+
+    // The outside line's curvature where it was last seen.
+    float line_curvature = 0.0f;
+
+    // Sheds work when frames run over budget.
+    lane_detect::FrameScheduler scheduler(frame_budget_us, stop_every_n_frames);
+    #if(CALIBRATION_MODE == 1)
+    uint32_t frame_count = 0;
+    #endif
+
+    // Numbers frames and measures their capture-to-output latency.
+    lane_detect::LatencyTracker latency(lane_detect::frame_period_for(frame_size));
+
+    // Counts each stage's heap allocations, frame by frame, against their budgets.
+    lane_detect::heap_stats::StageMeter heap_meter;
+    for (uint8_t stage = 0; stage < static_cast<uint8_t>(lane_detect::Stage::Count); stage++)
+    {
+        heap_meter.set_budget(static_cast<lane_detect::Stage>(stage), lane_detect::heap_stats::STAGE_BUDGET_ALLOCS[stage]);
+    }
+
+    // Runs the two detectors on separate cores.
+    lane_detect::ForkJoin detectors;
+
+    // Only this task and the detectors' worker are counted by the heap meter; the recorder's
+    // writer, the black box's dumper and the row workers allocate on their own schedules.
+    detectors.run(
+        [] { lane_detect::heap_stats::count_calling_task(0); },
+        [] { lane_detect::heap_stats::count_calling_task(1); });
+
+    // Each detector writes its mask into the black box's current slot, or, while the black box
+    // is frozen, into a mask of its own which is kept across frames so that it is not reallocated.
+    // Stop-line results also persist since the scheduler may skip its detection.
+    cv::Mat1b outside_mask(frame_geometry::height, frame_geometry::width);
+    cv::Mat1b stop_mask(frame_geometry::height, frame_geometry::width);
+    cv::Mat1b outside_thresh;
+    cv::Mat1b stop_thresh;
+
+    // The masks' runs, which the detectors and the display work from, and each detector's space
+    // for morphology.
+    lane_detect::RleMask outside_runs;
+    lane_detect::RleMask stop_runs;
+    lane_detect::BitMask outside_bits;
+    lane_detect::BitMask stop_bits;
+    lane_detect::RleMask display_runs;
+    lane_detect::EdgeDetector outside_edges;
+    lane_detect::LineFitter outside_fitter(lane_detect::OUTSIDE_LINE_FIT_BUDGET, lane_detect::OUTSIDE_LINE_FIT_SEED);
+    lane_detect::CurveFitter outside_curve(frame_geometry::height);
+    outside_runs.create(frame_geometry::height, frame_geometry::width);
+    outside_edges.create(frame_geometry::height, frame_geometry::width);
+    stop_runs.create(frame_geometry::height, frame_geometry::width);
+    cv::Mat1b display_frame;
+    cv::Mat1b class_map;
+    bool detected = false;
+
+    // The class map, split into a mask per class in one pass, which every detector takes its mask
+    // from instead of thresholding the map again.
+    lane_detect::ClassPlanes class_planes;
+    class_planes.create(frame_geometry::height, frame_geometry::width);
+
+    // Looks class maps up coarse-to-fine, if coarse_shift asks for it.
+    lane_detect::CoarseLookup coarse_lookup(coarse_shift);
+    if (coarse_shift > 0)
+    {
+        coarse_lookup.create(frame_geometry::height, frame_geometry::width);
+    }
+
+    // The extra classes are only reported, not displayed, so they share one mask between them.
+    // Like the stop line's, their results persist while the stop detection is decimated.
+    cv::Mat1b extra_thresh;
+    lane_detect::RleMask extra_runs;
+    lane_detect::BitMask extra_bits;
+    extra_runs.create(frame_geometry::height, frame_geometry::width);
+    uint8_t extra_detected = 0;
+
     while (true)
     {
-        // Crop the current frame so that it will fit on the screen.
-        cv::Mat working_frame = lane_detect::get_frame(&fb);
+        // Commands are handled between frames, so that a frame is never processed half in one
+        // mode and half in another.
+        #if(CALIBRATION_MODE == 0)
+        lane_detect::Command command;
+        while (commands.poll(command))
+        {
+            handle_command(command, capture_mode, outside_detector, &fb, calibration, derived, profiles, recorder, black_box, control, latency, heap_meter);
+        }
+        #endif
+
+        // The frame is moved straight into the black box, unless it is frozen for a dump.
+        size_t box_frame_size = 0;
+        uint8_t* box_frame = black_box.frame_buffer(box_frame_size);
+        int64_t capture_us = 0;
+        cv::Mat working_frame = lane_detect::get_frame(&fb, box_frame, box_frame_size, capture_us);
         if (working_frame.size[0] == 0)
         {
             vTaskDelay(1);
             continue;
         }
+        const int64_t frame_start_us = esp_timer_get_time();
+        const uint32_t sequence = latency.begin_frame(capture_us, frame_start_us);
+        const bool in_black_box = (box_frame != nullptr && working_frame.data == box_frame);
+        outside_thresh = in_black_box ? black_box.mask(false) : outside_mask;
 
         #if(CALIBRATION_MODE == 1)
         lane_detect::debug::send_matrix(working_frame);
         #endif
 
-        const auto start_tick = xTaskGetTickCount();
+        const auto plan = scheduler.plan_frame();
+        int64_t stage_start = esp_timer_get_time();
+        lane_detect::BlackBoxEntry box_entry = {};
+        bool ran_stop_detection = false;
+        heap_meter.begin_frame();
 
-        // Get into the right color space for thresholding.
-        cv::Mat bgr;
-        cv::cvtColor(working_frame, bgr, cv::COLOR_BGR5652BGR);
-        cv::Mat hsv;
-        cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV, 3);
-
-        // Perform detection on the outsid line.
-        cv::Mat hsv_outside = hsv.clone();
-        cv::Mat1b outside_thresh;
+        // Records the time since the previous stage ended against the given stage.
+        const auto end_stage = [&](const lane_detect::Stage stage)
+        {
+            const int64_t now = esp_timer_get_time();
+            box_entry.stage_us[static_cast<uint8_t>(stage)] = static_cast<uint32_t>(now - stage_start);
+            scheduler.record_stage(stage, box_entry.stage_us[static_cast<uint8_t>(stage)]);
+            latency.mark_stage(stage, now);
+            heap_meter.end_stage(stage);
+            stage_start = now;
+        };
+
+        // Records the time since the previous stage ended as a block of stages which ran in
+        // parallel; their own costs are recorded separately.
+        const auto end_parallel_stages = [&]()
+        {
+            const int64_t now = esp_timer_get_time();
+            scheduler.record_frame_time(static_cast<uint32_t>(now - stage_start));
+            latency.mark_stage(lane_detect::Stage::OutsideDetect, now);
+            if (ran_stop_detection)
+            {
+                latency.mark_stage(lane_detect::Stage::StopDetect, now);
+                heap_meter.end_parallel_stages(lane_detect::Stage::OutsideDetect, lane_detect::Stage::StopDetect);
+            }
+            else
+            {
+                heap_meter.end_stage(lane_detect::Stage::OutsideDetect);
+            }
+            stage_start = now;
+        };
+
+        // Get into the right color space for thresholding. RGB565 is classified straight from
+        // the profile's generated table, if it has one; otherwise it goes through HSV. Grayscale
+        // is classified by the profile's luma table, unless only edges will be looked for. YUV is thresholded as captured. A class map is split by class for the detectors,
+        // unless the scanline mode will only sample a few rows of it.
+        const bool outside_by_edges = lane_detect::OutsideDetector::Edges == outside_detector && !plan.scanline_mode;
+        const auto classify = [&](const uint8_t* table)
+        {
+            if (coarse_shift > 0)
+            {
+                const lane_detect::ProfileRegion& region = derived.detection_region;
+                coarse_lookup.lookup(working_frame, table, cv::Rect2i(region.x, region.y, region.width, region.height), class_map);
+            }
+            else
+            {
+                lane_detect::parallel_lookup(working_frame, table, class_map);
+            }
+        };
+
+        cv::Mat frame;
+        const lane_detect::ClassPlanes* planes = nullptr;
+        if (lane_detect::CaptureMode::Yuv422 == capture_mode)
+        {
+            frame = working_frame;
+        }
+        else if (lane_detect::CaptureMode::Grayscale == capture_mode && outside_by_edges)
+        {
+            frame = working_frame;
+        }
+        else if (lane_detect::CaptureMode::Grayscale == capture_mode)
+        {
+            classify(derived.luma_classes);
+            frame = class_map;
+        }
+        else if (derived.class_table < lane_detect::PROFILE_COUNT)
+        {
+            classify(lane_detect::generated_profiles[derived.class_table].class_table);
+            frame = class_map;
+        }
+        else
+        {
+            cv::Mat bgr;
+            lane_detect::parallel_cvt_color(working_frame, bgr, cv::COLOR_BGR5652BGR, CV_8UC3);
+            lane_detect::parallel_cvt_color(bgr, frame, cv::COLOR_BGR2HSV, CV_8UC3);
+        }
+        if (frame.data == class_map.data && !plan.scanline_mode)
+        {
+            class_planes.split(class_map, 0, static_cast<uint16_t>(class_map.rows));
+            planes = &class_planes;
+        }
+        end_stage(lane_detect::Stage::Convert);
+
+        // Perform detection on the outside line and the stop line at once, one on each core. Both
+        // only read the frame, and each writes to its own mask. The extra classes follow the stop
+        // line on its core. When the stop detection is decimated away, the previous results stand.
+        const uint16_t crop_rows = frame.rows - calibration.values.outside.crop_top - calibration.values.outside.crop_bottom;
+        const uint16_t extra_top = plan.shrink_roi ? (crop_rows >> roi_shrink_shift) : 0;
+
+        // When cutting back, only the columns the line is predicted in are searched, across the
+        // rows left. Until there is a prediction that is every column.
+        lane_detect::SearchWindow search_window = whole_row;
+        if (plan.shrink_roi || plan.scanline_mode)
+        {
+            search_window = line_estimator.predicted_window(
+                xTaskGetTickCount(),
+                calibration.values.line_pos,
+                static_cast<int16_t>(line_row),
+                calibration.values.outside.crop_top + extra_top,
+                frame.rows - calibration.values.outside.crop_bottom - 1,
+                search_window_spreads,
+                frame.cols);
+        }
         cv::Point2i outside_line_center;
-        float outside_line_slope;
-        outside_line_detection(hsv_outside, outside_thresh, outside_line_center, outside_line_slope);
-        int outside_dist_from_ideal = outside_line_center.x - expected_line_pos;
+        lane_detect::LineFit outside_line_fit;
+        LineEvidence outside_evidence;
+        uint32_t outside_us = 0;
+        uint32_t stop_us = 0;
+        const bool was_detected = detected;
+
+        const auto detect_outside = [&]()
+        {
+            const int64_t start = esp_timer_get_time();
+            if (plan.scanline_mode)
+            {
+                outside_line_scanline(calibration, frame, outside_thresh, outside_runs, outside_fitter, outside_curve, outside_line_center, outside_line_fit, outside_evidence, extra_top, search_window);
+            }
+            else if (outside_by_edges)
+            {
+                outside_line_edges(calibration, working_frame, luma_source(capture_mode), outside_thresh, outside_runs, outside_edges, outside_fitter, outside_curve, outside_line_center, outside_line_fit, outside_evidence, extra_top, search_window);
+            }
+            else
+            {
+                outside_line_detection(calibration, frame, planes, outside_thresh, outside_runs, outside_bits, outside_fitter, outside_curve, outside_line_center, outside_line_fit, outside_evidence, extra_top, search_window);
+            }
+            outside_us = static_cast<uint32_t>(esp_timer_get_time() - start);
+        };
+
+        const auto detect_stop = [&]()
+        {
+            const int64_t start = esp_timer_get_time();
+            stop_line_detection(calibration, frame, planes, stop_thresh, stop_runs, stop_bits, detected);
+            extra_detected = extra_class_detection(calibration, frame, planes, extra_thresh, extra_runs, extra_bits);
+            stop_us = static_cast<uint32_t>(esp_timer_get_time() - start);
+        };
+
+        if (lane_detect::CaptureMode::Grayscale == capture_mode)
+        {
+            // There is no color to find the stop line by.
+            detect_outside();
+            detected = false;
+            extra_detected = 0;
+            stop_thresh = in_black_box ? black_box.mask(true) : stop_mask;
+            stop_thresh.setTo(0);
+            stop_runs.clear();
+            box_entry.stop_mask_valid = true;
+        }
+        else if (plan.run_stop_detection)
+        {
+            stop_thresh = in_black_box ? black_box.mask(true) : stop_mask;
+            detectors.run(detect_outside, detect_stop);
+            ran_stop_detection = true;
+            scheduler.record_stage(lane_detect::Stage::StopDetect, stop_us, false);
+            box_entry.stage_us[static_cast<uint8_t>(lane_detect::Stage::StopDetect)] = stop_us;
+            box_entry.stop_mask_valid = true;
+        }
+        else
+        {
+            detect_outside();
+        }
+        scheduler.record_stage(lane_detect::Stage::OutsideDetect, outside_us, false);
+        box_entry.stage_us[static_cast<uint8_t>(lane_detect::Stage::OutsideDetect)] = outside_us;
+        end_parallel_stages();
+        const float outside_line_slope = outside_line_fit.slope;
+
+        // A center of -1 means the line was missed; let the estimator predict through it rather
+        // than reporting the raw -1 as a position.
+        const bool outside_detected = outside_line_center.x >= 0;
+        line_estimator.advance_to(xTaskGetTickCount(), outside_detected);
+        int confidence = 0;
+        if (outside_detected)
+        {
+            confidence = detection_confidence(outside_evidence, outside_line_fit, line_estimator.estimate(), outside_line_center.x - calibration.values.line_pos);
+            line_estimator.update(outside_line_center.x - calibration.values.line_pos, outside_line_slope);
+            line_row = outside_line_center.y;
+        }
+        const auto line_estimate = line_estimator.estimate();
+        int outside_dist_from_ideal = lane_detect::from_fixed(line_estimate.offset);
 
-        // Perform detection on the stop line.
-        cv::Mat1b stop_thresh;
-        bool detected;
-        stop_line_detection(hsv, stop_thresh, detected);
+        // The curve is fitted in the undistorted frame, so it is measured at the undistorted
+        // centerpoint. Like the estimate, it holds through misses until the line is lost.
+        lane_detect::CurveFit curve_fit;
+        if (outside_detected && outside_curve.fit(curve_fit))
+        {
+            const lane_detect::FramePoint center = lane_detect::undistort(outside_line_center.x, outside_line_center.y, frame_geometry::width, frame_geometry::height);
+            line_curvature = curve_fit.curvature(center.row);
+        }
+        else if (!line_estimate.valid)
+        {
+            line_curvature = 0.0f;
+        }
 
         // Write to the screen.
-        PrintParams params;
-        params.start_tick = start_tick;
-        params.frame = outside_thresh | stop_thresh;
-        params.outside_dist_from_ideal = outside_dist_from_ideal;
-        params.outside_line_slope = outside_line_slope;
-        params.stop_detected = detected;
-        output_to_screen(screen, params);
-
-        // Write to TX.
+        if (plan.run_display)
+        {
+            PrintParams params;
+            params.frame_period_us = latency.processed_period();
+            lane_detect::RleMask::composite_or(outside_runs, stop_runs, display_runs);
+            display_runs.rasterize(display_frame);
+            if (outside_line_center.x >= 0)
+            {
+                cv::line(display_frame, cv::Point2i(outside_line_center.x, 0), cv::Point2i(outside_line_center.x, display_frame.rows), 0xff);
+            }
+            params.frame = display_frame;
+            params.outside_dist_from_ideal = outside_dist_from_ideal;
+            params.outside_line_slope = outside_line_slope;
+            params.stop_detected = detected;
+            output_to_screen(screen, params);
+            end_stage(lane_detect::Stage::Display);
+        }
+
+        // Hand the frame's results to the control output, which sends them from its next period.
+        #if(CALIBRATION_MODE == 0)
+        lane_detect::ControlFrame control_frame;
+        control_frame.line_pos = calibration.values.line_pos;
+        control_frame.line_row = line_row;
+        control_frame.curvature = line_curvature;
+        control_frame.confidence = static_cast<uint8_t>(confidence);
+        control_frame.extra_count = calibration.values.extra_count;
+        control_frame.extra_detected = extra_detected;
+        const int64_t output_us = control.publish(line_estimator, control_frame);
+        end_stage(lane_detect::Stage::Uart);
+        latency.end_frame(output_us);
+        #else
+        latency.end_frame(esp_timer_get_time());
+        #endif
+        heap_meter.end_frame();
+
+        // Record the frame as captured, with what was made of it. This only copies; the writing
+        // happens on the other core.
+        if (recorder.recording())
+        {
+            lane_detect::FrameRecordInfo info = {};
+            info.timestamp_us = capture_us;
+            info.capture_mode = static_cast<uint8_t>(capture_mode);
+            info.stop_detected = detected;
+            info.outside_dist = static_cast<int16_t>(outside_dist_from_ideal);
+            info.outside_slope = outside_line_slope;
+            recorder.record(working_frame, info);
+        }
+
+        // Keep the frame in the black box, and trigger it on a stop line or a frame over budget.
+        if (in_black_box)
+        {
+            const int64_t box_start = esp_timer_get_time();
+            box_entry.info.timestamp_us = capture_us;
+            box_entry.info.sequence = sequence;
+            box_entry.info.width = working_frame.cols;
+            box_entry.info.height = working_frame.rows;
+            box_entry.info.capture_mode = static_cast<uint8_t>(capture_mode);
+            box_entry.info.stop_detected = detected;
+            box_entry.info.outside_dist = static_cast<int16_t>(outside_dist_from_ideal);
+            box_entry.info.outside_slope = outside_line_slope;
+            box_entry.frame_us = static_cast<uint32_t>(box_start - frame_start_us);
+            box_entry.level = static_cast<uint8_t>(plan.level);
+            if (detected && !was_detected)
+            {
+                black_box.trigger(lane_detect::BlackBoxTrigger::StopDetected);
+            }
+            else if (box_entry.frame_us > frame_budget_us)
+            {
+                black_box.trigger(lane_detect::BlackBoxTrigger::Overrun);
+            }
+            black_box.commit(box_entry);
+            #if(CALIBRATION_MODE == 1)
+            black_box_us += static_cast<uint32_t>(esp_timer_get_time() - box_start);
+            #endif
+        }
+
+        // A black box dump has the UART to itself; the controller asked for it.
         #if(CALIBRATION_MODE == 0)
-        auto dist_string = std::to_string(outside_dist_from_ideal);
-        uart_write_bytes(UART_NUM, "D", 1);
-        uart_write_bytes(UART_NUM, dist_string.data(), dist_string.size());
-        uart_write_bytes(UART_NUM, "E", 1);
+        control.hold(black_box.dump_pending());
+        #endif
+
+        scheduler.end_frame();
+
+        #if(CALIBRATION_MODE == 1)
+        // Periodically report how much time was spent at each degradation level.
+        if (0 == (++frame_count % scheduler_report_frames))
+        {
+            ESP_LOGI(TAG, "detect: outside %luus, stop %luus",
+                static_cast<unsigned long>(scheduler.stage_cost(lane_detect::Stage::OutsideDetect)),
+                static_cast<unsigned long>(scheduler.stage_cost(lane_detect::Stage::StopDetect)));
+            ESP_LOGI(TAG, "frame %luus of %luus budget; levels: full %lu, no-display %lu, stop/N %lu, small-roi %lu, scanline %lu",
+                static_cast<unsigned long>(scheduler.frame_cost()),
+                static_cast<unsigned long>(scheduler.budget()),
+                static_cast<unsigned long>(scheduler.frames_at_level(lane_detect::QualityLevel::Full)),
+                static_cast<unsigned long>(scheduler.frames_at_level(lane_detect::QualityLevel::SkipDisplay)),
+                static_cast<unsigned long>(scheduler.frames_at_level(lane_detect::QualityLevel::DecimateStop)),
+                static_cast<unsigned long>(scheduler.frames_at_level(lane_detect::QualityLevel::ShrinkRoi)),
+                static_cast<unsigned long>(scheduler.frames_at_level(lane_detect::QualityLevel::Scanline)));
+            ESP_LOGI(TAG, "black box: %u frames in %u bytes, %luus/frame",
+                static_cast<unsigned>(black_box.slot_count()),
+                static_cast<unsigned>(black_box.memory_used()),
+                static_cast<unsigned long>(black_box_us / scheduler_report_frames));
+            black_box_us = 0;
+            ESP_LOGI(TAG, "latency: p50 %luus, p99 %luus; %lu frames dropped",
+                static_cast<unsigned long>(latency.latency().percentile(50)),
+                static_cast<unsigned long>(latency.latency().percentile(99)),
+                static_cast<unsigned long>(latency.dropped()));
+
+            const auto heap_marks = lane_detect::heap_stats::high_water();
+            ESP_LOGI(TAG, "heap: convert %lu, outside %lu, stop %lu allocs/frame at worst; high water internal %u, psram %u; %lu frames over budget",
+                static_cast<unsigned long>(heap_meter.worst(lane_detect::Stage::Convert).allocs),
+                static_cast<unsigned long>(heap_meter.worst(lane_detect::Stage::OutsideDetect).allocs),
+                static_cast<unsigned long>(heap_meter.worst(lane_detect::Stage::StopDetect).allocs),
+                static_cast<unsigned>(heap_marks.internal),
+                static_cast<unsigned>(heap_marks.psram),
+                static_cast<unsigned long>(heap_meter.over_budget_frames()));
+        }
         #endif
 
         vTaskDelay(1);
@@ -459,10 +1524,31 @@ inline void main_loop()
 }
 
 
+#if(LIVE_TUNING == 1)
+// The baked-in calibration's loop isn't otherwise built while tuning live; instantiated here so
+// that it keeps compiling.
+template void main_loop<StaticCalibration>(StaticCalibration& calibration, lane_detect::ProfileDerived derived, const lane_detect::CalibrationProfiles* profiles);
+#endif
+
+
 /// @brief The entry-point.
 void app_main(void)
 {
-    lane_detect::config_cam();
-
-    main_loop();
+    ESP_LOGI(TAG, "Built from calibration %08lx", static_cast<unsigned long>(params_checksum));
+    lane_detect::start_parallel_pool();
+    lane_detect::config_cam(initial_capture_mode, frame_size);
+
+    #if(LIVE_TUNING == 1)
+    // Start in the first profile; the others are switched to with the 'P' command.
+    static lane_detect::CalibrationProfiles profiles(frame_geometry::width, frame_geometry::height, params_checksum);
+    profiles.load(lane_detect::generated_profiles, calibration_width, calibration_height);
+    static lane_detect::RuntimeCalibration calibration = {params_calibration};
+    lane_detect::ProfileDerived derived;
+    profiles.select(0, calibration, derived);
+    main_loop(calibration, derived, &profiles);
+    #else
+    // params.h is the first generated profile, so its class table is that profile's.
+    StaticCalibration calibration;
+    main_loop(calibration, lane_detect::derive_profile(params_calibration, frame_geometry::width, frame_geometry::height, 0));
+    #endif
 }
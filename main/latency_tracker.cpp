@@ -0,0 +1,166 @@
+#include "latency_tracker.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+
+namespace lane_detect
+{
+    // The processed frame period is smoothed as ema += (sample - ema) / 2^PERIOD_EMA_SHIFT.
+    constexpr uint8_t PERIOD_EMA_SHIFT = 4;
+
+
+    RollingHistogram::RollingHistogram(const uint32_t bucket_us):
+        bucket_us_(std::max<uint32_t>(1, bucket_us)),
+        samples_(),
+        head_(0),
+        count_(0),
+        buckets_()
+    {
+    }
+
+
+    void RollingHistogram::add(const uint32_t value_us)
+    {
+        const auto bucket_of = [this](const uint32_t value)
+        {
+            return std::min<uint32_t>(value / bucket_us_, HISTOGRAM_BUCKETS - 1);
+        };
+
+        if (HISTOGRAM_WINDOW == count_)
+        {
+            buckets_[bucket_of(samples_[head_])]--;
+        }
+        else
+        {
+            count_++;
+        }
+
+        samples_[head_] = value_us;
+        buckets_[bucket_of(value_us)]++;
+        head_ = (head_ + 1) % HISTOGRAM_WINDOW;
+    }
+
+
+    uint32_t RollingHistogram::percentile(const uint8_t percent) const
+    {
+        if (0 == count_)
+        {
+            return 0;
+        }
+
+        // The window is full or fills from the start, so the samples are always the first count_.
+        uint32_t sorted[HISTOGRAM_WINDOW];
+        memcpy(sorted, samples_, count_ * sizeof(uint32_t));
+        const uint16_t rank = std::min<uint32_t>(count_ * std::min<uint8_t>(percent, 100) / 100, count_ - 1);
+        std::nth_element(sorted, sorted + rank, sorted + count_);
+        return sorted[rank];
+    }
+
+
+    LatencyTracker::LatencyTracker(const uint32_t frame_period_us, const uint32_t latency_bucket_us, const uint32_t jitter_bucket_us):
+        latency_(latency_bucket_us),
+        jitter_(jitter_bucket_us),
+        current_(),
+        last_(),
+        period_us_(std::max<uint32_t>(1, frame_period_us)),
+        processed_period_us_(0),
+        dropped_(0),
+        started_(false)
+    {
+    }
+
+
+    uint32_t LatencyTracker::begin_frame(const int64_t capture_us, const int64_t fetched_us)
+    {
+        uint32_t sequence = 0;
+        if (started_)
+        {
+            const uint32_t interval = static_cast<uint32_t>(capture_us - current_.capture_us);
+
+            // An interval of about N frame periods means N - 1 frames were produced but never
+            // processed. The jitter is how far it was from exactly N.
+            const uint32_t periods = std::max<uint32_t>(1, (interval + period_us_ / 2) / period_us_);
+            const int64_t delta = static_cast<int64_t>(interval) - static_cast<int64_t>(periods) * period_us_;
+            jitter_.add(static_cast<uint32_t>(delta < 0 ? -delta : delta));
+            const uint32_t missed = periods - 1;
+
+            if (0 == processed_period_us_)
+            {
+                processed_period_us_ = interval;
+            }
+            else
+            {
+                const int32_t change = static_cast<int32_t>(interval) - static_cast<int32_t>(processed_period_us_);
+                processed_period_us_ = static_cast<uint32_t>(static_cast<int32_t>(processed_period_us_) + (change >> PERIOD_EMA_SHIFT));
+            }
+
+            dropped_ += missed;
+            sequence = current_.sequence + 1 + missed;
+        }
+        started_ = true;
+
+        memset(&current_, 0, sizeof(current_));
+        current_.sequence = sequence;
+        current_.capture_us = capture_us;
+        current_.fetched_us = fetched_us;
+        return sequence;
+    }
+
+
+    void LatencyTracker::mark_stage(const Stage stage, const int64_t end_us)
+    {
+        current_.stage_end_us[static_cast<uint8_t>(stage)] = end_us;
+    }
+
+
+    void LatencyTracker::end_frame(const int64_t output_us)
+    {
+        current_.output_us = output_us;
+        latency_.add(static_cast<uint32_t>(output_us - current_.capture_us));
+        last_ = current_;
+    }
+
+
+    void LatencyTracker::report() const
+    {
+        printf("LATENCY frames %u, dropped %lu, period %luus, processed every %luus\n",
+            static_cast<unsigned>(latency_.count()),
+            static_cast<unsigned long>(dropped_),
+            static_cast<unsigned long>(period_us_),
+            static_cast<unsigned long>(processed_period_us_));
+
+        const RollingHistogram* histograms[] = {&latency_, &jitter_};
+        const char* names[] = {"latency", "jitter"};
+        for (uint8_t h = 0; h < 2; h++)
+        {
+            const RollingHistogram& histogram = *histograms[h];
+            printf("%s p50 %luus, p90 %luus, p99 %luus, max %luus;",
+                names[h],
+                static_cast<unsigned long>(histogram.percentile(50)),
+                static_cast<unsigned long>(histogram.percentile(90)),
+                static_cast<unsigned long>(histogram.percentile(99)),
+                static_cast<unsigned long>(histogram.percentile(100)));
+            for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            {
+                printf(" %u", static_cast<unsigned>(histogram.bucket(i)));
+            }
+            printf(" (per %luus)\n", static_cast<unsigned long>(histogram.bucket_width()));
+        }
+
+        // The last frame's timeline, relative to its capture.
+        printf("last frame %lu: fetched +%ldus",
+            static_cast<unsigned long>(last_.sequence),
+            static_cast<long>(last_.fetched_us - last_.capture_us));
+        for (uint8_t stage = 0; stage < static_cast<uint8_t>(Stage::Count); stage++)
+        {
+            if (last_.stage_end_us[stage] != 0)
+            {
+                printf(", %s +%ldus", stage_name(static_cast<Stage>(stage)), static_cast<long>(last_.stage_end_us[stage] - last_.capture_us));
+            }
+        }
+        printf(", output +%ldus\n", static_cast<long>(last_.output_us - last_.capture_us));
+        fflush(stdout);
+    }
+}
@@ -0,0 +1,144 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Tracks the end-to-end latency of the pipeline, from the sensor capturing a frame to the
+/// controller receiving its output, and the jitter in the interval between captured frames.
+///
+/// Like the frame scheduler, the tracker never reads a clock itself; timestamps are handed to it,
+/// all from esp_timer (which the camera driver also stamps frames with).
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#include "frame_scheduler.h"
+
+namespace lane_detect
+{
+    /// @brief The number of buckets in a RollingHistogram. The last one also holds everything
+    /// beyond it.
+    constexpr uint8_t HISTOGRAM_BUCKETS = 16;
+
+    /// @brief The number of most recent samples a RollingHistogram covers.
+    constexpr uint16_t HISTOGRAM_WINDOW = 256;
+
+
+    /// @brief A histogram of the most recent samples, with evenly sized buckets.
+    class RollingHistogram
+    {
+        public:
+        /// @param bucket_us The width of each bucket, in microseconds.
+        explicit RollingHistogram(uint32_t bucket_us);
+
+        /// @brief Adds a sample, evicting the oldest if the window is full.
+        /// @param value_us The sample, in microseconds.
+        void add(uint32_t value_us);
+
+        /// @return The number of samples in the window.
+        uint16_t count() const { return count_; }
+
+        /// @return The number of samples in a bucket.
+        uint16_t bucket(uint8_t index) const { return buckets_[index]; }
+
+        /// @return The width of each bucket, in microseconds.
+        uint32_t bucket_width() const { return bucket_us_; }
+
+        /// @brief Finds a percentile of the samples in the window. Sorts a copy of the window, so
+        /// it is for reporting, not for every frame.
+        /// @param percent The percentile, from 0 to 100.
+        /// @return The percentile, in microseconds, or 0 if there are no samples.
+        uint32_t percentile(uint8_t percent) const;
+
+        private:
+        uint32_t bucket_us_;
+        uint32_t samples_[HISTOGRAM_WINDOW];
+        uint16_t head_;
+        uint16_t count_;
+        uint16_t buckets_[HISTOGRAM_BUCKETS];
+    };
+
+
+    /// @brief The timestamps of one frame, in microseconds.
+    struct FrameTimes
+    {
+        /// @brief Numbers every frame the sensor produced, counting those which were never
+        /// processed, so that gaps show where frames were dropped.
+        uint32_t sequence;
+
+        /// @brief When the camera driver stamped the frame, at the start of its capture.
+        int64_t capture_us;
+
+        /// @brief When the pipeline got the frame from the driver.
+        int64_t fetched_us;
+
+        /// @brief When each stage ended. 0 if it didn't run.
+        int64_t stage_end_us[static_cast<uint8_t>(Stage::Count)];
+
+        /// @brief When the output finished going out over the UART.
+        int64_t output_us;
+    };
+
+
+    /// @brief Numbers frames, and keeps histograms of their latency and jitter.
+    class LatencyTracker
+    {
+        public:
+        /// @param frame_period_us The time between frames from the sensor, as configured, in
+        /// microseconds. It isn't learned from the frames, since a pipeline which only keeps up
+        /// with every other frame would learn twice the period, and never see a frame dropped.
+        /// @param latency_bucket_us The width of each latency histogram bucket, in microseconds.
+        /// @param jitter_bucket_us The width of each jitter histogram bucket, in microseconds.
+        explicit LatencyTracker(uint32_t frame_period_us, uint32_t latency_bucket_us = 4000, uint32_t jitter_bucket_us = 500);
+
+        /// @brief Starts a frame. Works out how many frames the sensor produced since the last
+        /// one, from the gap between their capture times in frame periods.
+        /// @param capture_us When the frame was captured.
+        /// @param fetched_us When the pipeline got it.
+        /// @return The frame's sequence number.
+        uint32_t begin_frame(int64_t capture_us, int64_t fetched_us);
+
+        /// @brief Stamps the end of a stage of the current frame.
+        /// @param stage The stage.
+        /// @param end_us When it ended.
+        void mark_stage(Stage stage, int64_t end_us);
+
+        /// @brief Finishes the current frame.
+        /// @param output_us When its output finished going out.
+        void end_frame(int64_t output_us);
+
+        /// @brief Prints the histograms, percentiles, drop count and the last frame's timestamps
+        /// to the serial port.
+        void report() const;
+
+        /// @return The capture-to-output latency of recent frames.
+        const RollingHistogram& latency() const { return latency_; }
+
+        /// @return How far the interval between recent processed frames was from a whole number of
+        /// frame periods.
+        const RollingHistogram& jitter() const { return jitter_; }
+
+        /// @return The number of frames the sensor produced which were never processed.
+        uint32_t dropped() const { return dropped_; }
+
+        /// @return The time between frames from the sensor, in microseconds, as configured.
+        uint32_t frame_period() const { return period_us_; }
+
+        /// @return The average time between processed frames, in microseconds. 0 until two frames
+        /// have been seen.
+        uint32_t processed_period() const { return processed_period_us_; }
+
+        /// @return The timestamps of the last finished frame.
+        const FrameTimes& last_frame() const { return last_; }
+
+        private:
+        RollingHistogram latency_;
+        RollingHistogram jitter_;
+        FrameTimes current_;
+        FrameTimes last_;
+        uint32_t period_us_;
+        uint32_t processed_period_us_;
+        uint32_t dropped_;
+        bool started_;
+    };
+}
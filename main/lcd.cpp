@@ -54,9 +54,9 @@ void lane_detect::lcd_draw_data(SSD1306_t& screen, std::string preamble, bool da
 void lane_detect::lcd_draw_matrix(SSD1306_t& screen, const cv::Mat& bin_mat)
 {
     curr_row = 0;
-    for (uint8_t row = 0; row < bin_mat.rows; row++)
+    for (int row = 0; row < bin_mat.rows; row++)
     {
-        for (uint8_t col = 0; col < bin_mat.cols; col++)
+        for (int col = 0; col < bin_mat.cols; col++)
         {
             const bool invert = (0 == bin_mat.at<uint8_t>(row, col));
             _ssd1306_pixel(&screen, col, row, invert);
@@ -0,0 +1,217 @@
+#include "line_fit.h"
+
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
+
+namespace lane_detect
+{
+    // The chance that RANSAC draws at least one pair of inliers, which decides when it has tried
+    // enough candidates to stop early.
+    constexpr float RANSAC_CONFIDENCE = 0.99f;
+
+    // The deadline is checked once per this many candidates.
+    constexpr uint16_t DEADLINE_CHECK_INTERVAL = 8;
+
+    // cosf(pi / 2) isn't quite 0, so a fitted direction this close to an axis is taken as on it.
+    constexpr float AXIS_EPSILON = 1e-6f;
+
+
+    /// @return The time, in microseconds, for the deadline.
+    static int64_t now_us()
+    {
+        #ifdef ESP_PLATFORM
+        return esp_timer_get_time();
+        #else
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        #endif
+    }
+
+
+    LineFitter::LineFitter(const LineFitBudget& budget, const uint32_t seed):
+        budget_(budget),
+        seed_(seed),
+        state_(seed),
+        count_(0),
+        iterations_(0)
+    {
+        cols_.resize(budget.max_points);
+        rows_.resize(budget.max_points);
+    }
+
+
+    bool LineFitter::add_point(const float col, const float row)
+    {
+        if (count_ >= budget_.max_points)
+        {
+            return false;
+        }
+
+        cols_[count_] = col;
+        rows_[count_] = row;
+        count_++;
+        return true;
+    }
+
+
+    uint32_t LineFitter::next_random()
+    {
+        // Marsaglia's xorshift32.
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+
+    uint16_t LineFitter::count_inliers(const uint16_t a, const uint16_t b) const
+    {
+        // A point's distance from the line is its cross product with the line's direction, over
+        // the direction's length; comparing against the length saves the division.
+        const float d_col = cols_[b] - cols_[a];
+        const float d_row = rows_[b] - rows_[a];
+        const float limit = budget_.inlier_distance * sqrtf(d_col * d_col + d_row * d_row);
+
+        uint16_t inliers = 0;
+        for (uint16_t i = 0; i < count_; i++)
+        {
+            const float cross = (cols_[i] - cols_[a]) * d_row - (rows_[i] - rows_[a]) * d_col;
+            if (fabsf(cross) <= limit)
+            {
+                inliers++;
+            }
+        }
+        return inliers;
+    }
+
+
+    bool LineFitter::fit(LineFit& fit)
+    {
+        iterations_ = 0;
+        if (count_ < 2)
+        {
+            return false;
+        }
+
+        // Draw pairs of distinct points until the deadline, the cap, or until enough have been
+        // drawn that one was almost certainly a pair of inliers, given the best count so far.
+        state_ = seed_;
+        const int64_t start_us = now_us();
+        uint16_t best_a = 0;
+        uint16_t best_b = 1;
+        uint16_t best_inliers = 0;
+        uint32_t needed = budget_.max_iterations;
+        while (iterations_ < needed)
+        {
+            if (iterations_ > 0 && 0 == iterations_ % DEADLINE_CHECK_INTERVAL
+                && now_us() - start_us > budget_.max_us)
+            {
+                break;
+            }
+            iterations_++;
+
+            const uint16_t a = static_cast<uint16_t>(next_random() % count_);
+            uint16_t b = static_cast<uint16_t>(next_random() % (count_ - 1));
+            if (b >= a)
+            {
+                b++;
+            }
+            if (cols_[a] == cols_[b] && rows_[a] == rows_[b])
+            {
+                continue;
+            }
+
+            const uint16_t inliers = count_inliers(a, b);
+            if (inliers > best_inliers)
+            {
+                best_inliers = inliers;
+                best_a = a;
+                best_b = b;
+                if (inliers == count_)
+                {
+                    break;
+                }
+
+                const float ratio = static_cast<float>(inliers) / count_;
+                const float enough = logf(1.0f - RANSAC_CONFIDENCE) / logf(1.0f - ratio * ratio);
+                if (enough < needed)
+                {
+                    needed = static_cast<uint32_t>(ceilf(enough));
+                }
+            }
+        }
+
+        if (best_inliers < 2)
+        {
+            return false;
+        }
+
+        // Refine by total least squares over the inliers, which treats rows and columns alike, so
+        // steep lines fit as well as shallow ones. The inliers are taken again against the
+        // refined line, and it is refined once more.
+        float point_col = cols_[best_a];
+        float point_row = rows_[best_a];
+        float dir_col = cols_[best_b] - cols_[best_a];
+        float dir_row = rows_[best_b] - rows_[best_a];
+        const float length = sqrtf(dir_col * dir_col + dir_row * dir_row);
+        dir_col /= length;
+        dir_row /= length;
+
+        uint16_t inliers = 0;
+        for (uint8_t pass = 0; pass < 2; pass++)
+        {
+            float sum_col = 0.0f;
+            float sum_row = 0.0f;
+            inliers = 0;
+            for (uint16_t i = 0; i < count_; i++)
+            {
+                const float cross = (cols_[i] - point_col) * dir_row - (rows_[i] - point_row) * dir_col;
+                if (fabsf(cross) <= budget_.inlier_distance)
+                {
+                    sum_col += cols_[i];
+                    sum_row += rows_[i];
+                    inliers++;
+                }
+            }
+            if (inliers < 2)
+            {
+                return false;
+            }
+
+            const float mean_col = sum_col / inliers;
+            const float mean_row = sum_row / inliers;
+            float s_cc = 0.0f;
+            float s_rr = 0.0f;
+            float s_cr = 0.0f;
+            for (uint16_t i = 0; i < count_; i++)
+            {
+                const float cross = (cols_[i] - point_col) * dir_row - (rows_[i] - point_row) * dir_col;
+                if (fabsf(cross) <= budget_.inlier_distance)
+                {
+                    const float d_col = cols_[i] - mean_col;
+                    const float d_row = rows_[i] - mean_row;
+                    s_cc += d_col * d_col;
+                    s_rr += d_row * d_row;
+                    s_cr += d_col * d_row;
+                }
+            }
+
+            // The line runs along the scatter's major axis.
+            const float angle = 0.5f * atan2f(2.0f * s_cr, s_cc - s_rr);
+            point_col = mean_col;
+            point_row = mean_row;
+            dir_col = cosf(angle);
+            dir_row = sinf(angle);
+        }
+
+        fit.slope = (fabsf(dir_col) > AXIS_EPSILON) ? dir_row / dir_col : INFINITY;
+        fit.intercept = (fabsf(dir_row) > AXIS_EPSILON) ? point_col - point_row * dir_col / dir_row : INFINITY;
+        fit.inlier_ratio = static_cast<float>(inliers) / count_;
+        return true;
+    }
+}
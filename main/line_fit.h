@@ -0,0 +1,109 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Fits a straight line to a handful of points on it, robustly and within a fixed budget.
+///
+/// The slope through a blob's two extreme pixels swings with a single stray pixel. Instead, a few
+/// dozen points are sampled along the line (the middles of its runs, or scanline hits), and RANSAC
+/// finds the line most of them agree with: pairs of points are drawn as candidates, the one with
+/// the most points near it wins, and the winner is refined by least squares over those points.
+/// The pairs come from a seeded xorshift generator, reseeded for every fit, so the same points
+/// always give the same line. Both the points and the candidates are capped, and the candidates
+/// are also cut off by a deadline, so the worst case is bounded.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace lane_detect
+{
+    /// @brief A line fitted by a LineFitter.
+    struct LineFit
+    {
+        /// @brief The slope, in rows per column. Infinite if the line is vertical.
+        float slope;
+
+        /// @brief The column at which the line crosses row 0. Infinite if the line is horizontal.
+        float intercept;
+
+        /// @brief The fraction of the points which lie on the line, from 0 to 1; a measure of
+        /// how much the fit can be trusted.
+        float inlier_ratio;
+    };
+
+
+    /// @brief The limits on a LineFitter.
+    struct LineFitBudget
+    {
+        /// @brief The most points kept. Any more are dropped.
+        uint16_t max_points;
+
+        /// @brief The most candidate lines tried.
+        uint16_t max_iterations;
+
+        /// @brief The longest the candidates may take, in microseconds. Checked every few
+        /// candidates, so it may be overrun by a few.
+        uint32_t max_us;
+
+        /// @brief How far, in pixels, a point may lie from a line and still be on it.
+        float inlier_distance;
+    };
+
+
+    /// @brief The budget the outside line is fitted with: at most 48 points sampled along it, at
+    /// most 64 candidate lines or 300 us, whichever runs out first, and points within 1.5 pixels
+    /// of a line count as on it. Shared with the host tests, so that they fit as the pipeline does.
+    constexpr LineFitBudget OUTSIDE_LINE_FIT_BUDGET = {48, 64, 300, 1.5f};
+
+    /// @brief The seed the outside line is fitted with, which makes its fits repeatable.
+    constexpr uint32_t OUTSIDE_LINE_FIT_SEED = 0x2545f491;
+
+
+    /// @brief Robustly fits a line to a bounded set of points, by RANSAC then least squares.
+    class LineFitter
+    {
+        public:
+        /// @param budget The limits on each fit.
+        /// @param seed The seed each fit starts its random draws from. Must not be 0.
+        LineFitter(const LineFitBudget& budget, uint32_t seed);
+
+        /// @brief Drops the points, for the next fit.
+        void clear() { count_ = 0; }
+
+        /// @brief Adds a point.
+        /// @param col The point's column. May be fractional.
+        /// @param row The point's row.
+        /// @return False if the points are full, and the point was dropped.
+        bool add_point(float col, float row);
+
+        /// @return The number of points.
+        uint16_t point_count() const { return count_; }
+
+        /// @brief Fits a line to the points.
+        /// @param fit The line. Output param. Only written on success.
+        /// @return False if there were fewer than two points on any line.
+        bool fit(LineFit& fit);
+
+        /// @return The number of candidates the last fit tried.
+        uint16_t iterations() const { return iterations_; }
+
+        private:
+        /// @brief Draws the next number from the xorshift generator.
+        uint32_t next_random();
+
+        /// @brief Counts the points within inlier_distance of the line through two points.
+        uint16_t count_inliers(uint16_t a, uint16_t b) const;
+
+        LineFitBudget budget_;
+        uint32_t seed_;
+        uint32_t state_;
+        uint16_t count_;
+        uint16_t iterations_;
+
+        /// @brief The points' columns and rows, reserved for max_points up front.
+        std::vector<float> cols_;
+        std::vector<float> rows_;
+    };
+}
@@ -0,0 +1,294 @@
+#include "parallel_rows.h"
+
+#undef EPS
+#include "opencv2/imgproc.hpp"
+#define EPS 192
+
+#ifdef ESP_PLATFORM
+#include <exception>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#endif
+
+
+namespace lane_detect
+{
+    #ifdef ESP_PLATFORM
+
+    static const char TAG[] = "parallel_rows";
+
+    // The number of workers in the pool; one per core.
+    constexpr uint8_t pool_size = 2;
+
+    // Workers run above the main task so that a stripe on the caller's core isn't starved by it.
+    constexpr UBaseType_t worker_priority = 5;
+    constexpr uint32_t worker_stack_size = 4096;
+
+
+    /// @brief The shared state of the worker pool. There is only ever one.
+    struct ParallelPool
+    {
+        TaskHandle_t workers[pool_size];
+
+        /// @brief Held for the duration of a dispatch. Taken without waiting; if it's already
+        /// held, the caller does the work itself.
+        SemaphoreHandle_t busy;
+
+        /// @brief Given once by each worker as it finishes its stripe.
+        SemaphoreHandle_t done;
+
+        const cv::ParallelLoopBody* body;
+        cv::Range stripes[pool_size];
+        std::exception_ptr errors[pool_size];
+        bool started;
+    };
+
+    static ParallelPool pool = {};
+
+
+    /// @brief The loop run by each worker: wait for a stripe, run it, report back.
+    static void worker_task(void* index_p)
+    {
+        const auto index = reinterpret_cast<uintptr_t>(index_p);
+        while (true)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+            pool.errors[index] = nullptr;
+            try
+            {
+                if (!pool.stripes[index].empty())
+                {
+                    (*pool.body)(pool.stripes[index]);
+                }
+            }
+            catch (...)
+            {
+                pool.errors[index] = std::current_exception();
+            }
+
+            xSemaphoreGive(pool.done);
+        }
+    }
+
+
+    /// @brief Deletes whatever of the pool was created, so that a pool which failed to start
+    /// holds nothing and everything runs on the calling task.
+    /// @param workers The number of workers created.
+    static void release_pool(const uint8_t workers)
+    {
+        for (uint8_t i = 0; i < workers; i++)
+        {
+            vTaskDelete(pool.workers[i]);
+            pool.workers[i] = nullptr;
+        }
+        if (pool.busy != nullptr)
+        {
+            vSemaphoreDelete(pool.busy);
+            pool.busy = nullptr;
+        }
+        if (pool.done != nullptr)
+        {
+            vSemaphoreDelete(pool.done);
+            pool.done = nullptr;
+        }
+    }
+
+
+    void start_parallel_pool()
+    {
+        if (pool.started)
+        {
+            return;
+        }
+
+        pool.busy = xSemaphoreCreateMutex();
+        pool.done = xSemaphoreCreateCounting(pool_size, 0);
+        if (pool.busy == nullptr || pool.done == nullptr)
+        {
+            ESP_LOGE(TAG, "Failed to create the worker pool's semaphores");
+            release_pool(0);
+            return;
+        }
+
+        for (uintptr_t i = 0; i < pool_size; i++)
+        {
+            const auto core = (0 == i) ? PRO_CPU_NUM : APP_CPU_NUM;
+            const auto created = xTaskCreatePinnedToCore(worker_task, "parallel_rows", worker_stack_size, reinterpret_cast<void*>(i), worker_priority, &pool.workers[i], core);
+            if (created != pdPASS)
+            {
+                // The workers already created are waiting on a notification, so they can go.
+                ESP_LOGE(TAG, "Failed to create a worker");
+                release_pool(static_cast<uint8_t>(i));
+                return;
+            }
+        }
+
+        pool.started = true;
+    }
+
+
+    void parallel_for_rows(const cv::Range& range, const cv::ParallelLoopBody& body)
+    {
+        const bool worth_splitting = range.size() >= min_parallel_rows;
+        if (!pool.started || !worth_splitting || xSemaphoreTake(pool.busy, 0) != pdTRUE)
+        {
+            body(range);
+            return;
+        }
+
+        // Split the rows in half. Each worker gets its own half.
+        const int middle = range.start + (range.size() >> 1);
+        pool.body = &body;
+        pool.stripes[0] = cv::Range(range.start, middle);
+        pool.stripes[1] = cv::Range(middle, range.end);
+
+        for (uint8_t i = 0; i < pool_size; i++)
+        {
+            xTaskNotifyGive(pool.workers[i]);
+        }
+        for (uint8_t i = 0; i < pool_size; i++)
+        {
+            xSemaphoreTake(pool.done, portMAX_DELAY);
+        }
+
+        std::exception_ptr error = nullptr;
+        for (uint8_t i = 0; i < pool_size; i++)
+        {
+            if (pool.errors[i] && !error)
+            {
+                error = pool.errors[i];
+            }
+        }
+
+        xSemaphoreGive(pool.busy);
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    #else
+
+    void start_parallel_pool()
+    {
+    }
+
+
+    void parallel_for_rows(const cv::Range& range, const cv::ParallelLoopBody& body)
+    {
+        if (range.size() < min_parallel_rows)
+        {
+            body(range);
+            return;
+        }
+
+        cv::parallel_for_(range, body);
+    }
+
+    #endif
+
+
+    void parallel_cvt_color(const cv::Mat& src, cv::Mat& dst, const int code, const int dst_type)
+    {
+        dst.create(src.rows, src.cols, dst_type);
+
+        parallel_for_rows(cv::Range(0, src.rows), [&](const cv::Range& rows)
+        {
+            cv::Mat dst_rows = dst.rowRange(rows);
+            cv::cvtColor(src.rowRange(rows), dst_rows, code);
+        });
+    }
+
+
+    void parallel_in_range(const cv::Mat& src, const cv::Scalar& low, const cv::Scalar& high, cv::Mat1b& dst)
+    {
+        dst.create(src.rows, src.cols);
+
+        // Three-channel 8-bit frames (i.e. HSV) go through the project's own kernel; anything
+        // else falls back to OpenCV.
+        if (CV_8UC3 == src.type())
+        {
+            const uint8_t low_bounds[3] = {cv::saturate_cast<uint8_t>(low[0]), cv::saturate_cast<uint8_t>(low[1]), cv::saturate_cast<uint8_t>(low[2])};
+            const uint8_t high_bounds[3] = {cv::saturate_cast<uint8_t>(high[0]), cv::saturate_cast<uint8_t>(high[1]), cv::saturate_cast<uint8_t>(high[2])};
+            parallel_in_range(src, low_bounds, high_bounds, dst);
+            return;
+        }
+
+        parallel_for_rows(cv::Range(0, src.rows), [&](const cv::Range& rows)
+        {
+            cv::Mat1b dst_rows = dst.rowRange(rows);
+            cv::inRange(src.rowRange(rows), low, high, dst_rows);
+        });
+    }
+
+
+    void parallel_in_range(const cv::Mat& src, const uint8_t low[3], const uint8_t high[3], cv::Mat1b& dst)
+    {
+        CV_Assert(CV_8UC3 == src.type());
+        dst.create(src.rows, src.cols);
+
+        parallel_for_rows(cv::Range(0, src.rows), [&](const cv::Range& rows)
+        {
+            for (int row = rows.start; row < rows.end; row++)
+            {
+                kernels::threshold_3ch(src.ptr<uint8_t>(row), low, high, dst.ptr<uint8_t>(row), src.cols);
+            }
+        });
+    }
+
+
+    void parallel_in_range_yuyv(const cv::Mat& src, const kernels::YuvBounds& bounds, cv::Mat1b& dst)
+    {
+        dst.create(src.rows, src.cols);
+
+        parallel_for_rows(cv::Range(0, src.rows), [&](const cv::Range& rows)
+        {
+            for (int row = rows.start; row < rows.end; row++)
+            {
+                kernels::threshold_yuyv(src.ptr<uint8_t>(row), bounds, dst.ptr<uint8_t>(row), src.cols);
+            }
+        });
+    }
+
+
+    void parallel_lookup(const cv::Mat& src, const uint8_t* table, cv::Mat1b& dst)
+    {
+        CV_Assert(CV_8UC2 == src.type() || CV_8UC1 == src.type());
+        dst.create(src.rows, src.cols);
+
+        const bool wide = (CV_8UC2 == src.type());
+        parallel_for_rows(cv::Range(0, src.rows), [&](const cv::Range& rows)
+        {
+            for (int row = rows.start; row < rows.end; row++)
+            {
+                if (wide)
+                {
+                    kernels::lookup_16(src.ptr<uint16_t>(row), table, dst.ptr<uint8_t>(row), src.cols);
+                }
+                else
+                {
+                    kernels::lookup_8(src.ptr<uint8_t>(row), table, dst.ptr<uint8_t>(row), src.cols);
+                }
+            }
+        });
+    }
+
+
+    void parallel_test_bits(const cv::Mat& src, const uint8_t bits, cv::Mat1b& dst)
+    {
+        dst.create(src.rows, src.cols);
+
+        parallel_for_rows(cv::Range(0, src.rows), [&](const cv::Range& rows)
+        {
+            for (int row = rows.start; row < rows.end; row++)
+            {
+                kernels::test_bits(src.ptr<uint8_t>(row), bits, dst.ptr<uint8_t>(row), src.cols);
+            }
+        });
+    }
+}
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Splits row-parallel work across both cores of the ESP-32.
+///
+/// The vendored OpenCV (4.2) has no pluggable parallel backend, and the prebuilt library runs
+/// cv::parallel_for_ serially, so this is a project-level replacement: a pool of two worker
+/// tasks, one pinned to each core, which each take half of a row range. Off-device, work is
+/// handed to OpenCV's own cv::parallel_for_, which does have a threading backend there.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#include "opencv2/core/utility.hpp"
+#define EPS 192
+
+#include "pixel_kernels.h"
+
+namespace lane_detect
+{
+    /// @brief Ranges smaller than this many rows are run on the calling task, since the
+    /// dispatch would cost more than it saves.
+    constexpr int min_parallel_rows = 16;
+
+
+    /// @brief Starts the worker pool. Call once at boot, before any of the functions below.
+    /// Until then (or if it fails), everything runs on the calling task.
+    void start_parallel_pool();
+
+
+    /// @brief Runs a loop body across a range of rows, split between both cores. Returns once all
+    /// rows are done. If the pool is already busy (e.g. when called from both sides of a fork-join
+    /// at once), the body is run on the calling task instead.
+    /// @param range The rows to process.
+    /// @param body The body to run. Must be safe to call on disjoint sub-ranges concurrently.
+    void parallel_for_rows(const cv::Range& range, const cv::ParallelLoopBody& body);
+
+
+    /// @brief Wraps a callable as a cv::ParallelLoopBody without copying or allocating.
+    template <typename Function>
+    class RowLoopBody : public cv::ParallelLoopBody
+    {
+        public:
+        explicit RowLoopBody(const Function& function): function_(function) {}
+
+        void operator()(const cv::Range& range) const override
+        {
+            function_(range);
+        }
+
+        private:
+        const Function& function_;
+    };
+
+
+    /// @brief Runs a callable taking a cv::Range across a range of rows. See above.
+    template <typename Function>
+    void parallel_for_rows(const cv::Range& range, const Function& function)
+    {
+        parallel_for_rows(range, static_cast<const cv::ParallelLoopBody&>(RowLoopBody<Function>(function)));
+    }
+
+
+    /// @brief A row-parallel cv::cvtColor.
+    /// @param src The source frame.
+    /// @param dst The converted frame. Output param.
+    /// @param code The conversion code, as in cv::cvtColor.
+    /// @param dst_type The type of the converted frame, e.g. CV_8UC3.
+    void parallel_cvt_color(const cv::Mat& src, cv::Mat& dst, int code, int dst_type);
+
+
+    /// @brief A row-parallel cv::inRange.
+    /// @param src The source frame.
+    /// @param low The lower bound.
+    /// @param high The upper bound.
+    /// @param dst The mask. Output param. If it is already the right size it is written in place,
+    /// so it may be a view into a larger mask.
+    void parallel_in_range(const cv::Mat& src, const cv::Scalar& low, const cv::Scalar& high, cv::Mat1b& dst);
+
+
+    /// @brief A row-parallel cv::inRange of a three-channel 8-bit frame, with the bounds already
+    /// in 8 bits.
+    /// @param src The source frame, CV_8UC3.
+    /// @param low The lower bound of each channel.
+    /// @param high The upper bound of each channel.
+    /// @param dst The mask. Output param. If it is already the right size it is written in place,
+    /// so it may be a view into a larger mask.
+    void parallel_in_range(const cv::Mat& src, const uint8_t low[3], const uint8_t high[3], cv::Mat1b& dst);
+
+
+    /// @brief A row-parallel threshold of a packed YUV422 frame. See kernels::threshold_yuyv.
+    /// @param src The source frame, CV_8UC2. Must start on a pixel pair.
+    /// @param bounds The bounds.
+    /// @param dst The mask. Output param. If it is already the right size it is written in place,
+    /// so it may be a view into a larger mask.
+    void parallel_in_range_yuyv(const cv::Mat& src, const kernels::YuvBounds& bounds, cv::Mat1b& dst);
+
+
+    /// @brief A row-parallel table lookup, e.g. to classify pixels.
+    /// @param src The source frame: CV_8UC2 (looked up as native-endian 16-bit pixels, in a
+    /// 65536-entry table) or CV_8UC1 (in a 256-entry table).
+    /// @param table The table.
+    /// @param dst The looked-up values. Output param.
+    void parallel_lookup(const cv::Mat& src, const uint8_t* table, cv::Mat1b& dst);
+
+
+    /// @brief A row-parallel threshold of class bits. See kernels::test_bits.
+    /// @param src The class bits of each pixel, CV_8UC1.
+    /// @param bits The bits to test for.
+    /// @param dst The mask. Output param. If it is already the right size it is written in place,
+    /// so it may be a view into a larger mask.
+    void parallel_test_bits(const cv::Mat& src, uint8_t bits, cv::Mat1b& dst);
+}
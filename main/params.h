@@ -1,45 +0,0 @@
-///////////////////////////////////////////////////////////////////////////////////////////////////
-/// A generated file which contains constants determined in the Python debugging tool.
-///
-/// Author: Andrew Huffman
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-#pragma once
-
-#include <stdint.h>
-
-constexpr uint8_t expected_line_pos = 66;
-
-constexpr uint8_t expected_red_y = 82;
-constexpr uint8_t expected_red_radius = 2;
-
-constexpr uint8_t outside_thresh_min_hue = 8;
-constexpr uint8_t outside_thresh_min_sat = 0;
-constexpr uint8_t outside_thresh_min_val = 238;
-
-constexpr uint8_t outside_thresh_max_hue = 179;
-constexpr uint8_t outside_thresh_max_sat = 255;
-constexpr uint8_t outside_thresh_max_val = 255;
-
-constexpr uint8_t outside_cropping_top = 51;
-constexpr uint8_t outside_cropping_bottom = 0;
-constexpr uint8_t outside_cropping_left = 22;
-constexpr uint8_t outside_cropping_right = 0;
-
-constexpr uint16_t outside_min_detect_area = 139;
-
-constexpr uint8_t stop_thresh_min_hue = 0;
-constexpr uint8_t stop_thresh_min_sat = 49;
-constexpr uint8_t stop_thresh_min_val = 156;
-
-constexpr uint8_t stop_thresh_max_hue = 29;
-constexpr uint8_t stop_thresh_max_sat = 159;
-constexpr uint8_t stop_thresh_max_val = 247;
-
-constexpr uint8_t stop_cropping_top = 48;
-constexpr uint8_t stop_cropping_bottom = 0;
-constexpr uint8_t stop_cropping_left = 0;
-constexpr uint8_t stop_cropping_right = 0;
-
-constexpr uint16_t stop_min_detect_area = 139;
-
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Maps points in the frame to the ground plane in front of the car, through a perspective table
+/// generated at build time by gen_params.py from the debugger settings.
+///
+/// Rather than warping whole frames, only the few points the detectors find are mapped. As long
+/// as the camera isn't rolled, a row of the frame is a line across the ground at one distance, so
+/// the table has one entry per row: a point costs two lookups and a few multiplies.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include "params.h"
+
+namespace lane_detect
+{
+    /// @brief Where the points of a row of the calibrated frame lie on the ground.
+    struct PerspectiveRow
+    {
+        /// @brief The ground x, per column.
+        float x_scale;
+
+        /// @brief The ground x of column 0.
+        float x_offset;
+
+        /// @brief The ground y of the row.
+        float ground_y;
+    };
+
+    /// @brief One entry per row of the frame the settings were calibrated at. In millimetres if
+    /// perspective_calibrated, else pixels, with y counting up from the bottom row.
+    extern const PerspectiveRow perspective_rows[calibration_height];
+
+
+    /// @brief A point on the ground. x is to the right of the camera, y ahead of it.
+    struct GroundPoint
+    {
+        float x;
+        float y;
+    };
+
+
+    /// @brief A line on the ground, relative to where it is expected.
+    struct GroundLine
+    {
+        /// @brief How far right of where it is expected the line is, at the point it was seen.
+        float offset;
+
+        /// @brief The angle of the line from straight ahead, in radians, positive to the right.
+        float heading;
+    };
+
+
+    /// @brief Maps a point in the frame to the ground.
+    /// @param col The column. May be fractional.
+    /// @param row The row. May be fractional; rows between entries are interpolated.
+    /// @param width The width of the frame the point is in.
+    /// @param height The height of the frame the point is in.
+    /// @return The point on the ground.
+    inline GroundPoint to_ground(const float col, const float row, const uint16_t width, const uint16_t height)
+    {
+        const float cal_col = col * calibration_width / width;
+        const float cal_row = fminf(fmaxf(row * calibration_height / height, 0.0f), calibration_height - 1);
+
+        const uint16_t first = static_cast<uint16_t>(cal_row);
+        const uint16_t second = (first + 1 < calibration_height) ? first + 1 : first;
+        const float t = cal_row - first;
+        const PerspectiveRow& a = perspective_rows[first];
+        const PerspectiveRow& b = perspective_rows[second];
+
+        const float x_scale = a.x_scale + t * (b.x_scale - a.x_scale);
+        const float x_offset = a.x_offset + t * (b.x_offset - a.x_offset);
+        return {x_scale * cal_col + x_offset, a.ground_y + t * (b.ground_y - a.ground_y)};
+    }
+
+
+    /// @brief Maps a straight line in the frame to the ground. Perspective keeps straight lines
+    /// straight, so two points on it are enough.
+    /// @param col The column of a point on the line.
+    /// @param row The row of the point.
+    /// @param slope The slope of the line in the frame, rows per column. May be infinite.
+    /// @param expected_col The column the line is expected at, in the same row.
+    /// @param width The width of the frame.
+    /// @param height The height of the frame.
+    /// @return The line on the ground.
+    inline GroundLine to_ground_line(const float col, const float row, const float slope, const float expected_col, const uint16_t width, const uint16_t height)
+    {
+        // Step a few pixels along the line; up the frame, unless that would leave it.
+        constexpr float step = 8.0f;
+        float d_col = 0.0f;
+        float d_row = -step;
+        if (isfinite(slope) && fabsf(slope) > 1.0f / step)
+        {
+            d_col = -step / slope;
+        }
+        else if (isfinite(slope))
+        {
+            d_col = (slope > 0) ? -step : step;
+            d_row = slope * d_col;
+        }
+        if (row + d_row < 0)
+        {
+            d_col = -d_col;
+            d_row = -d_row;
+        }
+
+        const GroundPoint near = to_ground(col, row, width, height);
+        const GroundPoint far = to_ground(col + d_col, row + d_row, width, height);
+        const GroundPoint expected = to_ground(expected_col, row, width, height);
+
+        // The heading is measured along the line away from the car, whichever way it was stepped.
+        float d_x = far.x - near.x;
+        float d_y = far.y - near.y;
+        if (d_y < 0)
+        {
+            d_x = -d_x;
+            d_y = -d_y;
+        }
+
+        GroundLine result;
+        result.offset = near.x - expected.x;
+        result.heading = atan2f(d_x, d_y);
+        return result;
+    }
+}
@@ -0,0 +1,216 @@
+#include "pixel_kernels.h"
+
+#include <string.h>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#include "opencv2/core/hal/intrin.hpp"
+#define EPS 192
+
+
+namespace lane_detect::kernels
+{
+    void swap_bytes_16(uint8_t* data, const size_t pixels)
+    {
+        swap_bytes_16(data, data, pixels);
+    }
+
+
+    void swap_bytes_16(const uint8_t* src, uint8_t* dst, const size_t pixels)
+    {
+        size_t i = 0;
+
+        #if CV_SIMD
+        auto src_words = reinterpret_cast<const uint16_t*>(src);
+        auto dst_words = reinterpret_cast<uint16_t*>(dst);
+        for (; i + cv::v_uint16::nlanes <= pixels; i += cv::v_uint16::nlanes)
+        {
+            const cv::v_uint16 v = cv::vx_load(src_words + i);
+            cv::v_store(dst_words + i, (v << 8) | (v >> 8));
+        }
+        #endif
+
+        for (; i < pixels; i++)
+        {
+            const uint8_t temp = src[2 * i];
+            dst[2 * i] = src[2 * i + 1];
+            dst[2 * i + 1] = temp;
+        }
+    }
+
+
+    void threshold_3ch(const uint8_t* src, const uint8_t low[3], const uint8_t high[3], uint8_t* dst, const size_t pixels)
+    {
+        size_t i = 0;
+
+        #if CV_SIMD
+        const cv::v_uint8 low0 = cv::vx_setall_u8(low[0]);
+        const cv::v_uint8 low1 = cv::vx_setall_u8(low[1]);
+        const cv::v_uint8 low2 = cv::vx_setall_u8(low[2]);
+        const cv::v_uint8 high0 = cv::vx_setall_u8(high[0]);
+        const cv::v_uint8 high1 = cv::vx_setall_u8(high[1]);
+        const cv::v_uint8 high2 = cv::vx_setall_u8(high[2]);
+        for (; i + cv::v_uint8::nlanes <= pixels; i += cv::v_uint8::nlanes)
+        {
+            cv::v_uint8 c0, c1, c2;
+            cv::v_load_deinterleave(src + 3 * i, c0, c1, c2);
+
+            const cv::v_uint8 in0 = (c0 >= low0) & (c0 <= high0);
+            const cv::v_uint8 in1 = (c1 >= low1) & (c1 <= high1);
+            const cv::v_uint8 in2 = (c2 >= low2) & (c2 <= high2);
+            cv::v_store(dst + i, in0 & in1 & in2);
+        }
+        #endif
+
+        for (; i < pixels; i++)
+        {
+            const uint8_t* pixel = src + 3 * i;
+            const bool in = pixel[0] >= low[0] && pixel[0] <= high[0]
+                && pixel[1] >= low[1] && pixel[1] <= high[1]
+                && pixel[2] >= low[2] && pixel[2] <= high[2];
+            dst[i] = in ? 0xff : 0;
+        }
+    }
+
+
+    void threshold_yuyv(const uint8_t* src, const YuvBounds& bounds, uint8_t* dst, const size_t pixels)
+    {
+        size_t i = 0;
+
+        #if CV_SIMD
+        // Each pixel pair shares one U and one V. With Y split out, the chroma bytes alternate
+        // U, V, so they are compared against bounds which alternate the same way. Viewing each
+        // U, V pair as one 16-bit lane then gives "both in bounds" for both pixels of the pair.
+        const cv::v_uint8 y_low = cv::vx_setall_u8(bounds.low[0]);
+        const cv::v_uint8 y_high = cv::vx_setall_u8(bounds.high[0]);
+        const cv::v_uint8 uv_low = cv::v_reinterpret_as_u8(cv::vx_setall_u16(bounds.low[1] | (bounds.low[2] << 8)));
+        const cv::v_uint8 uv_high = cv::v_reinterpret_as_u8(cv::vx_setall_u16(bounds.high[1] | (bounds.high[2] << 8)));
+        const cv::v_uint16 both = cv::vx_setall_u16(0xffff);
+        for (; i + cv::v_uint8::nlanes <= pixels; i += cv::v_uint8::nlanes)
+        {
+            cv::v_uint8 y, uv;
+            cv::v_load_deinterleave(src + 2 * i, y, uv);
+
+            const cv::v_uint8 y_in = (y >= y_low) & (y <= y_high);
+            const cv::v_uint8 uv_in = (uv >= uv_low) & (uv <= uv_high);
+            const cv::v_uint8 chroma_in = cv::v_reinterpret_as_u8(cv::v_reinterpret_as_u16(uv_in) == both);
+            cv::v_store(dst + i, y_in & chroma_in);
+        }
+        #endif
+
+        for (; i + 1 < pixels; i += 2)
+        {
+            const uint8_t* pair = src + 2 * i;
+            const bool chroma_in = pair[1] >= bounds.low[1] && pair[1] <= bounds.high[1]
+                && pair[3] >= bounds.low[2] && pair[3] <= bounds.high[2];
+            dst[i] = (chroma_in && pair[0] >= bounds.low[0] && pair[0] <= bounds.high[0]) ? 0xff : 0;
+            dst[i + 1] = (chroma_in && pair[2] >= bounds.low[0] && pair[2] <= bounds.high[0]) ? 0xff : 0;
+        }
+
+        if (i < pixels)
+        {
+            dst[i] = 0;
+        }
+    }
+
+
+    void lookup_16(const uint16_t* src, const uint8_t* table, uint8_t* dst, const size_t pixels)
+    {
+        // There is no gather in the universal intrinsics; a scalar loop, unrolled by four so the
+        // loads can overlap.
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4)
+        {
+            const uint8_t a = table[src[i]];
+            const uint8_t b = table[src[i + 1]];
+            const uint8_t c = table[src[i + 2]];
+            const uint8_t d = table[src[i + 3]];
+            dst[i] = a;
+            dst[i + 1] = b;
+            dst[i + 2] = c;
+            dst[i + 3] = d;
+        }
+
+        for (; i < pixels; i++)
+        {
+            dst[i] = table[src[i]];
+        }
+    }
+
+
+    void lookup_8(const uint8_t* src, const uint8_t* table, uint8_t* dst, const size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            dst[i] = table[src[i]];
+        }
+    }
+
+
+    void test_bits(const uint8_t* src, const uint8_t bits, uint8_t* dst, const size_t pixels)
+    {
+        size_t i = 0;
+
+        #if CV_SIMD
+        const cv::v_uint8 mask = cv::vx_setall_u8(bits);
+        const cv::v_uint8 zero = cv::vx_setzero_u8();
+        for (; i + cv::v_uint8::nlanes <= pixels; i += cv::v_uint8::nlanes)
+        {
+            cv::v_store(dst + i, (cv::vx_load(src + i) & mask) != zero);
+        }
+        #endif
+
+        for (; i < pixels; i++)
+        {
+            dst[i] = (src[i] & bits) ? 0xff : 0;
+        }
+    }
+
+
+    void accumulate_columns(const uint8_t* mask, uint16_t* sums, const size_t cols)
+    {
+        size_t col = 0;
+
+        #if CV_SIMD
+        for (; col + cv::v_uint8::nlanes <= cols; col += cv::v_uint8::nlanes)
+        {
+            cv::v_uint16 lo, hi;
+            cv::v_expand(cv::vx_load(mask + col), lo, hi);
+            cv::v_store(sums + col, cv::vx_load(sums + col) + lo);
+            cv::v_store(sums + col + cv::v_uint16::nlanes, cv::vx_load(sums + col + cv::v_uint16::nlanes) + hi);
+        }
+        #endif
+
+        for (; col < cols; col++)
+        {
+            sums[col] += mask[col];
+        }
+    }
+
+
+    void pack_mask(const uint8_t* mask, uint32_t* bits, const size_t pixels)
+    {
+        memset(bits, 0, ((pixels + 31) >> 5) * sizeof(uint32_t));
+        size_t i = 0;
+
+        #if CV_SIMD
+        // v_signmask yields one bit per lane, so a vector must fit inside one 32-bit word.
+        static_assert(cv::v_uint8::nlanes <= 32 && 0 == (32 % cv::v_uint8::nlanes), "Unsupported vector width");
+        const cv::v_uint8 zero = cv::vx_setzero_u8();
+        for (; i + cv::v_uint8::nlanes <= pixels; i += cv::v_uint8::nlanes)
+        {
+            const cv::v_uint8 set = cv::vx_load(mask + i) != zero;
+            const uint32_t lane_bits = static_cast<uint32_t>(cv::v_signmask(set));
+            bits[i >> 5] |= lane_bits << (i & 31);
+        }
+        #endif
+
+        for (; i < pixels; i++)
+        {
+            if (mask[i] != 0)
+            {
+                bits[i >> 5] |= (1u << (i & 31));
+            }
+        }
+    }
+}
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The project's own per-pixel hot loops, written against OpenCV's universal intrinsics
+/// (opencv2/core/hal/intrin.hpp) with a plain scalar loop for the pixels left over. On a desktop
+/// the vector loops compile to SSE (or AVX/NEON, when OpenCV's headers enable them). The ESP-32
+/// has no SIMD the headers know of, so CV_SIMD is 0 there and only the scalar loops are built;
+/// the intrin_cpp.hpp emulation (CV_FORCE_SIMD128_CPP) is deliberately not used, since it is
+/// plain loops over arrays and only adds overhead.
+///
+/// All functions work on flat runs of pixels; callers loop over rows so that ROIs and
+/// non-continuous matrices are handled.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lane_detect::kernels
+{
+    /// @brief Swaps the two bytes of each 16-bit pixel in place. The camera delivers RGB565
+    /// big-endian; OpenCV expects it little-endian.
+    /// @param data The pixels.
+    /// @param pixels The number of 16-bit pixels.
+    void swap_bytes_16(uint8_t* data, size_t pixels);
+
+
+    /// @brief Swaps the two bytes of each 16-bit pixel, into another buffer. Costs the same as
+    /// swapping in place, so a frame can be moved out of the camera's buffer for free.
+    /// @param src The pixels.
+    /// @param dst The swapped pixels. Output param. May be src.
+    /// @param pixels The number of 16-bit pixels.
+    void swap_bytes_16(const uint8_t* src, uint8_t* dst, size_t pixels);
+
+
+    /// @brief Thresholds interleaved three-channel pixels, as cv::inRange does: 0xff where every
+    /// channel is within its inclusive bounds, 0 otherwise.
+    /// @param src The pixels, three bytes each.
+    /// @param low The lower bound of each channel.
+    /// @param high The upper bound of each channel.
+    /// @param dst The mask. Output param.
+    /// @param pixels The number of pixels.
+    void threshold_3ch(const uint8_t* src, const uint8_t low[3], const uint8_t high[3], uint8_t* dst, size_t pixels);
+
+
+    /// @brief Inclusive bounds on each channel of a YUV pixel, in the order Y, U, V.
+    struct YuvBounds
+    {
+        uint8_t low[3];
+        uint8_t high[3];
+    };
+
+
+    /// @brief Thresholds YUV422 pixels (packed Y0 U Y1 V, as delivered by the camera) straight into
+    /// a mask, without converting color spaces: 0xff where Y, U and V are all within bounds.
+    /// @param src The pixels, two bytes each. Must start on a pixel pair.
+    /// @param bounds The bounds.
+    /// @param dst The mask. Output param.
+    /// @param pixels The number of pixels. Should be even; an unpaired last pixel is never set.
+    void threshold_yuyv(const uint8_t* src, const YuvBounds& bounds, uint8_t* dst, size_t pixels);
+
+
+    /// @brief Looks each 16-bit pixel up in a table: dst[i] = table[src[i]].
+    /// @param src The pixels, native-endian.
+    /// @param table The table, with 65536 entries.
+    /// @param dst The looked-up values. Output param.
+    /// @param pixels The number of pixels.
+    void lookup_16(const uint16_t* src, const uint8_t* table, uint8_t* dst, size_t pixels);
+
+
+    /// @brief Looks each 8-bit pixel up in a table: dst[i] = table[src[i]].
+    /// @param src The pixels.
+    /// @param table The table, with 256 entries.
+    /// @param dst The looked-up values. Output param.
+    /// @param pixels The number of pixels.
+    void lookup_8(const uint8_t* src, const uint8_t* table, uint8_t* dst, size_t pixels);
+
+
+    /// @brief Thresholds class bits into a mask: 0xff where any of the given bits are set, 0
+    /// otherwise.
+    /// @param src The class bits of each pixel.
+    /// @param bits The bits to test for.
+    /// @param dst The mask. Output param.
+    /// @param pixels The number of pixels.
+    void test_bits(const uint8_t* src, uint8_t bits, uint8_t* dst, size_t pixels);
+
+
+    /// @brief Adds one row of a mask into a running per-column sum.
+    /// @param mask The row.
+    /// @param sums The per-column sums. Updated. Must not pass 65535: the vector loop saturates
+    /// where the scalar one would wrap.
+    /// @param cols The number of columns.
+    void accumulate_columns(const uint8_t* mask, uint16_t* sums, size_t cols);
+
+
+    /// @brief Packs a mask row into bits, one per pixel, least-significant bit first. A bit is set
+    /// where the mask is nonzero. Bits past the end of the row in the last word are cleared.
+    /// @param mask The row.
+    /// @param bits The packed row; must hold (pixels + 31) / 32 words. Output param.
+    /// @param pixels The number of pixels.
+    void pack_mask(const uint8_t* mask, uint32_t* bits, size_t pixels);
+}
@@ -0,0 +1,182 @@
+#include "profile_format.h"
+
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+
+
+namespace lane_detect
+{
+    static_assert(std::is_trivially_copyable_v<StoredProfile>, "Profiles are stored as raw bytes");
+
+
+    /// @brief Rescales a line's cropping and area.
+    static LineCalibration rescale_line(
+        LineCalibration line,
+        const uint32_t from_width,
+        const uint32_t from_height,
+        const uint32_t to_width,
+        const uint32_t to_height
+    )
+    {
+        line.crop_top = line.crop_top * to_height / from_height;
+        line.crop_bottom = line.crop_bottom * to_height / from_height;
+        line.crop_left = line.crop_left * to_width / from_width;
+        line.crop_right = line.crop_right * to_width / from_width;
+        line.min_area = static_cast<uint64_t>(line.min_area) * to_width * to_height / (static_cast<uint64_t>(from_width) * from_height);
+        return line;
+    }
+
+
+    ProfileDerived derive_profile(const Calibration& calibration, const uint16_t frame_width, const uint16_t frame_height, const uint8_t class_table)
+    {
+        ProfileDerived derived;
+        memset(&derived, 0, sizeof(derived));
+
+        // The union of the regions each line's cropping leaves, skipping any which leave nothing.
+        int left = frame_width;
+        int top = frame_height;
+        int right = 0;
+        int bottom = 0;
+        const auto add = [&](const LineCalibration& line)
+        {
+            const int line_right = frame_width - line.crop_right;
+            const int line_bottom = frame_height - line.crop_bottom;
+            if (line.crop_left < line_right && line.crop_top < line_bottom)
+            {
+                left = std::min<int>(left, line.crop_left);
+                top = std::min<int>(top, line.crop_top);
+                right = std::max(right, line_right);
+                bottom = std::max(bottom, line_bottom);
+            }
+        };
+        add(calibration.outside);
+        add(calibration.stop);
+        for (uint8_t index = 0; index < calibration.extra_count; index++)
+        {
+            add(calibration.extra[index]);
+        }
+        if (left < right && top < bottom)
+        {
+            derived.detection_region = {
+                static_cast<uint16_t>(left),
+                static_cast<uint16_t>(top),
+                static_cast<uint16_t>(right - left),
+                static_cast<uint16_t>(bottom - top),
+            };
+        }
+
+        build_luma_classes(calibration, derived.luma_classes);
+        derived.class_table = class_table;
+        return derived;
+    }
+
+
+    StoredProfile make_profile(const uint8_t slot, const uint32_t params_checksum, const Calibration& calibration, const uint16_t frame_width, const uint16_t frame_height, const uint8_t class_table)
+    {
+        StoredProfile profile;
+        memset(&profile, 0, sizeof(profile));
+        profile.magic = PROFILE_MAGIC;
+        profile.version = PROFILE_VERSION;
+        profile.slot = slot;
+        profile.params_checksum = params_checksum;
+        profile.frame_width = frame_width;
+        profile.frame_height = frame_height;
+        strncpy(profile.name, PROFILE_NAMES[slot], PROFILE_NAME_LENGTH - 1);
+        profile.calibration = calibration;
+        profile.derived = derive_profile(calibration, frame_width, frame_height, class_table);
+        return profile;
+    }
+
+
+    ProfileStatus check_profile(const void* blob, const size_t size, const uint8_t slot, const uint32_t params_checksum)
+    {
+        if (size != sizeof(StoredProfile))
+        {
+            return ProfileStatus::WrongSize;
+        }
+
+        // The blob may not be aligned, so the header is copied out rather than cast.
+        StoredProfile header;
+        memcpy(&header, blob, sizeof(header));
+        if (header.magic != PROFILE_MAGIC)
+        {
+            return ProfileStatus::WrongMagic;
+        }
+        if (header.version != PROFILE_VERSION)
+        {
+            return ProfileStatus::WrongVersion;
+        }
+        if (header.slot != slot)
+        {
+            return ProfileStatus::WrongSlot;
+        }
+        if (header.params_checksum != params_checksum)
+        {
+            return ProfileStatus::WrongChecksum;
+        }
+
+        // Flash can be corrupted under a good header; the sizes are divided by when rescaling,
+        // and the extra classes and class table index fixed arrays.
+        if (0 == header.frame_width
+            || 0 == header.frame_height
+            || header.calibration.extra_count > MAX_EXTRA_CLASSES
+            || (header.derived.class_table >= PROFILE_COUNT && header.derived.class_table != NO_CLASS_TABLE))
+        {
+            return ProfileStatus::Corrupt;
+        }
+
+        return ProfileStatus::Ok;
+    }
+
+
+    Calibration rescale_calibration(
+        const Calibration& calibration,
+        const uint16_t from_width,
+        const uint16_t from_height,
+        const uint16_t to_width,
+        const uint16_t to_height
+    )
+    {
+        Calibration result = calibration;
+        result.outside = rescale_line(calibration.outside, from_width, from_height, to_width, to_height);
+        result.stop = rescale_line(calibration.stop, from_width, from_height, to_width, to_height);
+        for (uint8_t index = 0; index < calibration.extra_count; index++)
+        {
+            result.extra[index] = rescale_line(calibration.extra[index], from_width, from_height, to_width, to_height);
+        }
+        result.line_pos = calibration.line_pos * to_width / from_width;
+        result.stop_row = calibration.stop_row * to_height / from_height;
+        result.stop_radius = calibration.stop_radius * to_height / from_height;
+        return result;
+    }
+
+
+    ProfileStatus read_profile(
+        const void* blob,
+        const size_t size,
+        const uint8_t slot,
+        const uint32_t params_checksum,
+        const uint16_t frame_width,
+        const uint16_t frame_height,
+        StoredProfile& profile
+    )
+    {
+        const ProfileStatus status = check_profile(blob, size, slot, params_checksum);
+        if (status != ProfileStatus::Ok)
+        {
+            return status;
+        }
+
+        memcpy(&profile, blob, sizeof(profile));
+        profile.name[PROFILE_NAME_LENGTH - 1] = '\0';
+        if (profile.frame_width != frame_width || profile.frame_height != frame_height)
+        {
+            profile.calibration = rescale_calibration(profile.calibration, profile.frame_width, profile.frame_height, frame_width, frame_height);
+            profile.frame_width = frame_width;
+            profile.frame_height = frame_height;
+            profile.derived = derive_profile(profile.calibration, frame_width, frame_height, profile.derived.class_table);
+        }
+        return ProfileStatus::Ok;
+    }
+}
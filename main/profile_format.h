@@ -0,0 +1,176 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// The stored form of a calibration profile, apart from where it is stored.
+///
+/// A profile is kept in a fixed, versioned binary layout, so loading is a read and a header check
+/// rather than a parse. Alongside the calibration it holds what the pipeline derives from it, so
+/// that switching profiles is a copy. Nothing here touches NVS, so it builds and is tested
+/// off-device.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "calibration.h"
+
+namespace lane_detect
+{
+    /// @brief Marks a blob as a stored profile.
+    constexpr uint16_t PROFILE_MAGIC = 0x4c43;
+
+    /// @brief The version of StoredProfile's layout. Bump whenever it (or Calibration) changes;
+    /// profiles of any other version are replaced with the defaults at boot.
+    constexpr uint8_t PROFILE_VERSION = 6;
+
+    /// @brief The number of profile slots.
+    constexpr uint8_t PROFILE_COUNT = 3;
+
+    /// @brief The longest profile name, including the terminator. NVS keys are limited to 15
+    /// characters plus the terminator, and names double as keys.
+    constexpr uint8_t PROFILE_NAME_LENGTH = 16;
+
+    /// @brief The name of each profile slot. Must match PROFILE_NAMES in gen_params.py.
+    constexpr const char* PROFILE_NAMES[PROFILE_COUNT] = {"indoor", "outdoor", "dim"};
+
+    /// @brief Marks a profile which no generated class table classifies for, so that its RGB565
+    /// frames are converted to HSV and thresholded instead.
+    constexpr uint8_t NO_CLASS_TABLE = 0xff;
+
+
+    /// @brief A rectangle of the frame, in pixels.
+    struct ProfileRegion
+    {
+        uint16_t x;
+        uint16_t y;
+        uint16_t width;
+        uint16_t height;
+    };
+
+
+    /// @brief What the pipeline works out from a calibration before detecting with it.
+    struct ProfileDerived
+    {
+        /// @brief The part of the frame which any detector looks at: the union of the classes'
+        /// crops. Empty if every crop leaves nothing.
+        ProfileRegion detection_region;
+
+        /// @brief The class bits of each luma value, for classifying grayscale frames (see
+        /// build_luma_classes).
+        uint8_t luma_classes[256];
+
+        /// @brief The slot of the generated profile (see generated_profiles.h) whose RGB565 class
+        /// table classifies for the calibration's colors, or NO_CLASS_TABLE.
+        uint8_t class_table;
+    };
+
+
+    /// @brief A calibration profile, exactly as it is stored in NVS.
+    struct StoredProfile
+    {
+        /// @brief PROFILE_MAGIC.
+        uint16_t magic;
+
+        /// @brief PROFILE_VERSION, as of when the profile was written.
+        uint8_t version;
+
+        /// @brief Which slot the profile belongs in.
+        uint8_t slot;
+
+        /// @brief The params_checksum of the build which wrote the profile. A profile from
+        /// another calibration is replaced with the new build's at boot, rather than overriding
+        /// it.
+        uint32_t params_checksum;
+
+        /// @brief The frame size the calibration's pixel values are in. Profiles of another size
+        /// are rescaled on load.
+        uint16_t frame_width;
+        uint16_t frame_height;
+
+        /// @brief The profile's name, null-terminated.
+        char name[PROFILE_NAME_LENGTH];
+
+        /// @brief The calibration itself.
+        Calibration calibration;
+
+        /// @brief What is derived from the calibration, at the frame size above.
+        ProfileDerived derived;
+    };
+
+
+    /// @brief Why a blob could not be used as a profile.
+    enum class ProfileStatus : uint8_t
+    {
+        Ok,
+        WrongSize,      ///< The blob is not the size of a StoredProfile.
+        WrongMagic,     ///< The blob is not a profile.
+        WrongVersion,   ///< The blob is a profile of another layout version.
+        WrongSlot,      ///< The blob belongs to another slot.
+        WrongChecksum,  ///< The blob was written by a build of another calibration.
+        Corrupt,        ///< The blob has a profile's header, but a frame size of zero, more
+                        ///< extra classes than a Calibration holds, or no such class table.
+    };
+
+
+    /// @brief Works out what the pipeline needs from a calibration.
+    /// @param calibration The calibration.
+    /// @param frame_width The frame width the calibration is in pixels of.
+    /// @param frame_height The frame height the calibration is in pixels of.
+    /// @param class_table The slot of the generated profile whose class table classifies for the
+    /// calibration's colors, or NO_CLASS_TABLE.
+    /// @return The derived data.
+    ProfileDerived derive_profile(const Calibration& calibration, uint16_t frame_width, uint16_t frame_height, uint8_t class_table);
+
+
+    /// @brief Builds a profile ready to be stored.
+    /// @param slot The slot the profile is for.
+    /// @param params_checksum The params_checksum of this build.
+    /// @param calibration The calibration.
+    /// @param frame_width The frame width the calibration is in pixels of.
+    /// @param frame_height The frame height the calibration is in pixels of.
+    /// @param class_table The slot of the generated profile whose class table classifies for the
+    /// calibration's colors, or NO_CLASS_TABLE.
+    /// @return The profile.
+    StoredProfile make_profile(uint8_t slot, uint32_t params_checksum, const Calibration& calibration, uint16_t frame_width, uint16_t frame_height, uint8_t class_table);
+
+
+    /// @brief Checks whether a blob read from storage is a usable profile.
+    /// @param blob The blob.
+    /// @param size The size of the blob, in bytes.
+    /// @param slot The slot it was read from.
+    /// @param params_checksum The params_checksum of this build.
+    /// @return Ok if the blob may be used as a StoredProfile.
+    ProfileStatus check_profile(const void* blob, size_t size, uint8_t slot, uint32_t params_checksum);
+
+
+    /// @brief Rescales a calibration from one frame size to another.
+    /// @param calibration The calibration. Its extra_count must be at most MAX_EXTRA_CLASSES.
+    /// @param from_width The frame width it is in pixels of. Must not be 0.
+    /// @param from_height The frame height it is in pixels of. Must not be 0.
+    /// @param to_width The frame width to rescale to.
+    /// @param to_height The frame height to rescale to.
+    /// @return The rescaled calibration.
+    Calibration rescale_calibration(
+        const Calibration& calibration,
+        uint16_t from_width,
+        uint16_t from_height,
+        uint16_t to_width,
+        uint16_t to_height
+    );
+
+
+    /// @brief Reads a profile from a blob read from storage, rescaling it (and deriving it again)
+    /// to the capture frame size if it was stored at another.
+    /// @param blob The blob. Need not be aligned.
+    /// @param size The size of the blob, in bytes.
+    /// @param slot The slot it was read from.
+    /// @param params_checksum The params_checksum of this build.
+    /// @param frame_width The frame width the pipeline captures at.
+    /// @param frame_height The frame height the pipeline captures at.
+    /// @param profile The profile. Output param. Only written if the blob is usable.
+    /// @return Ok if the blob was usable, and the profile was written.
+    ProfileStatus read_profile(const void* blob, size_t size, uint8_t slot, uint32_t params_checksum, uint16_t frame_width, uint16_t frame_height, StoredProfile& profile);
+
+}
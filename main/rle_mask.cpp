@@ -0,0 +1,435 @@
+#include "rle_mask.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "parallel_rows.h"
+
+
+namespace lane_detect
+{
+    /// @brief Loads four bytes, which needn't be aligned.
+    static inline uint32_t load_word(const uint8_t* data)
+    {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        return word;
+    }
+
+
+    RleMask::RleMask(const uint8_t runs_per_row):
+        runs_per_row_(std::max<uint8_t>(1, runs_per_row)),
+        rows_(0),
+        cols_(0)
+    {
+    }
+
+
+    void RleMask::create(const uint16_t rows, const uint16_t cols)
+    {
+        if (rows != rows_ || cols != cols_)
+        {
+            const uint32_t slots = static_cast<uint32_t>(rows) * runs_per_row_;
+            CV_Assert(slots <= UINT16_MAX);
+
+            rows_ = rows;
+            cols_ = cols;
+            runs_.resize(slots);
+            counts_.resize(rows);
+            parents_.resize(slots);
+            stats_.resize(slots);
+            roots_.reserve(slots);
+        }
+        clear();
+    }
+
+
+    void RleMask::clear()
+    {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        roots_.clear();
+    }
+
+
+    void RleMask::encode_row(const uint16_t row, const uint8_t* data, const uint16_t first_col, const uint16_t end_col)
+    {
+        Run* runs = &runs_[slot(row)];
+        uint8_t count = 0;
+
+        uint16_t col = first_col;
+        while (col < end_col)
+        {
+            // Skip the gap, a word at a time where it's clear.
+            while (col + 4 <= end_col && 0 == load_word(data + col))
+            {
+                col += 4;
+            }
+            while (col < end_col && 0 == data[col])
+            {
+                col++;
+            }
+            if (col == end_col)
+            {
+                break;
+            }
+
+            // Then the run. Thresholded masks are 0xff where set.
+            const uint16_t start = col;
+            while (col + 4 <= end_col && UINT32_MAX == load_word(data + col))
+            {
+                col += 4;
+            }
+            while (col < end_col && data[col] != 0)
+            {
+                col++;
+            }
+
+            if (count < runs_per_row_)
+            {
+                runs[count++] = {start, col};
+            }
+            else
+            {
+                runs[count - 1].end = col;
+            }
+        }
+
+        counts_[row] = count;
+    }
+
+
+    void RleMask::add_run(const uint16_t row, const uint16_t start, const uint16_t end)
+    {
+        Run* runs = &runs_[slot(row)];
+        uint8_t& count = counts_[row];
+        if (count < runs_per_row_)
+        {
+            runs[count++] = {start, end};
+        }
+        else
+        {
+            runs[count - 1].end = end;
+        }
+    }
+
+
+    void RleMask::encode(const cv::Mat1b& mask, const cv::Rect2i& roi)
+    {
+        CV_Assert(mask.rows == rows_ && mask.cols == cols_);
+        const cv::Rect2i clipped = roi & cv::Rect2i(0, 0, cols_, rows_);
+        if (clipped.empty())
+        {
+            return;
+        }
+
+        // Each row has its own slots, so the halves never touch.
+        const uint16_t first_col = static_cast<uint16_t>(clipped.x);
+        const uint16_t end_col = static_cast<uint16_t>(clipped.x + clipped.width);
+        parallel_for_rows(cv::Range(clipped.y, clipped.y + clipped.height), [&](const cv::Range& range)
+        {
+            for (int row = range.start; row < range.end; row++)
+            {
+                encode_row(static_cast<uint16_t>(row), mask.ptr<uint8_t>(row), first_col, end_col);
+            }
+        });
+    }
+
+
+    void RleMask::encode(const BitMask& bits)
+    {
+        const cv::Rect2i& roi = bits.roi();
+        CV_Assert(roi.x + roi.width <= cols_ && roi.y + roi.height <= rows_);
+
+        for (int row = 0; row < roi.height; row++)
+        {
+            const uint32_t* words = bits.row(static_cast<uint16_t>(row));
+            Run* runs = &runs_[slot(static_cast<uint16_t>(roi.y + row))];
+            uint8_t count = 0;
+            uint16_t start = 0;
+            bool in_run = false;
+
+            // Each set bit of word ^ (word << 1) is where a run starts or ends; the bit shifted in
+            // is the last pixel of the previous word.
+            uint32_t carry = 0;
+            for (uint16_t word = 0; word < bits.words_per_row(); word++)
+            {
+                uint32_t edges = words[word] ^ ((words[word] << 1) | carry);
+                carry = words[word] >> 31;
+                while (edges != 0)
+                {
+                    const uint16_t col = static_cast<uint16_t>(roi.x + (word << 5) + __builtin_ctz(edges));
+                    edges &= edges - 1;
+                    if (!in_run)
+                    {
+                        start = col;
+                    }
+                    else if (count < runs_per_row_)
+                    {
+                        runs[count++] = {start, col};
+                    }
+                    else
+                    {
+                        runs[count - 1].end = col;
+                    }
+                    in_run = !in_run;
+                }
+            }
+
+            // A run reaching the region's right edge ends there.
+            if (in_run)
+            {
+                const uint16_t col = static_cast<uint16_t>(roi.x + roi.width);
+                if (count < runs_per_row_)
+                {
+                    runs[count++] = {start, col};
+                }
+                else
+                {
+                    runs[count - 1].end = col;
+                }
+            }
+
+            counts_[roi.y + row] = count;
+        }
+    }
+
+
+    uint16_t RleMask::find_root(uint16_t run)
+    {
+        while (parents_[run] != run)
+        {
+            parents_[run] = parents_[parents_[run]];
+            run = parents_[run];
+        }
+        return run;
+    }
+
+
+    uint16_t RleMask::find_blobs()
+    {
+        roots_.clear();
+
+        // Every run starts as its own blob. Runs which touch a run in the row above (diagonally
+        // counts) join its blob; the blob is named after its first run in raster order.
+        for (uint16_t row = 0; row < rows_; row++)
+        {
+            const uint32_t first = slot(row);
+            for (uint8_t i = 0; i < counts_[row]; i++)
+            {
+                parents_[first + i] = static_cast<uint16_t>(first + i);
+            }
+
+            if (0 == row)
+            {
+                continue;
+            }
+
+            const uint32_t above = slot(row - 1);
+            uint8_t a = 0;
+            uint8_t b = 0;
+            while (a < counts_[row - 1] && b < counts_[row])
+            {
+                const Run& upper = runs_[above + a];
+                const Run& lower = runs_[first + b];
+                if (upper.start <= lower.end && lower.start <= upper.end)
+                {
+                    const uint16_t upper_root = find_root(static_cast<uint16_t>(above + a));
+                    const uint16_t lower_root = find_root(static_cast<uint16_t>(first + b));
+                    if (upper_root < lower_root)
+                    {
+                        parents_[lower_root] = upper_root;
+                    }
+                    else if (lower_root < upper_root)
+                    {
+                        parents_[upper_root] = lower_root;
+                    }
+                }
+
+                // Move past whichever run ends first; it can't touch anything further right.
+                if (upper.end <= lower.end)
+                {
+                    a++;
+                }
+                else
+                {
+                    b++;
+                }
+            }
+        }
+
+        // Gather each blob's statistics. A blob's first run is always visited before the rest of
+        // it, so its statistics start there. Every run is pointed straight at its blob's first
+        // run on the way, so that intersects() needn't search.
+        for (uint16_t row = 0; row < rows_; row++)
+        {
+            const uint32_t first = slot(row);
+            for (uint8_t i = 0; i < counts_[row]; i++)
+            {
+                const uint16_t index = static_cast<uint16_t>(first + i);
+                const Run& run = runs_[index];
+                const uint16_t root = find_root(index);
+                parents_[index] = root;
+
+                BlobStats& stats = stats_[root];
+                if (root == index)
+                {
+                    stats = {run.start, run.end, row, static_cast<uint16_t>(row + 1), row, row, 0u};
+                    roots_.push_back(root);
+                }
+
+                if (run.start < stats.left)
+                {
+                    stats.left = run.start;
+                    stats.left_row = row;
+                }
+                if (run.end > stats.right)
+                {
+                    stats.right = run.end;
+                    stats.right_row = row;
+                }
+                stats.bottom = row + 1;
+                stats.area += run.end - run.start;
+            }
+        }
+
+        return blob_count();
+    }
+
+
+    Blob RleMask::blob(const uint16_t index) const
+    {
+        const uint16_t root = roots_[index];
+        const BlobStats& stats = stats_[root];
+
+        Blob result;
+        result.bounds = cv::Rect2i(stats.left, stats.top, stats.right - stats.left, stats.bottom - stats.top);
+        result.area = stats.area;
+        result.leftmost = cv::Point2i(stats.left, stats.left_row);
+        result.rightmost = cv::Point2i(stats.right - 1, stats.right_row);
+        result.label = root;
+        return result;
+    }
+
+
+    bool RleMask::largest_blob(Blob& blob) const
+    {
+        if (roots_.empty())
+        {
+            return false;
+        }
+
+        uint16_t largest = 0;
+        uint32_t largest_area = 0;
+        for (uint16_t i = 0; i < roots_.size(); i++)
+        {
+            const BlobStats& stats = stats_[roots_[i]];
+            const uint32_t area = static_cast<uint32_t>(stats.right - stats.left) * (stats.bottom - stats.top);
+            if (area > largest_area)
+            {
+                largest_area = area;
+                largest = i;
+            }
+        }
+
+        blob = this->blob(largest);
+        return true;
+    }
+
+
+    bool RleMask::intersects(const Blob& blob, const cv::Rect2i& rect) const
+    {
+        const cv::Rect2i overlap = blob.bounds & rect;
+        if (overlap.empty())
+        {
+            return false;
+        }
+
+        for (int row = overlap.y; row < overlap.y + overlap.height; row++)
+        {
+            const uint32_t first = slot(static_cast<uint16_t>(row));
+            for (uint8_t i = 0; i < counts_[row]; i++)
+            {
+                const Run& run = runs_[first + i];
+                if (run.start >= overlap.x + overlap.width)
+                {
+                    break;
+                }
+                if (run.end > overlap.x && parents_[first + i] == blob.label)
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+    void RleMask::rasterize(cv::Mat1b& dst, const uint8_t value) const
+    {
+        dst.create(rows_, cols_);
+        for (uint16_t row = 0; row < rows_; row++)
+        {
+            uint8_t* data = dst.ptr<uint8_t>(row);
+            const Run* runs = row_runs(row);
+            uint16_t col = 0;
+            for (uint8_t i = 0; i < counts_[row]; i++)
+            {
+                memset(data + col, 0, runs[i].start - col);
+                memset(data + runs[i].start, value, runs[i].end - runs[i].start);
+                col = runs[i].end;
+            }
+            memset(data + col, 0, cols_ - col);
+        }
+    }
+
+
+    void RleMask::composite_or(const RleMask& a, const RleMask& b, RleMask& dst)
+    {
+        CV_Assert(a.rows_ == b.rows_ && a.cols_ == b.cols_ && &dst != &a && &dst != &b);
+        dst.create(a.rows_, a.cols_);
+
+        for (uint16_t row = 0; row < a.rows_; row++)
+        {
+            const Run* a_runs = a.row_runs(row);
+            const Run* b_runs = b.row_runs(row);
+            const uint8_t a_count = a.counts_[row];
+            const uint8_t b_count = b.counts_[row];
+            Run* out = &dst.runs_[dst.slot(row)];
+            uint8_t count = 0;
+
+            // Take the runs in order of their start, merging each into the last if they overlap
+            // or touch.
+            uint8_t i = 0;
+            uint8_t j = 0;
+            while (i < a_count || j < b_count)
+            {
+                const bool take_a = j == b_count || (i < a_count && a_runs[i].start <= b_runs[j].start);
+                const Run& run = take_a ? a_runs[i++] : b_runs[j++];
+                if (count > 0 && run.start <= out[count - 1].end)
+                {
+                    out[count - 1].end = std::max(out[count - 1].end, run.end);
+                }
+                else if (count < dst.runs_per_row_)
+                {
+                    out[count++] = run;
+                }
+                else
+                {
+                    out[count - 1].end = std::max(out[count - 1].end, run.end);
+                }
+            }
+            dst.counts_[row] = count;
+        }
+    }
+
+
+    uint32_t RleMask::run_count() const
+    {
+        uint32_t count = 0;
+        for (const uint8_t row_count : counts_)
+        {
+            count += row_count;
+        }
+        return count;
+    }
+}
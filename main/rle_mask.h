@@ -0,0 +1,196 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// A run-length-encoded binary mask, and blob analysis over its runs.
+///
+/// A thresholded lane mask is mostly long stretches of zeros with a few short runs of ones, so
+/// the detectors work on the runs rather than the pixels: connected components, bounding boxes
+/// and areas all cost in proportion to the number of runs. Each row has a fixed number of run
+/// slots, so rows can be encoded in parallel, and nothing is allocated after the first frame.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#undef EPS
+#include "opencv2/core.hpp"
+#define EPS 192
+
+#include "bit_mask.h"
+
+namespace lane_detect
+{
+    /// @brief The default number of runs kept per row. Rows with more have their last runs merged.
+    constexpr uint8_t DEFAULT_RUNS_PER_ROW = 16;
+
+
+    /// @brief A run of set pixels in one row.
+    struct Run
+    {
+        /// @brief The first column of the run.
+        uint16_t start;
+
+        /// @brief One past the last column of the run.
+        uint16_t end;
+    };
+
+
+    /// @brief A connected group of runs (8-connected, as cv::findContours sees it).
+    struct Blob
+    {
+        /// @brief The bounding box.
+        cv::Rect2i bounds;
+
+        /// @brief The number of set pixels.
+        uint32_t area;
+
+        /// @brief The leftmost set pixel. The topmost, if there are several.
+        cv::Point2i leftmost;
+
+        /// @brief The rightmost set pixel. The topmost, if there are several.
+        cv::Point2i rightmost;
+
+        /// @brief Identifies the blob within its mask.
+        uint16_t label;
+    };
+
+
+    /// @brief A binary mask, stored as the runs of set pixels in each row.
+    class RleMask
+    {
+        public:
+        /// @param runs_per_row The most runs kept per row.
+        explicit RleMask(uint8_t runs_per_row = DEFAULT_RUNS_PER_ROW);
+
+        /// @brief Sizes the mask, and clears it. Only allocates if the size has changed.
+        /// @param rows The number of rows.
+        /// @param cols The number of columns.
+        void create(uint16_t rows, uint16_t cols);
+
+        /// @brief Clears every row.
+        void clear();
+
+        /// @brief Encodes part of a row of a dense mask, replacing whatever the row held. If the
+        /// row has more runs than fit, the last ones are merged into one, gaps and all.
+        /// @param row The row.
+        /// @param data The dense row, from column 0. Any non-zero byte is set.
+        /// @param first_col The first column to encode.
+        /// @param end_col One past the last column to encode.
+        void encode_row(uint16_t row, const uint8_t* data, uint16_t first_col, uint16_t end_col);
+
+        /// @brief Adds a run to the end of a row. If the row is full, the run is merged into its
+        /// last one.
+        /// @param row The row.
+        /// @param start The first column of the run. Must be past the end of the row's last run.
+        /// @param end One past the last column of the run.
+        void add_run(uint16_t row, uint16_t start, uint16_t end);
+
+        /// @brief Encodes a region of a dense mask, a row at a time across both cores. Rows
+        /// outside the region are left alone.
+        /// @param mask The dense mask, the same size as this one.
+        /// @param roi The region to encode.
+        void encode(const cv::Mat1b& mask, const cv::Rect2i& roi);
+
+        /// @brief Encodes a packed region of a mask, e.g. after morphology. Rows outside the
+        /// region are left alone.
+        /// @param bits The packed region, which must lie within this mask.
+        void encode(const BitMask& bits);
+
+        /// @brief Finds the connected blobs. Must be called again after the mask changes.
+        /// @return The number of blobs.
+        uint16_t find_blobs();
+
+        /// @return The number of blobs found by the last find_blobs().
+        uint16_t blob_count() const { return static_cast<uint16_t>(roots_.size()); }
+
+        /// @brief Gets a blob found by the last find_blobs(), in the order of their top-left runs.
+        /// @param index The blob's index, below blob_count().
+        /// @return The blob.
+        Blob blob(uint16_t index) const;
+
+        /// @brief Picks the blob with the largest bounding box, from the last find_blobs().
+        /// @param blob The blob. Output param.
+        /// @return False if there are no blobs.
+        bool largest_blob(Blob& blob) const;
+
+        /// @brief Tests whether any pixel of a blob lies within a rectangle.
+        /// @param blob A blob from the last find_blobs().
+        /// @param rect The rectangle.
+        /// @return True if they intersect.
+        bool intersects(const Blob& blob, const cv::Rect2i& rect) const;
+
+        /// @brief Writes the mask out as a dense one.
+        /// @param dst The dense mask. Output param. If it is already the right size it is written
+        /// in place.
+        /// @param value The value of set pixels. Unset pixels are 0.
+        void rasterize(cv::Mat1b& dst, uint8_t value = 0xff) const;
+
+        /// @brief ORs two masks of the same size together, run by run.
+        /// @param a The first mask.
+        /// @param b The second mask.
+        /// @param dst The combined mask. Output param. Must not be a or b.
+        static void composite_or(const RleMask& a, const RleMask& b, RleMask& dst);
+
+        /// @return The number of rows.
+        uint16_t rows() const { return rows_; }
+
+        /// @return The number of columns.
+        uint16_t cols() const { return cols_; }
+
+        /// @return The number of runs in a row.
+        uint8_t row_run_count(uint16_t row) const { return counts_[row]; }
+
+        /// @return The runs in a row, left to right.
+        const Run* row_runs(uint16_t row) const { return &runs_[static_cast<uint32_t>(row) * runs_per_row_]; }
+
+        /// @brief Tests whether a run belongs to a blob.
+        /// @param blob A blob from the last find_blobs().
+        /// @param row The run's row.
+        /// @param index The run's index within its row.
+        /// @return True if it does.
+        bool in_blob(const Blob& blob, uint16_t row, uint8_t index) const { return parents_[slot(row) + index] == blob.label; }
+
+        /// @return The number of runs in the whole mask.
+        uint32_t run_count() const;
+
+        private:
+        /// @brief A blob's statistics as they are gathered, kept at the index of its first run.
+        struct BlobStats
+        {
+            uint16_t left;
+            uint16_t right;
+            uint16_t top;
+            uint16_t bottom;
+            uint16_t left_row;
+            uint16_t right_row;
+            uint32_t area;
+        };
+
+        /// @brief Finds the first run of the blob a run belongs to, halving the path as it goes.
+        uint16_t find_root(uint16_t run);
+
+        /// @brief The index of a row's first run slot.
+        uint32_t slot(uint16_t row) const { return static_cast<uint32_t>(row) * runs_per_row_; }
+
+        uint8_t runs_per_row_;
+        uint16_t rows_;
+        uint16_t cols_;
+
+        /// @brief Each row's runs, in runs_per_row_ slots a row.
+        std::vector<Run> runs_;
+
+        /// @brief The number of runs in each row.
+        std::vector<uint8_t> counts_;
+
+        /// @brief For each run, another run in its blob; after find_blobs(), the blob's first run.
+        std::vector<uint16_t> parents_;
+
+        /// @brief The statistics of each blob, at the index of its first run.
+        std::vector<BlobStats> stats_;
+
+        /// @brief The first run of each blob.
+        std::vector<uint16_t> roots_;
+    };
+}
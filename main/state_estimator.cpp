@@ -0,0 +1,220 @@
+#include "state_estimator.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+
+namespace lane_detect
+{
+    // Filter gains. The offset responds quickly since it is what the controller steers by. The
+    // lean comes from the RANSAC fit through points sampled along the line (see line_fit.h), so
+    // one stray point no longer swings it, but it is still measured over a short blob, from
+    // points quantized to whole pixels, and a fit which settles on a different set of inliers
+    // jumps; so it is trusted a little less.
+    constexpr fixed_t offset_alpha = to_fixed(0.5f);
+    constexpr fixed_t offset_beta = to_fixed(0.1f);
+    constexpr fixed_t offset_process_spread = to_fixed(1);
+    constexpr fixed_t offset_min_spread = to_fixed(1);
+    constexpr fixed_t offset_max_spread = to_fixed(48);
+
+    constexpr fixed_t lean_alpha = to_fixed(0.4f);
+    constexpr fixed_t lean_beta = to_fixed(0.05f);
+    constexpr fixed_t lean_process_spread = to_fixed(0.05f);
+    constexpr fixed_t lean_min_spread = to_fixed(0.05f);
+    constexpr fixed_t lean_max_spread = to_fixed(8);
+
+    // How much of the rate survives each period of prediction without a measurement.
+    constexpr fixed_t miss_rate_damping = to_fixed(0.75f);
+
+
+    AlphaBetaAxis::AlphaBetaAxis(
+        const fixed_t alpha,
+        const fixed_t beta,
+        const fixed_t process_spread,
+        const fixed_t min_spread,
+        const fixed_t max_spread
+    ):
+        value(0),
+        rate(0),
+        spread(max_spread),
+        alpha_(alpha),
+        beta_(beta),
+        process_spread_(process_spread),
+        min_spread_(min_spread),
+        max_spread_(max_spread),
+        last_periods_(1)
+    {
+    }
+
+
+    void AlphaBetaAxis::predict(const uint16_t periods, const bool measured)
+    {
+        if (0 == periods)
+        {
+            return;
+        }
+
+        value += rate * periods;
+        spread = std::min<fixed_t>(max_spread_, spread + process_spread_ * periods);
+
+        if (!measured)
+        {
+            for (uint16_t i = 0; i < periods && rate != 0; i++)
+            {
+                rate = fixed_mul(rate, miss_rate_damping);
+            }
+        }
+
+        last_periods_ = periods;
+    }
+
+
+    fixed_t AlphaBetaAxis::update(const fixed_t measurement)
+    {
+        const fixed_t residual = measurement - value;
+
+        value += fixed_mul(alpha_, residual);
+        rate += fixed_mul(beta_, residual) / last_periods_;
+
+        // Shrink the spread by how much the measurement was trusted, then widen it by how far off
+        // the prediction was, so that disagreeing measurements keep the uncertainty high.
+        spread = fixed_mul(spread, FIXED_ONE - alpha_) + fixed_mul(abs(residual), alpha_);
+        spread = std::clamp(spread, min_spread_, max_spread_);
+
+        last_periods_ = 1;
+        return residual;
+    }
+
+
+    void AlphaBetaAxis::reset(const fixed_t measurement)
+    {
+        value = measurement;
+        rate = 0;
+        spread = max_spread_;
+        last_periods_ = 1;
+    }
+
+
+    LineStateEstimator::LineStateEstimator(const uint32_t control_period_ticks):
+        offset_(offset_alpha, offset_beta, offset_process_spread, offset_min_spread, offset_max_spread),
+        lean_(lean_alpha, lean_beta, lean_process_spread, lean_min_spread, lean_max_spread),
+        control_period_ticks_(std::max<uint32_t>(1, control_period_ticks)),
+        last_ticks_(0),
+        periods_since_measurement_(0),
+        initialized_(false)
+    {
+    }
+
+
+    void LineStateEstimator::advance_to(const uint32_t now_ticks, const bool measured)
+    {
+        if (!initialized_)
+        {
+            last_ticks_ = now_ticks;
+            return;
+        }
+
+        // Only whole periods are predicted across; the remainder carries over to the next call.
+        const uint32_t elapsed = (now_ticks - last_ticks_) / control_period_ticks_;
+        const uint16_t periods = static_cast<uint16_t>(std::min<uint32_t>(elapsed, UINT16_MAX));
+        last_ticks_ += elapsed * control_period_ticks_;
+
+        offset_.predict(periods, measured);
+        lean_.predict(periods, measured);
+
+        if (!measured)
+        {
+            periods_since_measurement_ = std::min<uint32_t>(UINT16_MAX, periods_since_measurement_ + periods);
+        }
+    }
+
+
+    void LineStateEstimator::update(const int offset, const float slope)
+    {
+        const fixed_t measured_offset = to_fixed(offset);
+        const bool has_slope = !isnan(slope);
+        const float lean = (0.0f != slope) ? 1.0f / slope : (signbit(slope) ? -max_tracked_lean : max_tracked_lean);
+        const fixed_t measured_lean = has_slope
+            ? to_fixed(std::clamp(lean, -max_tracked_lean, max_tracked_lean))
+            : lean_.value;
+
+        // After the line has been lost the old state says nothing useful, so start over.
+        if (!initialized_ || periods_since_measurement_ > max_predicted_periods)
+        {
+            offset_.reset(measured_offset);
+            lean_.reset(measured_lean);
+            initialized_ = true;
+        }
+        else
+        {
+            offset_.update(measured_offset);
+            if (has_slope)
+            {
+                lean_.update(measured_lean);
+            }
+        }
+
+        periods_since_measurement_ = 0;
+    }
+
+
+    LaneEstimate LineStateEstimator::estimate() const
+    {
+        LaneEstimate result;
+        result.offset = offset_.value;
+        result.offset_rate = offset_.rate;
+        result.lean = lean_.value;
+        result.lean_rate = lean_.rate;
+        result.offset_spread = offset_.spread;
+        result.lean_spread = lean_.spread;
+        result.periods_since_measurement = periods_since_measurement_;
+        result.valid = initialized_ && periods_since_measurement_ <= max_predicted_periods;
+        return result;
+    }
+
+
+    LaneEstimate LineStateEstimator::predict_to(const uint32_t now_ticks) const
+    {
+        LineStateEstimator predicted = *this;
+        predicted.advance_to(now_ticks, false);
+        return predicted.estimate();
+    }
+
+
+    SearchWindow LineStateEstimator::predicted_window(
+        const uint32_t now_ticks,
+        const int16_t expected_col,
+        const int16_t reference_row,
+        const int16_t first_row,
+        const int16_t last_row,
+        const uint8_t spreads,
+        const int16_t cols
+    ) const
+    {
+        SearchWindow window;
+        window.first_col = 0;
+        window.last_col = cols - 1;
+
+        const LaneEstimate predicted = predict_to(now_ticks);
+        if (!predicted.valid)
+        {
+            return window;
+        }
+
+        // The line leans, so its column differs at each end of the band, and the further a row is
+        // from where the offset was measured the more the lean's uncertainty adds to the offset's.
+        const fixed_t center = to_fixed(expected_col) + predicted.offset;
+        const fixed_t first_row_col = center + predicted.lean * (first_row - reference_row);
+        const fixed_t last_row_col = center + predicted.lean * (last_row - reference_row);
+        const int reach = std::max(abs(first_row - reference_row), abs(last_row - reference_row));
+        const fixed_t spread = (predicted.offset_spread + predicted.lean_spread * reach) * spreads;
+
+        const int first_col = from_fixed(std::min(first_row_col, last_row_col) - spread) - 1;
+        const int last_col = from_fixed(std::max(first_row_col, last_row_col) + spread) + 1;
+        window.first_col = static_cast<int16_t>(std::clamp(first_col, 0, cols - 1));
+        window.last_col = static_cast<int16_t>(std::clamp(last_col, 0, cols - 1));
+        return window;
+    }
+}
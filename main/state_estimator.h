@@ -0,0 +1,210 @@
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// A small fixed-point state estimator which filters the outside line's offset and lean across
+/// frames, predicting through frames in which the line was not detected, between frames for the
+/// control messages, and ahead of a frame for where to search it.
+///
+/// Author: Andrew Huffman
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+namespace lane_detect
+{
+    /// @brief A signed fixed-point number with FIXED_SHIFT fractional bits.
+    using fixed_t = int32_t;
+
+    /// @brief The number of fractional bits in a fixed_t.
+    constexpr uint8_t FIXED_SHIFT = 8;
+
+    /// @brief The fixed-point representation of 1.
+    constexpr fixed_t FIXED_ONE = (1 << FIXED_SHIFT);
+
+
+    /// @brief Converts an integer into a fixed-point number.
+    constexpr fixed_t to_fixed(const int value)
+    {
+        return value * FIXED_ONE;
+    }
+
+
+    /// @brief Converts a float into a fixed-point number, rounding to the nearest step.
+    constexpr fixed_t to_fixed(const float value)
+    {
+        return static_cast<fixed_t>(value * FIXED_ONE + (value < 0 ? -0.5f : 0.5f));
+    }
+
+
+    /// @brief Converts a fixed-point number into an integer, rounding to the nearest integer.
+    constexpr int from_fixed(const fixed_t value)
+    {
+        return (value + (FIXED_ONE >> 1)) >> FIXED_SHIFT;
+    }
+
+
+    /// @brief Multiplies two fixed-point numbers.
+    constexpr fixed_t fixed_mul(const fixed_t a, const fixed_t b)
+    {
+        return static_cast<fixed_t>((static_cast<int64_t>(a) * b) >> FIXED_SHIFT);
+    }
+
+
+    /// @brief A single quantity tracked by an alpha-beta filter: a value, its rate of change per
+    /// control period, and a spread which estimates how far off the value may be.
+    class AlphaBetaAxis
+    {
+        public:
+        /// @brief Constructs the axis.
+        /// @param alpha The gain applied to the residual when correcting the value.
+        /// @param beta The gain applied to the residual when correcting the rate.
+        /// @param process_spread How much the spread grows per control period of prediction.
+        /// @param min_spread The spread never drops below this.
+        /// @param max_spread The spread never grows above this.
+        AlphaBetaAxis(fixed_t alpha, fixed_t beta, fixed_t process_spread, fixed_t min_spread, fixed_t max_spread);
+
+        /// @brief Advances the value by its rate. Used both between measurements and through misses.
+        /// @param periods The number of control periods to predict across.
+        /// @param measured Whether a measurement will follow this prediction. If not, the rate is
+        /// damped so that the prediction settles rather than running away.
+        void predict(uint16_t periods, bool measured);
+
+        /// @brief Corrects the value and rate with a measurement.
+        /// @param measurement The measured value.
+        /// @return The residual (measurement minus prediction).
+        fixed_t update(fixed_t measurement);
+
+        /// @brief Throws away the history and starts over at a measurement.
+        void reset(fixed_t measurement);
+
+        /// @brief The filtered value.
+        fixed_t value;
+
+        /// @brief The filtered rate, in units per control period.
+        fixed_t rate;
+
+        /// @brief An estimate of the value's uncertainty, in the same units as the value.
+        fixed_t spread;
+
+        private:
+        fixed_t alpha_;
+        fixed_t beta_;
+        fixed_t process_spread_;
+        fixed_t min_spread_;
+        fixed_t max_spread_;
+
+        /// @brief The number of periods covered by the most recent prediction.
+        uint16_t last_periods_;
+    };
+
+
+    /// @brief A snapshot of the estimator's state.
+    struct LaneEstimate
+    {
+        /// @brief The offset of the outside line from its calibrated column, in pixels.
+        fixed_t offset;
+
+        /// @brief The change in offset per control period.
+        fixed_t offset_rate;
+
+        /// @brief The lean of the outside line: how many columns it moves per row, so 0 when it is
+        /// vertical in the frame.
+        fixed_t lean;
+
+        /// @brief The change in lean per control period.
+        fixed_t lean_rate;
+
+        /// @brief The uncertainty in the offset, in pixels.
+        fixed_t offset_spread;
+
+        /// @brief The uncertainty in the lean.
+        fixed_t lean_spread;
+
+        /// @brief The number of control periods since the last detection.
+        uint16_t periods_since_measurement;
+
+        /// @brief False until the first detection, and again once the line has been lost for too long.
+        bool valid;
+    };
+
+
+    /// @brief An inclusive range of columns in which the outside line is predicted to be.
+    struct SearchWindow
+    {
+        int16_t first_col;
+        int16_t last_col;
+    };
+
+
+    /// @brief The number of control periods the estimator predicts through before reporting the
+    /// line as lost.
+    constexpr uint16_t max_predicted_periods = 30;
+
+    /// @brief Leans are clamped to this magnitude, since a horizontal line reports an infinite lean.
+    constexpr float max_tracked_lean = 64.0f;
+
+
+    /// @brief Gets the slope (rows per column) of a line with a given lean.
+    /// @return The slope; infinite for a vertical line.
+    inline float lean_to_slope(const fixed_t lean)
+    {
+        return (0 != lean) ? static_cast<float>(FIXED_ONE) / lean : INFINITY;
+    }
+
+
+    /// @brief Filters the outside line's offset and lean, along with their rates. The lean is
+    /// filtered rather than the slope since a line near vertical, which is the usual case, has a
+    /// slope which flips between large positive and negative values, and averages to nonsense.
+    /// The estimator is updated once per frame, but time is measured in whole control periods, so
+    /// the rates keep their units however long a frame takes or however many are skipped, and the
+    /// state can be predicted to any time in between.
+    class LineStateEstimator
+    {
+        public:
+        /// @brief Constructs the estimator.
+        /// @param control_period_ticks The length of one control period, in RTOS ticks.
+        explicit LineStateEstimator(uint32_t control_period_ticks = 1);
+
+        /// @brief Predicts the state forward to the given time. Call once per control update,
+        /// before any measurement taken at that time.
+        /// @param now_ticks The current tick count.
+        /// @param measured Whether a measurement will be supplied for this time.
+        void advance_to(uint32_t now_ticks, bool measured);
+
+        /// @brief Folds in a detection of the outside line.
+        /// @param offset The detected offset from the calibrated column, in pixels.
+        /// @param slope The detected slope, in rows per column; infinite for a vertical line. If this
+        /// is NAN, only the offset is updated.
+        void update(int offset, float slope);
+
+        /// @return The current state.
+        LaneEstimate estimate() const;
+
+        /// @brief Predicts the state at a later time, as if nothing is measured until then,
+        /// leaving the estimator as it is.
+        /// @param now_ticks The time to predict to. Not before the last call to advance_to().
+        /// @return The predicted state.
+        LaneEstimate predict_to(uint32_t now_ticks) const;
+
+        /// @brief Gets the columns in which the outside line is expected across a band of rows,
+        /// for a search restricted to them.
+        /// @param now_ticks The time of the frame to be searched.
+        /// @param expected_col The calibrated column of the line; offsets are measured from here.
+        /// @param reference_row The row the offsets were measured at.
+        /// @param first_row The first row of the band.
+        /// @param last_row The last row of the band.
+        /// @param spreads How many spreads either side of the prediction to include.
+        /// @param cols The width of the frame. The window is clamped to it.
+        /// @return The window. If the estimate is not valid, this covers the whole frame.
+        SearchWindow predicted_window(uint32_t now_ticks, int16_t expected_col, int16_t reference_row, int16_t first_row, int16_t last_row, uint8_t spreads, int16_t cols) const;
+
+        private:
+        AlphaBetaAxis offset_;
+        AlphaBetaAxis lean_;
+        uint32_t control_period_ticks_;
+        uint32_t last_ticks_;
+        uint16_t periods_since_measurement_;
+        bool initialized_;
+    };
+}